@@ -0,0 +1,184 @@
+// Fuzzes the TLSF allocator against a shadow map of live ranges and times allocate/free.
+// Usage: allocator_bench [operations] [seed]
+// Exits with 1 if any allocation overlaps, is misaligned or an invariant breaks.
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+#include "bench_common.h"
+#include "tlsf_allocator.h"
+
+using namespace baas;
+
+namespace
+{
+    constexpr uint64_t CAPACITY = 256ull << 20;
+
+    struct Workload
+    {
+        std::mt19937_64 rng;
+
+        uint64_t size()
+        {
+            // Log uniform from 16 bytes to 4 MiB, roughly what meshes and textures look like.
+            double exponent = std::uniform_real_distribution<double>(4.0, 22.0)(rng);
+            return static_cast<uint64_t>(std::exp2(exponent));
+        }
+
+        uint64_t alignment()
+        {
+            constexpr uint64_t alignments[] = { 1, 16, 256, 4096, 65536 };
+            return alignments[std::uniform_int_distribution<int>(0, 4)(rng)];
+        }
+    };
+
+    void check_placement(const std::map<uint64_t, uint64_t>& live, const tlsf_allocator::Allocation& allocation,
+        uint64_t size, uint64_t alignment)
+    {
+        if (allocation.offset % alignment != 0 || allocation.size < size || allocation.offset + allocation.size > CAPACITY)
+        {
+            throw std::runtime_error("bad allocation placement");
+        }
+        auto next = live.lower_bound(allocation.offset);
+        if (next != live.end() && next->first < allocation.offset + allocation.size)
+        {
+            throw std::runtime_error("allocation overlaps the next live range");
+        }
+        if (next != live.begin() && std::prev(next)->second > allocation.offset)
+        {
+            throw std::runtime_error("allocation overlaps the previous live range");
+        }
+    }
+
+    void fuzz(std::size_t operations, uint64_t seed)
+    {
+        Workload workload{ std::mt19937_64(seed) };
+        tlsf_allocator::TlsfAllocator allocator(CAPACITY);
+        std::vector<tlsf_allocator::Allocation> allocations;
+        std::map<uint64_t, uint64_t> live;
+        std::size_t failed{ 0 };
+        for (std::size_t op = 0; op < operations; ++op)
+        {
+            // Biased towards allocating until the heap is fairly full, then it churns.
+            bool do_free = !allocations.empty() && std::uniform_int_distribution<int>(0, 99)(workload.rng) < 45;
+            if (do_free)
+            {
+                std::size_t pick = std::uniform_int_distribution<std::size_t>(0, allocations.size() - 1)(workload.rng);
+                allocator.free(allocations[pick]);
+                live.erase(allocations[pick].offset);
+                allocations[pick] = allocations.back();
+                allocations.pop_back();
+            }
+            else
+            {
+                uint64_t size = workload.size();
+                uint64_t alignment = workload.alignment();
+                auto allocation = allocator.allocate(size, alignment);
+                if (allocation)
+                {
+                    check_placement(live, *allocation, size, alignment);
+                    live[allocation->offset] = allocation->offset + allocation->size;
+                    allocations.push_back(*allocation);
+                }
+                else
+                {
+                    ++failed;
+                }
+            }
+            if (op % 1024 == 0)
+            {
+                allocator.validate();
+            }
+        }
+        allocator.validate();
+        auto stats = allocator.stats();
+        std::printf("fuzz: %zu ops, %u live, %.1f of %.1f MiB used, %u free blocks, fragmentation %.3f, %zu failed allocations\n",
+            operations, stats.allocation_count, stats.bytes_used / 1048576.0, CAPACITY / 1048576.0,
+            stats.free_block_count, stats.fragmentation, failed);
+
+        for (auto&& allocation : allocations)
+        {
+            allocator.free(allocation);
+        }
+        allocator.validate();
+        stats = allocator.stats();
+        if (stats.free_block_count != 1 || stats.largest_free_block != CAPACITY)
+        {
+            throw std::runtime_error("freeing everything didn't coalesce back into one block");
+        }
+    }
+
+    void time_operations(std::size_t operations, uint64_t seed)
+    {
+        Workload workload{ std::mt19937_64(seed) };
+        std::vector<uint64_t> sizes(operations);
+        for (auto& size : sizes)
+        {
+            size = workload.size() / 16;
+        }
+        tlsf_allocator::TlsfAllocator allocator(CAPACITY);
+        std::vector<tlsf_allocator::Allocation> allocations;
+        allocations.reserve(operations);
+
+        // A steady state of LIVE_COUNT allocations, each new one replaces a pseudo random old one.
+        constexpr std::size_t LIVE_COUNT = 4096;
+        std::size_t frees{ 0 };
+        std::size_t failures{ 0 };
+        auto start = bench::Clock::now();
+        for (std::size_t op = 0; op < operations; ++op)
+        {
+            if (allocations.size() == LIVE_COUNT)
+            {
+                std::size_t pick = (op * 2654435761u) % LIVE_COUNT;
+                allocator.free(allocations[pick]);
+                allocations[pick] = allocations.back();
+                allocations.pop_back();
+                ++frees;
+            }
+            if (auto allocation = allocator.allocate(sizes[op], 256))
+            {
+                allocations.push_back(*allocation);
+            }
+            else
+            {
+                ++failures;
+            }
+        }
+        double ms = bench::elapsed_ms(start);
+        auto stats = allocator.stats();
+        std::printf("timing: %zu allocations + %zu frees in %.1f ms, %.0f ns per operation, %zu failed, "
+                    "%.1f MiB used, fragmentation %.3f\n",
+            operations, frees, ms, ms * 1e6 / (operations + frees), failures, stats.bytes_used / 1048576.0,
+            stats.fragmentation);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    std::size_t operations{ 1000000 };
+    uint64_t seed{ 1 };
+    if (argc > 1)
+    {
+        std::from_chars(argv[1], argv[1] + std::string_view(argv[1]).size(), operations);
+    }
+    if (argc > 2)
+    {
+        std::from_chars(argv[2], argv[2] + std::string_view(argv[2]).size(), seed);
+    }
+    try
+    {
+        fuzz(operations, seed);
+        time_operations(operations, seed);
+    }
+    catch (std::exception& ex)
+    {
+        std::printf("FAILED: %s\n", ex.what());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,122 @@
+#ifndef BENCH_COMMON_H
+#define BENCH_COMMON_H
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <string>
+
+#include "mesh.h"
+
+namespace baas::bench
+{
+    using Clock = std::chrono::steady_clock;
+
+    inline double elapsed_ms(Clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    // Checks shared by the benches, a failed one is printed and counted.
+    inline int failures{ 0 };
+
+    inline void check(bool condition, const char* what)
+    {
+        if (!condition)
+        {
+            std::printf("FAILED: %s\n", what);
+            ++failures;
+        }
+    }
+
+    // Reports every check so far and returns main's exit code, 1 if any failed.
+    inline int check_result()
+    {
+        if (failures > 0)
+        {
+            std::printf("%d checks failed\n", failures);
+            return 1;
+        }
+        std::printf("All checks passed\n");
+        return 0;
+    }
+
+    // Same bumpy grid as write_grid_obj, built directly in memory.
+    inline mesh::Mesh make_grid_mesh(uint32_t n)
+    {
+        mesh::Mesh grid;
+        for (uint32_t y = 0; y < n; ++y)
+        {
+            for (uint32_t x = 0; x < n; ++x)
+            {
+                float height = 0.05f * std::sin(x * 0.37f) * std::cos(y * 0.23f);
+                grid.vertices.push_back({ { x / float(n), y / float(n), height }, { 0.0f, 0.0f, 1.0f },
+                    { x / float(n - 1), y / float(n - 1) } });
+            }
+        }
+        for (uint32_t y = 0; y + 1 < n; ++y)
+        {
+            for (uint32_t x = 0; x + 1 < n; ++x)
+            {
+                uint32_t a = y * n + x;
+                uint32_t b = a + 1;
+                uint32_t c = a + n;
+                uint32_t d = c + 1;
+                grid.indices.insert(grid.indices.end(), { a, b, d, a, d, c });
+            }
+        }
+        grid.ranges.push_back({ 0, static_cast<uint32_t>(grid.indices.size()), 0 });
+        grid.materials.emplace_back().name = "default";
+        return grid;
+    }
+
+    // Shuffles the triangle order, which is roughly what a scanner's OBJ export looks like.
+    inline void shuffle_triangles(mesh::Mesh& mesh, uint32_t seed = 1)
+    {
+        std::mt19937 rng(seed);
+        std::size_t triangle_count = mesh.indices.size() / 3;
+        for (std::size_t i = triangle_count; i > 1; --i)
+        {
+            std::size_t j = std::uniform_int_distribution<std::size_t>(0, i - 1)(rng);
+            for (std::size_t k = 0; k < 3; ++k)
+            {
+                std::swap(mesh.indices[(i - 1) * 3 + k], mesh.indices[j * 3 + k]);
+            }
+        }
+    }
+
+    // Writes a bumpy n x n vertex grid as an OBJ file. Stands in for a scan when no asset is given.
+    inline void write_grid_obj(const std::string& path, uint32_t n)
+    {
+        FILE* file = std::fopen(path.c_str(), "wb");
+        if (file == nullptr)
+        {
+            return;
+        }
+        for (uint32_t y = 0; y < n; ++y)
+        {
+            for (uint32_t x = 0; x < n; ++x)
+            {
+                float height = 0.05f * std::sin(x * 0.37f) * std::cos(y * 0.23f);
+                std::fprintf(file, "v %.6f %.6f %.6f\n", x / float(n), y / float(n), height);
+                std::fprintf(file, "vt %.6f %.6f\n", x / float(n - 1), y / float(n - 1));
+            }
+        }
+        std::fprintf(file, "vn 0 0 1\n");
+        for (uint32_t y = 0; y + 1 < n; ++y)
+        {
+            for (uint32_t x = 0; x + 1 < n; ++x)
+            {
+                uint32_t a = y * n + x + 1;
+                uint32_t b = a + 1;
+                uint32_t c = a + n;
+                uint32_t d = c + 1;
+                std::fprintf(file, "f %u/%u/1 %u/%u/1 %u/%u/1 %u/%u/1\n", a, a, b, b, d, d, c, c);
+            }
+        }
+        std::fclose(file);
+    }
+}
+#endif // !BENCH_COMMON_H
@@ -0,0 +1,93 @@
+// Compares the old ifstream copy path against the mapped file path.
+// Usage: file_ops_bench [file] [iterations]
+// Without a file a 256MB scratch file is generated in the working directory.
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "file_ops.h"
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    // What read_shader_code used to do before it was mapped: copy through ifstream and widen.
+    std::vector<uint32_t> legacy_read_shader_code(const std::string& path)
+    {
+        auto raw_file_data = baas::file_ops::read_file(path);
+        std::vector<uint32_t> shader_code;
+        shader_code.reserve(raw_file_data.size());
+        for (char byte : raw_file_data)
+        {
+            shader_code.push_back(static_cast<uint32_t>(byte));
+        }
+        return shader_code;
+    }
+
+    // Touch one byte per page so the mapped path pays for its page faults.
+    uint64_t touch_pages(std::span<const std::byte> bytes)
+    {
+        uint64_t sum{ 0 };
+        for (std::size_t i = 0; i < bytes.size(); i += 4096)
+        {
+            sum += static_cast<uint64_t>(bytes[i]);
+        }
+        return sum;
+    }
+
+    template <typename Fn>
+    void run(const char* name, std::size_t bytes, int iterations, Fn&& fn)
+    {
+        uint64_t sink{ 0 };
+        auto start = Clock::now();
+        for (int i = 0; i < iterations; ++i)
+        {
+            sink += fn();
+        }
+        std::chrono::duration<double> elapsed = Clock::now() - start;
+        double per_iter = elapsed.count() / iterations;
+        double mb = static_cast<double>(bytes) / (1024.0 * 1024.0);
+        std::printf("%-28s %10.3f ms %10.1f MB/s (sink %llu)\n", name, per_iter * 1000.0, mb / per_iter,
+            static_cast<unsigned long long>(sink));
+    }
+}
+
+int main(int argc, char** argv)
+{
+    std::string path = argc > 1 ? argv[1] : "file_ops_bench.tmp";
+    int iterations = argc > 2 ? std::stoi(argv[2]) : 5;
+
+    if (argc <= 1)
+    {
+        std::vector<char> block(1 << 20);
+        for (std::size_t i = 0; i < block.size(); ++i)
+        {
+            block[i] = static_cast<char>(i * 31);
+        }
+        std::ofstream out(path, std::ios::binary);
+        for (int i = 0; i < 256; ++i)
+        {
+            out.write(block.data(), static_cast<std::streamsize>(block.size()));
+        }
+    }
+
+    std::size_t size = baas::file_ops::map_file(path).size();
+    std::cout << "File: " << path << " (" << size << " bytes), " << iterations << " iterations, warm page cache\n";
+
+    run("ifstream + widen (old)", size, iterations, [&] { return legacy_read_shader_code(path).size(); });
+    run("read_file (ifstream copy)", size, iterations, [&] { return baas::file_ops::read_file(path).size(); });
+    run("map_file + touch pages", size, iterations, [&] {
+        auto file = baas::file_ops::map_file(path, baas::file_ops::AccessHint::sequential);
+        return touch_pages(file.bytes());
+    });
+
+    if (argc <= 1)
+    {
+        std::remove(path.c_str());
+    }
+    return 0;
+}
@@ -0,0 +1,257 @@
+// Checks the job system and measures how it scales from 1 to N threads.
+// Usage: job_system_bench [max_threads]
+// The checks run first: every parallel_for index exactly once, parents only completing after their
+// children, exceptions reaching the waiter, jobs submitted from several outside threads and waits
+// only helping with their own group.
+// Exits with 1 if any of them fails.
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench_common.h"
+#include "job_system.h"
+
+using namespace baas;
+
+namespace
+{
+    using bench::check;
+
+    void run_checks(job_system::JobSystem& jobs)
+    {
+        // Every index exactly once, for grains that do and don't divide the count.
+        for (std::size_t grain : { 0, 1, 7, 1000, 100000 })
+        {
+            constexpr std::size_t count = 100003;
+            std::vector<std::atomic<uint8_t>> hits(count);
+            jobs.parallel_for(count, [&](std::size_t begin, std::size_t end)
+                {
+                    for (std::size_t i = begin; i < end; ++i)
+                    {
+                        hits[i].fetch_add(1, std::memory_order_relaxed);
+                    }
+                }, grain);
+            check(std::all_of(hits.begin(), hits.end(), [](auto& hit) { return hit.load() == 1; }), "parallel_for visits every index once");
+        }
+
+        // A parent isn't done before its children, even when it runs long before they do.
+        {
+            std::atomic<int> finished_children{ 0 };
+            auto parent = jobs.create(nullptr);
+            for (int i = 0; i < 64; ++i)
+            {
+                jobs.run([&finished_children]()
+                    {
+                        std::this_thread::sleep_for(std::chrono::microseconds(200));
+                        finished_children.fetch_add(1);
+                    }, parent);
+            }
+            jobs.submit(parent);
+            jobs.wait(parent);
+            check(finished_children.load() == 64, "parent waits for its children");
+        }
+
+        // Nested fan out from inside jobs, deep enough that the tree is mostly stolen.
+        {
+            std::atomic<int> leaves{ 0 };
+            std::function<void(job_system::JobHandle, int)> spawn = [&](job_system::JobHandle parent, int depth)
+            {
+                if (depth == 0)
+                {
+                    leaves.fetch_add(1, std::memory_order_relaxed);
+                    return;
+                }
+                for (int i = 0; i < 2; ++i)
+                {
+                    auto child = jobs.create(nullptr, parent);
+                    // A weak handle, the job owning a strong one to itself would never be freed.
+                    child->work = [&spawn, weak_child = std::weak_ptr(child), depth]()
+                    {
+                        spawn(weak_child.lock(), depth - 1);
+                    };
+                    jobs.submit(child);
+                }
+            };
+            auto root = jobs.create(nullptr);
+            spawn(root, 14);
+            jobs.submit(root);
+            jobs.wait(root);
+            check(leaves.load() == (1 << 14), "nested children all complete before the root");
+        }
+
+        // The first exception from a child reaches whoever waits on the parent.
+        {
+            bool caught{ false };
+            try
+            {
+                jobs.parallel_for(1000, [](std::size_t begin, std::size_t)
+                    {
+                        if (begin == 500)
+                        {
+                            throw std::runtime_error("chunk 500");
+                        }
+                    }, 1);
+            }
+            catch (std::runtime_error& ex)
+            {
+                caught = std::string(ex.what()) == "chunk 500";
+            }
+            check(caught, "exceptions propagate to the waiter");
+        }
+
+        // Several threads that aren't workers submitting and waiting at the same time.
+        {
+            std::atomic<int> total{ 0 };
+            std::vector<std::thread> submitters;
+            for (int t = 0; t < 4; ++t)
+            {
+                submitters.emplace_back([&jobs, &total]()
+                    {
+                        for (int round = 0; round < 200; ++round)
+                        {
+                            auto group = jobs.create(nullptr);
+                            for (int i = 0; i < 16; ++i)
+                            {
+                                jobs.run([&total]() { total.fetch_add(1, std::memory_order_relaxed); }, group);
+                            }
+                            jobs.submit(group);
+                            jobs.wait(group);
+                        }
+                    });
+            }
+            for (auto&& submitter : submitters)
+            {
+                submitter.join();
+            }
+            check(total.load() == 4 * 200 * 16, "outside threads submit and wait concurrently");
+        }
+    }
+
+    // A thread waiting on a parallel_for mustn't pick up a job someone queued before it, like a model
+    // load queued ahead of a frame's command recording.
+    void check_wait_keeps_to_its_group()
+    {
+        job_system::JobSystem jobs(1);
+        std::atomic<bool> blocking{ false };
+        std::atomic<bool> release{ false };
+        auto blocker = jobs.run([&]()
+            {
+                blocking.store(true);
+                while (!release.load())
+                {
+                    std::this_thread::yield();
+                }
+            });
+        while (!blocking.load())
+        {
+            std::this_thread::yield();
+        }
+        std::thread::id queued_thread;
+        auto queued = jobs.run([&queued_thread]() { queued_thread = std::this_thread::get_id(); });
+        std::atomic<int> chunks{ 0 };
+        jobs.parallel_for(64, [&chunks](std::size_t, std::size_t) { chunks.fetch_add(1); }, 1);
+        check(chunks.load() == 64 && !jobs.is_done(queued), "parallel_for runs without the job queued ahead of it");
+        release.store(true);
+        jobs.wait(blocker);
+        // The waiter may run it now, it is what it waits for.
+        jobs.wait(queued);
+        check(queued_thread != std::thread::id(), "the queued job still runs");
+    }
+
+    // Something that keeps a core busy without touching much memory.
+    float burn(std::size_t i)
+    {
+        float x = static_cast<float>(i % 1024) * 0.001f;
+        for (int k = 0; k < 200; ++k)
+        {
+            x = std::sin(x) * 1.0001f + 0.5f;
+        }
+        return x;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    unsigned max_threads = argc > 1 ? static_cast<unsigned>(std::stoul(argv[1])) : std::max(1U, std::thread::hardware_concurrency());
+
+    {
+        job_system::JobSystem jobs(std::max(max_threads, 2U) - 1);
+        run_checks(jobs);
+    }
+    {
+        // A single worker, waiting threads have to run most jobs themselves.
+        job_system::JobSystem jobs(1);
+        run_checks(jobs);
+    }
+    check_wait_keeps_to_its_group();
+    if (bench::check_result() != 0)
+    {
+        return 1;
+    }
+
+    constexpr std::size_t ITEMS = 1 << 17;
+    constexpr int TASKS = 1 << 15;
+    std::vector<float> results(ITEMS);
+    double single_loop_ms{ 0.0 };
+    double single_tasks_ms{ 0.0 };
+    // The single thread numbers are plain loops, so the speedups include the scheduler's overhead.
+    auto run_loop = [&results](std::size_t begin, std::size_t end)
+    {
+        for (std::size_t i = begin; i < end; ++i)
+        {
+            results[i] = burn(i);
+        }
+    };
+    auto run_task = [](std::atomic<uint64_t>& sink, int i)
+    {
+        sink.fetch_add(static_cast<uint64_t>(burn(static_cast<std::size_t>(i)) * 1000.0f), std::memory_order_relaxed);
+    };
+    for (unsigned threads = 1; threads <= max_threads; threads *= 2)
+    {
+        std::atomic<uint64_t> sink{ 0 };
+        double loop_ms{ 0.0 };
+        double tasks_ms{ 0.0 };
+        if (threads == 1)
+        {
+            auto start = bench::Clock::now();
+            run_loop(0, ITEMS);
+            loop_ms = bench::elapsed_ms(start);
+            start = bench::Clock::now();
+            for (int i = 0; i < TASKS; ++i)
+            {
+                run_task(sink, i);
+            }
+            tasks_ms = bench::elapsed_ms(start);
+            single_loop_ms = loop_ms;
+            single_tasks_ms = tasks_ms;
+        }
+        else
+        {
+            job_system::JobSystem jobs(threads - 1);
+            auto start = bench::Clock::now();
+            jobs.parallel_for(ITEMS, run_loop);
+            loop_ms = bench::elapsed_ms(start);
+
+            // Many tiny independent jobs, mostly measures scheduling overhead.
+            start = bench::Clock::now();
+            auto group = jobs.create(nullptr);
+            for (int i = 0; i < TASKS; ++i)
+            {
+                jobs.run([&sink, &run_task, i]() { run_task(sink, i); }, group);
+            }
+            jobs.submit(group);
+            jobs.wait(group);
+            tasks_ms = bench::elapsed_ms(start);
+        }
+        std::printf("%3u threads: parallel_for %8.1f ms speedup %5.2fx, %d small jobs %8.1f ms speedup %5.2fx (%.2f us per job)\n",
+            threads, loop_ms, single_loop_ms / loop_ms, TASKS, tasks_ms, single_tasks_ms / tasks_ms, tasks_ms * 1000.0 / TASKS);
+    }
+    return 0;
+}
@@ -0,0 +1,137 @@
+// Builds a LOD chain and reports simplification speed and the error of every level.
+// Usage: lod_bench [file.obj]
+// Without a file a 700x700 vertex bumpy grid is used. Also checks that the levels get smaller while
+// their errors grow, that the sidecar file reads back identically and that screen space selection
+// never picks a finer level further away. Exits with 1 if any of that fails.
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+
+#include "bench_common.h"
+#include "mesh_lod.h"
+#include "mesh_optimizer.h"
+#include "obj_loader.h"
+
+using namespace baas;
+
+namespace
+{
+    using bench::check;
+
+    std::size_t triangle_count(const mesh_lod::LodLevel& level)
+    {
+        std::size_t count{ 0 };
+        for (auto&& range : level.ranges)
+        {
+            count += range.index_count / 3;
+        }
+        return count;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    mesh::Mesh mesh;
+    if (argc > 1)
+    {
+        mesh = obj_loader::load_obj(argv[1]);
+    }
+    else
+    {
+        mesh = bench::make_grid_mesh(700);
+    }
+    mesh_optimizer::optimize_mesh(mesh);
+    auto view = mesh.view();
+    std::printf("%zu vertices, %zu triangles, %zu ranges\n", view.vertices.size(), view.triangle_count(), view.ranges.size());
+
+    mesh_lod::LodOptions options;
+    auto start = bench::Clock::now();
+    auto chain = mesh_lod::build_lod_chain(view, options);
+    double build_ms = bench::elapsed_ms(start);
+
+    std::array<float, 3> min = view.vertices.front().position;
+    std::array<float, 3> max = min;
+    for (auto&& vertex : view.vertices)
+    {
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            min[axis] = std::min(min[axis], vertex.position[axis]);
+            max[axis] = std::max(max[axis], vertex.position[axis]);
+        }
+    }
+    float radius = 0.5f * std::sqrt((max[0] - min[0]) * (max[0] - min[0]) + (max[1] - min[1]) * (max[1] - min[1]) +
+        (max[2] - min[2]) * (max[2] - min[2]));
+
+    double input_triangles = static_cast<double>(view.triangle_count());
+    std::printf("built %zu levels in %.1f ms, %.2f Mtri/s of input\n", chain.levels.size(), build_ms, input_triangles / build_ms / 1000.0);
+    std::size_t previous_triangles = view.triangle_count();
+    float previous_error = 0.0f;
+    for (std::size_t l = 0; l < chain.levels.size(); ++l)
+    {
+        auto& level = chain.levels[l];
+        auto triangles = triangle_count(level);
+        std::printf("  level %zu: %9zu triangles (%5.1f%%), error %.6f (%.4f%% of the radius)\n", l + 1, triangles,
+            100.0 * triangles / input_triangles, level.error, 100.0 * level.error / radius);
+        check(triangles < previous_triangles, "every level has fewer triangles than the one before");
+        check(level.error >= previous_error, "errors never shrink towards coarser levels");
+        check(level.ranges.size() == view.ranges.size(), "every level has one range per mesh range");
+        for (auto&& range : level.ranges)
+        {
+            check(range.first_index + range.index_count <= chain.indices.size() && range.index_count % 3 == 0, "level ranges stay inside the index list");
+        }
+        previous_triangles = triangles;
+        previous_error = level.error;
+    }
+    for (uint32_t index : chain.indices)
+    {
+        if (index >= view.vertices.size())
+        {
+            check(false, "indices point at existing vertices");
+            break;
+        }
+    }
+
+    // Sidecar round trip, and a key for different data must not load it.
+    auto path = (std::filesystem::temp_directory_path() / "lod_bench.vmllod").string();
+    auto key = mesh_lod::lod_key(view, options);
+    start = bench::Clock::now();
+    mesh_lod::write_lod_file(path, chain, key);
+    double write_ms = bench::elapsed_ms(start);
+    start = bench::Clock::now();
+    auto loaded = mesh_lod::read_lod_file(path, key);
+    double read_ms = bench::elapsed_ms(start);
+    check(loaded.has_value() && loaded->indices == chain.indices && loaded->levels.size() == chain.levels.size(), "sidecar reads back");
+    if (loaded)
+    {
+        for (std::size_t l = 0; l < chain.levels.size() && l < loaded->levels.size(); ++l)
+        {
+            check(loaded->levels[l].error == chain.levels[l].error && loaded->levels[l].ranges.size() == chain.levels[l].ranges.size(), "sidecar levels match");
+        }
+    }
+    check(!mesh_lod::read_lod_file(path, key + 1).has_value(), "a sidecar for other data is rejected");
+    std::printf("sidecar %.1f KiB (%.1f%% of the full mesh's indices), write %.2f ms, read %.2f ms\n",
+        std::filesystem::file_size(path) / 1024.0, 100.0 * std::filesystem::file_size(path) / view.indices.size_bytes(), write_ms, read_ms);
+    std::filesystem::remove(path);
+
+    // 1080p with a 0.8 radian field of view, one pixel of error.
+    std::vector<float> errors{ 0.0f };
+    for (auto&& level : chain.levels)
+    {
+        errors.push_back(level.error);
+    }
+    float projection_scale = 1080.0f / (2.0f * std::tan(0.4f));
+    std::size_t previous_level = 0;
+    check(mesh_lod::select_level(errors, 0.0f, projection_scale, 1.0f) == 0, "the full mesh is used up close");
+    std::printf("selected level by distance:");
+    for (float distance = radius * 0.5f; distance < radius * 5000.0f; distance *= 2.0f)
+    {
+        auto level = mesh_lod::select_level(errors, distance, projection_scale, 1.0f);
+        check(level >= previous_level, "further away never selects a finer level");
+        previous_level = level;
+        std::printf(" %.0fr:%zu", distance / radius, level);
+    }
+    std::printf("\n");
+
+    return bench::check_result();
+}
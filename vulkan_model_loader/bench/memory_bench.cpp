@@ -0,0 +1,263 @@
+// Checks the frame arena, block pool and object pool, then times a frame's worth of short lived
+// vectors from the heap against the same from an arena.
+// Usage: memory_bench [frames]
+// Built with COUNT_ALLOCATIONS it also checks that once warmed up, an arena frame, parallel_for and a
+// transform hierarchy update with its levels split across the job system make no heap allocations,
+// on the shared job system and on one with 3 workers however many cores there are.
+// Exits with 1 if any check fails.
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include <memory_resource>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+#include "alloc_counter.h"
+#include "bench_common.h"
+#include "frame_memory.h"
+#include "job_system.h"
+#include "scene.h"
+
+using namespace baas;
+
+namespace
+{
+    // Vectors per simulated frame and their length, about what recording a frame builds.
+    constexpr int VECTORS_PER_FRAME = 64;
+    constexpr std::size_t VECTOR_LENGTH = 256;
+
+    using bench::check;
+
+    bool aligned(const void* pointer, std::size_t alignment)
+    {
+        return reinterpret_cast<uintptr_t>(pointer) % alignment == 0;
+    }
+
+    // Sized up front like the engine's per frame vectors. Sums what it fills so the work isn't optimized out.
+    template <typename Vector>
+    uint64_t fill_frame(Vector& values)
+    {
+        uint64_t sum{ 0 };
+        values.reserve(values.size() + VECTOR_LENGTH);
+        for (std::size_t i = 0; i < VECTOR_LENGTH; ++i)
+        {
+            values.push_back(static_cast<uint32_t>(i * 7));
+        }
+        for (auto value : values)
+        {
+            sum += value;
+        }
+        return sum;
+    }
+
+    void check_arena()
+    {
+        frame_memory::Arena arena(1024);
+        auto a = arena.allocate(3, 1);
+        auto b = arena.allocate(16, 16);
+        auto c = arena.allocate(8, 64);
+        check(aligned(b, 16) && aligned(c, 64), "arena allocations are aligned");
+        check(a != b && b != c, "arena allocations don't overlap");
+        check(arena.used() <= arena.capacity() && arena.overflow_count() == 0, "small allocations stay in the block");
+
+        auto overflow = arena.allocate(4096, 16);
+        check(aligned(overflow, 16) && arena.overflow_count() == 1, "an allocation larger than the block overflows");
+        arena.reset();
+        check(arena.used() == 0, "reset rewinds");
+        check(arena.capacity() >= 4096 + 3 + 16 + 8, "the block grows to fit the frame that overflowed");
+        auto refit = arena.allocate(4096, 16);
+        check(aligned(refit, 16) && arena.overflow_count() == 1, "the grown block fits the same frame");
+
+        arena.reset();
+        {
+            std::pmr::vector<uint32_t> values(&arena);
+            fill_frame(values);
+            check(values.size() == VECTOR_LENGTH && values.back() == (VECTOR_LENGTH - 1) * 7, "pmr vector in an arena");
+        }
+        check(arena.used() >= VECTOR_LENGTH * sizeof(uint32_t), "deallocating leaves the memory in use until reset");
+    }
+
+    void check_pools(job_system::JobSystem& jobs)
+    {
+        frame_memory::BlockPool pool(24, 8, 4);
+        check(pool.block_size() >= 24, "block size covers the request");
+        auto first = pool.allocate(24, 8);
+        auto second = pool.allocate(16, 8);
+        check(first != second && pool.live_count() == 2, "pool hands out distinct blocks");
+        pool.deallocate(first, 24, 8);
+        check(pool.allocate(24, 8) == first, "a freed block is handed out again");
+        auto large = pool.allocate(1024, 8);
+        check(pool.oversized_count() == 1 && pool.live_count() == 2, "larger requests go upstream");
+        pool.deallocate(large, 1024, 8);
+        auto over_aligned = pool.allocate(16, 256);
+        check(aligned(over_aligned, 256) && pool.oversized_count() == 2, "over aligned requests go upstream");
+        pool.deallocate(over_aligned, 16, 256);
+
+        // Blocks crossing threads, every one freed by whichever chunk happens to run.
+        frame_memory::BlockPool shared_pool(64, 16, 32);
+        std::vector<void*> blocks(4096);
+        jobs.parallel_for(blocks.size(), [&](std::size_t begin, std::size_t end)
+            {
+                for (std::size_t i = begin; i < end; ++i)
+                {
+                    blocks[i] = shared_pool.allocate(64, 16);
+                    *static_cast<std::size_t*>(blocks[i]) = i;
+                }
+            });
+        bool intact{ true };
+        for (std::size_t i = 0; i < blocks.size(); ++i)
+        {
+            intact &= *static_cast<std::size_t*>(blocks[i]) == i;
+        }
+        check(intact, "pool blocks allocated from several threads don't overlap");
+        jobs.parallel_for(blocks.size(), [&](std::size_t begin, std::size_t end)
+            {
+                for (std::size_t i = begin; i < end; ++i)
+                {
+                    shared_pool.deallocate(blocks[i], 64, 16);
+                }
+            });
+        check(shared_pool.live_count() == 0, "every block returned to the pool");
+
+        struct Counted
+        {
+            int value;
+            int* destroyed;
+            Counted(int value, int* destroyed) : value(value), destroyed(destroyed)
+            {
+                if (value < 0)
+                {
+                    throw std::runtime_error("negative");
+                }
+            }
+            ~Counted() { ++*destroyed; }
+        };
+        int destroyed{ 0 };
+        frame_memory::ObjectPool<Counted> objects(8);
+        auto object = objects.create(5, &destroyed);
+        check(object->value == 5 && objects.live_count() == 1, "object pool constructs in place");
+        objects.destroy(object);
+        check(destroyed == 1 && objects.live_count() == 0, "object pool runs the destructor");
+        bool threw{ false };
+        try
+        {
+            objects.create(-1, &destroyed);
+        }
+        catch (std::runtime_error&)
+        {
+            threw = true;
+        }
+        check(threw && objects.live_count() == 0, "a throwing constructor gives its block back");
+    }
+
+    void check_no_allocations(job_system::JobSystem& jobs)
+    {
+        // Warm up first, the job pool, the submit queue and the arena all grow to fit once.
+        frame_memory::Arena arena(256);
+        std::atomic<uint64_t> sum{ 0 };
+        auto frame = [&]
+        {
+            arena.reset();
+            std::pmr::vector<uint32_t> values(&arena);
+            sum += fill_frame(values);
+            jobs.parallel_for(1000, [&sum](std::size_t begin, std::size_t end) { sum.fetch_add(end - begin, std::memory_order_relaxed); }, 10);
+        };
+        for (int i = 0; i < 3; ++i)
+        {
+            frame();
+        }
+        {
+            alloc_counter::Scope scope;
+            for (int i = 0; i < 100; ++i)
+            {
+                frame();
+            }
+            std::printf("arena frame and parallel_for: %llu heap allocations in 100 frames\n", static_cast<unsigned long long>(scope.allocations()));
+            check(scope.allocations() == 0, "steady state arena frames and parallel_for don't allocate");
+        }
+
+        // Wide enough levels to go through parallel_for.
+        scene::TransformHierarchy hierarchy;
+        auto root = hierarchy.add_node();
+        for (uint32_t i = 0; i < 100000; ++i)
+        {
+            hierarchy.add_node(root, { static_cast<float>(i), 0.0f, 0.0f });
+        }
+        hierarchy.update(jobs);
+        for (int i = 0; i < 3; ++i)
+        {
+            hierarchy.set_translation(root, { 0.0f, static_cast<float>(i), 0.0f });
+            hierarchy.update(jobs);
+        }
+        alloc_counter::Scope scope;
+        std::size_t updated{ 0 };
+        for (int i = 0; i < 20; ++i)
+        {
+            hierarchy.set_translation(root, { static_cast<float>(i), 0.0f, 0.0f });
+            updated += hierarchy.update(jobs);
+        }
+        std::printf("transform updates: %llu heap allocations in 20 updates of %zu nodes\n", static_cast<unsigned long long>(scope.allocations()), updated / 20);
+        check(scope.allocations() == 0, "steady state transform updates don't allocate");
+    }
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t frames{ 20000 };
+    if (argc > 1)
+    {
+        std::string_view arg = argv[1];
+        auto [end, error] = std::from_chars(arg.data(), arg.data() + arg.size(), frames);
+        if (error != std::errc() || end != arg.data() + arg.size() || frames == 0)
+        {
+            std::printf("Usage: memory_bench [frames]\n");
+            return 1;
+        }
+    }
+
+    auto& jobs = job_system::shared();
+    check_arena();
+    check_pools(jobs);
+    if (alloc_counter::enabled())
+    {
+        check_no_allocations(jobs);
+        job_system::JobSystem workers(3);
+        check_no_allocations(workers);
+    }
+    else
+    {
+        std::printf("Built without COUNT_ALLOCATIONS, not checking for heap allocations\n");
+    }
+
+    uint64_t sum{ 0 };
+    auto start = bench::Clock::now();
+    for (uint32_t frame = 0; frame < frames; ++frame)
+    {
+        for (int i = 0; i < VECTORS_PER_FRAME; ++i)
+        {
+            std::vector<uint32_t> values;
+            sum += fill_frame(values);
+        }
+    }
+    double heap_ms = bench::elapsed_ms(start);
+
+    frame_memory::Arena arena;
+    start = bench::Clock::now();
+    for (uint32_t frame = 0; frame < frames; ++frame)
+    {
+        arena.reset();
+        for (int i = 0; i < VECTORS_PER_FRAME; ++i)
+        {
+            std::pmr::vector<uint32_t> values(&arena);
+            sum += fill_frame(values);
+        }
+    }
+    double arena_ms = bench::elapsed_ms(start);
+    std::printf("%u frames of %d vectors: heap %.1f ms, arena %.1f ms (%.2fx), arena grew to %zu KiB (checksum %llu)\n", frames, VECTORS_PER_FRAME,
+        heap_ms, arena_ms, heap_ms / arena_ms, arena.capacity() / 1024, static_cast<unsigned long long>(sum));
+
+    return bench::check_result();
+}
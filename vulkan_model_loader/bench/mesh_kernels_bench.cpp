@@ -0,0 +1,158 @@
+// Runs every mesh kernel on every instruction set this CPU supports, checks the results are
+// bit identical to the scalar path and prints the timings.
+// Usage: mesh_kernels_bench [file.obj]
+// Without a file a shuffled 1000x1000 grid is used. Every vector width divides that vertex count, so
+// the comparison also runs on a small grid with 3 vertices more to cover the scalar tails.
+// Exits with 1 if any check fails.
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "bench_common.h"
+#include "mesh_kernels.h"
+#include "obj_loader.h"
+
+using namespace baas;
+
+namespace
+{
+    struct KernelResults
+    {
+        mesh_kernels::Aabb aabb;
+        mesh_kernels::VertexStreams frames;
+        std::vector<std::array<uint16_t, 4>> quantized;
+        std::vector<uint32_t> hashes;
+        mesh_kernels::VertexStreams deduplicated;
+        std::vector<uint32_t> deduplicated_indices;
+    };
+
+    template <typename T>
+    bool same_bits(const std::vector<T>& a, const std::vector<T>& b)
+    {
+        return a.size() == b.size() && (a.empty() || std::memcmp(a.data(), b.data(), a.size() * sizeof(T)) == 0);
+    }
+
+    bool same_streams(const mesh_kernels::VertexStreams& a, const mesh_kernels::VertexStreams& b)
+    {
+        return same_bits(a.position_x, b.position_x) && same_bits(a.position_y, b.position_y) &&
+            same_bits(a.position_z, b.position_z) && same_bits(a.normal_x, b.normal_x) &&
+            same_bits(a.normal_y, b.normal_y) && same_bits(a.normal_z, b.normal_z) && same_bits(a.u, b.u) &&
+            same_bits(a.v, b.v) && same_bits(a.tangent_x, b.tangent_x) && same_bits(a.tangent_y, b.tangent_y) &&
+            same_bits(a.tangent_z, b.tangent_z) && same_bits(a.tangent_w, b.tangent_w);
+    }
+
+    using bench::check;
+
+    KernelResults run(const mesh::Mesh& mesh, const mesh_kernels::VertexStreams& input, mesh_kernels::Isa isa)
+    {
+        KernelResults results;
+        auto context = vertex_format::make_encode_context(mesh.vertices);
+
+        auto start = bench::Clock::now();
+        results.aabb = mesh_kernels::compute_aabb(input, isa);
+        double aabb_ms = bench::elapsed_ms(start);
+
+        results.frames = input;
+        start = bench::Clock::now();
+        mesh_kernels::generate_normals(results.frames, mesh.indices, isa);
+        double normals_ms = bench::elapsed_ms(start);
+
+        start = bench::Clock::now();
+        mesh_kernels::generate_tangents(results.frames, mesh.indices, isa);
+        double tangents_ms = bench::elapsed_ms(start);
+
+        results.quantized.resize(input.size());
+        start = bench::Clock::now();
+        mesh_kernels::quantize_positions(input, context, results.quantized, isa);
+        double quantize_ms = bench::elapsed_ms(start);
+
+        results.hashes.resize(input.size());
+        start = bench::Clock::now();
+        mesh_kernels::hash_vertices(input, results.hashes, isa);
+        double hash_ms = bench::elapsed_ms(start);
+
+        results.deduplicated = input;
+        results.deduplicated_indices = mesh.indices;
+        start = bench::Clock::now();
+        mesh_kernels::deduplicate(results.deduplicated, results.deduplicated_indices, isa);
+        double dedup_ms = bench::elapsed_ms(start);
+
+        std::printf("  %-6s aabb %6.2f ms, normals %6.2f ms, tangents %6.2f ms, quantize %6.2f ms, hash %6.2f ms, "
+                    "deduplicate %6.2f ms\n",
+            std::string(mesh_kernels::isa_name(isa)).c_str(), aabb_ms, normals_ms, tangents_ms, quantize_ms, hash_ms,
+            dedup_ms);
+        return results;
+    }
+
+    void check_matches_scalar(const mesh::Mesh& mesh)
+    {
+        auto input = mesh_kernels::to_streams(mesh.vertices);
+        auto reference = run(mesh, input, mesh_kernels::Isa::scalar);
+        for (auto isa : mesh_kernels::supported_isas())
+        {
+            if (isa == mesh_kernels::Isa::scalar)
+            {
+                continue;
+            }
+            auto results = run(mesh, input, isa);
+            // Compared by value since min/max may pick either sign of zero.
+            check(results.aabb.min == reference.aabb.min && results.aabb.max == reference.aabb.max, "compute_aabb matches scalar");
+            check(same_streams(results.frames, reference.frames), "generate_normals/tangents match scalar");
+            check(same_bits(results.quantized, reference.quantized), "quantize_positions matches scalar");
+            check(same_bits(results.hashes, reference.hashes), "hash_vertices matches scalar");
+            check(same_streams(results.deduplicated, reference.deduplicated) &&
+                    same_bits(results.deduplicated_indices, reference.deduplicated_indices),
+                "deduplicate matches scalar");
+        }
+    }
+
+    // 100x100 vertices and one more triangle, 8n + 3. The extra corners stick out of the grid on every
+    // axis so a tail that gets skipped also shows up in the bounds.
+    mesh::Mesh make_odd_mesh()
+    {
+        auto mesh = bench::make_grid_mesh(100);
+        bench::shuffle_triangles(mesh);
+        auto first = static_cast<uint32_t>(mesh.vertices.size());
+        mesh.vertices.push_back({ { 1.5f, -0.25f, 0.5f }, { 0.0f, 0.0f, 1.0f }, { 0.25f, 0.75f } });
+        mesh.vertices.push_back({ { -0.5f, 1.25f, 0.25f }, { 0.0f, 0.0f, 1.0f }, { 0.5f, 0.5f } });
+        mesh.vertices.push_back({ { 0.5f, 0.5f, -0.75f }, { 0.0f, 0.0f, 1.0f }, { 0.75f, 0.25f } });
+        mesh.indices.insert(mesh.indices.end(), { first, first + 1, first + 2 });
+        mesh.ranges[0].index_count += 3;
+        return mesh;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    mesh::Mesh mesh;
+    if (argc > 1)
+    {
+        mesh = obj_loader::load_obj(argv[1]);
+    }
+    else
+    {
+        mesh = bench::make_grid_mesh(1000);
+        bench::shuffle_triangles(mesh);
+    }
+    std::printf("%zu vertices, %zu triangles\n", mesh.vertices.size(), mesh.triangle_count());
+
+    // The same input again, so deduplicate has something to merge.
+    mesh::Mesh doubled = mesh;
+    doubled.vertices.insert(doubled.vertices.end(), mesh.vertices.begin(), mesh.vertices.end());
+    for (std::size_t i = 0; i < mesh.indices.size(); i += 2)
+    {
+        doubled.indices[i] += static_cast<uint32_t>(mesh.vertices.size());
+    }
+
+    check_matches_scalar(mesh);
+    auto odd = make_odd_mesh();
+    std::printf("%zu vertices, %zu triangles\n", odd.vertices.size(), odd.triangle_count());
+    check_matches_scalar(odd);
+
+    auto doubled_streams = mesh_kernels::to_streams(doubled.vertices);
+    mesh_kernels::deduplicate(doubled_streams, doubled.indices);
+    check(doubled_streams.size() <= mesh.vertices.size(), "deduplicate merges a doubled mesh");
+
+    std::printf("best instruction set: %s\n", std::string(mesh_kernels::isa_name(mesh_kernels::best_isa())).c_str());
+    return bench::check_result();
+}
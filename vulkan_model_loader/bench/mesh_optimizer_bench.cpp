@@ -0,0 +1,259 @@
+// ACMR/ATVR and run time of the mesh optimization passes.
+// Usage: mesh_optimizer_bench [file.obj]
+// Without a file a 1000x1000 grid is used, split into three bands with a material each and with the
+// triangles shuffled within each band.
+// Also checks that every pass only reorders: each range keeps the same triangles with the same
+// winding, the vertex fetch remap is a bijection onto the new vertices and their contents don't
+// change. On the grid ACMR must not get worse than the shuffled input. Exits with 1 if any check fails.
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "bench_common.h"
+#include "mesh_optimizer.h"
+#include "obj_loader.h"
+
+using namespace baas;
+
+namespace
+{
+    constexpr uint32_t NO_VERTEX = std::numeric_limits<uint32_t>::max();
+
+    using Triangle = std::array<uint32_t, 3>;
+
+    using bench::check;
+
+    void print_stats(const char* label, const mesh_optimizer::VertexCacheStats& stats)
+    {
+        std::printf("  %-16s ACMR %.3f ATVR %.3f\n", label, stats.acmr, stats.atvr);
+    }
+
+    bool same_vertex(const mesh::Vertex& a, const mesh::Vertex& b)
+    {
+        return std::memcmp(&a, &b, sizeof(mesh::Vertex)) == 0;
+    }
+
+    // Ids that are equal exactly when the vertex contents are, so meshes whose vertices were renumbered
+    // can still be compared triangle by triangle.
+    class VertexIds
+    {
+    public:
+        explicit VertexIds(std::span<const mesh::Vertex> original) : sorted(original.begin(), original.end())
+        {
+            std::sort(sorted.begin(), sorted.end(), less);
+        }
+
+        // NO_VERTEX for a vertex that isn't in the original mesh.
+        std::vector<uint32_t> ids(std::span<const mesh::Vertex> vertices) const
+        {
+            std::vector<uint32_t> result;
+            result.reserve(vertices.size());
+            for (auto&& vertex : vertices)
+            {
+                auto found = std::lower_bound(sorted.begin(), sorted.end(), vertex, less);
+                result.push_back(found != sorted.end() && same_vertex(*found, vertex) ? static_cast<uint32_t>(found - sorted.begin()) : NO_VERTEX);
+            }
+            return result;
+        }
+
+    private:
+        std::vector<mesh::Vertex> sorted;
+
+        static bool less(const mesh::Vertex& a, const mesh::Vertex& b)
+        {
+            return std::memcmp(&a, &b, sizeof(mesh::Vertex)) < 0;
+        }
+    };
+
+    // A range's triangles as vertex ids, sorted. With keep_winding each triangle is only rotated to
+    // start at its smallest id, so two lists match only if the winding survived as well.
+    std::vector<Triangle> triangles(std::span<const uint32_t> indices, const mesh::MeshRange& range, std::span<const uint32_t> vertex_ids,
+        bool keep_winding)
+    {
+        std::vector<Triangle> result;
+        result.reserve(range.index_count / 3);
+        for (uint32_t i = range.first_index; i + 2 < range.first_index + range.index_count; i += 3)
+        {
+            Triangle triangle{ vertex_ids[indices[i]], vertex_ids[indices[i + 1]], vertex_ids[indices[i + 2]] };
+            if (keep_winding)
+            {
+                std::rotate(triangle.begin(), std::min_element(triangle.begin(), triangle.end()), triangle.end());
+            }
+            else
+            {
+                std::sort(triangle.begin(), triangle.end());
+            }
+            result.push_back(triangle);
+        }
+        std::sort(result.begin(), result.end());
+        return result;
+    }
+
+    void check_reordered(const mesh::Mesh& original, const mesh::Mesh& optimized, const char* same_triangles, const char* same_winding)
+    {
+        std::vector<uint32_t> original_ids(original.vertices.size());
+        std::vector<uint32_t> optimized_ids(optimized.vertices.size());
+        if (original.vertices.size() == optimized.vertices.size() &&
+            std::equal(original.vertices.begin(), original.vertices.end(), optimized.vertices.begin(), same_vertex))
+        {
+            // Only the triangles moved, the vertex indices can be compared as they are.
+            for (uint32_t i = 0; i < original_ids.size(); ++i)
+            {
+                original_ids[i] = i;
+            }
+            optimized_ids = original_ids;
+        }
+        else
+        {
+            VertexIds lookup(original.vertices);
+            original_ids = lookup.ids(original.vertices);
+            optimized_ids = lookup.ids(optimized.vertices);
+            bool contents_kept = std::find(optimized_ids.begin(), optimized_ids.end(), NO_VERTEX) == optimized_ids.end();
+            check(contents_kept, "vertex contents are unchanged");
+            if (!contents_kept)
+            {
+                return;
+            }
+        }
+
+        std::vector<mesh::MeshRange> ranges = original.ranges;
+        if (ranges.empty())
+        {
+            ranges.push_back({ 0, static_cast<uint32_t>(original.indices.size()), 0 });
+        }
+        bool triangles_kept{ true };
+        bool winding_kept{ true };
+        for (auto&& range : ranges)
+        {
+            triangles_kept &= triangles(original.indices, range, original_ids, false) == triangles(optimized.indices, range, optimized_ids, false);
+            winding_kept &= triangles(original.indices, range, original_ids, true) == triangles(optimized.indices, range, optimized_ids, true);
+        }
+        check(triangles_kept, same_triangles);
+        check(winding_kept, same_winding);
+    }
+
+    void check_fetch_remap(const mesh::Mesh& before)
+    {
+        mesh::Mesh fetched = before;
+        auto remap = mesh_optimizer::optimize_vertex_fetch(fetched.indices, fetched.vertices);
+
+        std::vector<bool> referenced(before.vertices.size());
+        for (auto index : before.indices)
+        {
+            referenced[index] = true;
+        }
+        std::vector<bool> hit(fetched.vertices.size());
+        std::size_t mapped{ 0 };
+        bool bijection = remap.size() == before.vertices.size();
+        bool contents_kept{ true };
+        for (std::size_t old_index = 0; bijection && old_index < remap.size(); ++old_index)
+        {
+            auto new_index = remap[old_index];
+            if (new_index == NO_VERTEX)
+            {
+                bijection &= !referenced[old_index];
+                continue;
+            }
+            bijection &= referenced[old_index] && new_index < hit.size() && !hit[new_index];
+            if (bijection)
+            {
+                hit[new_index] = true;
+                ++mapped;
+                contents_kept &= same_vertex(fetched.vertices[new_index], before.vertices[old_index]);
+            }
+        }
+        check(bijection && mapped == fetched.vertices.size(), "the fetch remap maps used vertices one to one onto the new ones");
+        check(contents_kept, "the fetch remap moves vertex contents unchanged");
+
+        bool indices_remapped = fetched.indices.size() == before.indices.size();
+        for (std::size_t i = 0; indices_remapped && i < before.indices.size(); ++i)
+        {
+            indices_remapped = fetched.indices[i] == remap[before.indices[i]];
+        }
+        check(indices_remapped, "indices go through the fetch remap");
+    }
+}
+
+int main(int argc, char** argv)
+{
+    bool generated = argc <= 1;
+    mesh::Mesh mesh;
+    if (!generated)
+    {
+        mesh = obj_loader::load_obj(argv[1]);
+    }
+    else
+    {
+        // Uneven bands of rows, triangles must never move from one range to another.
+        constexpr uint32_t GRID_SIZE = 1000;
+        constexpr std::array<uint32_t, 3> BAND_ENDS = { 200, 700, GRID_SIZE };
+        auto grid = bench::make_grid_mesh(GRID_SIZE);
+        bench::shuffle_triangles(grid);
+        mesh.vertices = std::move(grid.vertices);
+        for (uint32_t band = 0; band < BAND_ENDS.size(); ++band)
+        {
+            auto first_index = static_cast<uint32_t>(mesh.indices.size());
+            for (std::size_t i = 0; i < grid.indices.size(); i += 3)
+            {
+                auto row = std::min({ grid.indices[i], grid.indices[i + 1], grid.indices[i + 2] }) / GRID_SIZE;
+                if (row < BAND_ENDS[band] && (band == 0 || row >= BAND_ENDS[band - 1]))
+                {
+                    mesh.indices.insert(mesh.indices.end(), grid.indices.begin() + i, grid.indices.begin() + i + 3);
+                }
+            }
+            mesh.ranges.push_back({ first_index, static_cast<uint32_t>(mesh.indices.size()) - first_index, band });
+            mesh.materials.emplace_back().name = "band " + std::to_string(band);
+        }
+    }
+    std::printf("%zu vertices, %zu triangles\n", mesh.vertices.size(), mesh.triangle_count());
+    const mesh::Mesh input = mesh;
+
+    mesh::Mesh cache_only = mesh;
+    cache_only.ranges.clear();
+    auto start = bench::Clock::now();
+    mesh_optimizer::optimize_vertex_cache(cache_only.indices, cache_only.vertices.size());
+    double cache_ms = bench::elapsed_ms(start);
+
+    mesh::Mesh overdraw = cache_only;
+    start = bench::Clock::now();
+    mesh_optimizer::optimize_overdraw(overdraw.indices, overdraw.vertices);
+    double overdraw_ms = bench::elapsed_ms(start);
+
+    start = bench::Clock::now();
+    auto report = mesh_optimizer::optimize_mesh(mesh);
+    double total_ms = bench::elapsed_ms(start);
+
+    auto cache_stats = mesh_optimizer::analyze_vertex_cache(cache_only.indices, cache_only.vertices.size());
+    print_stats("input", report.before);
+    print_stats("vertex cache", cache_stats);
+    print_stats("+ overdraw", mesh_optimizer::analyze_vertex_cache(overdraw.indices, overdraw.vertices.size()));
+    print_stats("+ vertex fetch", report.after);
+
+    double triangles = static_cast<double>(mesh.triangle_count());
+    std::printf("vertex cache %.1f ms (%.1f Mtri/s), overdraw %.1f ms, full optimize_mesh %.1f ms\n", cache_ms,
+        triangles / cache_ms / 1000.0, overdraw_ms, total_ms);
+
+    mesh::Mesh unsplit = input;
+    unsplit.ranges.clear();
+    check_reordered(unsplit, cache_only, "the vertex cache pass keeps the same triangles", "the vertex cache pass keeps the winding");
+    check_reordered(unsplit, overdraw, "the overdraw pass keeps the same triangles", "the overdraw pass keeps the winding");
+    check(mesh.ranges.size() == input.ranges.size() &&
+        std::equal(mesh.ranges.begin(), mesh.ranges.end(), input.ranges.begin(), [](const mesh::MeshRange& a, const mesh::MeshRange& b)
+            {
+                return a.first_index == b.first_index && a.index_count == b.index_count && a.material == b.material;
+            }), "optimize_mesh leaves the ranges alone");
+    check_reordered(input, mesh, "each range keeps the same triangles", "each range keeps the winding");
+    check_fetch_remap(overdraw);
+    if (generated)
+    {
+        check(cache_stats.acmr <= report.before.acmr, "the vertex cache pass doesn't make ACMR worse");
+        check(report.after.acmr <= report.before.acmr, "optimize_mesh doesn't make ACMR worse");
+    }
+
+    return bench::check_result();
+}
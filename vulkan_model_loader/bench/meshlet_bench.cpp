@@ -0,0 +1,191 @@
+// Builds meshlets and reports partitioning quality and build speed.
+// Usage: meshlet_bench [file.obj]
+// Without a file a 700x700 vertex bumpy grid is used. Reports vertices and triangles per meshlet, how
+// full the meshlets are against their limits, how often vertices are repeated across meshlets and how
+// many meshlets the normal cones reject from a few viewpoints. Also checks that every triangle ends up
+// in exactly one meshlet with its winding, that the bounds hold their vertices, that a cone never
+// rejects a meshlet with a triangle facing the eye and that the sidecar reads back. Exits with 1 if any
+// of that fails.
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <random>
+#include <string>
+
+#include "bench_common.h"
+#include "mesh_optimizer.h"
+#include "meshlet.h"
+#include "obj_loader.h"
+
+using namespace baas;
+
+namespace
+{
+    using bench::check;
+
+    // Rotated so the smallest index comes first, which keeps the winding comparable.
+    std::array<uint32_t, 3> canonical(uint32_t a, uint32_t b, uint32_t c)
+    {
+        if (b < a && b < c)
+        {
+            return { b, c, a };
+        }
+        if (c < a && c < b)
+        {
+            return { c, a, b };
+        }
+        return { a, b, c };
+    }
+
+    std::vector<std::array<uint32_t, 3>> sorted_triangles(std::span<const uint32_t> indices)
+    {
+        std::vector<std::array<uint32_t, 3>> triangles;
+        for (std::size_t i = 0; i + 2 < indices.size(); i += 3)
+        {
+            triangles.push_back(canonical(indices[i], indices[i + 1], indices[i + 2]));
+        }
+        std::sort(triangles.begin(), triangles.end());
+        return triangles;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    mesh::Mesh mesh;
+    if (argc > 1)
+    {
+        mesh = obj_loader::load_obj(argv[1]);
+    }
+    else
+    {
+        mesh = bench::make_grid_mesh(700);
+    }
+    mesh_optimizer::optimize_mesh(mesh);
+    auto view = mesh.view();
+    std::printf("%zu vertices, %zu triangles, %zu ranges\n", view.vertices.size(), view.triangle_count(), view.ranges.size());
+
+    auto start = bench::Clock::now();
+    auto data = meshlet::build_meshlets(view);
+    double build_ms = bench::elapsed_ms(start);
+    auto meshlet_count = static_cast<double>(std::max<std::size_t>(data.meshlets.size(), 1));
+    std::printf("built %zu meshlets in %.1f ms, %.2f Mtri/s\n", data.meshlets.size(), build_ms, view.triangle_count() / build_ms / 1000.0);
+    std::printf("  %.1f vertices (%.1f%% of %u) and %.1f triangles (%.1f%% of %u) per meshlet\n", data.vertices.size() / meshlet_count,
+        100.0 * data.vertices.size() / meshlet_count / meshlet::MAX_VERTICES, meshlet::MAX_VERTICES, data.triangle_count() / meshlet_count,
+        100.0 * data.triangle_count() / meshlet_count / meshlet::MAX_TRIANGLES, meshlet::MAX_TRIANGLES);
+    std::printf("  every vertex is in %.2f meshlets on average\n", static_cast<double>(data.vertices.size()) / view.vertices.size());
+
+    // Same triangles, same winding, range by range.
+    check(data.ranges.size() == view.ranges.size(), "one meshlet range per mesh range");
+    auto indices = meshlet::meshlet_indices(data);
+    for (std::size_t r = 0; r < data.ranges.size() && r < view.ranges.size(); ++r)
+    {
+        auto& range = data.ranges[r];
+        std::vector<uint32_t> range_indices;
+        for (auto& meshlet : std::span(data.meshlets).subspan(range.first_meshlet, range.meshlet_count))
+        {
+            auto first = indices.begin() + std::size_t{ meshlet.triangle_offset } * 3;
+            range_indices.insert(range_indices.end(), first, first + std::size_t{ meshlet.triangle_count } * 3);
+        }
+        check(sorted_triangles(range_indices) == sorted_triangles(view.indices.subspan(view.ranges[r].first_index, view.ranges[r].index_count)),
+            "every triangle is in exactly one meshlet of its range");
+    }
+
+    std::size_t usable_cones{ 0 };
+    for (std::size_t m = 0; m < data.meshlets.size(); ++m)
+    {
+        auto& meshlet = data.meshlets[m];
+        auto& bounds = data.bounds[m];
+        check(meshlet.vertex_count <= meshlet::MAX_VERTICES && meshlet.triangle_count <= meshlet::MAX_TRIANGLES && meshlet.triangle_count > 0,
+            "meshlets stay within their limits");
+        for (uint32_t v : std::span(data.vertices).subspan(meshlet.vertex_offset, meshlet.vertex_count))
+        {
+            auto& p = view.vertices[v].position;
+            float dx = p[0] - bounds.center[0], dy = p[1] - bounds.center[1], dz = p[2] - bounds.center[2];
+            if (std::sqrt(dx * dx + dy * dy + dz * dz) > bounds.radius * 1.0001f + 1e-6f)
+            {
+                check(false, "bounding spheres hold their vertices");
+                break;
+            }
+        }
+        usable_cones += bounds.cone_cutoff < 1.0f;
+    }
+    std::printf("  %.1f%% of the meshlets have a normal cone\n", 100.0 * usable_cones / meshlet_count);
+
+    // Eyes all around the mesh at a few distances. A rejected meshlet may not have a single triangle
+    // facing the eye.
+    std::array<float, 3> min = view.vertices.front().position;
+    std::array<float, 3> max = min;
+    for (auto&& vertex : view.vertices)
+    {
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            min[axis] = std::min(min[axis], vertex.position[axis]);
+            max[axis] = std::max(max[axis], vertex.position[axis]);
+        }
+    }
+    std::array<float, 3> center{ (min[0] + max[0]) * 0.5f, (min[1] + max[1]) * 0.5f, (min[2] + max[2]) * 0.5f };
+    float radius = 0.5f * std::sqrt((max[0] - min[0]) * (max[0] - min[0]) + (max[1] - min[1]) * (max[1] - min[1]) + (max[2] - min[2]) * (max[2] - min[2]));
+    std::mt19937 rng(7);
+    std::normal_distribution<float> gaussian;
+    constexpr int EYE_COUNT = 16;
+    std::size_t culled{ 0 };
+    std::size_t wrongly_culled{ 0 };
+    start = bench::Clock::now();
+    for (int e = 0; e < EYE_COUNT; ++e)
+    {
+        std::array<float, 3> direction{ gaussian(rng), gaussian(rng), gaussian(rng) };
+        float length = std::sqrt(direction[0] * direction[0] + direction[1] * direction[1] + direction[2] * direction[2]);
+        float distance = radius * (1.5f + e % 4);
+        std::array<float, 3> eye{ center[0] + direction[0] / length * distance, center[1] + direction[1] / length * distance,
+            center[2] + direction[2] / length * distance };
+        for (std::size_t m = 0; m < data.meshlets.size(); ++m)
+        {
+            if (!meshlet::cone_culled(data.bounds[m], eye))
+            {
+                continue;
+            }
+            ++culled;
+            auto& meshlet = data.meshlets[m];
+            for (std::size_t i = std::size_t{ meshlet.triangle_offset } * 3; i < std::size_t{ meshlet.triangle_offset + meshlet.triangle_count } * 3; i += 3)
+            {
+                auto& a = view.vertices[indices[i]].position;
+                auto& b = view.vertices[indices[i + 1]].position;
+                auto& c = view.vertices[indices[i + 2]].position;
+                std::array<float, 3> e0{ b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+                std::array<float, 3> e1{ c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+                std::array<float, 3> n{ e0[1] * e1[2] - e0[2] * e1[1], e0[2] * e1[0] - e0[0] * e1[2], e0[0] * e1[1] - e0[1] * e1[0] };
+                float n_length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+                float facing = n[0] * (eye[0] - a[0]) + n[1] * (eye[1] - a[1]) + n[2] * (eye[2] - a[2]);
+                if (facing > 1e-4f * n_length * radius)
+                {
+                    ++wrongly_culled;
+                    break;
+                }
+            }
+        }
+    }
+    double cone_ms = bench::elapsed_ms(start);
+    check(wrongly_culled == 0, "cones only reject meshlets facing away from the eye");
+    std::printf("  cones reject %.1f%% of the meshlets from %d viewpoints around the mesh (%.1f ns per test)\n",
+        100.0 * culled / (meshlet_count * EYE_COUNT), EYE_COUNT, cone_ms * 1e6 / (meshlet_count * EYE_COUNT));
+
+    // Sidecar round trip, and a key for different data must not load it.
+    auto path = (std::filesystem::temp_directory_path() / "meshlet_bench.vmlmeshlet").string();
+    auto key = meshlet::meshlet_key(view);
+    start = bench::Clock::now();
+    meshlet::write_meshlet_file(path, data, key);
+    double write_ms = bench::elapsed_ms(start);
+    start = bench::Clock::now();
+    auto loaded = meshlet::read_meshlet_file(path, key);
+    double read_ms = bench::elapsed_ms(start);
+    check(loaded.has_value() && loaded->vertices == data.vertices && loaded->triangles == data.triangles &&
+            loaded->meshlets.size() == data.meshlets.size() && loaded->bounds.size() == data.bounds.size() && loaded->ranges.size() == data.ranges.size(),
+        "sidecar reads back");
+    check(!meshlet::read_meshlet_file(path, key + 1).has_value(), "a sidecar for other data is rejected");
+    std::printf("sidecar %.1f KiB (%.1f%% of the mesh's indices), write %.2f ms, read %.2f ms\n", std::filesystem::file_size(path) / 1024.0,
+        100.0 * std::filesystem::file_size(path) / view.indices.size_bytes(), write_ms, read_ms);
+    std::filesystem::remove(path);
+
+    return bench::check_result();
+}
@@ -0,0 +1,139 @@
+// Parse throughput of the OBJ loader for 1..N threads.
+// Usage: obj_loader_bench [file.obj] [max_threads]
+// Without a file a 1000x1000 grid (~2M triangles) is generated in the working directory.
+// First checks small files with known results, that malformed ones are rejected and that every
+// thread count gives the same mesh. Exits with 1 if any check fails.
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#include "bench_common.h"
+#include "file_ops.h"
+#include "obj_loader.h"
+
+using namespace baas;
+
+namespace
+{
+    using bench::check;
+
+    bool same_mesh(const mesh::Mesh& a, const mesh::Mesh& b)
+    {
+        return a.vertices.size() == b.vertices.size() && a.indices == b.indices && a.ranges.size() == b.ranges.size() &&
+            std::memcmp(a.vertices.data(), b.vertices.data(), a.vertices.size() * sizeof(mesh::Vertex)) == 0 &&
+            std::equal(a.ranges.begin(), a.ranges.end(), b.ranges.begin(), [](const mesh::MeshRange& x, const mesh::MeshRange& y)
+                {
+                    return x.first_index == y.first_index && x.index_count == y.index_count && x.material == y.material;
+                });
+    }
+
+    bool rejects(std::string_view text, const char* message)
+    {
+        try
+        {
+            obj_loader::parse_obj(text);
+        }
+        catch (std::runtime_error& error)
+        {
+            return std::strcmp(error.what(), message) == 0;
+        }
+        return false;
+    }
+
+    void check_parsing()
+    {
+        constexpr std::string_view quad =
+            "v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\n"
+            "vt 0 0\nvt 1 0\nvt 1 1\nvt 0 1\n"
+            "vn 0 0 1\n"
+            "f 1/1/1 2/2/1 3/3/1 4/4/1\n";
+        auto mesh = obj_loader::parse_obj(quad);
+        check(mesh.vertices.size() == 4 && mesh.triangle_count() == 2, "a quad is two triangles over four vertices");
+        check(mesh.indices == std::vector<uint32_t>({ 0, 1, 2, 0, 2, 3 }), "a quad is fanned from its first corner");
+        check(mesh.vertices[2].position == std::array{ 1.0f, 1.0f, 0.0f } && mesh.vertices[2].normal == std::array{ 0.0f, 0.0f, 1.0f },
+            "positions and normals come through");
+        check(mesh.vertices[1].uv == std::array{ 1.0f, 1.0f }, "uvs are flipped to a top left origin");
+        check(mesh.ranges.size() == 1 && mesh.ranges[0].first_index == 0 && mesh.ranges[0].index_count == 6, "one range covers the quad");
+
+        constexpr std::string_view relative =
+            "v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\n"
+            "vt 0 0\nvt 1 0\nvt 1 1\nvt 0 1\n"
+            "vn 0 0 1\n"
+            "f -4/-4/-1 -3/-3/-1 -2/-2/-1 -1/-1/-1\n";
+        check(same_mesh(obj_loader::parse_obj(relative), mesh), "relative indices resolve like absolute ones");
+
+        // One line per chunk, so relative indices and shared corners cross chunk boundaries.
+        constexpr std::string_view chunked =
+            "v 0 0 0\nv 1 0 0\nv 1 1 0\nf 1 2 3\nv 0 1 0\nf -4 -2 -1\nf 2 3 4\n";
+        obj_loader::LoadOptions one_chunk;
+        one_chunk.thread_count = 1;
+        obj_loader::LoadOptions many_chunks;
+        many_chunks.thread_count = 16;
+        many_chunks.min_chunk_size = 1;
+        auto whole = obj_loader::parse_obj(chunked, one_chunk);
+        check(whole.vertices.size() == 4 && whole.triangle_count() == 3, "corners are shared between faces");
+        check(same_mesh(obj_loader::parse_obj(chunked, many_chunks), whole), "chunk boundaries don't change the mesh");
+
+        check(rejects("v 0 0 0\nv 1 0 0\nv 1 1 0\nf 1 2 4\n", "OBJ face index out of range"), "an index past the last position is rejected");
+        check(rejects("v 0 0 0\nv 1 0 0\nv 1 1 0\nf 1 2 4294967298\n", "OBJ face index out of range"),
+            "an index past 32 bits is rejected instead of wrapping");
+        check(rejects("v 0 0 0\nv 1 0 0\nv 1 1 0\nvt 0 0\nf 1/1 2/1 3/4294967296\n", "OBJ face index out of range"),
+            "an index one past 32 bits isn't taken for a missing uv");
+        check(rejects("v 0 0 0\nv 1 0 0\nv 1 1 0\nf 1 2 -4\n", "OBJ relative index points before the start of the file"),
+            "a relative index before the first position is rejected");
+        check(rejects("v 0 0 0\nv 1 0 0\nv 1 1 0\nf 0 1 2\n", "OBJ face index 0 is invalid"), "index 0 is rejected");
+        check(rejects("v 0 0 0\nv 1 0 0\nf 1 2\n", "OBJ face with fewer than 3 vertices"), "a two corner face is rejected");
+        check(rejects("v 0 0 0\nv 1 0 0\nv 1 1 0\nf 1 2 x\n", "Malformed face index in OBJ file"), "a non numeric index is rejected");
+    }
+}
+
+int main(int argc, char** argv)
+{
+    check_parsing();
+
+    bool generated = argc <= 1;
+    std::string path = generated ? "obj_loader_bench.obj" : argv[1];
+    unsigned max_threads = argc > 2 ? static_cast<unsigned>(std::stoul(argv[2])) : std::max(1U, std::thread::hardware_concurrency());
+    if (generated)
+    {
+        bench::write_grid_obj(path, 1000);
+    }
+
+    double megabytes = static_cast<double>(file_ops::map_file(path).size()) / (1024.0 * 1024.0);
+    std::printf("%s: %.1f MB\n", path.c_str(), megabytes);
+
+    double single_thread_ms{ 0.0 };
+    mesh::Mesh single_thread_mesh;
+    for (unsigned threads = 1; threads <= std::max(max_threads, 2U); threads *= 2)
+    {
+        obj_loader::LoadOptions options;
+        options.thread_count = threads;
+
+        auto start = bench::Clock::now();
+        auto mesh = obj_loader::load_obj(path, options);
+        double ms = bench::elapsed_ms(start);
+        std::printf("%3u threads: %9.1f ms %8.1f MB/s speedup %.2fx (%zu vertices, %zu triangles)\n", threads, ms,
+            megabytes / (ms / 1000.0), (threads == 1 ? ms : single_thread_ms) / ms, mesh.vertices.size(), mesh.triangle_count());
+        if (threads == 1)
+        {
+            single_thread_ms = ms;
+            single_thread_mesh = std::move(mesh);
+        }
+        else
+        {
+            check(same_mesh(mesh, single_thread_mesh), "every thread count gives the same mesh");
+        }
+    }
+    if (generated)
+    {
+        check(single_thread_mesh.vertices.size() == 1000 * 1000 && single_thread_mesh.triangle_count() == 999 * 999 * 2,
+            "the generated grid has a vertex per grid point and two triangles per cell");
+        std::remove(path.c_str());
+    }
+
+    return bench::check_result();
+}
@@ -0,0 +1,129 @@
+// Measures what a CPU zone costs with the profiler disabled and enabled, and checks that zones from
+// several threads end up in the frame history, the stats summary and a Chrome trace.
+// Usage: profiler_bench [trace.json]
+// Built with COUNT_ALLOCATIONS it also checks that once every history slot has held a frame, recording
+// zones and ending frames makes no heap allocations.
+// Exits with 1 if a check fails. Without ENABLE_PROFILER zones compile away, and only the timing is reported.
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include "alloc_counter.h"
+#include "bench_common.h"
+#include "job_system.h"
+#include "profiler.h"
+
+using namespace baas;
+
+namespace
+{
+    using bench::check;
+
+    // Kept out of line so the loop can't be folded away.
+    [[gnu::noinline]] void zoned_work(volatile uint64_t& sink)
+    {
+        profiler::Zone zone("bench zone");
+        sink = sink + 1;
+    }
+
+    double ns_per_zone(uint32_t count)
+    {
+        volatile uint64_t sink{ 0 };
+        auto start = bench::Clock::now();
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            zoned_work(sink);
+        }
+        return bench::elapsed_ms(start) * 1e6 / count;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    auto& profiler = profiler::Profiler::shared();
+    profiler.set_thread_name("main");
+
+    profiler.set_enabled(false);
+    double disabled_ns = ns_per_zone(10'000'000);
+    profiler.set_enabled(true);
+    profiler.end_startup();
+    double enabled_ns = ns_per_zone(200'000);
+    profiler.end_frame();
+    std::printf("zone cost: %.2f ns disabled, %.2f ns enabled\n", disabled_ns, enabled_ns);
+
+    // A few frames of nested zones on the job system's threads.
+    constexpr int FRAMES = 8;
+    for (int frame = 0; frame < FRAMES; ++frame)
+    {
+        profiler::Zone frame_zone("frame");
+        profiler::Zone stage("update");
+        job_system::shared().parallel_for(64, [](std::size_t begin, std::size_t end)
+            {
+                profiler::Zone zone("job");
+                volatile double x{ 0.0 };
+                for (std::size_t i = begin * 10000; i < end * 10000; ++i)
+                {
+                    x = x + static_cast<double>(i);
+                }
+            }, 4);
+        stage.next("render");
+        profiler.record_gpu("gpu frame", profiler::now_ns() - 1'000'000, profiler::now_ns());
+        stage.end();
+        frame_zone.end();
+        profiler.end_frame();
+    }
+
+    auto report = profiler.stats_report();
+    std::printf("%s\n", report.c_str());
+#ifdef BAAS_PROFILER
+    check(report.find("update") != std::string::npos && report.find("render") != std::string::npos, "stages show up in the summary");
+    check(report.find("job") != std::string::npos, "zones from job threads show up in the summary");
+    check(report.find("gpu frame") != std::string::npos, "GPU zones show up in the summary");
+#endif
+
+    auto path = argc > 1 ? std::string(argv[1]) : (std::filesystem::temp_directory_path() / "profiler_bench.json").string();
+    profiler.write_chrome_trace(path);
+    std::ifstream in(path);
+    std::stringstream contents;
+    contents << in.rdbuf();
+    auto trace = contents.str();
+    check(trace.starts_with("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[") && trace.ends_with("]}\n"), "the trace is one JSON object");
+#ifdef BAAS_PROFILER
+    check(trace.find("\"name\":\"job worker 1\"") != std::string::npos || job_system::shared().thread_count() == 1, "worker threads are named");
+    check(trace.find("\"cat\":\"gpu\"") != std::string::npos, "GPU zones are in the trace");
+#endif
+    std::printf("trace %s, %.1f KiB\n", path.c_str(), trace.size() / 1024.0);
+    if (argc <= 1)
+    {
+        std::filesystem::remove(path);
+    }
+
+    if (alloc_counter::enabled())
+    {
+        auto profiled_frame = [&profiler]
+        {
+            profiler::Zone frame_zone("frame");
+            profiler::Zone stage("update");
+            stage.next("render");
+            profiler.record_gpu("gpu frame", profiler::now_ns() - 1'000'000, profiler::now_ns());
+            stage.end();
+            frame_zone.end();
+            profiler.end_frame();
+        };
+        for (std::size_t frame = 0; frame < profiler::FRAME_HISTORY; ++frame)
+        {
+            profiled_frame();
+        }
+        alloc_counter::Scope scope;
+        for (int frame = 0; frame < 100; ++frame)
+        {
+            profiled_frame();
+        }
+        std::printf("profiled frames: %llu heap allocations in 100 frames\n", static_cast<unsigned long long>(scope.allocations()));
+        check(scope.allocations() == 0, "steady state profiled frames don't allocate");
+    }
+
+    return bench::check_result();
+}
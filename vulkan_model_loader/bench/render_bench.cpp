@@ -0,0 +1,313 @@
+// Headless frame time benchmark. Renders K pipelined frames and reports CPU record time, wait
+// time and frame time percentiles, then K frames that each wait for their fence to measure
+// submit to fence latency.
+// Usage: render_bench [model.obj] [--frames K] [--frames-in-flight N] [--width W] [--height H]
+//                     [--instances I] [--record-threads T] [--gpu-driven] [--no-lod] [--meshlets]
+//                     [--capture out.png] [--profile] [--trace out.json] [--no-textures]
+//                     [--texture-format bc7|bc1|rgba8] [--texture-budget MiB] [--resize-every N]
+//                     [--minimize-every N] [--frame-arenas] [--grid N]
+// Compare --record-threads 1 against the default to see what parallel draw recording buys with many
+// instances, --gpu-driven to see the draw recording cost stop growing with them and --no-lod to see
+// what drawing distant instances at full detail costs. --meshlets on top of --gpu-driven culls the
+// full detail instances per meshlet. --profile adds the startup breakdown and the CPU and GPU zone
+// summary of the pipelined frames, --trace writes them as a Chrome trace. --no-textures and a small
+// --texture-budget show what sampling and streaming the model's textures cost. --resize-every switches
+// the targets between the full and a 3/4 size every N pipelined frames and compares those frames with
+// the rest, which is the stall a window resize costs. --minimize-every sets the targets to 0x0 every N
+// pipelined frames and back after N more, like a window that is minimized and restored, and checks
+// that exactly the frames in between are skipped.
+// --grid writes an N x N vertex grid to render_bench_grid.obj in the working directory and renders
+// that instead of a model. Debug builds run with the validation layer and exit with 1 if it reported
+// an error, which is how ctest runs it.
+// Built with COUNT_ALLOCATIONS it also counts heap allocations made while render_frame runs, on any
+// thread. With --frame-arenas and without --profile, which allocates when recording zones, it exits
+// with 1 if any of the last serialized frames allocated.
+// Run from the build directory so shaders/ resolves. Works on lavapipe, e.g.
+// VK_ICD_FILENAMES=/usr/share/vulkan/icd.d/lvp_icd.x86_64.json ./bench/render_bench model.obj
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "alloc_counter.h"
+#include "bench_common.h"
+#include "frame_stats.h"
+#include "game_engine.h"
+#include "profiler.h"
+#include "texture.h"
+
+using namespace baas;
+
+namespace
+{
+    constexpr uint32_t WARMUP_FRAMES = 10;
+
+    void print_summary(const char* label, const frame_stats::Summary& summary)
+    {
+        std::printf("  %-16s mean %7.3f  p50 %7.3f  p95 %7.3f  p99 %7.3f  max %7.3f ms\n", label, summary.mean,
+            summary.p50, summary.p95, summary.p99, summary.max);
+    }
+
+    bool parse_count(std::string_view text, uint32_t& value)
+    {
+        auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+        return error == std::errc() && end == text.data() + text.size();
+    }
+}
+
+int main(int argc, char** argv)
+{
+    game_engine::EngineConfig config;
+    config.headless = true;
+    uint32_t frame_count{ 500 };
+    uint32_t resize_every{ 0 };
+    uint32_t minimize_every{ 0 };
+    uint32_t grid_size{ 0 };
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string_view arg = argv[i];
+        if (arg == "--capture" && i + 1 < argc)
+        {
+            config.capture_path = argv[++i];
+        }
+        else if (arg == "--gpu-driven")
+        {
+            config.gpu_driven = true;
+        }
+        else if (arg == "--no-lod")
+        {
+            config.lods = false;
+        }
+        else if (arg == "--meshlets")
+        {
+            config.meshlets = true;
+        }
+        else if (arg == "--no-textures")
+        {
+            config.textures = false;
+        }
+        else if (arg == "--texture-format" && i + 1 < argc)
+        {
+            auto format = texture::parse_format(argv[++i]);
+            if (!format)
+            {
+                std::printf("Expected bc7, bc1 or rgba8 after --texture-format\n");
+                return 1;
+            }
+            config.texture_format = *format;
+        }
+        else if (arg == "--profile")
+        {
+            config.profile = true;
+        }
+        else if (arg == "--frame-arenas")
+        {
+            config.frame_arenas = true;
+        }
+        else if (arg == "--trace" && i + 1 < argc)
+        {
+            config.trace_path = argv[++i];
+        }
+        else if ((arg == "--frames" || arg == "--frames-in-flight" || arg == "--width" || arg == "--height" ||
+                     arg == "--instances" || arg == "--record-threads" || arg == "--texture-budget" || arg == "--resize-every" || arg == "--minimize-every" ||
+                     arg == "--grid") && i + 1 < argc)
+        {
+            uint32_t& value = arg == "--frames" ? frame_count
+                : arg == "--width"              ? config.width
+                : arg == "--height"             ? config.height
+                : arg == "--instances"          ? config.instance_count
+                : arg == "--record-threads"     ? config.record_threads
+                : arg == "--texture-budget"     ? config.texture_budget_mb
+                : arg == "--resize-every"       ? resize_every
+                : arg == "--minimize-every"     ? minimize_every
+                : arg == "--grid"               ? grid_size
+                                                : config.frames_in_flight;
+            if (!parse_count(argv[++i], value) || value == 0)
+            {
+                std::printf("Expected a positive number after %s\n", argv[i - 1]);
+                return 1;
+            }
+        }
+        else if (!arg.starts_with("--"))
+        {
+            config.model_path = arg;
+        }
+        else
+        {
+            std::printf("Unknown option: %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    if (grid_size != 0)
+    {
+        config.model_path = "render_bench_grid.obj";
+        bench::write_grid_obj(config.model_path, grid_size);
+    }
+
+    try
+    {
+        game_engine::GameEngine engine(config);
+        bool minimized{ false };
+        // Frames rendered while minimized or skipped while not.
+        uint32_t mismatched_frames{ 0 };
+        uint32_t skipped_frames{ 0 };
+        auto render = [&](uint32_t count, bool wait_for_gpu, std::vector<frame_stats::FrameTiming>& timings,
+                          std::vector<uint64_t>& allocations, uint32_t resize_every = 0, uint32_t minimize_every = 0)
+        {
+            timings.reserve(count);
+            allocations.reserve(count);
+            auto start = bench::Clock::now();
+            auto frame_start = start;
+            bool small{ false };
+            for (uint32_t frame = 0; frame < count; ++frame)
+            {
+                if (resize_every != 0 && frame % resize_every == resize_every - 1)
+                {
+                    small = !small;
+                    engine.resize(small ? std::max(config.width * 3 / 4, 1u) : config.width, small ? std::max(config.height * 3 / 4, 1u) : config.height);
+                }
+                if (minimize_every != 0 && frame % minimize_every == minimize_every - 1)
+                {
+                    minimized = !minimized;
+                    engine.resize(minimized ? 0 : config.width, minimized ? 0 : config.height);
+                }
+                frame_stats::FrameTiming timing{};
+                alloc_counter::Scope frame_allocations;
+                bool rendered = engine.render_frame(frame / 60.0, timing, wait_for_gpu);
+                mismatched_frames += rendered == minimized ? 1 : 0;
+                skipped_frames += rendered ? 0 : 1;
+                allocations.push_back(frame_allocations.allocations());
+                auto now = bench::Clock::now();
+                timing.frame_ms = std::chrono::duration<double, std::milli>(now - frame_start).count();
+                frame_start = now;
+                timings.push_back(timing);
+            }
+            return bench::elapsed_ms(start);
+        };
+        auto column = [](const std::vector<frame_stats::FrameTiming>& timings, double frame_stats::FrameTiming::* field)
+        {
+            std::vector<double> values;
+            for (auto&& timing : timings)
+            {
+                values.push_back(timing.*field);
+            }
+            return frame_stats::summarize(values);
+        };
+        auto print_allocations = [](const std::vector<uint64_t>& allocations)
+        {
+            if (!alloc_counter::enabled())
+            {
+                return;
+            }
+            uint64_t total{ 0 };
+            std::size_t frames{ 0 };
+            for (auto count : allocations)
+            {
+                total += count;
+                frames += count > 0;
+            }
+            std::printf("  %-16s %llu in %zu of %zu frames\n", "heap allocations", static_cast<unsigned long long>(total), frames, allocations.size());
+        };
+
+        std::vector<frame_stats::FrameTiming> warmup;
+        std::vector<uint64_t> warmup_allocations;
+        render(WARMUP_FRAMES, false, warmup, warmup_allocations);
+
+        std::vector<frame_stats::FrameTiming> pipelined;
+        std::vector<uint64_t> pipelined_allocations;
+        double pipelined_ms = render(frame_count, false, pipelined, pipelined_allocations, resize_every, minimize_every);
+        std::printf("%ux%u, %u frames in flight, %u instances, %u frames: %.1f frames/s\n", config.width, config.height,
+            config.frames_in_flight, config.instance_count, frame_count, frame_count * 1000.0 / pipelined_ms);
+        print_summary("cpu record", column(pipelined, &frame_stats::FrameTiming::record_ms));
+        print_summary("draw record", column(pipelined, &frame_stats::FrameTiming::draw_record_ms));
+        print_summary("wait", column(pipelined, &frame_stats::FrameTiming::wait_ms));
+        print_summary("frame", column(pipelined, &frame_stats::FrameTiming::frame_ms));
+        print_allocations(pipelined_allocations);
+        if (resize_every != 0)
+        {
+            std::vector<frame_stats::FrameTiming> resized;
+            std::vector<frame_stats::FrameTiming> steady;
+            for (auto&& timing : pipelined)
+            {
+                (timing.resize_ms > 0.0 ? resized : steady).push_back(timing);
+            }
+            std::printf("%zu resizes between %ux%u and 3/4 of that\n", resized.size(), config.width, config.height);
+            if (!resized.empty())
+            {
+                print_summary("resize", column(resized, &frame_stats::FrameTiming::resize_ms));
+                print_summary("resized frame", column(resized, &frame_stats::FrameTiming::frame_ms));
+                print_summary("other frames", column(steady, &frame_stats::FrameTiming::frame_ms));
+            }
+            // The serialized frames and the capture are at the original size again.
+            if (resized.size() % 2 == 1)
+            {
+                engine.resize(config.width, config.height);
+            }
+        }
+        if (minimize_every != 0)
+        {
+            std::printf("%u frames skipped while minimized every %u frames\n", skipped_frames, minimize_every);
+            if (minimized)
+            {
+                minimized = false;
+                engine.resize(config.width, config.height);
+            }
+        }
+        if (config.profile)
+        {
+            std::printf("%s\n", profiler::Profiler::shared().stats_report().c_str());
+        }
+        // Before the serialized frames, which would push the pipelined ones out of the history.
+        if (!config.trace_path.empty())
+        {
+            profiler::Profiler::shared().write_chrome_trace(config.trace_path);
+            std::printf("Wrote %s\n", config.trace_path.c_str());
+        }
+
+        std::vector<frame_stats::FrameTiming> serialized;
+        std::vector<uint64_t> serialized_allocations;
+        double serialized_ms = render(frame_count, true, serialized, serialized_allocations);
+        std::printf("waiting for every frame: %.1f frames/s\n", frame_count * 1000.0 / serialized_ms);
+        print_summary("submit to fence", column(serialized, &frame_stats::FrameTiming::submit_to_fence_ms));
+        print_allocations(serialized_allocations);
+
+        if (!config.capture_path.empty())
+        {
+            engine.save_frame(config.capture_path);
+            std::printf("Saved %s\n", config.capture_path.c_str());
+        }
+
+        // By then the model is in, its textures have streamed and the arenas have grown to fit.
+        if (alloc_counter::enabled() && config.frame_arenas && !config.profile)
+        {
+            auto steady = std::min<std::size_t>(WARMUP_FRAMES, serialized_allocations.size());
+            for (auto i = serialized_allocations.size() - steady; i < serialized_allocations.size(); ++i)
+            {
+                if (serialized_allocations[i] > 0)
+                {
+                    std::printf("FAILED: steady state frame %zu made %llu heap allocations\n", i, static_cast<unsigned long long>(serialized_allocations[i]));
+                    return 1;
+                }
+            }
+        }
+        if (mismatched_frames > 0)
+        {
+            std::printf("FAILED: %u frames were skipped while not minimized or rendered while minimized\n", mismatched_frames);
+            return 1;
+        }
+        if (engine.validation_errors() > 0)
+        {
+            std::printf("FAILED: the validation layer reported %u errors\n", engine.validation_errors());
+            return 1;
+        }
+    }
+    catch (std::exception& ex)
+    {
+        std::printf("Error: %s\n", ex.what());
+        return 1;
+    }
+    return 0;
+}
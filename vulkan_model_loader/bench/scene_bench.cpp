@@ -0,0 +1,244 @@
+// Measures world matrix updates of the transform hierarchy at 10k, 100k and 1M nodes.
+// Usage: scene_bench
+// The scene is a root with assemblies of 100 parts each, like a large CAD assembly. Reported per size:
+// moving the root (every node recomputed), moving 1% of the parts, moving 1% of the assemblies (their
+// parts follow), an update with nothing changed, and for comparison a single threaded pass over
+// array of structs nodes that recomputes everything with full 4x4 multiplies. Also checks the results
+// against composing each node's chain of local matrices from scratch, that partial updates end up
+// exactly where a full one does, whether they follow the changed subtrees or walk whole levels, and
+// that nodes added out of depth order still see their parent's final matrix. Exits with 1 if any of
+// that fails.
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include "bench_common.h"
+#include "job_system.h"
+#include "scene.h"
+
+using namespace baas;
+
+namespace
+{
+    constexpr uint32_t PARTS_PER_ASSEMBLY = 100;
+    constexpr int REPEATS = 5;
+
+    using bench::check;
+
+    transform::Vec4 random_rotation(std::mt19937& rng)
+    {
+        std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+        auto axis = transform::normalize({ unit(rng), unit(rng), unit(rng) + 2.0f });
+        return transform::axis_angle(axis, unit(rng) * 3.14159f);
+    }
+
+    transform::Vec3 random_offset(std::mt19937& rng, float range)
+    {
+        std::uniform_real_distribution<float> unit(-range, range);
+        return { unit(rng), unit(rng), unit(rng) };
+    }
+
+    // Root, then every assembly, then every part, so the levels come out in node order.
+    scene::TransformHierarchy build_scene(uint32_t node_count, std::vector<uint32_t>& assemblies, std::vector<uint32_t>& parts)
+    {
+        std::mt19937 rng(node_count);
+        scene::TransformHierarchy hierarchy;
+        hierarchy.reserve(node_count);
+        auto root = hierarchy.add_node();
+        uint32_t assembly_count = std::max((node_count - 1) / (PARTS_PER_ASSEMBLY + 1), 1u);
+        assemblies.clear();
+        parts.clear();
+        for (uint32_t i = 0; i < assembly_count; ++i)
+        {
+            assemblies.push_back(hierarchy.add_node(root, random_offset(rng, 100.0f), random_rotation(rng)));
+        }
+        for (uint32_t i = 0; hierarchy.size() < node_count; ++i)
+        {
+            parts.push_back(hierarchy.add_node(assemblies[i % assembly_count], random_offset(rng, 5.0f), random_rotation(rng), { 1.0f, 1.0f, 1.0f }));
+        }
+        return hierarchy;
+    }
+
+    // Every node's chain of local matrices multiplied from scratch.
+    transform::Mat4 reference_world(const scene::TransformHierarchy& hierarchy, uint32_t node)
+    {
+        auto world = transform::compose(hierarchy.translation(node), hierarchy.rotation(node), hierarchy.scale(node));
+        for (auto parent = hierarchy.parent(node); parent != scene::NO_PARENT; parent = hierarchy.parent(parent))
+        {
+            world = transform::multiply(transform::compose(hierarchy.translation(parent), hierarchy.rotation(parent), hierarchy.scale(parent)), world);
+        }
+        return world;
+    }
+
+    float max_difference(const transform::Mat4& a, const transform::Mat4& b)
+    {
+        float result{ 0.0f };
+        for (std::size_t i = 0; i < a.size(); ++i)
+        {
+            result = std::max(result, std::abs(a[i] - b[i]));
+        }
+        return result;
+    }
+
+    // What the hierarchy replaces: one struct per node and a full 4x4 multiply for each of them.
+    struct AosNode
+    {
+        uint32_t parent;
+        transform::Vec3 translation;
+        transform::Vec4 rotation;
+        transform::Vec3 scale;
+        transform::Mat4 world;
+        bool dirty;
+    };
+
+    double aos_update_ms(const scene::TransformHierarchy& hierarchy)
+    {
+        std::vector<AosNode> nodes;
+        nodes.reserve(hierarchy.size());
+        for (uint32_t node = 0; node < hierarchy.size(); ++node)
+        {
+            nodes.push_back({ hierarchy.parent(node), hierarchy.translation(node), hierarchy.rotation(node), hierarchy.scale(node), transform::identity(), true });
+        }
+        auto start = bench::Clock::now();
+        for (auto&& node : nodes)
+        {
+            auto local = transform::compose(node.translation, node.rotation, node.scale);
+            node.world = node.parent == scene::NO_PARENT ? local : transform::multiply(nodes[node.parent].world, local);
+            node.dirty = false;
+        }
+        double ms = bench::elapsed_ms(start);
+        volatile float sink = nodes.back().world[12];
+        (void)sink;
+        return ms;
+    }
+
+    template <typename Change>
+    double median_update_ms(scene::TransformHierarchy& hierarchy, Change&& change, std::size_t& updated)
+    {
+        std::vector<double> times;
+        for (int repeat = 0; repeat < REPEATS; ++repeat)
+        {
+            change(repeat);
+            auto start = bench::Clock::now();
+            updated = hierarchy.update();
+            times.push_back(bench::elapsed_ms(start));
+        }
+        std::sort(times.begin(), times.end());
+        return times[times.size() / 2];
+    }
+
+    void run_checks()
+    {
+        std::vector<uint32_t> assemblies;
+        std::vector<uint32_t> parts;
+        auto hierarchy = build_scene(20'000, assemblies, parts);
+        check(hierarchy.update() == hierarchy.size(), "the first update computes every node");
+        check(hierarchy.update() == 0, "an update with nothing changed does nothing");
+        check(hierarchy.depth_count() == 3, "root, assemblies and parts are three levels");
+
+        float worst{ 0.0f };
+        for (uint32_t node = 0; node < hierarchy.size(); node += 7)
+        {
+            worst = std::max(worst, max_difference(hierarchy.world(node), reference_world(hierarchy, node)));
+        }
+        check(worst < 1e-3f, "world matrices match composing each chain from scratch");
+
+        // Moving one assembly recomputes it and its parts only, and lands where a full update does.
+        std::mt19937 rng(3);
+        hierarchy.set_translation(assemblies[5], random_offset(rng, 100.0f));
+        hierarchy.set_rotation(parts[17], random_rotation(rng));
+        std::size_t children{ 0 };
+        for (auto part : parts)
+        {
+            children += hierarchy.parent(part) == assemblies[5] ? 1 : 0;
+        }
+        bool part_in_assembly = hierarchy.parent(parts[17]) == assemblies[5];
+        check(hierarchy.update() == 1 + children + (part_in_assembly ? 0 : 1), "only the moved nodes and their subtrees are recomputed");
+        auto partial = std::vector<transform::Mat4>(hierarchy.world_matrices().begin(), hierarchy.world_matrices().end());
+        hierarchy.set_translation(0, hierarchy.translation(0));
+        hierarchy.update();
+        check(std::equal(partial.begin(), partial.end(), hierarchy.world_matrices().begin()), "partial updates match a full one exactly");
+
+        // A third of the assemblies is too much of the scene to follow subtrees, the levels are walked.
+        std::size_t moved{ 0 };
+        for (std::size_t i = 0; i < assemblies.size(); i += 3)
+        {
+            hierarchy.set_rotation(assemblies[i], random_rotation(rng));
+            moved += 1 + std::count_if(parts.begin(), parts.end(), [&](uint32_t part) { return hierarchy.parent(part) == assemblies[i]; });
+        }
+        check(hierarchy.update() == moved, "a large partial update recomputes the moved subtrees only");
+        partial.assign(hierarchy.world_matrices().begin(), hierarchy.world_matrices().end());
+        hierarchy.set_translation(0, hierarchy.translation(0));
+        hierarchy.update();
+        check(std::equal(partial.begin(), partial.end(), hierarchy.world_matrices().begin()), "a large partial update matches a full one exactly");
+
+        // A child added to an early node after deeper nodes exist still waits for its parent's level.
+        auto late = hierarchy.add_node(parts[0], { 1.0f, 0.0f, 0.0f });
+        auto later = hierarchy.add_node(late, { 0.0f, 1.0f, 0.0f });
+        hierarchy.set_translation(assemblies[0], { 3.0f, 2.0f, 1.0f });
+        hierarchy.update();
+        check(max_difference(hierarchy.world(later), reference_world(hierarchy, later)) < 1e-3f && hierarchy.depth_count() == 5,
+            "nodes added out of depth order update after their parents");
+
+        bool threw{ false };
+        try
+        {
+            hierarchy.add_node(static_cast<uint32_t>(hierarchy.size()));
+        }
+        catch (std::runtime_error&)
+        {
+            threw = true;
+        }
+        check(threw, "a parent that doesn't exist yet is rejected");
+    }
+}
+
+int main()
+{
+    run_checks();
+    std::printf("%u threads, %u parts per assembly, median of %d updates\n", job_system::shared().thread_count(), PARTS_PER_ASSEMBLY, REPEATS);
+    for (uint32_t node_count : { 10'000u, 100'000u, 1'000'000u })
+    {
+        std::vector<uint32_t> assemblies;
+        std::vector<uint32_t> parts;
+        auto build_start = bench::Clock::now();
+        auto hierarchy = build_scene(node_count, assemblies, parts);
+        hierarchy.update();
+        double build_ms = bench::elapsed_ms(build_start);
+
+        std::mt19937 rng(node_count + 1);
+        std::size_t updated{ 0 };
+        double root_ms = median_update_ms(hierarchy, [&](int) { hierarchy.set_rotation(0, random_rotation(rng)); }, updated);
+        check(updated == node_count, "moving the root recomputes everything");
+        double aos_ms = aos_update_ms(hierarchy);
+        double parts_ms = median_update_ms(hierarchy, [&](int)
+            {
+                for (std::size_t i = 0; i < parts.size() / 100; ++i)
+                {
+                    hierarchy.set_translation(parts[rng() % parts.size()], random_offset(rng, 5.0f));
+                }
+            }, updated);
+        std::size_t parts_updated = updated;
+        double assemblies_ms = median_update_ms(hierarchy, [&](int)
+            {
+                for (std::size_t i = 0; i < std::max<std::size_t>(assemblies.size() / 100, 1); ++i)
+                {
+                    hierarchy.set_rotation(assemblies[rng() % assemblies.size()], random_rotation(rng));
+                }
+            }, updated);
+        std::size_t assemblies_updated = updated;
+        double clean_ms = median_update_ms(hierarchy, [](int) {}, updated);
+        check(updated == 0, "an unchanged hierarchy isn't recomputed");
+
+        std::printf("%7u nodes: built in %.1f ms\n", node_count, build_ms);
+        std::printf("  root moved       %8.3f ms  %6.1f ns/node  (array of structs, 1 thread: %.3f ms)\n", root_ms, root_ms * 1e6 / node_count, aos_ms);
+        std::printf("  1%% of parts      %8.3f ms  %zu nodes recomputed\n", parts_ms, parts_updated);
+        std::printf("  1%% of assemblies %8.3f ms  %zu nodes recomputed\n", assemblies_ms, assemblies_updated);
+        std::printf("  nothing changed  %8.3f ms\n", clean_ms);
+    }
+
+    return bench::check_result();
+}
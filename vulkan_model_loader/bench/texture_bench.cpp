@@ -0,0 +1,204 @@
+// Imports a texture and reports decode, mip generation and block compression speed and quality.
+// Usage: texture_bench [image.png|image.jpg]
+// Without a file a 1024x1024 synthetic image with gradients, edges and noise is used. Also checks that
+// a PNG written by image_io decodes back exactly, that mips average in linear space for sRGB, that BC1
+// keeps punch through alpha, that BC7 beats BC1 (clearly so on gradients) and that the sidecar reads back identically and is
+// rejected for another key or when truncated. Exits with 1 if any of that fails.
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+
+#include "bench_common.h"
+#include "image_io.h"
+#include "texture.h"
+
+using namespace baas;
+
+namespace
+{
+    using bench::check;
+
+    image_io::DecodedImage make_test_image(uint32_t size)
+    {
+        image_io::DecodedImage image{ size, size, std::vector<uint8_t>(std::size_t{ size } * size * 4) };
+        std::mt19937 rng(7);
+        std::uniform_int_distribution<int> noise(-4, 4);
+        for (uint32_t y = 0; y < size; ++y)
+        {
+            for (uint32_t x = 0; x < size; ++x)
+            {
+                uint8_t* pixel = image.rgba.data() + (std::size_t{ y } * size + x) * 4;
+                float u = x / float(size);
+                float v = y / float(size);
+                // Smooth gradients in the top half, hard edged tiles with noise in the bottom half.
+                int r = static_cast<int>(255 * u);
+                int g = static_cast<int>(255 * v);
+                int b = static_cast<int>(127.5f + 127.5f * std::sin(u * 20.0f) * std::cos(v * 13.0f));
+                if (y >= size / 2)
+                {
+                    bool tile = ((x / 37) + (y / 29)) % 2 == 0;
+                    r = tile ? 200 + noise(rng) : 40 + noise(rng);
+                    g = tile ? 60 + noise(rng) : 180 + noise(rng);
+                    b = (x * 7 + y * 3) % 256;
+                }
+                pixel[0] = static_cast<uint8_t>(std::clamp(r, 0, 255));
+                pixel[1] = static_cast<uint8_t>(std::clamp(g, 0, 255));
+                pixel[2] = static_cast<uint8_t>(std::clamp(b, 0, 255));
+                pixel[3] = 255;
+            }
+        }
+        return image;
+    }
+
+    // Over RGB of the first rows of the images, alpha only matters for cutouts which are checked on their own.
+    double psnr(std::span<const uint8_t> a, std::span<const uint8_t> b, uint32_t width, uint32_t rows)
+    {
+        double squared{ 0.0 };
+        std::size_t count{ 0 };
+        for (std::size_t i = 0; i < std::size_t{ width } * rows * 4; ++i)
+        {
+            if (i % 4 == 3)
+            {
+                continue;
+            }
+            double difference = double(a[i]) - double(b[i]);
+            squared += difference * difference;
+            ++count;
+        }
+        double mse = squared / std::max<std::size_t>(count, 1);
+        return mse == 0.0 ? 99.0 : 10.0 * std::log10(255.0 * 255.0 / mse);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    auto temp = std::filesystem::temp_directory_path();
+    image_io::DecodedImage image;
+    if (argc > 1)
+    {
+        auto start = bench::Clock::now();
+        image = image_io::read_image(argv[1]);
+        double decode_ms = bench::elapsed_ms(start);
+        std::printf("%s: %ux%u, decoded in %.2f ms (%.1f MP/s)\n", argv[1], image.width, image.height, decode_ms,
+            image.width * double(image.height) / decode_ms / 1000.0);
+    }
+    else
+    {
+        image = make_test_image(1024);
+        // image_io's own PNG writer stores uncompressed deflate blocks, which covers the stored path of
+        // inflate and every row filter being 0.
+        auto png_path = (temp / "texture_bench.png").string();
+        image_io::write_png(png_path, image.width, image.height, image.rgba);
+        auto start = bench::Clock::now();
+        auto decoded = image_io::read_image(png_path);
+        double decode_ms = bench::elapsed_ms(start);
+        std::printf("synthetic %ux%u, PNG round trip decoded in %.2f ms\n", image.width, image.height, decode_ms);
+        check(decoded.width == image.width && decoded.height == image.height && decoded.rgba == image.rgba, "PNG round trip is exact");
+        std::filesystem::remove(png_path);
+    }
+
+    // A black and white checkerboard averages to half the light, which is 188 in sRGB and 128 when
+    // averaged as if it were linear.
+    image_io::DecodedImage checker{ 2, 2, { 0, 0, 0, 255, 255, 255, 255, 255, 255, 255, 255, 255, 0, 0, 0, 255 } };
+    auto srgb_mips = texture::generate_mips(checker, true);
+    auto linear_mips = texture::generate_mips(checker, false);
+    check(srgb_mips.size() == 2 && srgb_mips[1].rgba[0] == 188 && srgb_mips[1].rgba[3] == 255, "sRGB mips average in linear space");
+    check(linear_mips.size() == 2 && linear_mips[1].rgba[0] == 128, "linear mips average the values");
+    check(texture::mip_count(1024, 300) == 11 && texture::mip_count(1, 1) == 1, "mip counts");
+
+    auto start = bench::Clock::now();
+    auto mips = texture::generate_mips(image, true);
+    double mip_ms = bench::elapsed_ms(start);
+    check(mips.size() == texture::mip_count(image.width, image.height) && mips.back().width == 1 && mips.back().height == 1,
+        "mip chain ends at 1x1");
+    std::printf("%zu mips in %.2f ms\n", mips.size(), mip_ms);
+
+    // Hard edges with noise on top are where one subset modes run out, the smooth half of the synthetic
+    // image shows the difference in precision.
+    double psnr_by_format[3]{};
+    double smooth_psnr_by_format[3]{};
+    for (auto format : { texture::Format::bc1, texture::Format::bc7 })
+    {
+        const char* name = format == texture::Format::bc1 ? "BC1" : "BC7";
+        start = bench::Clock::now();
+        auto encoded = texture::encode_level(image, format);
+        double encode_ms = bench::elapsed_ms(start);
+        auto decoded = texture::decode_level(encoded, format, image.width, image.height);
+        double quality = psnr(image.rgba, decoded, image.width, image.height);
+        psnr_by_format[static_cast<int>(format)] = quality;
+        smooth_psnr_by_format[static_cast<int>(format)] = psnr(image.rgba, decoded, image.width, image.height / 2);
+        std::printf("%s: %.1f ms (%.1f MP/s on %u threads), %.2f dB PSNR, %.1f KiB\n", name, encode_ms,
+            image.width * double(image.height) / encode_ms / 1000.0, job_system::shared().thread_count(), quality, encoded.size() / 1024.0);
+    }
+    check(psnr_by_format[1] > 30.0, "BC1 is above 30 dB");
+    check(psnr_by_format[2] > psnr_by_format[1], "BC7 is better than BC1");
+    if (argc <= 1)
+    {
+        std::printf("smooth half: BC1 %.2f dB, BC7 %.2f dB\n", smooth_psnr_by_format[1], smooth_psnr_by_format[2]);
+        check(smooth_psnr_by_format[2] > smooth_psnr_by_format[1] + 5.0, "BC7 is at least 5 dB better than BC1 on gradients");
+    }
+
+    // Cutout alpha survives BC1 and is exact in BC7 for a two valued alpha.
+    image_io::DecodedImage cutout{ 8, 8, std::vector<uint8_t>(8 * 8 * 4) };
+    for (uint32_t i = 0; i < 64; ++i)
+    {
+        uint8_t* pixel = cutout.rgba.data() + i * 4;
+        pixel[0] = static_cast<uint8_t>(i * 4);
+        pixel[1] = 100;
+        pixel[2] = static_cast<uint8_t>(255 - i * 4);
+        pixel[3] = (i % 8 + i / 8) % 3 == 0 ? 0 : 255;
+    }
+    for (auto format : { texture::Format::bc1, texture::Format::bc7 })
+    {
+        auto decoded = texture::decode_level(texture::encode_level(cutout, format), format, 8, 8);
+        bool alpha_kept{ true };
+        for (uint32_t i = 0; i < 64; ++i)
+        {
+            alpha_kept &= (decoded[i * 4 + 3] >= 128) == (cutout.rgba[i * 4 + 3] >= 128);
+        }
+        check(alpha_kept, format == texture::Format::bc1 ? "BC1 keeps cutout alpha" : "BC7 keeps cutout alpha");
+    }
+
+    // Odd sizes round up to whole blocks and still decode to the right size.
+    auto small = texture::build_texture(make_test_image(6), { texture::Format::bc7, true });
+    check(small.mip_levels().size() == 3 && small.mip_levels()[2].size == 16 &&
+            texture::decode_level(small.level_data(1), texture::Format::bc7, 3, 3).size() == 3 * 3 * 4,
+        "small levels are single blocks");
+
+    texture::TextureOptions options{ texture::Format::bc7, true };
+    start = bench::Clock::now();
+    auto built = texture::build_texture(image, options);
+    double build_ms = bench::elapsed_ms(start);
+    auto path = (temp / "texture_bench.vmltex").string();
+    constexpr uint64_t key = 0x1234;
+    start = bench::Clock::now();
+    texture::write_texture_file(path, built, key);
+    double write_ms = bench::elapsed_ms(start);
+    start = bench::Clock::now();
+    auto read = texture::read_texture_file(path, key);
+    double read_ms = bench::elapsed_ms(start);
+    check(read.has_value(), "sidecar reads back");
+    if (read)
+    {
+        bool same = read->format() == built.format() && read->srgb() == built.srgb() && read->mip_levels().size() == built.mip_levels().size();
+        for (std::size_t level = 0; same && level < built.mip_levels().size(); ++level)
+        {
+            auto a = read->level_data(level);
+            auto b = built.level_data(level);
+            same = a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin());
+        }
+        check(same, "sidecar levels match");
+        check(read->from_cache() && !built.from_cache(), "cached texture is mapped");
+    }
+    check(!texture::read_texture_file(path, key + 1).has_value(), "sidecar with another key is rejected");
+    std::printf("full BC7 chain built in %.1f ms, sidecar %.1f KiB, write %.2f ms, read %.2f ms\n", build_ms, std::filesystem::file_size(path) / 1024.0,
+        write_ms, read_ms);
+    std::filesystem::resize_file(path, std::filesystem::file_size(path) - 1);
+    check(!texture::read_texture_file(path, key).has_value(), "truncated sidecar is rejected");
+    std::filesystem::remove(path);
+
+    return bench::check_result();
+}
@@ -0,0 +1,36 @@
+// Size, encode speed and round trip error of the vertex formats.
+// Usage: vertex_format_bench [file.obj]
+#include <cstdio>
+
+#include "bench_common.h"
+#include "obj_loader.h"
+#include "vertex_format.h"
+
+using namespace baas;
+
+namespace
+{
+    template <typename VertexType>
+    void report(const char* name, const mesh::Mesh& mesh)
+    {
+        auto context = vertex_format::make_encode_context(mesh.vertices);
+        auto start = bench::Clock::now();
+        auto encoded = vertex_format::encode_vertices<VertexType>(mesh.vertices, context);
+        double encode_ms = bench::elapsed_ms(start);
+        auto error = vertex_format::measure_error<VertexType>(mesh.vertices, context);
+
+        double megabytes = static_cast<double>(encoded.size() * sizeof(VertexType)) / (1024.0 * 1024.0);
+        std::printf("%-8s %2zu bytes/vertex %8.1f MB, encode %7.1f ms | max error: position %.3g, normal %.4f deg, uv %.3g\n",
+            name, sizeof(VertexType), megabytes, encode_ms, error.max_position_error, error.max_normal_error_degrees,
+            error.max_uv_error);
+    }
+}
+
+int main(int argc, char** argv)
+{
+    mesh::Mesh mesh = argc > 1 ? obj_loader::load_obj(argv[1]) : bench::make_grid_mesh(1000);
+    std::printf("%zu vertices\n", mesh.vertices.size());
+    report<vertex_format::FullVertex>("full", mesh);
+    report<vertex_format::PackedVertex>("packed", mesh);
+    return 0;
+}
@@ -0,0 +1,26 @@
+#ifndef ALLOC_COUNTER_H
+#define ALLOC_COUNTER_H
+
+#include <cstdint>
+
+// Counts calls to the global operator new on every thread, so a bench can check that a code path never
+// reaches the heap. The replacement operators are only compiled in with COUNT_ALLOCATIONS, without it
+// enabled() is false and the count stays 0.
+namespace baas::alloc_counter
+{
+    bool enabled();
+    // Since the start of the process.
+    uint64_t count();
+
+    // Allocations made while it is alive, on any thread.
+    class Scope
+    {
+    public:
+        Scope() : start(count()) {}
+        uint64_t allocations() const { return count() - start; }
+
+    private:
+        uint64_t start;
+    };
+}
+#endif // !ALLOC_COUNTER_H
@@ -1,13 +1,67 @@
 #ifndef FILE_OPS_H
 #define FILE_OPS_H
 
-#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <span>
 #include <string>
+#include <string_view>
+#include <vector>
 
 namespace baas::file_ops
 {
     using FileData = std::vector<char>;
 
+    enum class AccessHint
+    {
+        normal,
+        sequential,
+        random
+    };
+
+    // Read only view of a whole file mapped into the address space.
+    // Nothing is copied, pages are faulted in by the OS as they are touched.
+    class MappedFile
+    {
+    public:
+        MappedFile() = default;
+        explicit MappedFile(const std::string_view file_path, AccessHint hint = AccessHint::normal);
+        ~MappedFile();
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+        MappedFile(MappedFile&& other) noexcept;
+        MappedFile& operator=(MappedFile&& other) noexcept;
+
+        std::span<const std::byte> bytes() const { return { mapped_data, mapped_size }; }
+
+        // The mapping is page aligned so the cast is safe. Throws if the size isn't a multiple of 4.
+        std::span<const uint32_t> words() const;
+
+        std::string_view text() const
+        {
+            return { reinterpret_cast<const char*>(mapped_data), mapped_size };
+        }
+
+        std::size_t size() const { return mapped_size; }
+        bool empty() const { return mapped_size == 0; }
+
+    private:
+        const std::byte* mapped_data{ nullptr };
+        std::size_t mapped_size{ 0 };
+#ifdef _WIN32
+        void* file_handle{ nullptr };
+        void* mapping_handle{ nullptr };
+#endif
+
+        void release() noexcept;
+    };
+
+    // Fast non cryptographic 64 bit hash, good enough to notice a changed asset.
+    uint64_t hash_bytes(std::span<const std::byte> bytes, uint64_t seed = 0);
+
+    MappedFile map_file(const std::string_view file_path, AccessHint hint = AccessHint::normal);
+
     FileData read_file(const std::string_view file_path);
 
     std::vector<uint32_t> read_shader_code(const std::string_view file_path);
@@ -0,0 +1,74 @@
+#ifndef FILE_WATCHER_H
+#define FILE_WATCHER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Tells which files changed on disk, for hot reloading. A background thread collects change events,
+// from inotify on Linux and by polling modification times elsewhere. Compilers and editors write a
+// file in several steps, so events are coalesced per file and a change is only reported once the file
+// has been quiet for a while.
+namespace baas::file_watcher
+{
+    using Clock = std::chrono::steady_clock;
+
+    struct Change
+    {
+        // As given to watch().
+        std::string path;
+        // When the burst's first event arrived, reload latency is measured from here.
+        Clock::time_point first_event;
+        uint32_t event_count;
+    };
+
+    class FileWatcher
+    {
+    public:
+        explicit FileWatcher(std::chrono::milliseconds quiet_period = std::chrono::milliseconds(50));
+        FileWatcher(const FileWatcher&) = delete;
+        FileWatcher& operator=(const FileWatcher&) = delete;
+        ~FileWatcher();
+
+        // The file's directory is watched rather than the file, so files replaced through a rename are
+        // still seen. The file doesn't have to exist yet.
+        void watch(const std::string& path);
+
+        // Every file whose burst of events has been quiet for quiet_period, once per burst.
+        std::vector<Change> poll_changes();
+
+        // False when inotify couldn't be set up, nothing is ever reported then.
+        bool available() const { return watching; }
+
+    private:
+        struct Watched
+        {
+            std::string path;
+            std::string name;
+            // inotify watch of the directory, unused when polling.
+            int directory_watch{ -1 };
+            std::filesystem::file_time_type last_write{};
+            uint32_t event_count{ 0 };
+            Clock::time_point first_event{};
+            Clock::time_point last_event{};
+        };
+
+        std::chrono::milliseconds quiet_period;
+        int inotify_fd{ -1 };
+        bool watching{ false };
+        std::mutex mutex;
+        std::vector<Watched> files;
+        std::atomic<bool> stopping{ false };
+        std::thread thread;
+
+        void run();
+        // Called with the mutex held.
+        void record_event(Watched& file, Clock::time_point now);
+    };
+}
+#endif // !FILE_WATCHER_H
@@ -0,0 +1,142 @@
+#ifndef FRAME_MEMORY_H
+#define FRAME_MEMORY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+// Memory resources that keep the frame loop off the global heap. Both hold on to what they got from
+// upstream, so once they have seen the largest frame, allocating from them never reaches the heap
+// again. Use them through std::pmr containers or directly.
+namespace baas::frame_memory
+{
+    // Linear allocator for memory that only lives for one frame. Allocating bumps an offset through one
+    // block, deallocate does nothing and reset() rewinds. A frame that needs more than the block gets the
+    // rest from upstream, and the next reset replaces the block with one large enough for that frame.
+    // Not thread safe, give each thread its own.
+    class Arena : public std::pmr::memory_resource
+    {
+    public:
+        explicit Arena(std::size_t capacity = 64 * 1024, std::pmr::memory_resource* upstream = std::pmr::new_delete_resource());
+        Arena(const Arena&) = delete;
+        Arena& operator=(const Arena&) = delete;
+        ~Arena() override;
+
+        // Frees everything allocated since the last reset.
+        void reset();
+
+        std::size_t capacity() const { return block_size; }
+        // Since the last reset, what went to upstream included.
+        std::size_t used() const { return offset + overflow_bytes; }
+        // Allocations that didn't fit the block, since construction.
+        uint64_t overflow_count() const { return overflow_total; }
+
+    private:
+        struct Overflow
+        {
+            void* pointer;
+            std::size_t bytes;
+            std::size_t alignment;
+        };
+
+        std::pmr::memory_resource* upstream;
+        std::byte* block{ nullptr };
+        std::size_t block_size{ 0 };
+        std::size_t offset{ 0 };
+        std::size_t overflow_bytes{ 0 };
+        uint64_t overflow_total{ 0 };
+        // Only touched once the block has run out, so it may use the heap.
+        std::vector<Overflow> overflows;
+
+        void* do_allocate(std::size_t bytes, std::size_t alignment) override;
+        void do_deallocate(void* pointer, std::size_t bytes, std::size_t alignment) override;
+        bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+    };
+
+    // Fixed size blocks carved from chunks and recycled through a free list. Chunks go back to upstream
+    // only when the pool is destroyed. Requests larger or more aligned than a block go straight to
+    // upstream and are counted. Thread safe.
+    class BlockPool : public std::pmr::memory_resource
+    {
+    public:
+        BlockPool(std::size_t block_size, std::size_t block_alignment = alignof(std::max_align_t), std::size_t blocks_per_chunk = 64,
+            std::pmr::memory_resource* upstream = std::pmr::new_delete_resource());
+        BlockPool(const BlockPool&) = delete;
+        BlockPool& operator=(const BlockPool&) = delete;
+        // Blocks still handed out are released with their chunks.
+        ~BlockPool() override;
+
+        std::size_t block_size() const { return size; }
+        // Blocks handed out right now.
+        std::size_t live_count() const;
+        // Requests that didn't fit a block, since construction.
+        uint64_t oversized_count() const;
+
+    private:
+        struct FreeBlock
+        {
+            FreeBlock* next;
+        };
+
+        std::size_t size;
+        std::size_t alignment;
+        std::size_t blocks_per_chunk;
+        std::pmr::memory_resource* upstream;
+        mutable std::mutex mutex;
+        FreeBlock* free_list{ nullptr };
+        std::vector<std::byte*> chunks;
+        std::size_t live{ 0 };
+        uint64_t oversized{ 0 };
+
+        void* do_allocate(std::size_t bytes, std::size_t alignment) override;
+        void do_deallocate(void* pointer, std::size_t bytes, std::size_t alignment) override;
+        bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+    };
+
+    // A block pool sized for T that constructs and destroys them too.
+    template <typename T>
+    class ObjectPool
+    {
+    public:
+        explicit ObjectPool(std::size_t objects_per_chunk = 64, std::pmr::memory_resource* upstream = std::pmr::new_delete_resource())
+            : blocks(sizeof(T), alignof(T), objects_per_chunk, upstream)
+        {
+        }
+
+        template <typename... Args>
+        T* create(Args&&... args)
+        {
+            void* memory = blocks.allocate(sizeof(T), alignof(T));
+            try
+            {
+                return ::new (memory) T(std::forward<Args>(args)...);
+            }
+            catch (...)
+            {
+                blocks.deallocate(memory, sizeof(T), alignof(T));
+                throw;
+            }
+        }
+
+        void destroy(T* object)
+        {
+            if (object != nullptr)
+            {
+                object->~T();
+                blocks.deallocate(object, sizeof(T), alignof(T));
+            }
+        }
+
+        std::size_t live_count() const { return blocks.live_count(); }
+        // For std::pmr containers of T, their nodes only fit if they are no larger than T.
+        std::pmr::memory_resource* resource() { return &blocks; }
+
+    private:
+        BlockPool blocks;
+    };
+}
+#endif // !FRAME_MEMORY_H
@@ -0,0 +1,66 @@
+#ifndef FRAME_STATS_H
+#define FRAME_STATS_H
+
+#include <cstddef>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace baas::frame_stats
+{
+    // Milliseconds spent on each part of one frame.
+    struct FrameTiming
+    {
+        // Blocked on the frame's fence and on acquiring a swapchain image.
+        double wait_ms;
+        // Command buffer recording and queue submission.
+        double record_ms;
+        // Wall time of the part of record_ms spent recording the draw list, however many threads did it.
+        double draw_record_ms;
+        // Start of this frame to the start of the next.
+        double frame_ms;
+        // Submission to the frame's fence signalling. Only measured when the caller waits for each
+        // frame, otherwise 0.
+        double submit_to_fence_ms;
+        // Recreating the swapchain or the offscreen targets before the frame, 0 unless it was resized or
+        // its present mode changed.
+        double resize_ms;
+    };
+
+    struct Summary
+    {
+        std::size_t count;
+        double mean;
+        double p50;
+        double p95;
+        double p99;
+        double max;
+    };
+
+    // Nearest rank percentiles. The samples are copied, not reordered in place.
+    Summary summarize(std::span<const double> samples);
+
+    // Keeps the last `capacity` frames.
+    class FrameStats
+    {
+    public:
+        explicit FrameStats(std::size_t capacity = 1024);
+
+        void add(const FrameTiming& timing);
+        void clear();
+        std::size_t size() const { return count; }
+        std::size_t total_frames() const { return total; }
+
+        Summary summarize(double FrameTiming::* field) const;
+
+        // One line of frame, record and wait percentiles for logging.
+        std::string report() const;
+
+    private:
+        std::vector<FrameTiming> frames;
+        std::size_t next{ 0 };
+        std::size_t count{ 0 };
+        std::size_t total{ 0 };
+    };
+}
+#endif // !FRAME_STATS_H
@@ -5,53 +5,508 @@
 #include <GLFW/glfw3.h>
 #include <vulkan/vulkan.hpp>
 
+#include <array>
+#include <atomic>
 #include <bitset>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "file_watcher.h"
+#include "frame_memory.h"
+#include "frame_stats.h"
+#include "gpu_allocator.h"
+#include "gpu_profiler.h"
+#include "job_system.h"
+#include "mesh_cache.h"
+#include "mesh_lod.h"
+#include "meshlet.h"
+#include "pipeline_cache.h"
+#include "scene.h"
+#include "texture.h"
+#include "texture_streamer.h"
+#include "transform.h"
+#include "upload_service.h"
+#include "vertex_format.h"
+
 namespace baas::game_engine
 {
 
     // TODO Put this in a nicer place later
     constexpr uint32_t WIDTH = 800;
     constexpr uint32_t HEIGHT = 600;
+    // Vertical, in radians.
+    constexpr float FIELD_OF_VIEW = 0.8f;
     
+    // Picked at compile time, the pipeline's vertex input state is generated from it.
+#ifdef PACKED_VERTICES
+    using EngineVertex = vertex_format::PackedVertex;
+#else
+    using EngineVertex = vertex_format::FullVertex;
+#endif
+
+    // Matches the push constant block in shader.vert. model_view_projection is only the view projection
+    // when the instances come from a buffer.
+    struct PushConstants
+    {
+        std::array<float, 16> model_view_projection;
+        std::array<float, 4> position_offset;
+        std::array<float, 4> position_scale;
+        uint32_t material;
+    };
+    
+    // Matches the push constant block in cull.comp and cull_meshlets.comp, exactly the 128 bytes
+    // every device supports.
+    struct CullPushConstants
+    {
+        std::array<transform::Vec4, 6> frustum_planes;
+        // xyz is the eye in scene space, w the LOD projection scale divided by the allowed pixel error.
+        transform::Vec4 camera;
+        uint32_t instance_count;
+        uint32_t range_count;
+        uint32_t lod_count;
+        // 0 without meshlets, otherwise instances at full detail are left to cull_meshlets.comp.
+        uint32_t meshlet_count;
+    };
+    static_assert(sizeof(CullPushConstants) <= 128);
+
+    // Upper bound on the meshlet draws one frame can emit, 20 bytes each.
+    constexpr uint64_t MAX_MESHLET_DRAWS = 1 << 21;
+
+    // Matches Meshlet in cull_meshlets.comp. Bounds are relative to the model's center, like the
+    // instances' positions.
+    struct MeshletDraw
+    {
+        transform::Vec4 sphere;
+        // w is unused.
+        transform::Vec4 cone_apex;
+        // xyz is the axis, w the cutoff.
+        transform::Vec4 cone;
+        uint32_t first_index;
+        uint32_t index_count;
+        uint32_t material;
+        uint32_t padding;
+    };
+
+    // Matches Instances in shader.vert off the GPU driven path, the top three rows of an instance's
+    // world matrix.
+    struct InstanceTransform
+    {
+        std::array<transform::Vec4, 3> rows;
+    };
+
+    // Matches textures in shader.frag, a model's textures past this many aren't drawn.
+    constexpr uint32_t MAX_TEXTURES = 256;
+
+    // Matches Material in shader.frag.
+    struct MaterialData
+    {
+        std::array<float, 4> diffuse;
+        // Into the texture array, 0 is the white default.
+        uint32_t texture;
+        std::array<uint32_t, 3> padding;
+    };
+
+    // Pipeline variants are a bitmask, every combination is compiled at startup.
+    constexpr uint32_t PIPELINE_WIREFRAME = 1;
+    constexpr uint32_t PIPELINE_DOUBLE_SIDED = 2;
+    constexpr uint32_t PIPELINE_VARIANT_COUNT = 4;
+
     namespace engine_state_bit
     {
         constexpr std::size_t WINDOW_BIT {0};
         constexpr std::size_t VK_INSTANCE_BIT {1};
     }
 
+    struct EngineConfig
+    {
+        // Empty means no model is loaded.
+        std::string model_path;
+        mesh_cache::CachePolicy cache_policy{ mesh_cache::CachePolicy::use_cache };
+        // How many frames the CPU may record ahead of the GPU.
+        uint32_t frames_in_flight{ 2 };
+        // Exit after this many frames, 0 runs until the window is closed.
+        uint32_t max_frames{ 0 };
+        // No GLFW window, surface or swapchain. Frames are rendered into offscreen images that can be
+        // read back with save_frame.
+        bool headless{ false };
+        // Only used in headless mode, a window takes the size of its surface.
+        uint32_t width{ WIDTH };
+        uint32_t height{ HEIGHT };
+        // Empty picks mailbox where the surface has it and fifo otherwise. Modes the surface lacks fall
+        // back to fifo, which every surface has.
+        std::optional<vk::PresentModeKHR> present_mode;
+        // Written at the end of main_loop in headless mode, .png or .ppm.
+        std::string capture_path;
+        // Compiled pipelines are kept here between runs, empty compiles from scratch every time.
+        std::string pipeline_cache_path{ "pipeline_cache.bin" };
+        bool wireframe{ false };
+        // Disables back face culling.
+        bool double_sided{ false };
+        // Copies of the model laid out on a grid, each one drawn separately.
+        uint32_t instance_count{ 1 };
+        // Secondary command buffers the draw list is split into and recorded on the job system each
+        // frame. 0 uses one per job system thread, 1 records everything inline into the primary.
+        uint32_t record_threads{ 0 };
+        // Cull instances in a compute shader and draw the survivors with a single indirect count draw,
+        // so the CPU cost no longer grows with the instance count. Falls back to CPU recorded draws
+        // without drawIndirectCount, multiDrawIndirect and drawIndirectFirstInstance.
+        bool gpu_driven{ false };
+        // Build or load the model's LOD chain and draw each instance at the coarsest level whose error
+        // stays under lod_pixel_error pixels on screen.
+        bool lods{ true };
+        float lod_pixel_error{ 1.0f };
+        // GPU driven only. Instances drawn at full detail are split into meshlets, each culled on its own
+        // by frustum and normal cone before it is drawn.
+        bool meshlets{ false };
+        // Turns on the CPU and GPU zones, prints the startup breakdown and a zone summary every couple of
+        // seconds. A trace path turns them on too and gets a Chrome trace when main_loop returns.
+        bool profile{ false };
+        std::string trace_path;
+        // Diffuse textures named by the model's materials are imported into this format and cached next
+        // to the source. Devices without BC support get them decoded to RGBA8 when they are uploaded.
+        bool textures{ true };
+        texture::Format texture_format{ texture::Format::bc7 };
+        // Device memory for streamed mip levels. Every texture's mip tail is resident regardless.
+        uint32_t texture_budget_mb{ 256 };
+        // Windowed only. The shaders, the model and its textures are watched, and a change is swapped in
+        // at the start of a frame while the renderer keeps going.
+        bool hot_reload{ true };
+        // Per frame scratch vectors come from arenas rewound every frame instead of the heap. Keeps the
+        // steady state frame off the heap, but memory_bench has the heap ahead for vectors this size.
+        bool frame_arenas{ false };
+    };
+
+    // What startup needs to know about a physical device, asked once per device instead of once per check.
+    struct DeviceCapabilities
+    {
+        vk::PhysicalDevice physical_device;
+        vk::PhysicalDeviceProperties properties;
+        vk::PhysicalDeviceFeatures features;
+        // All false on devices older than 1.2.
+        vk::PhysicalDeviceVulkan12Features features12;
+        std::vector<vk::QueueFamilyProperties> queue_families;
+        // Per queue family. Without a surface the graphics families stand in.
+        std::vector<bool> present_support;
+        std::vector<vk::ExtensionProperties> extensions;
+        // Empty in headless mode.
+        vk::SurfaceCapabilitiesKHR surface_capabilities;
+        std::vector<vk::SurfaceFormatKHR> surface_formats;
+        std::vector<vk::PresentModeKHR> present_modes;
+
+        bool has_extension(std::string_view name) const;
+    };
+
+    // Everything one frame in flight owns. The pool is reset as a whole at the start of the
+    // frame instead of resetting or reallocating individual command buffers.
+    struct FrameResources
+    {
+        vk::UniqueCommandPool command_pool;
+        vk::UniqueCommandBuffer command_buffer;
+        // Per recording slot, all executed from command_buffer inside the render pass.
+        std::vector<vk::UniqueCommandPool> secondary_pools;
+        std::vector<vk::UniqueCommandBuffer> secondary_buffers;
+        vk::UniqueSemaphore image_available;
+        vk::UniqueFence in_flight;
+        // Rewritten before the frame is recorded whenever the streamer's views have changed since.
+        vk::DescriptorSet material_set;
+        std::optional<uint64_t> material_set_version;
+        // Off the GPU driven path, persistently mapped InstanceTransforms for this frame's draws, each
+        // recording slot writes the range of instances it draws.
+        gpu_allocator::Buffer instance_buffer;
+        vk::DescriptorSet instance_set;
+        // Scratch for recording this frame, rewound once its fence has passed. The first is the render
+        // thread's, then one per recording slot. Empty without frame_arenas.
+        std::vector<std::unique_ptr<frame_memory::Arena>> arenas;
+
+        // Slot 0 is the render thread's, the heap without arenas.
+        std::pmr::memory_resource* scratch(std::size_t slot) const
+        {
+            return arenas.empty() ? std::pmr::get_default_resource() : arenas[slot].get();
+        }
+    };
+
+    // Render targets replaced by a resize or a present mode change. Frames recorded before the
+    // replacement may still use them, so they are destroyed once those frames' fences have passed
+    // rather than after waiting for the device to go idle.
+    struct RetiredTargets
+    {
+        vk::UniqueSwapchainKHR swap_chain;
+        std::vector<vk::UniqueImageView> image_views;
+        std::vector<gpu_allocator::Image> offscreen_images;
+        gpu_allocator::Image depth_image;
+        vk::UniqueImageView depth_view;
+        std::vector<vk::UniqueFramebuffer> framebuffers;
+        std::vector<vk::UniqueSemaphore> render_finished;
+        // Frames submitted before these were retired.
+        uint64_t frame;
+    };
+
+    // Pipelines and model resources replaced by a hot reload. Destroyed once the frames recorded with
+    // them have finished and nothing is still being uploaded into them.
+    struct RetiredResources
+    {
+        std::vector<vk::UniquePipeline> pipelines;
+        std::vector<gpu_allocator::Buffer> buffers;
+        vk::UniqueDescriptorPool descriptor_pool;
+        std::unique_ptr<texture_streamer::TextureStreamer> textures;
+        // Covers every upload submitted before these were retired.
+        upload_service::UploadHandle uploads;
+        uint64_t frame;
+    };
+
     class GameEngine
     {
     public:
-        GameEngine();
+        explicit GameEngine(const EngineConfig& config = {});
         ~GameEngine();
         void main_loop();
+
+        // Records, submits and presents one frame. Returns false when the frame was skipped because
+        // the swapchain is out of date. With wait_for_gpu the call blocks until the frame's fence
+        // signals and fills in timing.submit_to_fence_ms.
+        bool render_frame(double time_seconds, frame_stats::FrameTiming& timing, bool wait_for_gpu = false);
+
+        // Headless mode only. Reads back the most recently rendered image.
+        void save_frame(std::string_view path);
+
+        // The targets are recreated at the start of the next frame. Headless mode only, a window follows
+        // its framebuffer size. A zero size skips frames like a minimized window until the next resize.
+        void resize(uint32_t width, uint32_t height);
+        // Switches to the next present mode the surface has, fifo, mailbox, immediate. Bound to V.
+        void cycle_present_mode();
+        // Falls back to fifo if the surface doesn't have it. Ignored in headless mode.
+        void set_present_mode(vk::PresentModeKHR mode);
+
+        // Errors the validation layer reported so far. Always 0 in release builds, which don't enable it.
+        uint32_t validation_errors() const { return validation_error_count.load(); }
     private:
+        EngineConfig config;
         GLFWwindow* window;
+        // Counted by the debug callback, which may be called from any thread.
+        std::atomic<uint32_t> validation_error_count{ 0 };
 
         vk::UniqueInstance vk_instance;
         vk::UniqueHandle<vk::DebugUtilsMessengerEXT, vk::DispatchLoaderDynamic> debug_messenger;
         vk::UniqueSurfaceKHR surface;
         vk::PhysicalDevice physical_device;
+        DeviceCapabilities device_caps;
         vk::UniqueDevice device;
+        // Declared before every buffer and image so it outlives them.
+        std::unique_ptr<gpu_allocator::GpuAllocator> allocator;
 
+        uint32_t graphics_family{ 0 };
+        uint32_t present_family{ 0 };
+        uint32_t transfer_family{ 0 };
+        bool calibrated_timestamps{ false };
         vk::Queue graphics_queue;
         vk::Queue present_queue;
+        vk::Queue transfer_queue;
+        // Guards graphics and present submissions, the upload service takes it too when it shares their queue.
+        std::mutex queue_mutex;
+        std::unique_ptr<upload_service::UploadService> uploads;
+        // Null unless profiling.
+        std::unique_ptr<gpu_profiler::GpuProfiler> gpu_zones;
 
         vk::UniqueSwapchainKHR swap_chain;
+        vk::Format swap_chain_format;
+        vk::ColorSpaceKHR swap_chain_color_space{ vk::ColorSpaceKHR::eSrgbNonlinear };
+        vk::PresentModeKHR present_mode{ vk::PresentModeKHR::eFifo };
+        vk::Extent2D swap_chain_extent;
         std::vector<vk::Image> swap_chain_images;
         std::vector<vk::UniqueImageView> image_views;
+        // Headless render targets, one per frame in flight. swap_chain_images points at these.
+        std::vector<gpu_allocator::Image> offscreen_images;
+
+        vk::Format depth_format;
+        gpu_allocator::Image depth_image;
+        vk::UniqueImageView depth_view;
 
         vk::UniqueRenderPass render_pass;
+        std::vector<vk::UniqueFramebuffer> framebuffers;
+        std::deque<RetiredTargets> retired_targets;
+        // Set by the framebuffer size callback and by out of date or suboptimal results, the targets are
+        // recreated before the next frame.
+        bool framebuffer_resized{ false };
+        std::optional<vk::Extent2D> requested_extent;
+        std::optional<vk::PresentModeKHR> requested_present_mode;
 
+        std::unique_ptr<pipeline_cache::PipelineCache> pipeline_disk_cache;
         vk::UniquePipelineLayout pipeline_layout;
+        std::array<vk::UniquePipeline, PIPELINE_VARIANT_COUNT> pipelines;
+        bool wireframe_supported{ false };
+        uint32_t pipeline_variant{ 0 };
+        vk::Pipeline graphics_pipeline;
+        // Vertex, fragment, then cull and meshlet cull on the GPU driven path. The modules are kept so a
+        // hot reload only rebuilds the pipelines using the shader that changed.
+        std::vector<std::string> shader_paths;
+        std::vector<vk::UniqueShaderModule> shader_modules;
+
+        // GPU driven path. The scene set holds the instances, the mesh ranges of every LOD, the LOD errors,
+        // the meshlets and the draws, count and per draw instances and materials the cull shaders write,
+        // the vertex shader reads the instances and the per draw entries too.
+        bool gpu_driven{ false };
+        vk::UniqueDescriptorSetLayout scene_set_layout;
+        vk::UniqueDescriptorPool descriptor_pool;
+        vk::DescriptorSet scene_set;
+        vk::UniquePipelineLayout cull_layout;
+        vk::UniquePipeline cull_pipeline;
+        vk::UniquePipeline meshlet_cull_pipeline;
+        gpu_allocator::Buffer instance_buffer;
+        gpu_allocator::Buffer range_buffer;
+        gpu_allocator::Buffer lod_error_buffer;
+        gpu_allocator::Buffer meshlet_buffer;
+        gpu_allocator::Buffer draw_commands;
+        gpu_allocator::Buffer draw_count;
+        gpu_allocator::Buffer draw_instances;
+        uint32_t max_draw_count{ 0 };
+        // Instances per cull_meshlets.comp dispatch row limit, the shader loops over the rest.
+        uint32_t max_meshlet_rows{ 1 };
+
+        // Set 1 of the graphics pipelines, the texture array and the materials. Set 0 is the scene set on
+        // the GPU driven path and the frame's instance buffer otherwise.
+        vk::UniqueDescriptorSetLayout instance_set_layout;
+        vk::UniqueDescriptorPool instance_pool;
+        vk::UniqueDescriptorSetLayout material_set_layout;
+        vk::UniqueDescriptorPool material_pool;
+        vk::UniqueSampler texture_sampler;
+        gpu_allocator::Image default_texture;
+        vk::UniqueImageView default_texture_view;
+        // Host visible, written once the model's textures are known.
+        gpu_allocator::Buffer material_buffer;
+        std::unique_ptr<texture_streamer::TextureStreamer> textures;
+        // Streamer index of the texture in each array slot past the default.
+        std::vector<uint32_t> texture_slots;
+
+        std::vector<FrameResources> frames;
+        // Signalled when rendering to a swapchain image is done. Kept per image rather than per frame
+        // since the presentation engine may still be waiting on it when the frame slot comes around again.
+        std::vector<vk::UniqueSemaphore> render_finished;
+        // The fence of the frame that last rendered to each swapchain image.
+        std::vector<vk::Fence> images_in_flight;
+        std::size_t current_frame{ 0 };
+        // Frames submitted so far, retired targets are destroyed by it.
+        uint64_t frame_number{ 0 };
+        std::optional<uint32_t> last_image_index;
+        frame_stats::FrameStats frame_timings;
+        // steady_clock nanoseconds when the constructor started, for the time to first frame.
+        int64_t startup_ns{ 0 };
+        bool first_frame_submitted{ false };
+        bool model_frame_submitted{ false };
 
         std::bitset<2> engine_state;
 
+        mesh_cache::LoadedMesh model;
+        gpu_allocator::Buffer model_vertices;
+        gpu_allocator::Buffer model_indices;
+        upload_service::UploadHandle model_upload;
+        PushConstants model_constants{};
+        transform::Vec3 model_center{};
+        float model_radius{ 1.0f };
+        // Root, a node per grid row and a node per instance below it. World matrices place the model's
+        // center, its own centering is part of the position offset.
+        scene::TransformHierarchy transforms;
+        std::vector<uint32_t> instance_nodes;
+        float scene_radius{ 1.0f };
+        // Level 0 is the model itself. lod_ranges holds one run of the model's ranges per level, all
+        // indexing model_indices, which has the LOD chain's indices after the model's.
+        std::vector<float> lod_errors;
+        std::vector<mesh::MeshRange> lod_ranges;
+        // Empty unless meshlets are on, their indices follow the LOD chain's in model_indices.
+        std::vector<MeshletDraw> meshlet_draws;
+        // Filled by parse_model, which runs before the device exists, and emptied once upload_model has
+        // handed them to the upload service.
+        std::vector<EngineVertex> staged_vertices;
+        std::vector<uint32_t> staged_lod_indices;
+        std::vector<uint32_t> staged_meshlet_indices;
+        // Imported textures, one per distinct file and empty where the import failed, and the one each
+        // material uses. Materials without a texture point past the end.
+        std::vector<std::optional<texture::Texture>> staged_textures;
+        std::vector<uint32_t> staged_material_textures;
+        // The model and the texture files it uses, what hot reloading watches besides the shaders.
+        std::vector<std::string> model_files;
 
-        void init_window();
-        void init_vulkan();
+        // Null without hot reloading. A changed model is first run through the caches as a job, the swap
+        // happens at the start of the first frame after that job is done.
+        std::unique_ptr<file_watcher::FileWatcher> watcher;
+        job_system::JobHandle model_reload;
+        // The first change not yet swapped in, and whether anything changed after the load started.
+        std::optional<file_watcher::Change> model_change;
+        bool model_files_changed{ false };
+        // Swapped in but not yet in a submitted frame, reported with their latency once they are. A
+        // reloaded model counts from the first frame that draws it.
+        std::vector<file_watcher::Change> applied_changes;
+        std::deque<RetiredResources> retired_resources;
 
+        // Startup stages, the constructor runs them as a dependency graph on the job system.
+        void init_window();
         void create_instance();
+        void select_physical_device();
+        void create_device();
+        // Formats, present mode and extent, so the swapchain and the pipelines can be created in parallel.
+        void choose_swap_chain_settings();
+        // From the surface's current extent or the framebuffer size, 0x0 while the window is minimized.
+        vk::Extent2D choose_extent() const;
+        void create_swap_chain(vk::SwapchainKHR old_swap_chain = {});
+        void create_offscreen_targets();
+        void create_depth_buffer();
+        void create_render_pass();
+        void create_pipelines();
+        // Checks for the SPIR-V magic first, so a half written file fails here instead of in the driver.
+        vk::UniqueShaderModule load_shader(std::string_view path) const;
+        // Every variant from the current shader modules, null where the device has no wireframe.
+        std::array<vk::UniquePipeline, PIPELINE_VARIANT_COUNT> create_graphics_pipelines() const;
+        vk::UniquePipeline create_cull_pipeline(vk::ShaderModule module) const;
+        void allocate_scene_set();
+        void create_framebuffers();
+        void create_frame_resources();
+        // Sampler, default texture and a material set per frame, needs the pipelines and the frames.
+        void create_material_resources();
+        // Instance buffer and set per frame, same dependencies.
+        void create_instance_resources();
+        // CPU only, safe to run before the device exists.
+        void parse_model();
+        void upload_model();
+        void create_scene_buffers();
+        // Retires the current targets and builds new ones at the new size or present mode, without
+        // waiting for the GPU. Returns false while the window is minimized.
+        bool recreate_targets();
+        // Retired targets and resources whose frames and uploads are done.
+        void release_retired();
+        void upload_textures();
+        // Asks the streamer for the detail the model's nearest instance needs.
+        void request_texture_detail(double time_seconds);
+        void write_material_set(FrameResources& frame);
+        // Hot reloading, all on the render thread at the start of a frame after its fence.
+        void start_watching();
+        void apply_file_changes();
+        // Throws and keeps the old pipelines if the shader doesn't load or compile.
+        void reload_shader(std::size_t index);
+        void reload_model();
+
+        gpu_allocator::Buffer create_host_buffer(vk::BufferUsageFlags usage, vk::DeviceSize size) const;
+        gpu_allocator::Buffer create_host_buffer(vk::BufferUsageFlags usage, std::span<const std::byte> data) const;
+
+        void record_commands(vk::CommandBuffer command_buffer, uint32_t image_index, double time_seconds, bool draw_model, frame_stats::FrameTiming& timing);
+        // Draws instances [first_instance, last_instance) grouped by LOD, one instanced draw per level and
+        // range. Writes only their part of the frame's instance buffer, so it is safe to call from several
+        // threads at once as long as each has its own scratch.
+        void record_draws(vk::CommandBuffer command_buffer, const FrameResources& frame, uint32_t first_instance, uint32_t last_instance, double time_seconds,
+            std::pmr::memory_resource* scratch) const;
+        // Outside the render pass, fills draw_commands and draw_count for record_indirect_draws.
+        void record_culling(vk::CommandBuffer command_buffer, const transform::Mat4& view_projection, double time_seconds) const;
+        void record_indirect_draws(vk::CommandBuffer command_buffer, vk::DescriptorSet material_set, const transform::Mat4& view_projection) const;
+        transform::Mat4 view_projection(double time_seconds) const;
+        transform::Vec3 camera_position(double time_seconds) const;
+        // Viewport height over 2 tan(fov / 2), turns an object space error at some distance into pixels.
+        float lod_projection_scale() const;
 
         bool window_enabled() const 
         {
@@ -0,0 +1,148 @@
+#ifndef GPU_ALLOCATOR_H
+#define GPU_ALLOCATOR_H
+
+#include <vulkan/vulkan.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "tlsf_allocator.h"
+
+// Sub-allocates buffers and images out of a few large vk::DeviceMemory blocks per memory type
+// instead of one vkAllocateMemory each. The placement logic is tlsf_allocator.
+namespace baas::gpu_allocator
+{
+    constexpr vk::DeviceSize DEFAULT_BLOCK_SIZE = 64ull << 20;
+
+    // Buffers and optimal tiling images never share a block, which keeps them apart by more
+    // than bufferImageGranularity without having to pad every allocation.
+    enum class ResourceKind
+    {
+        buffer,
+        image
+    };
+
+    struct Allocation
+    {
+        vk::DeviceMemory memory;
+        vk::DeviceSize offset{ 0 };
+        vk::DeviceSize size{ 0 };
+        // Host visible blocks stay mapped for their whole life, null otherwise.
+        std::byte* mapped{ nullptr };
+
+        uint32_t pool{ 0 };
+        void* block{ nullptr };
+        tlsf_allocator::Allocation range{};
+
+        explicit operator bool() const { return static_cast<bool>(memory); }
+    };
+
+    struct Stats
+    {
+        vk::DeviceSize bytes_used;
+        vk::DeviceSize bytes_reserved;
+        vk::DeviceSize largest_free_block;
+        uint32_t allocation_count;
+        // Live vkAllocateMemory calls.
+        uint32_t block_count;
+        // 1 - largest free range / free bytes, over all blocks.
+        double fragmentation;
+    };
+
+    class GpuAllocator
+    {
+    public:
+        GpuAllocator(vk::PhysicalDevice physical_device, vk::Device device, vk::DeviceSize block_size = DEFAULT_BLOCK_SIZE);
+        GpuAllocator(const GpuAllocator&) = delete;
+        GpuAllocator& operator=(const GpuAllocator&) = delete;
+
+        // Picks a memory type with all `required` flags, preferring one that also has `preferred`.
+        // Throws if nothing fits.
+        Allocation allocate(const vk::MemoryRequirements& requirements, vk::MemoryPropertyFlags required, ResourceKind kind,
+            vk::MemoryPropertyFlags preferred = {});
+        void free(Allocation& allocation);
+
+        Stats stats() const;
+        std::string report() const;
+
+        vk::Device get_device() const { return device; }
+
+    private:
+        struct MemoryBlock
+        {
+            vk::UniqueDeviceMemory memory;
+            std::byte* mapped;
+            tlsf_allocator::TlsfAllocator ranges;
+            // Sized for a single large resource, released as soon as it's freed.
+            bool dedicated;
+        };
+
+        struct Pool
+        {
+            uint32_t memory_type;
+            ResourceKind kind;
+            std::vector<std::unique_ptr<MemoryBlock>> blocks;
+        };
+
+        vk::Device device;
+        vk::PhysicalDeviceMemoryProperties memory_properties;
+        vk::DeviceSize block_size;
+        std::vector<Pool> pools;
+        mutable std::mutex mutex;
+
+        uint32_t find_memory_type(uint32_t type_bits, vk::MemoryPropertyFlags properties) const;
+        MemoryBlock& add_block(Pool& pool, vk::DeviceSize size, bool dedicated);
+    };
+
+    // A vk::Buffer bound to an allocation, both released together. Passing more than one distinct
+    // queue family creates it with concurrent sharing.
+    class Buffer
+    {
+    public:
+        Buffer() = default;
+        Buffer(GpuAllocator& allocator, vk::DeviceSize size, vk::BufferUsageFlags usage, vk::MemoryPropertyFlags required,
+            vk::MemoryPropertyFlags preferred = {}, std::span<const uint32_t> queue_families = {});
+        Buffer(Buffer&& other) noexcept;
+        Buffer& operator=(Buffer&& other) noexcept;
+        ~Buffer();
+
+        vk::Buffer get() const { return *buffer; }
+        vk::DeviceSize size() const { return buffer_size; }
+        std::byte* mapped() const { return allocation.mapped; }
+        explicit operator bool() const { return static_cast<bool>(buffer); }
+
+    private:
+        GpuAllocator* owner{ nullptr };
+        vk::UniqueBuffer buffer;
+        Allocation allocation;
+        vk::DeviceSize buffer_size{ 0 };
+
+        void release();
+    };
+
+    class Image
+    {
+    public:
+        Image() = default;
+        Image(GpuAllocator& allocator, const vk::ImageCreateInfo& create_info, vk::MemoryPropertyFlags required);
+        Image(Image&& other) noexcept;
+        Image& operator=(Image&& other) noexcept;
+        ~Image();
+
+        vk::Image get() const { return *image; }
+        explicit operator bool() const { return static_cast<bool>(image); }
+
+    private:
+        GpuAllocator* owner{ nullptr };
+        vk::UniqueImage image;
+        Allocation allocation;
+
+        void release();
+    };
+}
+#endif // !GPU_ALLOCATOR_H
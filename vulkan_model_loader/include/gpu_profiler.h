@@ -0,0 +1,97 @@
+#ifndef GPU_PROFILER_H
+#define GPU_PROFILER_H
+
+#include <vulkan/vulkan.hpp>
+
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <vector>
+
+// GPU zones from timestamp queries. Every frame in flight owns a slice of one query pool, its results
+// are read once the frame's fence has passed and handed to the CPU profiler on the steady_clock
+// timeline, so CPU and GPU zones line up in the trace.
+namespace baas::gpu_profiler
+{
+    constexpr uint32_t INVALID_ZONE = std::numeric_limits<uint32_t>::max();
+
+    class GpuProfiler
+    {
+    public:
+        // calibrated_timestamps says whether VK_EXT_calibrated_timestamps was enabled on the device,
+        // without it the clocks are lined up with one timed submit. The queue mutex may be null.
+        GpuProfiler(vk::Instance instance, vk::PhysicalDevice physical_device, vk::Device device, vk::Queue queue, uint32_t queue_family,
+            std::mutex* queue_mutex, uint32_t frames_in_flight, bool calibrated_timestamps, uint32_t zones_per_frame = 32);
+
+        // False when the queue family has no timestamps, every call is then a no-op.
+        bool available() const { return query_pool.get() != vk::QueryPool(); }
+
+        // Call right after beginning the frame's command buffer, once its fence has passed. Reports the
+        // zones the slot recorded last time and resets its queries.
+        void begin_frame(vk::CommandBuffer command_buffer, uint32_t frame_slot);
+        uint32_t begin_zone(vk::CommandBuffer command_buffer, const char* name);
+        void end_zone(vk::CommandBuffer command_buffer, uint32_t zone);
+
+        // Measures the offset between GPU ticks and steady_clock again.
+        void calibrate();
+
+    private:
+        struct Slot
+        {
+            std::vector<const char*> names;
+        };
+
+        vk::Instance instance;
+        vk::PhysicalDevice physical_device;
+        vk::Device device;
+        vk::Queue queue;
+        uint32_t queue_family;
+        std::mutex* queue_mutex;
+        bool calibrated_timestamps;
+        uint32_t zones_per_frame;
+        double nanoseconds_per_tick{ 1.0 };
+        uint64_t tick_mask{ ~uint64_t{ 0 } };
+        vk::UniqueQueryPool query_pool;
+        std::vector<Slot> slots;
+        uint32_t current_slot{ 0 };
+        // A GPU tick count and the steady_clock nanoseconds at the same moment.
+        uint64_t base_ticks{ 0 };
+        int64_t base_ns{ 0 };
+
+        bool calibrate_with_extension();
+        void calibrate_with_submit();
+    };
+
+    // Times the commands recorded during its lifetime.
+    class GpuZone
+    {
+    public:
+        GpuZone(GpuProfiler* profiler, vk::CommandBuffer command_buffer, const char* name)
+            : profiler(profiler), command_buffer(command_buffer)
+        {
+            if (profiler != nullptr)
+            {
+                zone = profiler->begin_zone(command_buffer, name);
+            }
+        }
+        ~GpuZone() { end(); }
+
+        // For zones that have to end before the scope does, e.g. before the command buffer is ended.
+        void end()
+        {
+            if (profiler != nullptr)
+            {
+                profiler->end_zone(command_buffer, zone);
+                profiler = nullptr;
+            }
+        }
+        GpuZone(const GpuZone&) = delete;
+        GpuZone& operator=(const GpuZone&) = delete;
+
+    private:
+        GpuProfiler* profiler;
+        vk::CommandBuffer command_buffer;
+        uint32_t zone{ INVALID_ZONE };
+    };
+}
+#endif // !GPU_PROFILER_H
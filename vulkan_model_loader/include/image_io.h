@@ -0,0 +1,42 @@
+#ifndef IMAGE_IO_H
+#define IMAGE_IO_H
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <vector>
+
+// Writers for frame captures and decoders for model textures. Pixels are tightly packed 8 bit RGBA
+// rows, top row first; the writers drop alpha since the render targets are opaque.
+namespace baas::image_io
+{
+    struct DecodedImage
+    {
+        uint32_t width{ 0 };
+        uint32_t height{ 0 };
+        std::vector<uint8_t> rgba;
+    };
+
+    void write_ppm(std::string_view path, uint32_t width, uint32_t height, std::span<const uint8_t> rgba);
+
+    // Uncompressed (stored deflate) PNG. Big files, but no zlib dependency and nothing to tune.
+    void write_png(std::string_view path, uint32_t width, uint32_t height, std::span<const uint8_t> rgba);
+
+    // Picks the format from the extension, .png or .ppm.
+    void write_image(std::string_view path, uint32_t width, uint32_t height, std::span<const uint8_t> rgba);
+
+    // Every color type and bit depth, interlaced or not. 16 bit channels are cut to their high byte,
+    // gamma and color chunks are ignored.
+    DecodedImage decode_png(std::span<const std::byte> data);
+
+    // Sequential and progressive Huffman JPEG with one or three components. Arithmetic coded, lossless
+    // and CMYK files throw, chroma is upsampled by repeating samples.
+    DecodedImage decode_jpeg(std::span<const std::byte> data);
+
+    // Picks the decoder from the signature rather than the extension, texture names in .mtl files lie.
+    DecodedImage decode_image(std::span<const std::byte> data);
+
+    DecodedImage read_image(std::string_view path);
+}
+#endif // !IMAGE_IO_H
@@ -0,0 +1,146 @@
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Work stealing task scheduler. Every worker owns a deque it pushes and pops at the bottom, idle
+// workers steal from the top of the others. Threads that aren't workers submit through a shared
+// queue. A waiting thread helps, but only with jobs of the group it waits for, so a frame's
+// parallel_for never ends up running a long load someone else queued.
+namespace baas::job_system
+{
+    class JobSystem;
+
+    // Non-owning reference to a callable taking (begin, end), so parallel_for doesn't copy its body
+    // into a std::function for every chunk. Only valid while the callable it refers to is.
+    class RangeFunction
+    {
+    public:
+        template <typename F>
+            requires (!std::is_same_v<std::remove_cvref_t<F>, RangeFunction>)
+        RangeFunction(F&& body)
+            : object(const_cast<void*>(static_cast<const void*>(std::addressof(body)))),
+              call([](void* object, std::size_t begin, std::size_t end) { (*static_cast<std::remove_reference_t<F>*>(object))(begin, end); })
+        {
+        }
+
+        void operator()(std::size_t begin, std::size_t end) const { call(object, begin, end); }
+
+    private:
+        void* object;
+        void (*call)(void* object, std::size_t begin, std::size_t end);
+    };
+
+    struct Job
+    {
+        std::function<void()> work;
+        // parallel_for chunks run range(begin, end) instead of work.
+        const RangeFunction* range{ nullptr };
+        std::size_t begin{ 0 };
+        std::size_t end{ 0 };
+        // 1 for the job itself plus one per unfinished child.
+        std::atomic<int32_t> unfinished{ 1 };
+        std::shared_ptr<Job> parent;
+        // Keeps a submitted job alive until it has run, cleared right after.
+        std::shared_ptr<Job> self;
+        std::atomic<bool> failed{ false };
+        std::exception_ptr error;
+        // Jobs created by a running job, or with a parent, join its group. Anything else starts a new one.
+        uint64_t group{ 0 };
+    };
+
+    // Completion is tracked through the handle, a job stays valid for as long as one exists.
+    using JobHandle = std::shared_ptr<Job>;
+
+    class JobSystem
+    {
+    public:
+        // 0 workers picks hardware_concurrency - 1, the thread calling wait makes up the rest. Returns
+        // once every worker has started, so their one time setup never lands in the caller's work.
+        explicit JobSystem(unsigned worker_count = 0);
+        JobSystem(const JobSystem&) = delete;
+        JobSystem& operator=(const JobSystem&) = delete;
+        // Jobs still queued are dropped, wait for them first.
+        ~JobSystem();
+
+        // Creates a job without starting it, so children can be attached before it runs. The parent
+        // doesn't complete before this job does, and must not have completed already.
+        JobHandle create(std::function<void()> work, const JobHandle& parent = {});
+        void submit(const JobHandle& job);
+        JobHandle run(std::function<void()> work, const JobHandle& parent = {});
+
+        // Runs other jobs of the same group until this one and all its children are done, then rethrows
+        // the first exception any of them threw.
+        void wait(const JobHandle& job);
+        bool is_done(const JobHandle& job) const;
+
+        // Calls body(begin, end) over [0, count) in chunks of about grain items, 0 picks a grain that
+        // gives each thread a few chunks to balance with. Returns once every chunk has run, without
+        // touching the heap once the job pool and the submit queue have grown to fit.
+        void parallel_for(std::size_t count, RangeFunction body, std::size_t grain = 0);
+
+        // Workers plus the calling thread.
+        unsigned thread_count() const { return static_cast<unsigned>(workers.size()) + 1; }
+        // Whether the calling thread is one of this scheduler's workers.
+        bool on_worker() const { return current_worker() >= 0; }
+
+    private:
+        // Chase-Lev deque with a fixed capacity. Only the owner pushes and pops, anyone can steal.
+        class WorkDeque
+        {
+        public:
+            static constexpr int64_t CAPACITY = 4096;
+
+            bool push(Job* job);
+            // A group other than 0 leaves a job of another group where it is and returns null.
+            Job* pop(uint64_t group);
+            Job* steal(uint64_t group);
+
+        private:
+            alignas(64) std::atomic<int64_t> top{ 0 };
+            alignas(64) std::atomic<int64_t> bottom{ 0 };
+            std::unique_ptr<std::atomic<Job*>[]> buffer{ new std::atomic<Job*>[CAPACITY] };
+            // Beside the jobs, a thief can't look into a job that may already have been run and freed.
+            std::unique_ptr<std::atomic<uint64_t>[]> groups{ new std::atomic<uint64_t>[CAPACITY] };
+        };
+
+        std::vector<std::unique_ptr<WorkDeque>> deques;
+        std::vector<std::thread> workers;
+
+        // Ring buffer, it only grows when submits outrun the threads taking jobs, so a queue that is
+        // drained and refilled every frame never allocates.
+        std::mutex injected_mutex;
+        std::vector<Job*> injected;
+        std::size_t injected_head{ 0 };
+        // Only changed under the lock, read without it to skip taking the lock on an empty queue.
+        std::atomic<std::size_t> injected_count{ 0 };
+
+        // Bumped on every submit, sleeping workers wait for it to change.
+        std::atomic<uint32_t> work_epoch{ 0 };
+        std::atomic<uint32_t> sleeping{ 0 };
+        std::atomic<bool> stopping{ false };
+        std::atomic<unsigned> started_workers{ 0 };
+
+        JobHandle allocate_job(const JobHandle& parent);
+        void worker_main(unsigned index);
+        // Group 0 takes any job.
+        Job* find_job(int worker_index, uint64_t group);
+        void execute(Job* job);
+        void finish(Job* job);
+        void wake_one();
+        int current_worker() const;
+    };
+
+    // Process wide scheduler with the default worker count, created on first use.
+    JobSystem& shared();
+}
+#endif // !JOB_SYSTEM_H
@@ -0,0 +1,59 @@
+#ifndef MESH_H
+#define MESH_H
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace baas::mesh
+{
+    // Full precision vertex as it comes out of the loaders.
+    struct Vertex
+    {
+        std::array<float, 3> position;
+        std::array<float, 3> normal;
+        std::array<float, 2> uv;
+    };
+
+    struct Material
+    {
+        std::string name;
+        std::array<float, 3> diffuse{ 1.0f, 1.0f, 1.0f };
+        std::string diffuse_texture;
+    };
+
+    // A run of indices drawn with one material.
+    struct MeshRange
+    {
+        uint32_t first_index;
+        uint32_t index_count;
+        uint32_t material;
+    };
+
+    // Non owning view of mesh data, either from a Mesh or straight out of a mapped cache file.
+    struct MeshView
+    {
+        std::span<const Vertex> vertices;
+        std::span<const uint32_t> indices;
+        std::span<const MeshRange> ranges;
+        std::span<const Material> materials;
+
+        std::size_t triangle_count() const { return indices.size() / 3; }
+    };
+
+    // Indexed triangle list, ready to be copied into vertex and index buffers.
+    struct Mesh
+    {
+        std::vector<Vertex> vertices;
+        std::vector<uint32_t> indices;
+        std::vector<MeshRange> ranges;
+        std::vector<Material> materials;
+
+        std::size_t triangle_count() const { return indices.size() / 3; }
+
+        MeshView view() const { return { vertices, indices, ranges, materials }; }
+    };
+}
+#endif // !MESH_H
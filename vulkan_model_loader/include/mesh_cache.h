@@ -0,0 +1,73 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "file_ops.h"
+#include "mesh.h"
+#include "obj_loader.h"
+
+namespace baas::mesh_cache
+{
+    constexpr uint32_t CACHE_VERSION = 2;
+    constexpr std::string_view CACHE_EXTENSION = ".vmlcache";
+
+    enum class CachePolicy
+    {
+        use_cache,  // Load the cache if it is valid, otherwise parse and write a new one.
+        rebuild,    // Always parse and overwrite the cache.
+        bypass      // Always parse and never touch the cache.
+    };
+
+    struct BuildOptions
+    {
+        obj_loader::LoadOptions load;
+        // Reorder triangles and vertices for the post transform cache before the cache is written.
+        bool optimize{ true };
+    };
+
+    // What the cache remembers about the asset it was built from.
+    struct SourceStamp
+    {
+        uint64_t size;
+        int64_t modified_time;
+        uint64_t content_hash;
+        uint64_t options_hash;
+    };
+
+    // A mesh either parsed into memory or viewed straight out of a mapped cache file.
+    class LoadedMesh
+    {
+    public:
+        LoadedMesh() = default;
+        explicit LoadedMesh(mesh::Mesh parsed_mesh);
+        LoadedMesh(file_ops::MappedFile mapped_file, mesh::MeshView mapped_view, std::vector<mesh::Material> mapped_materials);
+
+        const mesh::MeshView& view() const { return mesh_view; }
+        bool from_cache() const { return !cache_file.empty(); }
+
+    private:
+        mesh::Mesh parsed;
+        file_ops::MappedFile cache_file;
+        std::vector<mesh::Material> materials;
+        mesh::MeshView mesh_view;
+    };
+
+    std::string cache_path_for(const std::string_view source_path);
+
+    // Cheap part of the stamp, the content hash is only computed when the cheap part disagrees.
+    SourceStamp stamp_source(const std::string_view source_path, const BuildOptions& options, bool hash_content);
+
+    void write_cache(const std::string_view cache_path, const mesh::MeshView& mesh, const SourceStamp& stamp);
+
+    // Returns nothing when there is no cache or it no longer matches the source.
+    std::optional<LoadedMesh> try_load_cache(const std::string_view source_path, const BuildOptions& options);
+
+    LoadedMesh load_mesh(const std::string_view source_path, const BuildOptions& options = {},
+        CachePolicy policy = CachePolicy::use_cache);
+}
+#endif // !MESH_CACHE_H
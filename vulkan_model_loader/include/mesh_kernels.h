@@ -0,0 +1,74 @@
+#ifndef MESH_KERNELS_H
+#define MESH_KERNELS_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include "mesh.h"
+#include "vertex_encoding.h"
+
+// Batch preprocessing kernels over struct of arrays vertex data. Every kernel has a scalar
+// reference and SSE2/AVX2/NEON versions picked at runtime. All versions run the same
+// operations in the same order without FMA contraction, so results are bit identical to the
+// scalar reference. The one exception is compute_aabb, where a min/max over +0 and -0 may
+// return either zero.
+namespace baas::mesh_kernels
+{
+    enum class Isa
+    {
+        scalar,
+        sse2,
+        avx2,
+        neon
+    };
+
+    std::string_view isa_name(Isa isa);
+
+    // Compiled into this binary and supported by the CPU it's running on.
+    bool isa_supported(Isa isa);
+    std::vector<Isa> supported_isas();
+    Isa best_isa();
+
+    struct Aabb
+    {
+        std::array<float, 3> min;
+        std::array<float, 3> max;
+    };
+
+    struct VertexStreams
+    {
+        std::vector<float> position_x, position_y, position_z;
+        std::vector<float> normal_x, normal_y, normal_z;
+        std::vector<float> u, v;
+        // Only filled in by generate_tangents. w is the bitangent sign.
+        std::vector<float> tangent_x, tangent_y, tangent_z, tangent_w;
+
+        std::size_t size() const { return position_x.size(); }
+    };
+
+    VertexStreams to_streams(std::span<const mesh::Vertex> vertices);
+    void copy_normals(const VertexStreams& streams, std::span<mesh::Vertex> vertices);
+
+    Aabb compute_aabb(const VertexStreams& streams, Isa isa = best_isa());
+
+    // Area weighted face normals accumulated per vertex and normalized.
+    void generate_normals(VertexStreams& streams, std::span<const uint32_t> indices, Isa isa = best_isa());
+
+    // Per vertex tangent frames from positions and uvs, orthogonalized against the existing normals.
+    void generate_tangents(VertexStreams& streams, std::span<const uint32_t> indices, Isa isa = best_isa());
+
+    // Positions to unorm16 xyz (w = 65535), the same layout as vertex_format::Unorm16Position.
+    void quantize_positions(const VertexStreams& streams, const vertex_format::EncodeContext& context,
+        std::span<std::array<uint16_t, 4>> output, Isa isa = best_isa());
+
+    // 32 bit murmur3 style hash of every attribute's bit pattern, per vertex.
+    void hash_vertices(const VertexStreams& streams, std::span<uint32_t> output, Isa isa = best_isa());
+
+    // Merges bit identical vertices, rewrites indices and returns the old to new remap.
+    std::vector<uint32_t> deduplicate(VertexStreams& streams, std::span<uint32_t> indices, Isa isa = best_isa());
+}
+#endif // !MESH_KERNELS_H
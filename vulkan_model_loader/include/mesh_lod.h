@@ -0,0 +1,86 @@
+#ifndef MESH_LOD_H
+#define MESH_LOD_H
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "job_system.h"
+#include "mesh.h"
+#include "mesh_cache.h"
+
+// Level of detail chains built by quadric error edge collapse (Garland and Heckbert). Every edge
+// collapses onto one of its existing vertices, so all levels index the full mesh's vertex buffer
+// and only add indices.
+namespace baas::mesh_lod
+{
+    constexpr uint32_t LOD_VERSION = 1;
+    constexpr std::string_view LOD_EXTENSION = ".vmllod";
+
+    struct LodOptions
+    {
+        // Triangle count of each level relative to the full mesh, finest first.
+        std::vector<float> triangle_ratios{ 0.5f, 0.25f, 0.125f, 0.0625f };
+        // No collapse moves the surface further than this fraction of the mesh's bounding radius. Levels
+        // that can't reach their ratio below it end up coarser than the previous one or are dropped.
+        float max_relative_error{ 0.05f };
+    };
+
+    struct SimplifiedLevel
+    {
+        std::vector<uint32_t> indices;
+        // Largest quadric error of any collapse so far, as a distance in object space.
+        float error;
+    };
+
+    // One level of a chain, ranges line up with the full mesh's and index into LodChain::indices.
+    struct LodLevel
+    {
+        float error;
+        std::vector<mesh::MeshRange> ranges;
+    };
+
+    // Simplified levels only, the full mesh is level 0 with an error of 0.
+    struct LodChain
+    {
+        std::vector<uint32_t> indices;
+        std::vector<LodLevel> levels;
+    };
+
+    // Collapses edges of one triangle list in order of quadric error and snapshots it each time it gets
+    // down to the next of target_index_counts (descending). Stops early once the cheapest collapse
+    // would exceed max_error, the remaining snapshots are then all the final state. Vertices flagged
+    // in locked are never removed, neither are UV or normal seams (one position, several vertices).
+    std::vector<SimplifiedLevel> simplify(std::span<const uint32_t> indices, std::span<const mesh::Vertex> vertices,
+        std::span<const std::size_t> target_index_counts, float max_error, std::span<const uint8_t> locked = {});
+
+    // Simplifies every range as its own job. Vertices shared between ranges are locked so the ranges
+    // keep meeting without cracks.
+    LodChain build_lod_chain(const mesh::MeshView& mesh, const LodOptions& options = {},
+        job_system::JobSystem& jobs = job_system::shared());
+
+    // Picks the coarsest level whose error projects to at most pixel_error pixels. level_errors is in
+    // ascending order starting with the full mesh, projection_scale is the viewport height divided by
+    // 2 tan(vertical fov / 2) and distance is from the eye to the nearest point of the object.
+    std::size_t select_level(std::span<const float> level_errors, float distance, float projection_scale, float pixel_error);
+
+    std::string lod_path_for(const std::string_view source_path);
+
+    // Identifies the mesh and options a chain was built for, a chain is only valid for the exact vertex
+    // and index order it was built from.
+    uint64_t lod_key(const mesh::MeshView& mesh, const LodOptions& options);
+
+    void write_lod_file(const std::string_view path, const LodChain& chain, uint64_t key);
+
+    // Returns nothing when the file is missing, damaged or was built for something else.
+    std::optional<LodChain> read_lod_file(const std::string_view path, uint64_t key);
+
+    // Reads the sidecar next to the source or builds the chain and writes it, following the mesh cache's policy.
+    LodChain load_lods(const std::string_view source_path, const mesh::MeshView& mesh, const LodOptions& options = {},
+        mesh_cache::CachePolicy policy = mesh_cache::CachePolicy::use_cache);
+}
+#endif // !MESH_LOD_H
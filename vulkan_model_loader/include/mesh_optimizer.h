@@ -0,0 +1,49 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "mesh.h"
+
+namespace baas::mesh_optimizer
+{
+    // Post transform cache size used for the analysis. 16 entries is a conservative FIFO model of
+    // what desktop GPUs effectively get out of their vertex reuse.
+    constexpr uint32_t DEFAULT_CACHE_SIZE = 16;
+
+    struct VertexCacheStats
+    {
+        std::size_t transformed_vertices;
+        // Average cache miss ratio, transformed vertices per triangle. 0.5 is the best a regular grid can do, 3 the worst.
+        float acmr;
+        // Average transform to vertex ratio, transformed vertices per unique vertex. 1.0 is optimal.
+        float atvr;
+    };
+
+    struct OptimizationReport
+    {
+        VertexCacheStats before;
+        VertexCacheStats after;
+    };
+
+    VertexCacheStats analyze_vertex_cache(std::span<const uint32_t> indices, std::size_t vertex_count,
+        uint32_t cache_size = DEFAULT_CACHE_SIZE);
+
+    // Reorders triangles for post transform cache hits (Forsyth's linear speed optimizer).
+    void optimize_vertex_cache(std::span<uint32_t> indices, std::size_t vertex_count);
+
+    // Splits cache optimized triangles into clusters and sorts the clusters so outward facing ones
+    // draw first, without letting ACMR grow by more than threshold (Tipsify style).
+    void optimize_overdraw(std::span<uint32_t> indices, std::span<const mesh::Vertex> vertices, float threshold = 1.05f);
+
+    // Renumbers vertices in order of first use so vertex fetch walks memory linearly.
+    // Unreferenced vertices are dropped. Returns the old to new index remap.
+    std::vector<uint32_t> optimize_vertex_fetch(std::span<uint32_t> indices, std::vector<mesh::Vertex>& vertices);
+
+    // Runs all three passes, triangles never move between the mesh's ranges.
+    OptimizationReport optimize_mesh(mesh::Mesh& mesh, float overdraw_threshold = 1.05f);
+}
+#endif // !MESH_OPTIMIZER_H
@@ -0,0 +1,95 @@
+#ifndef MESHLET_H
+#define MESHLET_H
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "job_system.h"
+#include "mesh.h"
+#include "mesh_cache.h"
+
+// Splits a mesh into small clusters of triangles (meshlets) with bounds tight enough to cull each
+// cluster on its own, by frustum and by a cone containing all its triangles' normals.
+namespace baas::meshlet
+{
+    constexpr uint32_t MESHLET_VERSION = 1;
+    constexpr std::string_view MESHLET_EXTENSION = ".vmlmeshlet";
+    // The usual mesh shader sizes, so the same clusters work if the engine ever gets mesh shaders.
+    constexpr uint32_t MAX_VERTICES = 64;
+    constexpr uint32_t MAX_TRIANGLES = 124;
+
+    struct Meshlet
+    {
+        // First entry in MeshletData::vertices and first triangle in MeshletData::triangles.
+        uint32_t vertex_offset;
+        uint32_t triangle_offset;
+        uint32_t vertex_count;
+        uint32_t triangle_count;
+    };
+
+    struct Bounds
+    {
+        std::array<float, 3> center;
+        float radius;
+        // The cluster faces away from every eye inside the cone at cone_apex around -cone_axis, which
+        // is dot(normalize(cone_apex - eye), cone_axis) >= cone_cutoff. A cutoff of 1 never culls.
+        std::array<float, 3> cone_apex;
+        std::array<float, 3> cone_axis;
+        float cone_cutoff;
+    };
+
+    // The meshlets built from one of the mesh's ranges.
+    struct MeshletRange
+    {
+        uint32_t first_meshlet;
+        uint32_t meshlet_count;
+        uint32_t material;
+    };
+
+    struct MeshletData
+    {
+        std::vector<Meshlet> meshlets;
+        // One per meshlet.
+        std::vector<Bounds> bounds;
+        std::vector<MeshletRange> ranges;
+        // Mesh vertex indices, meshlet.vertex_count of them per meshlet.
+        std::vector<uint32_t> vertices;
+        // Three bytes per triangle indexing the meshlet's vertices.
+        std::vector<uint8_t> triangles;
+
+        std::size_t triangle_count() const { return triangles.size() / 3; }
+    };
+
+    // Greedy clustering per range, each range as its own job. Triangles are added by how few new
+    // vertices they bring in and how well their normal fits the cluster's, so clusters stay close to
+    // full and their cones narrow. Triangles keep their winding.
+    MeshletData build_meshlets(const mesh::MeshView& mesh, job_system::JobSystem& jobs = job_system::shared());
+
+    Bounds compute_bounds(std::span<const mesh::Vertex> vertices, std::span<const uint32_t> meshlet_vertices,
+        std::span<const uint8_t> meshlet_triangles);
+
+    bool cone_culled(const Bounds& bounds, const std::array<float, 3>& eye);
+
+    // A plain index list where meshlet i's triangles start at index triangle_offset * 3, so every
+    // meshlet can be drawn with one indexed draw from the regular vertex buffer.
+    std::vector<uint32_t> meshlet_indices(const MeshletData& data);
+
+    std::string meshlet_path_for(const std::string_view source_path);
+
+    uint64_t meshlet_key(const mesh::MeshView& mesh);
+
+    void write_meshlet_file(const std::string_view path, const MeshletData& data, uint64_t key);
+
+    // Returns nothing when the file is missing, damaged or was built for something else.
+    std::optional<MeshletData> read_meshlet_file(const std::string_view path, uint64_t key);
+
+    // Reads the sidecar next to the source or builds the meshlets and writes it, following the mesh cache's policy.
+    MeshletData load_meshlets(const std::string_view source_path, const mesh::MeshView& mesh,
+        mesh_cache::CachePolicy policy = mesh_cache::CachePolicy::use_cache);
+}
+#endif // !MESHLET_H
@@ -0,0 +1,35 @@
+#ifndef OBJ_LOADER_H
+#define OBJ_LOADER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+#include "mesh.h"
+
+namespace baas::obj_loader
+{
+    struct LoadOptions
+    {
+        // Most chunks parsed at once on the shared job system, 0 uses all of its threads.
+        unsigned thread_count{ 0 };
+        // Chunks smaller than this aren't worth handing to another thread.
+        std::size_t min_chunk_size{ 1 << 20 };
+        // OBJ puts the texture origin bottom left, Vulkan samples from the top left.
+        bool flip_v{ true };
+        bool load_materials{ true };
+    };
+
+    // Maps the file and parses it in line aligned chunks on the job system.
+    // The result only depends on the file contents and flip_v, never on the thread count.
+    mesh::Mesh load_obj(const std::string_view file_path, const LoadOptions& options = {});
+
+    // Same as load_obj for text that is already in memory. mtllib statements are ignored.
+    mesh::Mesh parse_obj(const std::string_view obj_text, const LoadOptions& options = {});
+
+    // Hash of the options that change the parsed result, used to key cached meshes.
+    uint64_t options_hash(const LoadOptions& options);
+
+    std::vector<mesh::Material> parse_mtl(const std::string_view mtl_text);
+}
+#endif // !OBJ_LOADER_H
@@ -0,0 +1,67 @@
+#ifndef PIPELINE_CACHE_H
+#define PIPELINE_CACHE_H
+
+#include <vulkan/vulkan.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "job_system.h"
+
+namespace baas::pipeline_cache
+{
+    constexpr uint32_t PIPELINE_CACHE_VERSION = 1;
+
+    // Written in front of the driver's blob. The driver checks its own header too, but some drivers
+    // crash on data from a different driver build instead of rejecting it, so this is checked first.
+    struct CacheFileHeader
+    {
+        char magic[4];
+        uint32_t version;
+        uint32_t vendor_id;
+        uint32_t device_id;
+        uint32_t driver_version;
+        uint8_t pipeline_cache_uuid[VK_UUID_SIZE];
+        uint8_t device_uuid[VK_UUID_SIZE];
+        uint8_t driver_uuid[VK_UUID_SIZE];
+        uint64_t data_size;
+        uint64_t data_hash;
+    };
+
+    // A vk::PipelineCache that is loaded from and saved to a file. An empty path keeps it in memory only.
+    class PipelineCache
+    {
+    public:
+        PipelineCache(vk::PhysicalDevice physical_device, vk::Device device, std::string_view path);
+
+        vk::PipelineCache get() const { return *cache; }
+
+        // True when a valid cache file for this device and driver was found.
+        bool warm() const { return loaded_size > 0; }
+        std::size_t loaded_bytes() const { return loaded_size; }
+        // Empty when the file was missing or fine, otherwise why it was thrown away.
+        const std::string& rejected_reason() const { return reject_reason; }
+
+        // Writes the current contents unless nothing changed since loading. Returns the bytes written.
+        std::size_t save();
+
+    private:
+        vk::Device device;
+        std::string path;
+        CacheFileHeader expected{};
+        vk::UniquePipelineCache cache;
+        std::size_t loaded_size{ 0 };
+        uint64_t loaded_hash{ 0 };
+        std::string reject_reason;
+    };
+
+    // Creates one pipeline per create info, each as its own job. The create infos only have to stay
+    // alive for the call.
+    std::vector<vk::UniquePipeline> create_graphics_pipelines(vk::Device device, vk::PipelineCache cache,
+        std::span<const vk::GraphicsPipelineCreateInfo> create_infos, job_system::JobSystem& jobs = job_system::shared());
+}
+#endif // !PIPELINE_CACHE_H
@@ -0,0 +1,167 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Scoped CPU zones and GPU zones collected per frame. Every thread records into a fixed size ring of
+// its own, allocated when the thread is first seen. end_frame copies what was recorded into a ring of
+// recent frames that the stats summary and the Chrome trace export read from, whose slots are reused,
+// so a profiled frame loop stops allocating once every slot has held a frame. Zones recorded before
+// end_startup are kept as the startup breakdown. Without ENABLE_PROFILER the zones compile to nothing,
+// with it they cost one relaxed load while the profiler is disabled.
+namespace baas::profiler
+{
+    constexpr std::size_t FRAME_HISTORY = 240;
+    // Zones a thread can record between two end_frame calls, beyond that the oldest are overwritten.
+    constexpr std::size_t THREAD_EVENT_CAPACITY = 4096;
+    // Thread index GPU zones are recorded under.
+    constexpr uint32_t GPU_THREAD = 0xFFFFFFFF;
+
+    // Nanoseconds on steady_clock, which is CLOCK_MONOTONIC on Linux. GPU timestamps are converted
+    // into the same domain.
+    inline int64_t now_ns()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    struct ZoneEvent
+    {
+        // Zone names are string literals, only the pointer is stored.
+        const char* name;
+        int64_t start_ns;
+        int64_t end_ns;
+        uint32_t thread;
+    };
+
+    struct FrameRecord
+    {
+        uint64_t frame;
+        int64_t start_ns;
+        int64_t end_ns;
+        std::vector<ZoneEvent> events;
+    };
+
+    class Profiler
+    {
+    public:
+        Profiler();
+        Profiler(const Profiler&) = delete;
+        Profiler& operator=(const Profiler&) = delete;
+
+        static bool enabled() { return active.load(std::memory_order_relaxed); }
+        void set_enabled(bool enable);
+
+        // Names the calling thread in reports and traces, unnamed threads show up as "thread N". Also
+        // registers the thread, which is the only time recording from it allocates.
+        void set_thread_name(std::string name);
+
+        void record(const char* name, int64_t start_ns, int64_t end_ns);
+        // GPU zones arrive a few frames late, they land in whichever frame is open when they are read back.
+        void record_gpu(const char* name, int64_t start_ns, int64_t end_ns);
+
+        // Everything recorded so far becomes the startup record.
+        void end_startup();
+        void end_frame();
+
+        // Per zone mean, p95 and max milliseconds per frame over the frame history.
+        std::string stats_report() const;
+        std::string startup_report() const;
+
+        // Chrome trace event JSON with the startup zones and the frame history, open it in
+        // chrome://tracing or ui.perfetto.dev.
+        void write_chrome_trace(const std::string_view path) const;
+
+        static Profiler& shared();
+
+    private:
+        struct ThreadBuffer
+        {
+            std::mutex mutex;
+            // Zones since the last collect, count of them starting at head.
+            std::unique_ptr<ZoneEvent[]> events{ new ZoneEvent[THREAD_EVENT_CAPACITY] };
+            std::size_t head{ 0 };
+            std::size_t count{ 0 };
+            uint32_t index;
+            std::string name;
+        };
+
+        static inline std::atomic<bool> active{ false };
+
+        mutable std::mutex mutex;
+        std::vector<std::shared_ptr<ThreadBuffer>> threads;
+        std::vector<ZoneEvent> gpu_events;
+        FrameRecord startup{};
+        // FRAME_HISTORY slots once enabled, frame n goes into slot n % FRAME_HISTORY.
+        std::vector<FrameRecord> history;
+        uint64_t frame_count{ 0 };
+        // Zones overwritten because a thread's ring was full.
+        std::atomic<uint64_t> dropped{ 0 };
+        int64_t epoch_ns;
+        int64_t frame_start_ns;
+
+        ThreadBuffer& thread_buffer();
+        // Appends and clears every thread's zones and the GPU zones, mutex has to be held.
+        void collect(std::vector<ZoneEvent>& events);
+        std::size_t recorded_frames() const { return static_cast<std::size_t>(std::min<uint64_t>(frame_count, FRAME_HISTORY)); }
+    };
+
+    // Times its own lifetime, or a series of stages in straight line code with next().
+    class Zone
+    {
+    public:
+#ifdef BAAS_PROFILER
+        explicit Zone(const char* name)
+        {
+            begin(name);
+        }
+        ~Zone() { end(); }
+
+        // Ends the current stage and starts the next one.
+        void next(const char* next_name)
+        {
+            end();
+            begin(next_name);
+        }
+
+        void end()
+        {
+            if (name != nullptr)
+            {
+                Profiler::shared().record(name, start_ns, now_ns());
+                name = nullptr;
+            }
+        }
+#else
+        explicit Zone(const char*) {}
+        void next(const char*) {}
+        void end() {}
+#endif
+        Zone(const Zone&) = delete;
+        Zone& operator=(const Zone&) = delete;
+
+#ifdef BAAS_PROFILER
+    private:
+        const char* name{ nullptr };
+        int64_t start_ns{ 0 };
+
+        void begin(const char* zone_name)
+        {
+            if (Profiler::enabled())
+            {
+                name = zone_name;
+                start_ns = now_ns();
+            }
+        }
+#endif
+    };
+}
+#endif // !PROFILER_H
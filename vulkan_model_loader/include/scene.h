@@ -0,0 +1,87 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "job_system.h"
+#include "transform.h"
+
+// Node transforms for scenes with hundreds of thousands of parts. Every property lives in its own
+// contiguous array indexed by node, so skipping over unchanged nodes only reads their parent and flag
+// and never their transforms. A parent is always added before its children, and update() goes one
+// depth level at a time, so a parent's world matrix is final before any of its children read it and
+// every level can be split across threads.
+namespace baas::scene
+{
+    constexpr uint32_t NO_PARENT = ~0u;
+
+    class TransformHierarchy
+    {
+    public:
+        void reserve(std::size_t count);
+
+        // Returns the new node's index, the parent has to exist already. Rotation is a unit quaternion.
+        uint32_t add_node(uint32_t parent = NO_PARENT, const transform::Vec3& translation = {}, const transform::Vec4& rotation = { 0.0f, 0.0f, 0.0f, 1.0f },
+            const transform::Vec3& scale = { 1.0f, 1.0f, 1.0f });
+
+        void set_translation(uint32_t node, const transform::Vec3& translation);
+        void set_rotation(uint32_t node, const transform::Vec4& rotation);
+        void set_scale(uint32_t node, const transform::Vec3& scale);
+
+        const transform::Vec3& translation(uint32_t node) const { return translations[node]; }
+        const transform::Vec4& rotation(uint32_t node) const { return rotations[node]; }
+        const transform::Vec3& scale(uint32_t node) const { return scales[node]; }
+        uint32_t parent(uint32_t node) const { return parents[node]; }
+        std::size_t size() const { return parents.size(); }
+        uint32_t depth_count() const { return static_cast<uint32_t>(level_starts.empty() ? 0 : level_starts.size() - 1); }
+
+        // As of the last update.
+        const transform::Mat4& world(uint32_t node) const { return worlds[node]; }
+        std::span<const transform::Mat4> world_matrices() const { return worlds; }
+
+        // Recomputes the world matrix of every node that changed since the last update and of everything
+        // below it. When that is a small part of the scene only those subtrees are visited, otherwise
+        // every level from the shallowest change down is walked. Levels with enough nodes are split
+        // across the job system. Returns how many nodes were recomputed, 0 costs a single check.
+        std::size_t update(job_system::JobSystem& jobs = job_system::shared());
+
+    private:
+        std::vector<uint32_t> parents;
+        std::vector<uint32_t> depths;
+        std::vector<transform::Vec3> translations;
+        std::vector<transform::Vec4> rotations;
+        std::vector<transform::Vec3> scales;
+        std::vector<transform::Mat4> worlds;
+        // A node is dirty when its entry equals epoch: its local transform changed since the last update,
+        // or during an update, its world matrix was just recomputed, which is what its children check.
+        // Each update moves on to the next epoch, so nothing is ever cleared. Not bytes or vector<bool>,
+        // neighbouring nodes are written from different threads.
+        std::vector<uint32_t> dirty_epochs;
+        uint32_t epoch{ 1 };
+        // Nodes whose local transform changed since the last update, each once.
+        std::vector<uint32_t> dirty_nodes;
+
+        // Node indices ordered by depth, level_starts[d] is where depth d begins. Scenes built breadth
+        // first end up with the identity order. The children of node n are children[child_starts[n]]
+        // up to child_starts[n + 1], and subtree_sizes counts a node and everything below it. All of
+        // it is rebuilt by update() after nodes were added.
+        std::vector<uint32_t> level_order;
+        std::vector<uint32_t> level_starts;
+        std::vector<uint32_t> child_starts;
+        std::vector<uint32_t> children;
+        std::vector<uint32_t> subtree_sizes;
+        bool levels_stale{ false };
+        // What a subtree update recomputes, one level after the other. Kept to reuse its capacity.
+        std::vector<uint32_t> pending;
+
+        void mark_dirty(uint32_t node);
+        void recompute(uint32_t node);
+        std::size_t update_levels(job_system::JobSystem& jobs);
+        std::size_t update_subtrees(job_system::JobSystem& jobs);
+        void build_levels();
+    };
+}
+#endif // !SCENE_H
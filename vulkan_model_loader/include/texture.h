@@ -0,0 +1,115 @@
+#ifndef TEXTURE_H
+#define TEXTURE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "file_ops.h"
+#include "image_io.h"
+#include "job_system.h"
+#include "mesh_cache.h"
+
+// Texture import: decoded images get a full mip chain and optionally block compression, and the result
+// is cached in a sidecar next to the source. Levels of a cached texture stay in the mapped file until
+// they are streamed to the GPU, so coarse levels can be uploaded without reading the fine ones.
+namespace baas::texture
+{
+    constexpr uint32_t TEXTURE_VERSION = 1;
+    constexpr std::string_view TEXTURE_EXTENSION = ".vmltex";
+
+    enum class Format : uint32_t
+    {
+        rgba8,
+        // 4 bpp, RGB with 1 bit alpha. Blocks with any alpha below 128 use the punch through mode.
+        bc1,
+        // 8 bpp RGBA, encoded with mode 6 only (one subset, 7 bit endpoints with a shared low bit).
+        bc7
+    };
+
+    // rgba8, bc1 or bc7, for command lines.
+    std::optional<Format> parse_format(std::string_view name);
+
+    struct TextureOptions
+    {
+        Format format{ Format::bc7 };
+        // Color textures are sRGB encoded, mips are then averaged in linear space. Alpha is always linear.
+        bool srgb{ true };
+    };
+
+    struct Level
+    {
+        uint32_t width;
+        uint32_t height;
+        // Into Texture::data().
+        uint64_t offset;
+        uint64_t size;
+    };
+
+    // A full mip chain, finest level first.
+    class Texture
+    {
+    public:
+        Texture() = default;
+        Texture(Format format, bool srgb, std::vector<Level> levels, std::vector<std::byte> data);
+        Texture(Format format, bool srgb, std::vector<Level> levels, file_ops::MappedFile file, std::size_t data_offset);
+
+        Format format() const { return texture_format; }
+        bool srgb() const { return is_srgb; }
+        uint32_t width() const { return levels.empty() ? 0 : levels.front().width; }
+        uint32_t height() const { return levels.empty() ? 0 : levels.front().height; }
+        std::span<const Level> mip_levels() const { return levels; }
+        std::span<const std::byte> data() const { return bytes; }
+        std::span<const std::byte> level_data(std::size_t level) const { return bytes.subspan(levels[level].offset, levels[level].size); }
+        bool from_cache() const { return !file.empty(); }
+
+    private:
+        Format texture_format{ Format::rgba8 };
+        bool is_srgb{ true };
+        std::vector<Level> levels;
+        std::vector<std::byte> built;
+        file_ops::MappedFile file;
+        std::span<const std::byte> bytes;
+    };
+
+    uint32_t mip_count(uint32_t width, uint32_t height);
+
+    // Bytes of one level, compressed formats round up to whole 4x4 blocks.
+    std::size_t level_size(Format format, uint32_t width, uint32_t height);
+
+    // Halves the image until it is 1x1 with a box filter, the first level is the image itself. Odd sizes
+    // repeat their last row or column.
+    std::vector<image_io::DecodedImage> generate_mips(image_io::DecodedImage image, bool srgb, job_system::JobSystem& jobs = job_system::shared());
+
+    // One level to the given format, block rows are compressed in parallel.
+    std::vector<std::byte> encode_level(const image_io::DecodedImage& image, Format format, job_system::JobSystem& jobs = job_system::shared());
+
+    // Back to RGBA for checking quality and for devices without BC support. Only understands the BC7
+    // mode encode_level writes, blocks of other modes come out magenta.
+    std::vector<uint8_t> decode_level(std::span<const std::byte> data, Format format, uint32_t width, uint32_t height);
+
+    Texture build_texture(image_io::DecodedImage image, const TextureOptions& options = {}, job_system::JobSystem& jobs = job_system::shared());
+
+    std::string texture_path_for(const std::string_view source_path);
+
+    // A map_Kd entry to a path, relative names are next to the model. Options in front of the name
+    // (-bm 1 name.png) are skipped, empty means the entry names no file.
+    std::string resolve_texture_path(const std::string_view model_path, const std::string_view map_entry);
+
+    // Identifies the source file's content and the options.
+    uint64_t texture_key(std::span<const std::byte> source, const TextureOptions& options);
+
+    void write_texture_file(const std::string_view path, const Texture& texture, uint64_t key);
+
+    // Returns nothing when the file is missing, damaged or was built for something else.
+    std::optional<Texture> read_texture_file(const std::string_view path, uint64_t key);
+
+    // Reads the sidecar next to the source or decodes, builds and writes it, following the mesh cache's policy.
+    Texture load_texture(const std::string_view source_path, const TextureOptions& options = {},
+        mesh_cache::CachePolicy policy = mesh_cache::CachePolicy::use_cache);
+}
+#endif // !TEXTURE_H
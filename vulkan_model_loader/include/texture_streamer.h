@@ -0,0 +1,147 @@
+#ifndef TEXTURE_STREAMER_H
+#define TEXTURE_STREAMER_H
+
+#include <vulkan/vulkan.hpp>
+
+#include <cstdint>
+#include <deque>
+#include <memory_resource>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include "gpu_allocator.h"
+#include "job_system.h"
+#include "texture.h"
+#include "upload_service.h"
+
+// Keeps a window of each texture's mip chain on the GPU, from some first level down to 1x1. The mip
+// tail is uploaded as soon as a texture is added, finer levels follow one at a time as they are asked
+// for and fit in the budget, and levels nobody needs are dropped again when the budget runs out.
+// Changing the window means a new image with the new levels, the old one keeps being sampled until
+// the upload has landed and is destroyed once the frames that might still use it are done. Decoding
+// and staging the levels runs as a job, the render thread only creates images and swaps them in.
+namespace baas::texture_streamer
+{
+    struct StreamerConfig
+    {
+        // Device memory for all textures together. Mip tails always stay, even over budget.
+        vk::DeviceSize budget_bytes{ 256ull << 20 };
+        // Uploads started per update, at least one upgrade is started regardless.
+        vk::DeviceSize upload_bytes_per_update{ 16ull << 20 };
+        // Images are destroyed this many updates after they were replaced.
+        uint32_t frames_in_flight{ 2 };
+        // Levels up to this size are the tail.
+        uint32_t tail_size{ 64 };
+        // Without textureCompressionBC, compressed levels are decoded to RGBA8 before the upload.
+        bool block_compression{ true };
+        // Levels bigger than this are never made resident, they wouldn't fit in the upload service's staging buffer.
+        vk::DeviceSize max_level_bytes{ upload_service::DEFAULT_STAGING_SIZE / 2 };
+    };
+
+    struct Stats
+    {
+        vk::DeviceSize resident_bytes;
+        vk::DeviceSize budget_bytes;
+        vk::DeviceSize uploaded_bytes;
+        uint32_t texture_count;
+        // Textures whose every wanted level is resident.
+        uint32_t satisfied_count;
+        uint32_t upgrades;
+        uint32_t downgrades;
+    };
+
+    class TextureStreamer
+    {
+    public:
+        // queue_families are the families that sample the images and the upload service's, images are
+        // shared between them concurrently.
+        TextureStreamer(vk::Device device, gpu_allocator::GpuAllocator& allocator, upload_service::UploadService& uploads,
+            std::span<const uint32_t> queue_families, const StreamerConfig& config = {});
+        TextureStreamer(const TextureStreamer&) = delete;
+        TextureStreamer& operator=(const TextureStreamer&) = delete;
+        // Waits for the upload jobs and their copies, the images must outlive them.
+        ~TextureStreamer();
+
+        // Starts uploading the mip tail and returns the texture's index.
+        uint32_t add(texture::Texture source);
+
+        // How many pixels across the texture covers on screen, the finest level that is still at least
+        // that big is what gets streamed in. Kept until the next request for the same texture.
+        void request(uint32_t index, float screen_size);
+
+        // Once per frame, after the frame's fence. Swaps in uploads whose timeline value has been
+        // signalled, destroys images no frame uses anymore and starts the next uploads in order of how
+        // many levels each texture is missing. Its lists of candidates live in scratch and are gone when
+        // it returns. Never waits for a job or the GPU.
+        void update(std::pmr::memory_resource* scratch = std::pmr::get_default_resource());
+
+        // Null until the texture's first upload has landed.
+        vk::ImageView view(uint32_t index) const;
+        std::size_t size() const { return entries.size(); }
+        // No upload job running and every copy executed, so nothing writes to the images anymore.
+        bool idle() const;
+
+        // Bumped whenever a view changes, descriptors written at an older version are stale.
+        uint64_t version() const { return view_version; }
+        // Upload timeline value covering every view handed out, for the GPU side wait.
+        uint64_t timeline_value() const { return resident_timeline_value; }
+
+        Stats stats() const;
+
+    private:
+        struct Resident
+        {
+            gpu_allocator::Image image;
+            vk::UniqueImageView view;
+            uint32_t first_level{ 0 };
+            vk::DeviceSize bytes{ 0 };
+        };
+
+        struct Entry
+        {
+            texture::Texture source;
+            vk::Format format;
+            // The tail's first level, nothing coarser than that is ever dropped.
+            uint32_t tail_level{ 0 };
+            // Finest level with max_level_bytes or less.
+            uint32_t finest_level{ 0 };
+            uint32_t wanted_level{ 0 };
+            std::optional<Resident> current;
+            std::optional<Resident> pending;
+            // Decodes and stages pending's levels. Sets pending_upload, which is only read once it is done.
+            job_system::JobHandle pending_job;
+            upload_service::UploadHandle pending_upload;
+        };
+
+        struct Retired
+        {
+            Resident resident;
+            uint64_t update;
+            // Set when copies into the image may still be pending, from an upload that failed halfway.
+            upload_service::UploadHandle upload;
+        };
+
+        vk::Device device;
+        gpu_allocator::GpuAllocator& allocator;
+        upload_service::UploadService& uploads;
+        std::vector<uint32_t> queue_families;
+        StreamerConfig config;
+
+        // A deque so the upload jobs' references stay valid while textures are added.
+        std::deque<Entry> entries;
+        std::deque<Retired> retired;
+        uint64_t update_count{ 0 };
+        uint64_t view_version{ 0 };
+        uint64_t resident_timeline_value{ 0 };
+        Stats counters{};
+
+        // Creates the image for levels [first_level, mip count) of the entry's source and starts the job
+        // that uploads them.
+        void start_upload(Entry& entry, uint32_t first_level);
+        vk::DeviceSize window_bytes(const Entry& entry, uint32_t first_level) const;
+        // Pending or current, whichever each entry will end up with.
+        vk::DeviceSize committed_bytes() const;
+    };
+}
+#endif // !TEXTURE_STREAMER_H
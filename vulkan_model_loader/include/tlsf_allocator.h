@@ -0,0 +1,92 @@
+#ifndef TLSF_ALLOCATOR_H
+#define TLSF_ALLOCATOR_H
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+// Two level segregated fit allocator over an abstract range of offsets. It never touches the
+// memory it manages, block bookkeeping lives on the side, so it works for device memory that
+// can't be written from the CPU and can be tested without a GPU.
+namespace baas::tlsf_allocator
+{
+    struct Allocation
+    {
+        uint64_t offset;
+        uint64_t size;
+        // Identifies the allocation when freeing it.
+        uint32_t block;
+    };
+
+    struct Stats
+    {
+        uint64_t capacity;
+        uint64_t bytes_used;
+        uint64_t bytes_free;
+        uint64_t largest_free_block;
+        uint32_t allocation_count;
+        uint32_t free_block_count;
+        // 1 - largest_free_block / bytes_free, 0 when all free space is one block.
+        double fragmentation;
+    };
+
+    class TlsfAllocator
+    {
+    public:
+        explicit TlsfAllocator(uint64_t capacity);
+
+        // Alignment must be a power of two. Empty when no free block is large enough.
+        std::optional<Allocation> allocate(uint64_t size, uint64_t alignment = 1);
+        void free(const Allocation& allocation);
+
+        bool empty() const { return allocation_count == 0; }
+        uint64_t capacity() const { return total_size; }
+        Stats stats() const;
+
+        // Walks every block and throws std::runtime_error if any invariant is broken.
+        void validate() const;
+
+    private:
+        static constexpr uint32_t SL_LOG2 = 5;
+        static constexpr uint32_t SL_COUNT = 1u << SL_LOG2;
+        static constexpr uint32_t FL_COUNT = 64;
+        static constexpr uint32_t NONE = UINT32_MAX;
+
+        struct Block
+        {
+            uint64_t offset;
+            uint64_t size;
+            uint32_t prev_physical;
+            uint32_t next_physical;
+            uint32_t prev_free;
+            uint32_t next_free;
+            bool is_free;
+        };
+
+        uint64_t total_size;
+        uint64_t used_size{ 0 };
+        uint32_t allocation_count{ 0 };
+        uint32_t free_block_count{ 0 };
+
+        std::vector<Block> blocks;
+        std::vector<uint32_t> unused_blocks;
+
+        uint64_t first_level_bitmap{ 0 };
+        std::array<uint32_t, FL_COUNT> second_level_bitmaps{};
+        std::array<std::array<uint32_t, SL_COUNT>, FL_COUNT> free_heads;
+
+        static void mapping(uint64_t size, uint32_t& first_level, uint32_t& second_level);
+
+        uint32_t new_block(uint64_t offset, uint64_t size);
+        void release_block(uint32_t index);
+        void insert_free(uint32_t index);
+        void remove_free(uint32_t index);
+        uint32_t find_free(uint64_t size) const;
+        // Splits the tail of a block off into a new free block.
+        void split(uint32_t index, uint64_t size);
+        // Absorbs the next physical block into index.
+        void merge_next(uint32_t index);
+    };
+}
+#endif // !TLSF_ALLOCATOR_H
@@ -0,0 +1,175 @@
+#ifndef TRANSFORM_H
+#define TRANSFORM_H
+
+#include <array>
+#include <cmath>
+
+// Just enough matrix math for the camera and model transforms. Matrices are column major like
+// GLSL's mat4, so they can be pushed to the shaders as is.
+namespace baas::transform
+{
+    using Vec3 = std::array<float, 3>;
+    using Vec4 = std::array<float, 4>;
+    using Mat4 = std::array<float, 16>;
+
+    constexpr Mat4 identity()
+    {
+        return { 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f };
+    }
+
+    inline Vec3 subtract(const Vec3& a, const Vec3& b)
+    {
+        return { a[0] - b[0], a[1] - b[1], a[2] - b[2] };
+    }
+
+    inline float dot(const Vec3& a, const Vec3& b)
+    {
+        return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+    }
+
+    inline Vec3 cross(const Vec3& a, const Vec3& b)
+    {
+        return { a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0] };
+    }
+
+    inline Vec3 normalize(const Vec3& v)
+    {
+        float length = std::sqrt(dot(v, v));
+        return length > 0.0f ? Vec3{ v[0] / length, v[1] / length, v[2] / length } : v;
+    }
+
+    inline Mat4 multiply(const Mat4& a, const Mat4& b)
+    {
+        Mat4 result{};
+        for (int column = 0; column < 4; ++column)
+        {
+            for (int row = 0; row < 4; ++row)
+            {
+                float sum = 0.0f;
+                for (int k = 0; k < 4; ++k)
+                {
+                    sum += a[k * 4 + row] * b[column * 4 + k];
+                }
+                result[column * 4 + row] = sum;
+            }
+        }
+        return result;
+    }
+
+    inline Mat4 translation(const Vec3& offset)
+    {
+        Mat4 result = identity();
+        result[12] = offset[0];
+        result[13] = offset[1];
+        result[14] = offset[2];
+        return result;
+    }
+
+    inline Mat4 rotation_y(float radians)
+    {
+        Mat4 result = identity();
+        result[0] = std::cos(radians);
+        result[2] = -std::sin(radians);
+        result[8] = std::sin(radians);
+        result[10] = std::cos(radians);
+        return result;
+    }
+
+    // Unit quaternion (x, y, z, w) rotating by radians around a unit axis.
+    inline Vec4 axis_angle(const Vec3& axis, float radians)
+    {
+        float s = std::sin(radians * 0.5f);
+        return { axis[0] * s, axis[1] * s, axis[2] * s, std::cos(radians * 0.5f) };
+    }
+
+    // Scale, then rotate by a unit quaternion, then translate.
+    inline Mat4 compose(const Vec3& translation, const Vec4& rotation, const Vec3& scale)
+    {
+        float x = rotation[0], y = rotation[1], z = rotation[2], w = rotation[3];
+        return { (1.0f - 2.0f * (y * y + z * z)) * scale[0], 2.0f * (x * y + z * w) * scale[0], 2.0f * (x * z - y * w) * scale[0], 0.0f,
+            2.0f * (x * y - z * w) * scale[1], (1.0f - 2.0f * (x * x + z * z)) * scale[1], 2.0f * (y * z + x * w) * scale[1], 0.0f,
+            2.0f * (x * z + y * w) * scale[2], 2.0f * (y * z - x * w) * scale[2], (1.0f - 2.0f * (x * x + y * y)) * scale[2], 0.0f,
+            translation[0], translation[1], translation[2], 1.0f };
+    }
+
+    // multiply for matrices whose last row is 0 0 0 1, which every model transform is. Each column is
+    // a sum of a's columns, and a's last row keeps the result's 0 0 0 1, so all four rows go through
+    // the same math and the compiler can do a column at a time in one vector.
+    inline Mat4 multiply_affine(const Mat4& a, const Mat4& b)
+    {
+        Mat4 result;
+        for (int column = 0; column < 4; ++column)
+        {
+            for (int row = 0; row < 4; ++row)
+            {
+                result[column * 4 + row] = a[row] * b[column * 4] + a[4 + row] * b[column * 4 + 1] + a[8 + row] * b[column * 4 + 2];
+            }
+        }
+        for (int row = 0; row < 4; ++row)
+        {
+            result[12 + row] += a[12 + row];
+        }
+        return result;
+    }
+
+    inline Vec3 transform_point(const Mat4& m, const Vec3& p)
+    {
+        return { m[0] * p[0] + m[4] * p[1] + m[8] * p[2] + m[12], m[1] * p[0] + m[5] * p[1] + m[9] * p[2] + m[13],
+            m[2] * p[0] + m[6] * p[1] + m[10] * p[2] + m[14] };
+    }
+
+    // Right handed view matrix looking from eye towards target.
+    inline Mat4 look_at(const Vec3& eye, const Vec3& target, const Vec3& up)
+    {
+        Vec3 forward = normalize(subtract(target, eye));
+        Vec3 side = normalize(cross(forward, up));
+        Vec3 camera_up = cross(side, forward);
+        return { side[0], camera_up[0], -forward[0], 0.0f, side[1], camera_up[1], -forward[1], 0.0f, side[2],
+            camera_up[2], -forward[2], 0.0f, -dot(side, eye), -dot(camera_up, eye), dot(forward, eye), 1.0f };
+    }
+
+    // Vulkan clip space: depth 0 to 1 and y pointing down, so counter clockwise faces stay front facing.
+    inline Mat4 perspective(float vertical_fov_radians, float aspect, float near_plane, float far_plane)
+    {
+        float focal = 1.0f / std::tan(vertical_fov_radians * 0.5f);
+        Mat4 result{};
+        result[0] = focal / aspect;
+        result[5] = -focal;
+        result[10] = far_plane / (near_plane - far_plane);
+        result[11] = -1.0f;
+        result[14] = near_plane * far_plane / (near_plane - far_plane);
+        return result;
+    }
+
+    // The six planes of a view projection's frustum as (normal, distance) with inward facing unit
+    // normals, so a sphere is outside when dot(normal, center) + distance < -radius for any of them.
+    // Left, right, bottom, top, near, far, for Vulkan's 0 to 1 depth range.
+    inline std::array<Vec4, 6> frustum_planes(const Mat4& m)
+    {
+        auto row = [&m](int i) { return Vec4{ m[i], m[4 + i], m[8 + i], m[12 + i] }; };
+        auto r0 = row(0);
+        auto r1 = row(1);
+        auto r2 = row(2);
+        auto r3 = row(3);
+        std::array<Vec4, 6> planes;
+        for (int i = 0; i < 4; ++i)
+        {
+            planes[0][i] = r3[i] + r0[i];
+            planes[1][i] = r3[i] - r0[i];
+            planes[2][i] = r3[i] + r1[i];
+            planes[3][i] = r3[i] - r1[i];
+            planes[4][i] = r2[i];
+            planes[5][i] = r3[i] - r2[i];
+        }
+        for (auto&& plane : planes)
+        {
+            float length = std::sqrt(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+            for (auto&& value : plane)
+            {
+                value /= length;
+            }
+        }
+        return planes;
+    }
+}
+#endif // !TRANSFORM_H
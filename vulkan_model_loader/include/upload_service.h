@@ -0,0 +1,141 @@
+#ifndef UPLOAD_SERVICE_H
+#define UPLOAD_SERVICE_H
+
+#include <vulkan/vulkan.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <vector>
+
+#include "gpu_allocator.h"
+
+// Streams data into device local buffers and images from loader threads. Copies are staged in a
+// persistently mapped ring buffer, recorded into a shared batch and submitted together on the
+// transfer queue. Every batch signals the next value of one timeline semaphore, so finding out
+// whether an upload is done is a counter read and never blocks the render thread. Only job workers
+// wait for ring space, any other thread gets a one off staging buffer when the ring is full.
+namespace baas::upload_service
+{
+    constexpr vk::DeviceSize DEFAULT_STAGING_SIZE = 32ull << 20;
+
+    class UploadService;
+
+    // Refers to the batch an upload was recorded into.
+    class UploadHandle
+    {
+    public:
+        UploadHandle() = default;
+        UploadHandle(UploadService* owner, uint64_t value)
+            : owner(owner), value(value)
+        {
+        }
+
+        // False for a default constructed handle. Doesn't block.
+        bool ready() const;
+        // Submits the batch if it's still being recorded and blocks until it has executed.
+        void wait() const;
+        // Value the timeline semaphore reaches once the upload is done, for GPU side waits.
+        uint64_t timeline_value() const { return value; }
+        explicit operator bool() const { return owner != nullptr; }
+
+    private:
+        UploadService* owner{ nullptr };
+        uint64_t value{ 0 };
+    };
+
+    struct Stats
+    {
+        uint64_t bytes_uploaded;
+        uint64_t copy_count;
+        uint64_t submit_count;
+        // Times a job worker had to wait for the GPU to free staging space.
+        uint64_t staging_stalls;
+        // Copies staged in a buffer of their own, the ring was full and the thread isn't a job worker.
+        uint64_t staging_overflows;
+    };
+
+    class UploadService
+    {
+    public:
+        // queue_mutex must be shared with every other user of the queue, which matters when the transfer
+        // queue is also the graphics queue. Null means the service is the only one submitting to it.
+        UploadService(vk::Device device, gpu_allocator::GpuAllocator& allocator, vk::Queue queue, uint32_t queue_family,
+            std::mutex* queue_mutex = nullptr, vk::DeviceSize staging_size = DEFAULT_STAGING_SIZE);
+        UploadService(const UploadService&) = delete;
+        UploadService& operator=(const UploadService&) = delete;
+        ~UploadService();
+
+        // The destination must be usable from queue_family, either exclusively owned by it or concurrent.
+        UploadHandle upload_buffer(vk::Buffer destination, vk::DeviceSize destination_offset, std::span<const std::byte> data);
+        // Replaces one mip level of the first array layer. The level is transitioned from undefined to
+        // final_layout, its previous contents are discarded. data must fit in the staging buffer.
+        UploadHandle upload_image(vk::Image destination, vk::Extent3D extent, uint32_t mip_level, std::span<const std::byte> data,
+            vk::ImageLayout final_layout = vk::ImageLayout::eShaderReadOnlyOptimal);
+
+        // Submits whatever has been recorded so far. Batches are also submitted on their own once they
+        // hold a quarter of the staging buffer.
+        UploadHandle flush();
+
+        bool is_complete(uint64_t value) const;
+        void wait(uint64_t value);
+
+        vk::Semaphore timeline() const { return *timeline_semaphore; }
+        Stats stats() const;
+
+    private:
+        static constexpr vk::DeviceSize STAGING_ALIGNMENT = 16;
+
+        struct Batch
+        {
+            vk::UniqueCommandPool command_pool;
+            vk::UniqueCommandBuffer command_buffer;
+            uint64_t value{ 0 };
+            // Staging space up to this point is free once the batch has executed.
+            uint64_t staging_end{ 0 };
+            vk::DeviceSize bytes{ 0 };
+            // Staging for copies that didn't fit in the ring, freed once the batch has executed.
+            std::vector<gpu_allocator::Buffer> overflow;
+        };
+
+        // Where one copy's source bytes go.
+        struct StagingSpace
+        {
+            vk::Buffer buffer;
+            vk::DeviceSize offset;
+            std::byte* data;
+        };
+
+        vk::Device device;
+        gpu_allocator::GpuAllocator& allocator;
+        vk::Queue queue;
+        uint32_t queue_family;
+        std::mutex own_queue_mutex;
+        std::mutex* queue_mutex;
+
+        gpu_allocator::Buffer staging;
+        // Running totals, the ring offset is head % staging.size().
+        uint64_t staging_head{ 0 };
+        uint64_t staging_tail{ 0 };
+
+        vk::UniqueSemaphore timeline_semaphore;
+        uint64_t submitted_value{ 0 };
+
+        std::optional<Batch> recording;
+        std::deque<Batch> in_flight;
+        std::vector<Batch> spare_batches;
+        Stats counters{};
+        mutable std::mutex mutex;
+
+        Batch& current_batch();
+        void submit_recording();
+        void reclaim();
+        // Drops the lock while a worker waits for space.
+        StagingSpace reserve_staging(std::unique_lock<std::mutex>& lock, vk::DeviceSize size);
+        void wait_locked(uint64_t value);
+    };
+}
+#endif // !UPLOAD_SERVICE_H
@@ -0,0 +1,182 @@
+#ifndef VERTEX_ENCODING_H
+#define VERTEX_ENCODING_H
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <span>
+
+#include "mesh.h"
+
+// Scalar building blocks for the packed vertex formats. Kept free of Vulkan so the encoders
+// can be used by offline tools and benchmarks.
+namespace baas::vertex_format
+{
+    // Per mesh dequantization parameters: position = offset + unorm * scale.
+    struct EncodeContext
+    {
+        std::array<float, 3> position_offset{ 0.0f, 0.0f, 0.0f };
+        std::array<float, 3> position_scale{ 1.0f, 1.0f, 1.0f };
+    };
+
+    inline EncodeContext make_encode_context(std::span<const mesh::Vertex> vertices)
+    {
+        EncodeContext context;
+        if (vertices.empty())
+        {
+            return context;
+        }
+        std::array<float, 3> min = vertices[0].position;
+        std::array<float, 3> max = vertices[0].position;
+        for (auto&& vertex : vertices)
+        {
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                min[axis] = std::min(min[axis], vertex.position[axis]);
+                max[axis] = std::max(max[axis], vertex.position[axis]);
+            }
+        }
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            context.position_offset[axis] = min[axis];
+            // A flat axis still needs a non zero scale so decoding stays finite.
+            context.position_scale[axis] = max[axis] > min[axis] ? max[axis] - min[axis] : 1.0f;
+        }
+        return context;
+    }
+
+    // Rounds half up, which is what mesh_kernels::quantize_positions does in every SIMD path.
+    inline uint16_t encode_unorm16(float value)
+    {
+        float clamped = std::min(std::max(value, 0.0f), 1.0f);
+        return static_cast<uint16_t>(static_cast<int32_t>(clamped * 65535.0f + 0.5f));
+    }
+
+    inline float decode_unorm16(uint16_t value)
+    {
+        return value / 65535.0f;
+    }
+
+    inline int16_t encode_snorm16(float value)
+    {
+        return static_cast<int16_t>(std::lround(std::clamp(value, -1.0f, 1.0f) * 32767.0f));
+    }
+
+    inline float decode_snorm16(int16_t value)
+    {
+        // Same rule the GPU uses, -32768 and -32767 both map to -1.
+        return std::max(value / 32767.0f, -1.0f);
+    }
+
+    // IEEE 754 binary16 with round to nearest even, the same as R16_SFLOAT.
+    inline uint16_t float_to_half(float value)
+    {
+        uint32_t bits = std::bit_cast<uint32_t>(value);
+        uint32_t sign = (bits >> 16) & 0x8000u;
+        uint32_t exponent = (bits >> 23) & 0xFFu;
+        uint32_t mantissa = bits & 0x7FFFFFu;
+
+        if (exponent == 0xFFu)
+        {
+            return static_cast<uint16_t>(sign | 0x7C00u | (mantissa != 0 ? 0x200u : 0u));
+        }
+        int32_t half_exponent = static_cast<int32_t>(exponent) - 127 + 15;
+        if (half_exponent >= 0x1F)
+        {
+            return static_cast<uint16_t>(sign | 0x7C00u);
+        }
+        if (half_exponent <= 0)
+        {
+            if (half_exponent < -10)
+            {
+                return static_cast<uint16_t>(sign);
+            }
+            mantissa |= 0x800000u;
+            uint32_t shift = static_cast<uint32_t>(14 - half_exponent);
+            uint32_t half_mantissa = mantissa >> shift;
+            uint32_t remainder = mantissa & ((1u << shift) - 1u);
+            uint32_t halfway = 1u << (shift - 1);
+            if (remainder > halfway || (remainder == halfway && (half_mantissa & 1u) != 0))
+            {
+                ++half_mantissa;
+            }
+            return static_cast<uint16_t>(sign | half_mantissa);
+        }
+        uint32_t half = sign | (static_cast<uint32_t>(half_exponent) << 10) | (mantissa >> 13);
+        uint32_t remainder = mantissa & 0x1FFFu;
+        if (remainder > 0x1000u || (remainder == 0x1000u && (half & 1u) != 0))
+        {
+            ++half; // A carry into the exponent is still the correctly rounded result.
+        }
+        return static_cast<uint16_t>(half);
+    }
+
+    inline float half_to_float(uint16_t half)
+    {
+        uint32_t sign = static_cast<uint32_t>(half & 0x8000u) << 16;
+        uint32_t exponent = (half >> 10) & 0x1Fu;
+        uint32_t mantissa = half & 0x3FFu;
+        if (exponent == 0)
+        {
+            float magnitude = std::ldexp(static_cast<float>(mantissa), -24);
+            return sign != 0 ? -magnitude : magnitude;
+        }
+        if (exponent == 0x1F)
+        {
+            return std::bit_cast<float>(sign | 0x7F800000u | (mantissa << 13));
+        }
+        return std::bit_cast<float>(sign | ((exponent + 112) << 23) | (mantissa << 13));
+    }
+
+    inline std::array<float, 3> decode_octahedral(float x, float y)
+    {
+        float z = 1.0f - std::abs(x) - std::abs(y);
+        float t = std::max(-z, 0.0f);
+        x += x >= 0.0f ? -t : t;
+        y += y >= 0.0f ? -t : t;
+        float length = std::sqrt(x * x + y * y + z * z);
+        return { x / length, y / length, z / length };
+    }
+
+    // Octahedral unit vector in two snorm16s. Tries the four neighbouring grid points and keeps
+    // the one that decodes closest to the input, which roughly halves the worst case error.
+    inline std::array<int16_t, 2> encode_octahedral(const std::array<float, 3>& normal)
+    {
+        float sum = std::abs(normal[0]) + std::abs(normal[1]) + std::abs(normal[2]);
+        if (sum == 0.0f)
+        {
+            return { 0, 0 };
+        }
+        float x = normal[0] / sum;
+        float y = normal[1] / sum;
+        if (normal[2] < 0.0f)
+        {
+            float folded_x = (1.0f - std::abs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+            float folded_y = (1.0f - std::abs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+            x = folded_x;
+            y = folded_y;
+        }
+
+        float length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+        std::array<int16_t, 2> best{};
+        float best_dot = -2.0f;
+        for (int i = 0; i < 4; ++i)
+        {
+            float qx = (i & 1) != 0 ? std::ceil(x * 32767.0f) : std::floor(x * 32767.0f);
+            float qy = (i & 2) != 0 ? std::ceil(y * 32767.0f) : std::floor(y * 32767.0f);
+            std::array<int16_t, 2> candidate{ static_cast<int16_t>(std::clamp(qx, -32767.0f, 32767.0f)),
+                static_cast<int16_t>(std::clamp(qy, -32767.0f, 32767.0f)) };
+            auto decoded = decode_octahedral(decode_snorm16(candidate[0]), decode_snorm16(candidate[1]));
+            float dot = (decoded[0] * normal[0] + decoded[1] * normal[1] + decoded[2] * normal[2]) / length;
+            if (dot > best_dot)
+            {
+                best_dot = dot;
+                best = candidate;
+            }
+        }
+        return best;
+    }
+}
+#endif // !VERTEX_ENCODING_H
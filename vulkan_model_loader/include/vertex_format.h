@@ -0,0 +1,197 @@
+#ifndef VERTEX_FORMAT_H
+#define VERTEX_FORMAT_H
+
+#include <vulkan/vulkan.hpp>
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <span>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "mesh.h"
+#include "vertex_encoding.h"
+
+namespace baas::vertex_format
+{
+    // Attribute encodings. Each one pairs its storage with the vk::Format the pipeline reads it as,
+    // so the encoder and the vertex input state come from the same place.
+
+    struct Float3Position
+    {
+        using Storage = std::array<float, 3>;
+        static constexpr vk::Format format = vk::Format::eR32G32B32Sfloat;
+
+        static Storage encode(const std::array<float, 3>& position, const EncodeContext&) { return position; }
+        static std::array<float, 3> decode(const Storage& stored, const EncodeContext&) { return stored; }
+    };
+
+    // 16 bit unorm relative to the mesh AABB. The 4th component pads to 8 bytes since there is no
+    // 3 component 16 bit format guaranteed for vertex input.
+    struct Unorm16Position
+    {
+        using Storage = std::array<uint16_t, 4>;
+        static constexpr vk::Format format = vk::Format::eR16G16B16A16Unorm;
+
+        static Storage encode(const std::array<float, 3>& position, const EncodeContext& context)
+        {
+            Storage stored{ 0, 0, 0, 65535 };
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                stored[axis] = encode_unorm16((position[axis] - context.position_offset[axis]) / context.position_scale[axis]);
+            }
+            return stored;
+        }
+
+        static std::array<float, 3> decode(const Storage& stored, const EncodeContext& context)
+        {
+            std::array<float, 3> position;
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                position[axis] = context.position_offset[axis] + decode_unorm16(stored[axis]) * context.position_scale[axis];
+            }
+            return position;
+        }
+    };
+
+    struct Float3Normal
+    {
+        using Storage = std::array<float, 3>;
+        static constexpr vk::Format format = vk::Format::eR32G32B32Sfloat;
+        static constexpr bool octahedral = false;
+
+        static Storage encode(const std::array<float, 3>& normal) { return normal; }
+        static std::array<float, 3> decode(const Storage& stored) { return stored; }
+    };
+
+    struct OctahedralNormal
+    {
+        using Storage = std::array<int16_t, 2>;
+        static constexpr vk::Format format = vk::Format::eR16G16Snorm;
+        static constexpr bool octahedral = true;
+
+        static Storage encode(const std::array<float, 3>& normal) { return encode_octahedral(normal); }
+        static std::array<float, 3> decode(const Storage& stored)
+        {
+            return decode_octahedral(decode_snorm16(stored[0]), decode_snorm16(stored[1]));
+        }
+    };
+
+    struct Float2TexCoord
+    {
+        using Storage = std::array<float, 2>;
+        static constexpr vk::Format format = vk::Format::eR32G32Sfloat;
+
+        static Storage encode(const std::array<float, 2>& uv) { return uv; }
+        static std::array<float, 2> decode(const Storage& stored) { return stored; }
+    };
+
+    struct Half2TexCoord
+    {
+        using Storage = std::array<uint16_t, 2>;
+        static constexpr vk::Format format = vk::Format::eR16G16Sfloat;
+
+        static Storage encode(const std::array<float, 2>& uv) { return { float_to_half(uv[0]), float_to_half(uv[1]) }; }
+        static std::array<float, 2> decode(const Storage& stored) { return { half_to_float(stored[0]), half_to_float(stored[1]) }; }
+    };
+
+    template <typename PositionEncoding, typename NormalEncoding, typename TexCoordEncoding>
+    struct Vertex
+    {
+        using Position = PositionEncoding;
+        using Normal = NormalEncoding;
+        using TexCoord = TexCoordEncoding;
+
+        typename PositionEncoding::Storage position;
+        typename NormalEncoding::Storage normal;
+        typename TexCoordEncoding::Storage uv;
+
+        // Every vertex shader variant is built from shader.vert, see CMakeLists.txt.
+        static constexpr std::string_view vertex_shader = NormalEncoding::octahedral ? "shaders/vert_packed.spv" : "shaders/vert.spv";
+        static constexpr std::string_view indirect_vertex_shader = NormalEncoding::octahedral ? "shaders/vert_packed_indirect.spv" : "shaders/vert_indirect.spv";
+
+        static constexpr vk::VertexInputBindingDescription binding_description(uint32_t binding = 0)
+        {
+            return vk::VertexInputBindingDescription(binding, sizeof(Vertex), vk::VertexInputRate::eVertex);
+        }
+
+        // Locations match shader.vert: 0 position, 1 normal, 2 uv.
+        static constexpr std::array<vk::VertexInputAttributeDescription, 3> attribute_descriptions(uint32_t binding = 0)
+        {
+            return { vk::VertexInputAttributeDescription(0, binding, PositionEncoding::format, offsetof(Vertex, position)),
+                vk::VertexInputAttributeDescription(1, binding, NormalEncoding::format, offsetof(Vertex, normal)),
+                vk::VertexInputAttributeDescription(2, binding, TexCoordEncoding::format, offsetof(Vertex, uv)) };
+        }
+
+        static Vertex encode(const mesh::Vertex& vertex, const EncodeContext& context)
+        {
+            return { PositionEncoding::encode(vertex.position, context), NormalEncoding::encode(vertex.normal),
+                TexCoordEncoding::encode(vertex.uv) };
+        }
+
+        static mesh::Vertex decode(const Vertex& vertex, const EncodeContext& context)
+        {
+            return { PositionEncoding::decode(vertex.position, context), NormalEncoding::decode(vertex.normal),
+                TexCoordEncoding::decode(vertex.uv) };
+        }
+    };
+
+    // 32 bytes, what the loaders produce.
+    using FullVertex = Vertex<Float3Position, Float3Normal, Float2TexCoord>;
+    // 16 bytes.
+    using PackedVertex = Vertex<Unorm16Position, OctahedralNormal, Half2TexCoord>;
+
+    static_assert(std::is_standard_layout_v<FullVertex> && sizeof(FullVertex) == 32);
+    static_assert(std::is_standard_layout_v<PackedVertex> && sizeof(PackedVertex) == 16);
+
+    template <typename VertexType>
+    std::vector<VertexType> encode_vertices(std::span<const mesh::Vertex> vertices, const EncodeContext& context)
+    {
+        std::vector<VertexType> encoded;
+        encoded.reserve(vertices.size());
+        for (auto&& vertex : vertices)
+        {
+            encoded.push_back(VertexType::encode(vertex, context));
+        }
+        return encoded;
+    }
+
+    // Worst case round trip error over a mesh.
+    struct EncodingError
+    {
+        float max_position_error;
+        float max_normal_error_degrees;
+        float max_uv_error;
+    };
+
+    template <typename VertexType>
+    EncodingError measure_error(std::span<const mesh::Vertex> vertices, const EncodeContext& context)
+    {
+        EncodingError error{};
+        for (auto&& vertex : vertices)
+        {
+            mesh::Vertex decoded = VertexType::decode(VertexType::encode(vertex, context), context);
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                error.max_position_error = std::max(error.max_position_error, std::abs(decoded.position[axis] - vertex.position[axis]));
+            }
+            for (int axis = 0; axis < 2; ++axis)
+            {
+                error.max_uv_error = std::max(error.max_uv_error, std::abs(decoded.uv[axis] - vertex.uv[axis]));
+            }
+            const auto& n = vertex.normal;
+            const auto& d = decoded.normal;
+            float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]) * std::sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+            if (length > 0.0f)
+            {
+                float dot = (d[0] * n[0] + d[1] * n[1] + d[2] * n[2]) / length;
+                float degrees = std::acos(std::clamp(dot, -1.0f, 1.0f)) * 57.2957795f;
+                error.max_normal_error_degrees = std::max(error.max_normal_error_degrees, degrees);
+            }
+        }
+        return error;
+    }
+}
+#endif // !VERTEX_FORMAT_H
@@ -1,9 +1,38 @@
 #version 450
 
-layout(location = 0) in vec3 fragColor;
+// Diffuse color times the diffuse texture with a fixed light. Set 1 matches the material set in
+// game_engine.h, materials without a texture point at a 1x1 white one.
+
+const uint MAX_TEXTURES = 256;
+
+struct Material {
+    vec4 diffuse;
+    uint texture;
+    uint padding0;
+    uint padding1;
+    uint padding2;
+};
+
+layout(set = 1, binding = 0) uniform sampler2D textures[MAX_TEXTURES];
+
+layout(std430, set = 1, binding = 1) readonly buffer Materials {
+    Material materials[];
+};
+
+layout(location = 0) in vec3 fragNormal;
+layout(location = 1) in vec2 fragTexCoord;
+layout(location = 2) flat in uint fragMaterial;
 
 layout(location = 0) out vec4 outColor;
 
 void main() {
-    outColor = vec4(fragColor, 1.0);
+    // The index is the same for the whole draw, which is all dynamic indexing asks for.
+    Material material = materials[fragMaterial];
+    vec4 color = texture(textures[material.texture], fragTexCoord) * material.diffuse;
+    if (color.a < 0.5) {
+        discard;
+    }
+    vec3 light = normalize(vec3(0.4, 0.8, 0.45));
+    float lit = 0.3 + 0.7 * max(dot(normalize(fragNormal), light), 0.0);
+    outColor = vec4(color.rgb * lit, 1.0);
 }
@@ -1,20 +1,80 @@
 #version 450
 
-layout(location = 0) out vec3 fragColor;
+// Compiled four times, OCTAHEDRAL_NORMALS is defined for the packed vertex format (see vertex_format.h)
+// and INDIRECT for the GPU driven path, where the cull shaders pass the draw's slot through firstInstance.
+// model_view_projection is only the view projection on both paths, instances place the model.
 
-vec2 positions[3] = vec2[](
-    vec2(0.0, -0.5),
-    vec2(0.5, 0.5),
-    vec2(-0.5, 0.5)
-);
+layout(push_constant) uniform PushConstants {
+    mat4 model_view_projection;
+    vec4 position_offset;
+    vec4 position_scale;
+    // Unused by the GPU driven path, the material comes with the draw.
+    uint material;
+} push;
 
-vec3 colors[3] = vec3[](
-    vec3(1.0, 0.0, 0.0),
-    vec3(0.0, 1.0, 0.0),
-    vec3(0.0, 0.0, 1.0)
-);
+#ifdef INDIRECT
+layout(std430, set = 0, binding = 0) readonly buffer Instances {
+    vec4 instances[];
+};
+
+// Instance and material of each draw, written by the cull shaders next to the draw itself.
+layout(std430, set = 0, binding = 6) readonly buffer DrawInstances {
+    uvec2 drawInstances[];
+};
+#else
+// Top three rows of each instance's world matrix, written by the CPU per frame and indexed by
+// gl_InstanceIndex, which includes the draw's firstInstance.
+struct InstanceTransform {
+    vec4 rows[3];
+};
+
+layout(std430, set = 0, binding = 0) readonly buffer Instances {
+    InstanceTransform instances[];
+};
+#endif
+
+layout(location = 0) in vec3 inPosition;
+#ifdef OCTAHEDRAL_NORMALS
+layout(location = 1) in vec2 inNormal;
+#else
+layout(location = 1) in vec3 inNormal;
+#endif
+layout(location = 2) in vec2 inTexCoord;
+
+layout(location = 0) out vec3 fragNormal;
+layout(location = 1) out vec2 fragTexCoord;
+layout(location = 2) flat out uint fragMaterial;
+
+vec3 decodeNormal() {
+#ifdef OCTAHEDRAL_NORMALS
+    vec3 n = vec3(inNormal, 1.0 - abs(inNormal.x) - abs(inNormal.y));
+    float t = max(-n.z, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+#else
+    return inNormal;
+#endif
+}
 
 void main() {
-    gl_Position = vec4(positions[gl_VertexIndex], 0.0, 1.0);
-    fragColor = colors[gl_VertexIndex];
+    // Packed positions are unorm relative to the mesh bounds, full positions use offset 0 and scale 1.
+    vec3 position = push.position_offset.xyz + inPosition * push.position_scale.xyz;
+#ifdef INDIRECT
+    uvec2 draw = drawInstances[gl_InstanceIndex];
+    position += instances[draw.x].xyz;
+    fragMaterial = draw.y;
+    vec3 normal = decodeNormal();
+#else
+    InstanceTransform instance = instances[gl_InstanceIndex];
+    vec4 local = vec4(position, 1.0);
+    position = vec3(dot(instance.rows[0], local), dot(instance.rows[1], local), dot(instance.rows[2], local));
+    fragMaterial = push.material;
+    // Fine without the inverse transpose as long as instances are scaled uniformly.
+    vec3 objectNormal = decodeNormal();
+    vec3 normal = normalize(vec3(dot(instance.rows[0].xyz, objectNormal), dot(instance.rows[1].xyz, objectNormal), dot(instance.rows[2].xyz, objectNormal)));
+#endif
+    gl_Position = push.model_view_projection * vec4(position, 1.0);
+    fragNormal = normal;
+    fragTexCoord = inTexCoord;
 }
@@ -0,0 +1,169 @@
+#include "alloc_counter.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace baas::alloc_counter
+{
+    namespace
+    {
+        std::atomic<uint64_t> allocations{ 0 };
+    }
+
+    bool enabled()
+    {
+#ifdef BAAS_COUNT_ALLOCATIONS
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    uint64_t count()
+    {
+        return allocations.load(std::memory_order_relaxed);
+    }
+
+#ifdef BAAS_COUNT_ALLOCATIONS
+    namespace
+    {
+        void* counted_malloc(std::size_t size)
+        {
+            allocations.fetch_add(1, std::memory_order_relaxed);
+            return std::malloc(size == 0 ? 1 : size);
+        }
+
+        void* counted_aligned_malloc(std::size_t size, std::size_t alignment)
+        {
+            allocations.fetch_add(1, std::memory_order_relaxed);
+            size = size == 0 ? alignment : (size + alignment - 1) / alignment * alignment;
+#ifdef _WIN32
+            return _aligned_malloc(size, alignment);
+#else
+            return std::aligned_alloc(alignment, size);
+#endif
+        }
+
+        void aligned_free(void* pointer)
+        {
+#ifdef _WIN32
+            _aligned_free(pointer);
+#else
+            std::free(pointer);
+#endif
+        }
+    }
+#endif
+}
+
+#ifdef BAAS_COUNT_ALLOCATIONS
+// Every replaceable form, so nothing slips past the count or mixes up allocators.
+void* operator new(std::size_t size)
+{
+    if (auto pointer = baas::alloc_counter::counted_malloc(size))
+    {
+        return pointer;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    return baas::alloc_counter::counted_malloc(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+    return baas::alloc_counter::counted_malloc(size);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment)
+{
+    if (auto pointer = baas::alloc_counter::counted_aligned_malloc(size, static_cast<std::size_t>(alignment)))
+    {
+        return pointer;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment)
+{
+    return operator new(size, alignment);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    return baas::alloc_counter::counted_aligned_malloc(size, static_cast<std::size_t>(alignment));
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+    return baas::alloc_counter::counted_aligned_malloc(size, static_cast<std::size_t>(alignment));
+}
+
+void operator delete(void* pointer) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, std::size_t) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer, std::size_t) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, const std::nothrow_t&) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, std::align_val_t) noexcept
+{
+    baas::alloc_counter::aligned_free(pointer);
+}
+
+void operator delete[](void* pointer, std::align_val_t) noexcept
+{
+    baas::alloc_counter::aligned_free(pointer);
+}
+
+void operator delete(void* pointer, std::size_t, std::align_val_t) noexcept
+{
+    baas::alloc_counter::aligned_free(pointer);
+}
+
+void operator delete[](void* pointer, std::size_t, std::align_val_t) noexcept
+{
+    baas::alloc_counter::aligned_free(pointer);
+}
+
+void operator delete(void* pointer, std::align_val_t, const std::nothrow_t&) noexcept
+{
+    baas::alloc_counter::aligned_free(pointer);
+}
+
+void operator delete[](void* pointer, std::align_val_t, const std::nothrow_t&) noexcept
+{
+    baas::alloc_counter::aligned_free(pointer);
+}
+#endif
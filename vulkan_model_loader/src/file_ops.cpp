@@ -4,19 +4,196 @@
 #include <stdexcept>
 
 #include <algorithm>
-#include <iterator>
+#include <cstring>
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 
 namespace baas::file_ops
 {
+    MappedFile::MappedFile(const std::string_view file_path, AccessHint hint)
+    {
+        const std::string path(file_path);
+#ifdef _WIN32
+        file_handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+            hint == AccessHint::sequential ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file_handle == INVALID_HANDLE_VALUE)
+        {
+            file_handle = nullptr;
+            throw std::runtime_error("Failed to open file: " + path);
+        }
+
+        LARGE_INTEGER file_size;
+        if (!GetFileSizeEx(file_handle, &file_size))
+        {
+            release();
+            throw std::runtime_error("Failed to stat file: " + path);
+        }
+        mapped_size = static_cast<std::size_t>(file_size.QuadPart);
+        if (mapped_size == 0)
+        {
+            return;
+        }
+
+        mapping_handle = CreateFileMappingA(file_handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping_handle == nullptr)
+        {
+            release();
+            throw std::runtime_error("Failed to map file: " + path);
+        }
+        mapped_data = static_cast<const std::byte*>(MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0));
+        if (mapped_data == nullptr)
+        {
+            release();
+            throw std::runtime_error("Failed to map file: " + path);
+        }
+#else
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            throw std::runtime_error("Failed to open file: " + path);
+        }
+
+        struct stat file_stat{};
+        if (fstat(fd, &file_stat) != 0)
+        {
+            close(fd);
+            throw std::runtime_error("Failed to stat file: " + path);
+        }
+        // Empty files can't be mapped, they just become an empty view.
+        if (file_stat.st_size == 0)
+        {
+            close(fd);
+            return;
+        }
+
+        void* mapping = mmap(nullptr, static_cast<std::size_t>(file_stat.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        // The mapping keeps its own reference to the file.
+        close(fd);
+        if (mapping == MAP_FAILED)
+        {
+            throw std::runtime_error("Failed to map file: " + path);
+        }
+        mapped_data = static_cast<const std::byte*>(mapping);
+        mapped_size = static_cast<std::size_t>(file_stat.st_size);
+
+        if (hint == AccessHint::sequential)
+        {
+            madvise(mapping, mapped_size, MADV_SEQUENTIAL);
+        }
+        else if (hint == AccessHint::random)
+        {
+            madvise(mapping, mapped_size, MADV_RANDOM);
+        }
+#endif
+    }
+
+    MappedFile::~MappedFile()
+    {
+        release();
+    }
+
+    MappedFile::MappedFile(MappedFile&& other) noexcept
+    {
+        *this = std::move(other);
+    }
+
+    MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+    {
+        if (this != &other)
+        {
+            release();
+            mapped_data = std::exchange(other.mapped_data, nullptr);
+            mapped_size = std::exchange(other.mapped_size, 0);
+#ifdef _WIN32
+            file_handle = std::exchange(other.file_handle, nullptr);
+            mapping_handle = std::exchange(other.mapping_handle, nullptr);
+#endif
+        }
+        return *this;
+    }
+
+    std::span<const uint32_t> MappedFile::words() const
+    {
+        if (mapped_size % sizeof(uint32_t) != 0)
+        {
+            throw std::runtime_error("Mapped file size is not a multiple of 4 bytes");
+        }
+        return { reinterpret_cast<const uint32_t*>(mapped_data), mapped_size / sizeof(uint32_t) };
+    }
+
+    void MappedFile::release() noexcept
+    {
+#ifdef _WIN32
+        if (mapped_data != nullptr)
+        {
+            UnmapViewOfFile(mapped_data);
+        }
+        if (mapping_handle != nullptr)
+        {
+            CloseHandle(mapping_handle);
+        }
+        if (file_handle != nullptr)
+        {
+            CloseHandle(file_handle);
+        }
+        file_handle = nullptr;
+        mapping_handle = nullptr;
+#else
+        if (mapped_data != nullptr)
+        {
+            munmap(const_cast<std::byte*>(mapped_data), mapped_size);
+        }
+#endif
+        mapped_data = nullptr;
+        mapped_size = 0;
+    }
+
+    MappedFile map_file(const std::string_view file_path, AccessHint hint)
+    {
+        return MappedFile(file_path, hint);
+    }
+
+    uint64_t hash_bytes(std::span<const std::byte> bytes, uint64_t seed)
+    {
+        constexpr uint64_t multiplier = 0x9E3779B97F4A7C15ull;
+        uint64_t hash = seed ^ (bytes.size() * multiplier);
+        std::size_t i{ 0 };
+        for (; i + sizeof(uint64_t) <= bytes.size(); i += sizeof(uint64_t))
+        {
+            uint64_t word;
+            std::memcpy(&word, bytes.data() + i, sizeof(word));
+            hash = (hash ^ (word * 0xC2B2AE3D27D4EB4Full)) * multiplier;
+            hash ^= hash >> 31;
+        }
+        for (; i < bytes.size(); ++i)
+        {
+            hash = (hash ^ static_cast<uint64_t>(bytes[i])) * multiplier;
+        }
+        hash ^= hash >> 33;
+        hash *= 0xFF51AFD7ED558CCDull;
+        hash ^= hash >> 33;
+        return hash;
+    }
+
     // Possibly make this generic to read either text or binary data.
     FileData read_file(const std::string_view file_path)
     {
-        std::ifstream file(file_path.data(), std::ios::ate | std::ios::binary);
-        if (file.is_open())
+        const std::string path(file_path);
+        std::ifstream file(path, std::ios::ate | std::ios::binary);
+        if (!file.is_open())
         {
-            std::string err_txt = "Failed to open file: "; // TODO combine the file path in this err message.
-            throw std::runtime_error(err_txt);
+            throw std::runtime_error("Failed to open file: " + path);
         }
         std::size_t file_size = static_cast<std::size_t>(file.tellg());
         file.seekg(0);
@@ -27,13 +204,11 @@ namespace baas::file_ops
         return file_data;
     }
 
+    // Prefer map_file(...).words() when the code only has to live as long as the mapping.
     std::vector<uint32_t> read_shader_code(const std::string_view file_path)
     {
-        FileData raw_file_data = read_file(file_path);
-
-        std::vector<uint32_t> shader_code(raw_file_data.size());
-        std::transform(raw_file_data.begin(), raw_file_data.end(), std::back_inserter(shader_code), [](char byte){return static_cast<uint32_t>(byte);});
-        
-        return shader_code;
+        MappedFile shader_file = map_file(file_path);
+        auto words = shader_file.words();
+        return std::vector<uint32_t>(words.begin(), words.end());
     }
-}
\ No newline at end of file
+}
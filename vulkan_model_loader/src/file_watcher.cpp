@@ -0,0 +1,171 @@
+#include "file_watcher.h"
+
+#include <algorithm>
+#include <cstdio>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#include "profiler.h"
+
+namespace baas::file_watcher
+{
+    namespace
+    {
+        // How long the thread sleeps at most before looking at the stop flag again.
+        constexpr int WAKE_MS = 100;
+        // Without inotify modification times are compared this often.
+        constexpr auto POLL_INTERVAL = std::chrono::milliseconds(250);
+
+        std::filesystem::file_time_type last_write_time(const std::string& path)
+        {
+            std::error_code error;
+            auto time = std::filesystem::last_write_time(path, error);
+            return error ? std::filesystem::file_time_type{} : time;
+        }
+    }
+
+    FileWatcher::FileWatcher(std::chrono::milliseconds quiet_period)
+        : quiet_period(quiet_period)
+    {
+#ifdef __linux__
+        inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (inotify_fd < 0)
+        {
+            std::printf("File watching unavailable, inotify_init1 failed\n");
+            return;
+        }
+#endif
+        watching = true;
+        thread = std::thread([this] { run(); });
+    }
+
+    FileWatcher::~FileWatcher()
+    {
+        stopping.store(true, std::memory_order_relaxed);
+        if (thread.joinable())
+        {
+            thread.join();
+        }
+#ifdef __linux__
+        if (inotify_fd >= 0)
+        {
+            close(inotify_fd);
+        }
+#endif
+    }
+
+    void FileWatcher::watch(const std::string& path)
+    {
+        if (!watching)
+        {
+            return;
+        }
+        std::filesystem::path file(path);
+        Watched entry;
+        entry.path = path;
+        entry.name = file.filename().string();
+        entry.last_write = last_write_time(path);
+#ifdef __linux__
+        auto directory = file.has_parent_path() ? file.parent_path().string() : std::string(".");
+        // Watching a directory twice hands back the same descriptor.
+        entry.directory_watch = inotify_add_watch(inotify_fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_MODIFY);
+        if (entry.directory_watch < 0)
+        {
+            std::printf("Can't watch %s for changes\n", directory.c_str());
+            return;
+        }
+#endif
+        std::lock_guard lock(mutex);
+        if (std::none_of(files.begin(), files.end(), [&path](const Watched& watched) { return watched.path == path; }))
+        {
+            files.push_back(std::move(entry));
+        }
+    }
+
+    std::vector<Change> FileWatcher::poll_changes()
+    {
+        std::vector<Change> changes;
+        auto now = Clock::now();
+        std::lock_guard lock(mutex);
+        for (auto&& file : files)
+        {
+            if (file.event_count > 0 && now - file.last_event >= quiet_period)
+            {
+                changes.push_back({ file.path, file.first_event, file.event_count });
+                file.event_count = 0;
+            }
+        }
+        return changes;
+    }
+
+    void FileWatcher::record_event(Watched& file, Clock::time_point now)
+    {
+        if (file.event_count == 0)
+        {
+            file.first_event = now;
+        }
+        file.last_event = now;
+        ++file.event_count;
+    }
+
+    void FileWatcher::run()
+    {
+        profiler::Profiler::shared().set_thread_name("file watcher");
+#ifdef __linux__
+        alignas(inotify_event) char buffer[4096];
+        pollfd descriptor{ inotify_fd, POLLIN, 0 };
+        while (!stopping.load(std::memory_order_relaxed))
+        {
+            if (poll(&descriptor, 1, WAKE_MS) <= 0)
+            {
+                continue;
+            }
+            ssize_t length;
+            while ((length = read(inotify_fd, buffer, sizeof(buffer))) > 0)
+            {
+                auto now = Clock::now();
+                std::lock_guard lock(mutex);
+                for (ssize_t offset = 0; offset < length;)
+                {
+                    auto event = reinterpret_cast<const inotify_event*>(buffer + offset);
+                    offset += sizeof(inotify_event) + event->len;
+                    for (auto&& file : files)
+                    {
+                        // After an overflow any file could have changed.
+                        if ((event->mask & IN_Q_OVERFLOW) || (event->len > 0 && file.directory_watch == event->wd && file.name == event->name))
+                        {
+                            record_event(file, now);
+                        }
+                    }
+                }
+            }
+        }
+#else
+        auto next_poll = Clock::now();
+        while (!stopping.load(std::memory_order_relaxed))
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(WAKE_MS));
+            auto now = Clock::now();
+            if (now < next_poll)
+            {
+                continue;
+            }
+            next_poll = now + POLL_INTERVAL;
+            std::lock_guard lock(mutex);
+            for (auto&& file : files)
+            {
+                auto time = last_write_time(file.path);
+                if (time != file.last_write)
+                {
+                    file.last_write = time;
+                    record_event(file, now);
+                }
+            }
+        }
+#endif
+    }
+}
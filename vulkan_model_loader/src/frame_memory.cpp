@@ -0,0 +1,150 @@
+#include "frame_memory.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+
+namespace baas::frame_memory
+{
+    namespace
+    {
+        std::size_t align_up(std::size_t value, std::size_t alignment)
+        {
+            return (value + alignment - 1) / alignment * alignment;
+        }
+    }
+
+    Arena::Arena(std::size_t capacity, std::pmr::memory_resource* upstream)
+        : upstream(upstream)
+    {
+        if (capacity > 0)
+        {
+            block = static_cast<std::byte*>(upstream->allocate(capacity, alignof(std::max_align_t)));
+            block_size = capacity;
+        }
+    }
+
+    Arena::~Arena()
+    {
+        reset();
+        if (block != nullptr)
+        {
+            upstream->deallocate(block, block_size, alignof(std::max_align_t));
+        }
+    }
+
+    void Arena::reset()
+    {
+        for (auto&& overflow : overflows)
+        {
+            upstream->deallocate(overflow.pointer, overflow.bytes, overflow.alignment);
+        }
+        overflows.clear();
+        // Room for everything the last frame wanted, so the next one like it stays in the block.
+        auto wanted = offset + overflow_bytes;
+        if (wanted > block_size)
+        {
+            if (block != nullptr)
+            {
+                upstream->deallocate(block, block_size, alignof(std::max_align_t));
+                block = nullptr;
+            }
+            block_size = std::bit_ceil(wanted);
+            block = static_cast<std::byte*>(upstream->allocate(block_size, alignof(std::max_align_t)));
+        }
+        offset = 0;
+        overflow_bytes = 0;
+    }
+
+    void* Arena::do_allocate(std::size_t bytes, std::size_t alignment)
+    {
+        if (block != nullptr)
+        {
+            auto base = reinterpret_cast<std::uintptr_t>(block);
+            auto start = align_up(base + offset, alignment) - base;
+            if (start + bytes <= block_size)
+            {
+                offset = start + bytes;
+                return block + start;
+            }
+        }
+        overflows.reserve(overflows.size() + 1);
+        void* pointer = upstream->allocate(bytes, alignment);
+        overflows.push_back({ pointer, bytes, alignment });
+        // Padding for the alignment included, it would need that in the block too.
+        overflow_bytes += bytes + alignment;
+        ++overflow_total;
+        return pointer;
+    }
+
+    void Arena::do_deallocate(void*, std::size_t, std::size_t)
+    {
+        // Everything goes at once in reset.
+    }
+
+    BlockPool::BlockPool(std::size_t block_size, std::size_t block_alignment, std::size_t blocks_per_chunk, std::pmr::memory_resource* upstream)
+        : alignment(std::max(block_alignment, alignof(FreeBlock))), blocks_per_chunk(std::max<std::size_t>(blocks_per_chunk, 1)), upstream(upstream)
+    {
+        size = align_up(std::max(block_size, sizeof(FreeBlock)), alignment);
+    }
+
+    BlockPool::~BlockPool()
+    {
+        for (auto chunk : chunks)
+        {
+            upstream->deallocate(chunk, size * blocks_per_chunk, alignment);
+        }
+    }
+
+    std::size_t BlockPool::live_count() const
+    {
+        std::lock_guard lock(mutex);
+        return live;
+    }
+
+    uint64_t BlockPool::oversized_count() const
+    {
+        std::lock_guard lock(mutex);
+        return oversized;
+    }
+
+    void* BlockPool::do_allocate(std::size_t bytes, std::size_t requested_alignment)
+    {
+        if (bytes > size || requested_alignment > alignment)
+        {
+            {
+                std::lock_guard lock(mutex);
+                ++oversized;
+            }
+            return upstream->allocate(bytes, requested_alignment);
+        }
+        std::lock_guard lock(mutex);
+        if (free_list == nullptr)
+        {
+            // Reserved first, so a failure leaves the pool as it was.
+            chunks.reserve(chunks.size() + 1);
+            auto chunk = static_cast<std::byte*>(upstream->allocate(size * blocks_per_chunk, alignment));
+            chunks.push_back(chunk);
+            for (std::size_t i = blocks_per_chunk; i-- > 0;)
+            {
+                free_list = ::new (chunk + i * size) FreeBlock{ free_list };
+            }
+        }
+        auto result = free_list;
+        free_list = free_list->next;
+        ++live;
+        return result;
+    }
+
+    void BlockPool::do_deallocate(void* pointer, std::size_t bytes, std::size_t requested_alignment)
+    {
+        if (bytes > size || requested_alignment > alignment)
+        {
+            upstream->deallocate(pointer, bytes, requested_alignment);
+            return;
+        }
+        std::lock_guard lock(mutex);
+        free_list = ::new (pointer) FreeBlock{ free_list };
+        --live;
+    }
+}
@@ -0,0 +1,85 @@
+#include "frame_stats.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <stdexcept>
+
+namespace baas::frame_stats
+{
+    Summary summarize(std::span<const double> samples)
+    {
+        Summary summary{};
+        summary.count = samples.size();
+        if (samples.empty())
+        {
+            return summary;
+        }
+        std::vector<double> sorted(samples.begin(), samples.end());
+        std::sort(sorted.begin(), sorted.end());
+        auto percentile = [&sorted](double fraction)
+        {
+            auto rank = static_cast<std::size_t>(std::ceil(fraction * sorted.size()));
+            return sorted[std::clamp<std::size_t>(rank, 1, sorted.size()) - 1];
+        };
+        double sum{ 0.0 };
+        for (double sample : sorted)
+        {
+            sum += sample;
+        }
+        summary.mean = sum / sorted.size();
+        summary.p50 = percentile(0.50);
+        summary.p95 = percentile(0.95);
+        summary.p99 = percentile(0.99);
+        summary.max = sorted.back();
+        return summary;
+    }
+
+    FrameStats::FrameStats(std::size_t capacity)
+        : frames(capacity)
+    {
+        if (capacity == 0)
+        {
+            throw std::runtime_error("FrameStats needs room for at least one frame");
+        }
+    }
+
+    void FrameStats::add(const FrameTiming& timing)
+    {
+        frames[next] = timing;
+        next = (next + 1) % frames.size();
+        count = std::min(count + 1, frames.size());
+        ++total;
+    }
+
+    void FrameStats::clear()
+    {
+        next = 0;
+        count = 0;
+    }
+
+    Summary FrameStats::summarize(double FrameTiming::* field) const
+    {
+        std::vector<double> samples;
+        samples.reserve(count);
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            samples.push_back(frames[i].*field);
+        }
+        return frame_stats::summarize(samples);
+    }
+
+    std::string FrameStats::report() const
+    {
+        auto frame = summarize(&FrameTiming::frame_ms);
+        auto record = summarize(&FrameTiming::record_ms);
+        auto draw_record = summarize(&FrameTiming::draw_record_ms);
+        auto wait = summarize(&FrameTiming::wait_ms);
+        char line[320];
+        std::snprintf(line, sizeof(line),
+            "%zu frames, %.1f fps | frame p50 %.2f p99 %.2f ms | cpu record p50 %.2f p99 %.2f ms (draws p50 %.2f) | wait p50 %.2f p99 %.2f ms",
+            frame.count, frame.mean > 0.0 ? 1000.0 / frame.mean : 0.0, frame.p50, frame.p99, record.p50, record.p99,
+            draw_record.p50, wait.p50, wait.p99);
+        return line;
+    }
+}
@@ -1,16 +1,29 @@
 #include "game_engine.h"
 
 #include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
 #include <iterator>
 #include <vector>
 #include <cstdint>
+#include <cstring>
+#include <functional>
 #include <iostream>
+#include <limits>
 #include <optional>
 #include <set>
 #include <stdexcept>
 #include <string>
+#include <type_traits>
+#include <utility>
 
 #include "file_ops.h"
+#include "image_io.h"
+#include "job_system.h"
+#include "pipeline_cache.h"
+#include "profiler.h"
+#include "texture.h"
 
 namespace baas::game_engine
 {
@@ -25,17 +38,14 @@ namespace baas::game_engine
     struct QueueFamilyIndices {
         std::optional<uint32_t> graphicsFamily;
         std::optional<uint32_t> presentFamily;
+        // Prefers a transfer only family (the DMA engines on discrete GPUs), then any family without
+        // graphics, then the graphics family itself.
+        std::optional<uint32_t> transferFamily;
 
         bool isComplete() {
             return graphicsFamily.has_value() && presentFamily.has_value();
         }
     };
-    // Utility Struct to determine swap chain support
-    struct SwapChainSupportDetails {
-        vk::SurfaceCapabilitiesKHR capabilities;
-        std::vector<vk::SurfaceFormatKHR> formats;
-        std::vector<vk::PresentModeKHR> presentModes;
-    };
 
     const std::vector<const char*> validationLayers = {
         "VK_LAYER_KHRONOS_validation"
@@ -45,6 +55,11 @@ namespace baas::game_engine
         VK_KHR_SWAPCHAIN_EXTENSION_NAME
     };    
 
+    // Storage buffers in the GPU driven path's scene set.
+    constexpr uint32_t SCENE_BINDING_COUNT = 7;
+    // Starting size of each frame arena, one that runs out grows to fit at the next reset.
+    constexpr std::size_t FRAME_ARENA_BYTES = 64 * 1024;
+
     VKAPI_ATTR VkBool32 VKAPI_CALL debug_callback(VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity, VkDebugUtilsMessageTypeFlagsEXT messageType, const VkDebugUtilsMessengerCallbackDataEXT* pCallbackData, void* pUserData);
 
     void glfw_key_press_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
@@ -54,19 +69,214 @@ namespace baas::game_engine
             glfwSetWindowShouldClose(window, GLFW_TRUE);
 
         }
+        if (key == GLFW_KEY_V && action == GLFW_PRESS)
+        {
+            static_cast<GameEngine*>(glfwGetWindowUserPointer(window))->cycle_present_mode();
+        }
         
     }
 
-    std::vector<const char*> get_required_extensions();
+    const char* present_mode_name(vk::PresentModeKHR mode)
+    {
+        switch (mode)
+        {
+        case vk::PresentModeKHR::eMailbox:
+            return "mailbox";
+        case vk::PresentModeKHR::eImmediate:
+            return "immediate";
+        case vk::PresentModeKHR::eFifoRelaxed:
+            return "fifo relaxed";
+        default:
+            return "fifo";
+        }
+    }
+
+    std::vector<const char*> get_required_extensions(bool headless);
+
+    bool DeviceCapabilities::has_extension(std::string_view name) const
+    {
+        return std::any_of(extensions.begin(), extensions.end(), [name](const vk::ExtensionProperties& extension)
+            {
+                return std::string_view(extension.extensionName.data()) == name;
+            });
+    }
+
+    DeviceCapabilities query_capabilities(vk::PhysicalDevice physical_device, vk::SurfaceKHR surface)
+    {
+        DeviceCapabilities capabilities;
+        capabilities.physical_device = physical_device;
+        capabilities.properties = physical_device.getProperties();
+        capabilities.features = physical_device.getFeatures();
+        // The 1.2 features can only be asked of a 1.2 device.
+        if (capabilities.properties.apiVersion >= vk::ApiVersion12)
+        {
+            auto features = physical_device.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceVulkan12Features>();
+            capabilities.features12 = features.get<vk::PhysicalDeviceVulkan12Features>();
+            capabilities.features12.pNext = nullptr;
+        }
+        capabilities.queue_families = physical_device.getQueueFamilyProperties();
+        capabilities.extensions = physical_device.enumerateDeviceExtensionProperties();
+        for (uint32_t i = 0; i < capabilities.queue_families.size(); ++i)
+        {
+            // Nothing is presented in headless mode, the graphics queue stands in.
+            bool graphics = static_cast<bool>(capabilities.queue_families[i].queueFlags & vk::QueueFlagBits::eGraphics);
+            capabilities.present_support.push_back(surface ? physical_device.getSurfaceSupportKHR(i, surface) == vk::True : graphics);
+        }
+        if (surface)
+        {
+            capabilities.surface_capabilities = physical_device.getSurfaceCapabilitiesKHR(surface);
+            capabilities.surface_formats = physical_device.getSurfaceFormatsKHR(surface);
+            capabilities.present_modes = physical_device.getSurfacePresentModesKHR(surface);
+        }
+        return capabilities;
+    }
+
+    QueueFamilyIndices find_queue_families(const DeviceCapabilities& capabilities)
+    {
+        QueueFamilyIndices indicies;
+        int transfer_rank {0};
+        for (uint32_t i = 0; i < capabilities.queue_families.size(); ++i)
+        {
+            auto flags = capabilities.queue_families[i].queueFlags;
+            if (!indicies.graphicsFamily && flags & vk::QueueFlagBits::eGraphics)
+            {
+                indicies.graphicsFamily = i;
+            }
+            if (!indicies.presentFamily && capabilities.present_support[i])
+            {
+                indicies.presentFamily = i;
+            }
+
+            // Graphics and compute queues can always transfer even without the bit set.
+            int rank = !(flags & (vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute)) && (flags & vk::QueueFlagBits::eTransfer) ? 3
+                : (flags & vk::QueueFlagBits::eCompute) && !(flags & vk::QueueFlagBits::eGraphics) ? 2
+                : 0;
+            if (rank > transfer_rank)
+            {
+                indicies.transferFamily = i;
+                transfer_rank = rank;
+            }
+        }
+        if (!indicies.transferFamily)
+        {
+            indicies.transferFamily = indicies.graphicsFamily;
+        }
+        return indicies;
+    }
+
+    // Startup jobs all use the engine, so none of them may outlive the constructor, not even when it throws.
+    class StartupJobs
+    {
+    public:
+        StartupJobs() = default;
+        StartupJobs(const StartupJobs&) = delete;
+        StartupJobs& operator=(const StartupJobs&) = delete;
+        ~StartupJobs()
+        {
+            for (auto&& job : pending)
+            {
+                try
+                {
+                    job_system::shared().wait(job);
+                }
+                catch (...)
+                {
+                    // Only reached while the constructor is already throwing, that error is the one reported.
+                }
+            }
+        }
+
+        job_system::JobHandle run(std::function<void()> work)
+        {
+            pending.push_back(job_system::shared().run(std::move(work)));
+            return pending.back();
+        }
+
+        // Rethrows what the job threw.
+        void wait(const job_system::JobHandle& job)
+        {
+            job_system::shared().wait(job);
+        }
+
+    private:
+        std::vector<job_system::JobHandle> pending;
+    };
 
-    GameEngine::GameEngine()
+    GameEngine::GameEngine(const EngineConfig& config)
+        : config(config), startup_ns(profiler::now_ns())
     {
-        init_window();
-        init_vulkan();
+        auto& zones = profiler::Profiler::shared();
+        if (config.profile || !config.trace_path.empty())
+        {
+            zones.set_enabled(true);
+            zones.set_thread_name("main");
+        }
+        {
+            profiler::Zone zone("startup");
+            // Startup as a dependency graph on the job system:
+            //   parse model --------------------------------------------------------------------> upload model
+            //   window -> instance -> device -> swapchain settings -> swapchain, depth buffer -> framebuffers
+            //                                                      -> render pass, pipelines  -> framebuffers, upload model
+            //                                                      -> frame resources         -> material and instance resources
+            // Only this thread waits on jobs, so a worker never sits blocked on another job.
+            StartupJobs jobs;
+            auto parse = config.model_path.empty() ? job_system::JobHandle() : jobs.run([this] { parse_model(); });
+            if (!config.headless)
+            {
+                init_window();
+            }
+            create_instance();
+            select_physical_device();
+            create_device();
+            choose_swap_chain_settings();
+
+            // Shader files are read and turned into modules in the pipeline job, so they overlap with
+            // the swapchain.
+            auto swap_chain_job = jobs.run([this]
+                {
+                    if (config.headless)
+                    {
+                        create_offscreen_targets();
+                    }
+                    else
+                    {
+                        create_swap_chain();
+                    }
+                    create_depth_buffer();
+                });
+            auto pipeline_job = jobs.run([this]
+                {
+                    create_render_pass();
+                    create_pipelines();
+                });
+            auto frame_job = jobs.run([this] { create_frame_resources(); });
+            jobs.wait(swap_chain_job);
+            jobs.wait(pipeline_job);
+            create_framebuffers();
+            jobs.wait(frame_job);
+            create_material_resources();
+            create_instance_resources();
+            if (parse)
+            {
+                jobs.wait(parse);
+                upload_model();
+            }
+            start_watching();
+        }
+        zones.end_startup();
+        if (config.profile)
+        {
+            std::cout << zones.startup_report() << '\n';
+        }
     }
 
     GameEngine::~GameEngine()
     {   
+        // Frames may still be executing, everything below is destroyed by the Unique handles.
+        if (device)
+        {
+            device->waitIdle();
+        }
         if (window_enabled())
         {
             glfwDestroyWindow(window);
@@ -77,31 +287,37 @@ namespace baas::game_engine
 
     void GameEngine::init_window()
     {
+        profiler::Zone zone("init window");
         glfwInit();
         glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
         window = glfwCreateWindow(WIDTH, HEIGHT, "Vulkan Model Loader", nullptr, nullptr);
-        
+
         engine_state.set(engine_state_bit::WINDOW_BIT);
         glfwSetWindowUserPointer(window, this);
         glfwSetKeyCallback(window, glfw_key_press_callback);
-
-        // TODO Add Frame Buffer Size callback
+        // Called from glfwPollEvents on the render thread, the targets are recreated before the next frame.
+        glfwSetFramebufferSizeCallback(window, [](GLFWwindow* window, int, int)
+            {
+                static_cast<GameEngine*>(glfwGetWindowUserPointer(window))->framebuffer_resized = true;
+            });
     }
 
-    void GameEngine::init_vulkan()
+    void GameEngine::create_instance()
     {
+        profiler::Zone zone("create instance");
         // Create Instance
         vk::ApplicationInfo app_info{};
         app_info.pApplicationName = "Vulkan Model Loader";
         app_info.applicationVersion = vk::makeVersion(1, 0, 0);
         app_info.pEngineName = "Vulkan HPP";
         app_info.engineVersion = vk::makeVersion(1, 0, 0);
-        app_info.apiVersion = vk::ApiVersion10;
+        // 1.2 for timeline semaphores.
+        app_info.apiVersion = vk::ApiVersion12;
 
         vk::InstanceCreateInfo create_info{};
         create_info.pApplicationInfo = &app_info;
 
-        auto extensions = get_required_extensions();
+        auto extensions = get_required_extensions(config.headless);
         create_info.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
         create_info.ppEnabledExtensionNames = extensions.data();
 
@@ -134,116 +350,81 @@ namespace baas::game_engine
             auto message_type_flags = message_type_bits::eGeneral | message_type_bits::eValidation | message_type_bits::ePerformance;
 
             using DebugCreateInfo = vk::DebugUtilsMessengerCreateInfoEXT;
-            DebugCreateInfo debug_create_info = DebugCreateInfo({}, severity_flags, message_type_flags, debug_callback);
+            DebugCreateInfo debug_create_info = DebugCreateInfo({}, severity_flags, message_type_flags, debug_callback, &validation_error_count);
             // TODO: It seems that the function for creating the messenger is null causing seg fault. Find out why this is. 
             debug_messenger = vk_instance->createDebugUtilsMessengerEXTUnique(debug_create_info, nullptr, dynamic_dispatch_loader);
         }
 
         // Setup Surface 
-        VkSurfaceKHR surface_temp;
-        auto result = glfwCreateWindowSurface(*vk_instance, window, nullptr, &surface_temp);
-        if (result != VK_SUCCESS)
+        if (!config.headless)
         {
-            /* code */
-            throw std::runtime_error("Failed to create surface");
+            VkSurfaceKHR surface_temp;
+            auto result = glfwCreateWindowSurface(*vk_instance, window, nullptr, &surface_temp);
+            if (result != VK_SUCCESS)
+            {
+                /* code */
+                throw std::runtime_error("Failed to create surface");
+            }
+            surface = vk::UniqueSurfaceKHR(surface_temp, *vk_instance);
         }
-        surface = vk::UniqueSurfaceKHR(surface_temp, *vk_instance);
+    }
 
-        // Choose PhysicalDevice
+    void GameEngine::select_physical_device()
+    {
+        profiler::Zone zone("choose physical device");
+        // Every device is asked everything once, the devices in parallel, and the answers are kept for
+        // the rest of startup.
         auto physical_devices = vk_instance->enumeratePhysicalDevices();
-        auto find_queue_families = [this](vk::PhysicalDevice& physical_device)
-        {
-            // Check Queue Families
-            QueueFamilyIndices indicies;
-            auto queue_family_properties = physical_device.getQueueFamilyProperties();
-            uint32_t i {0};
-            for (auto &&queue_family : queue_family_properties)
+        std::vector<DeviceCapabilities> candidates(physical_devices.size());
+        job_system::shared().parallel_for(physical_devices.size(), [&](std::size_t begin, std::size_t end)
             {
-                if (queue_family.queueFlags & vk::QueueFlagBits::eGraphics)
+                for (std::size_t i = begin; i < end; ++i)
                 {
-                    indicies.graphicsFamily = i;
+                    candidates[i] = query_capabilities(physical_devices[i], surface ? *surface : vk::SurfaceKHR());
                 }
-                VkBool32 present_support = physical_device.getSurfaceSupportKHR(i, *this->surface);
-                if (present_support)
-                {
-                    indicies.presentFamily = i;
-                }
-
-                if (indicies.isComplete())
-                {
-                    break;
-                }
-                ++i;
-            }
-
-            return indicies;
-        };
+            }, 1);
 
-        auto all_device_ext_present = [](vk::PhysicalDevice& physical_device)
+        for (auto&& candidate : candidates)
         {
-            // Check extension support
-            auto available_extensions = physical_device.enumerateDeviceExtensionProperties();
-            const char* required_extensions = vk::KHRSwapchainExtensionName;
-            return std::any_of(available_extensions.begin(), available_extensions.end(), 
-            [](vk::ExtensionProperties& extension)
+            // Timeline semaphores are core in 1.2.
+            if (candidate.properties.apiVersion < vk::ApiVersion12 || candidate.features12.timelineSemaphore != vk::True)
             {
-                std::string extension_name = std::string(extension.extensionName.data());
-                std::string expected_ext = std::string(vk::KHRSwapchainExtensionName);
-                return expected_ext == extension_name;
-            });
-        };
-
-        auto get_swap_chain_support_info = [this](vk::PhysicalDevice& physical_device)
-        {
-            SwapChainSupportDetails details;
-            details.capabilities = physical_device.getSurfaceCapabilitiesKHR(*this->surface);
-            details.formats = physical_device.getSurfaceFormatsKHR(*this->surface);
-            details.presentModes = physical_device.getSurfacePresentModesKHR(*this->surface);
-            return details;
-        };
-
-        std::optional<vk::PhysicalDevice> chosen_device; // This is probably dumb TODO. Find a way to do this better
-        QueueFamilyIndices indicies;
-        SwapChainSupportDetails swap_chain_details;
-        for (auto &&tmp_physical_device : physical_devices)
-        {
-            indicies = find_queue_families(tmp_physical_device);
-            bool extensions_supported = all_device_ext_present(tmp_physical_device);
-            swap_chain_details = get_swap_chain_support_info(tmp_physical_device);
-            bool swap_chains_adequate = !swap_chain_details.formats.empty() && !swap_chain_details.presentModes.empty();
-            if (indicies.isComplete() && extensions_supported && swap_chains_adequate)
+                continue;
+            }
+            if (!find_queue_families(candidate).isComplete())
             {
-                chosen_device = tmp_physical_device;
-                break;
+                continue;
+            }
+            bool swap_chains_adequate = config.headless ||
+                (candidate.has_extension(vk::KHRSwapchainExtensionName) && !candidate.surface_formats.empty() && !candidate.present_modes.empty());
+            if (swap_chains_adequate)
+            {
+                device_caps = std::move(candidate);
+                physical_device = device_caps.physical_device;
+                return;
             }
         }
+        throw std::runtime_error("Failed to find a suitable GPU");
+    }
 
-        if (!chosen_device.has_value())
-        {
-            throw std::runtime_error("Failed to find a suitable GPU");
-        }
-        else
-        {
-            physical_device = chosen_device.value();
-        }
-
-        // Create Logical Device
+    void GameEngine::create_device()
+    {
+        profiler::Zone zone("create device");
+        auto indicies = find_queue_families(device_caps);
         std::vector<uint32_t> unique_queue_families;
-        if (indicies.graphicsFamily == indicies.presentFamily)
-        {
-            unique_queue_families.push_back(indicies.graphicsFamily.value());
-        }
-        else
+        for (auto&& family : { indicies.graphicsFamily.value(), indicies.presentFamily.value(), indicies.transferFamily.value() })
         {
-            unique_queue_families.push_back(indicies.graphicsFamily.value());
-            unique_queue_families.push_back(indicies.presentFamily.value());
+            if (std::find(unique_queue_families.begin(), unique_queue_families.end(), family) == unique_queue_families.end())
+            {
+                unique_queue_families.push_back(family);
+            }
         }
 
         std::vector<vk::DeviceQueueCreateInfo> queue_create_infos;
         float queue_priority = 1.0f;
         for (auto &&queue_family_index : unique_queue_families)
         {
-            // vk::DeviceQueueCreateInfo queue_create_info(vk::DeviceQueueCreateFlags(), queue_family_index, 1.0f); // This constructor didn't work. Why? 
+            // vk::DeviceQueueCreateInfo queue_create_info(vk::DeviceQueueCreateFlags(), queue_family_index, 1.0f); // This constructor didn't work. Why?
             vk::DeviceQueueCreateInfo queue_create_info(vk::DeviceQueueCreateFlags(),queue_family_index, 1, &queue_priority);
             queue_create_infos.push_back(queue_create_info);
         }
@@ -253,69 +434,153 @@ namespace baas::game_engine
         {
             std::copy(validationLayers.begin(), validationLayers.end(), std::back_inserter(enabled_layers));
         }
-        
-        vk::DeviceCreateInfo device_create_info(vk::DeviceCreateFlags(),queue_create_infos, enabled_layers, device_extensions); // TODO this might not be right
-        
-        device = physical_device.createDeviceUnique(device_create_info);
 
-        graphics_queue = device->getQueue(indicies.graphicsFamily.value(), 0);
-        present_queue = device->getQueue(indicies.presentFamily.value(), 0);
+        auto enabled_device_extensions = config.headless ? std::vector<const char*>() : device_extensions;
+        // Wireframe variants need fillModeNonSolid, they are skipped where it's missing.
+        auto& supported_core = device_caps.features;
+        wireframe_supported = supported_core.fillModeNonSolid == vk::True;
+        // The GPU driven path draws with vkCmdDrawIndexedIndirectCount and passes instance indices through firstInstance.
+        // Culling runs on the graphics queue, so that family has to do compute as well.
+        bool gpu_driven_supported = supported_core.multiDrawIndirect == vk::True && supported_core.drawIndirectFirstInstance == vk::True &&
+            device_caps.features12.drawIndirectCount == vk::True &&
+            (device_caps.queue_families[indicies.graphicsFamily.value()].queueFlags & vk::QueueFlagBits::eCompute);
+        gpu_driven = config.gpu_driven && gpu_driven_supported;
+        if (config.gpu_driven && !gpu_driven_supported)
+        {
+            std::cout << "Indirect count draws aren't supported by this device, recording draws on the CPU\n";
+        }
+        // Lets the GPU profiler read both clocks at once instead of timing a submit.
+        calibrated_timestamps = profiler::Profiler::enabled() && device_caps.has_extension(vk::EXTCalibratedTimestampsExtensionName);
+        if (calibrated_timestamps)
+        {
+            enabled_device_extensions.push_back(vk::EXTCalibratedTimestampsExtensionName);
+        }
+        // Optional texture features are enabled wherever they exist, device_caps.features then says what is on.
+        auto enabled_features = vk::PhysicalDeviceFeatures()
+            .setFillModeNonSolid(wireframe_supported ? vk::True : vk::False)
+            .setMultiDrawIndirect(gpu_driven ? vk::True : vk::False)
+            .setDrawIndirectFirstInstance(gpu_driven ? vk::True : vk::False)
+            .setTextureCompressionBC(supported_core.textureCompressionBC)
+            .setSamplerAnisotropy(supported_core.samplerAnisotropy)
+            .setShaderSampledImageArrayDynamicIndexing(supported_core.shaderSampledImageArrayDynamicIndexing);
+        vk::StructureChain<vk::DeviceCreateInfo, vk::PhysicalDeviceVulkan12Features> device_create_info(
+            vk::DeviceCreateInfo(vk::DeviceCreateFlags(), queue_create_infos, enabled_layers, enabled_device_extensions, &enabled_features), // TODO this might not be right
+            vk::PhysicalDeviceVulkan12Features().setTimelineSemaphore(vk::True).setDrawIndirectCount(gpu_driven ? vk::True : vk::False));
+
+        device = physical_device.createDeviceUnique(device_create_info.get<vk::DeviceCreateInfo>());
+        allocator = std::make_unique<gpu_allocator::GpuAllocator>(physical_device, *device);
+
+        graphics_family = indicies.graphicsFamily.value();
+        present_family = indicies.presentFamily.value();
+        transfer_family = indicies.transferFamily.value();
+        graphics_queue = device->getQueue(graphics_family, 0);
+        present_queue = device->getQueue(present_family, 0);
+        transfer_queue = device->getQueue(transfer_family, 0);
+        // A shared queue needs its submissions serialized with the render thread's.
+        uploads = std::make_unique<upload_service::UploadService>(*device, *allocator, transfer_queue, transfer_family,
+            transfer_family == graphics_family || transfer_family == present_family ? &queue_mutex : nullptr);
+        std::cout << "Uploading on queue family " << transfer_family
+                  << (transfer_family == graphics_family ? " (shared with graphics)\n" : " (dedicated)\n");
+    }
 
-        // Create Swap Chains
-        vk::Format chosen_format;
-        vk::ColorSpaceKHR chosen_color_space;
-        for (auto &&available_format : swap_chain_details.formats)
+    void GameEngine::choose_swap_chain_settings()
+    {
+        // Everything the render pass and pipelines need to know about the targets, picked up front so
+        // they can be created alongside the swapchain. Stays on the main thread for glfwGetFramebufferSize.
+        depth_format = vk::Format::eUndefined;
+        for (auto candidate : { vk::Format::eD32Sfloat, vk::Format::eD16Unorm })
         {
-            if (available_format.format == vk::Format::eB8G8R8A8Srgb && available_format.colorSpace == vk::ColorSpaceKHR::eVkColorspaceSrgbNonlinear)
+            auto properties = physical_device.getFormatProperties(candidate);
+            if (properties.optimalTilingFeatures & vk::FormatFeatureFlagBits::eDepthStencilAttachment)
             {
-                chosen_format = available_format.format;
-                chosen_color_space = available_format.colorSpace;
+                depth_format = candidate;
                 break;
             }
         }
+        if (depth_format == vk::Format::eUndefined)
+        {
+            throw std::runtime_error("No supported depth format");
+        }
+
+        if (config.headless)
+        {
+            // RGBA8 so save_frame can copy the pixels out as they are.
+            swap_chain_format = vk::Format::eR8G8B8A8Unorm;
+            swap_chain_extent = vk::Extent2D(config.width, config.height);
+            return;
+        }
 
-        vk::PresentModeKHR chosen_present_mode{vk::PresentModeKHR::eFifo}; // Fallback to fifo if mailbox doesn't exist.
-        for (auto &&present_mode : swap_chain_details.presentModes)
+        // Fall back to whatever comes first, lavapipe and some Wayland compositors don't offer B8G8R8A8 sRGB.
+        swap_chain_format = device_caps.surface_formats.front().format;
+        swap_chain_color_space = device_caps.surface_formats.front().colorSpace;
+        for (auto &&available_format : device_caps.surface_formats)
         {
-            if (present_mode == vk::PresentModeKHR::eMailbox)
+            if (available_format.format == vk::Format::eB8G8R8A8Srgb && available_format.colorSpace == vk::ColorSpaceKHR::eVkColorspaceSrgbNonlinear)
             {
-                chosen_present_mode = present_mode;
+                swap_chain_format = available_format.format;
+                swap_chain_color_space = available_format.colorSpace;
                 break;
             }
         }
 
-        vk::Extent2D chosen_extent;
-        if (swap_chain_details.capabilities.currentExtent.width != std::numeric_limits<uint32_t>::max())
+        auto wanted_mode = config.present_mode.value_or(vk::PresentModeKHR::eMailbox);
+        present_mode = vk::PresentModeKHR::eFifo; // Fallback to fifo if the wanted mode doesn't exist.
+        for (auto &&available_mode : device_caps.present_modes)
         {
-            chosen_extent = swap_chain_details.capabilities.currentExtent;
+            if (available_mode == wanted_mode)
+            {
+                present_mode = available_mode;
+                break;
+            }
         }
-        else
+        if (config.present_mode && present_mode != *config.present_mode)
         {
-            int width;
-            int height;
-            auto capabilities = swap_chain_details.capabilities; // temp declaration here for simpler referencing.
-            glfwGetFramebufferSize(window, &width, &height);
+            std::cout << "The surface has no " << present_mode_name(*config.present_mode) << " present mode, using fifo\n";
+        }
+
+        swap_chain_extent = choose_extent();
+    }
 
-            chosen_extent = vk::Extent2D(static_cast<uint32_t>(width), static_cast<uint32_t>(height));
-            chosen_extent.width = std::clamp(chosen_extent.width, capabilities.minImageExtent.width, capabilities.maxImageExtent.width);
-            chosen_extent.height = std::clamp(chosen_extent.height, capabilities.minImageExtent.height, capabilities.maxImageExtent.height);
+    vk::Extent2D GameEngine::choose_extent() const
+    {
+        auto& capabilities = device_caps.surface_capabilities;
+        if (capabilities.currentExtent.width != std::numeric_limits<uint32_t>::max())
+        {
+            return capabilities.currentExtent;
+        }
+        int width;
+        int height;
+        glfwGetFramebufferSize(window, &width, &height);
+        if (width == 0 || height == 0)
+        {
+            return vk::Extent2D(0, 0);
         }
 
-        uint32_t image_count = swap_chain_details.capabilities.minImageCount + 1;
-        if (swap_chain_details.capabilities.maxImageCount > 0 && image_count > swap_chain_details.capabilities.maxImageCount) {
-            image_count = swap_chain_details.capabilities.maxImageCount;
+        auto extent = vk::Extent2D(static_cast<uint32_t>(width), static_cast<uint32_t>(height));
+        extent.width = std::clamp(extent.width, capabilities.minImageExtent.width, capabilities.maxImageExtent.width);
+        extent.height = std::clamp(extent.height, capabilities.minImageExtent.height, capabilities.maxImageExtent.height);
+        return extent;
+    }
+
+    void GameEngine::create_swap_chain(vk::SwapchainKHR old_swap_chain)
+    {
+        profiler::Zone zone("create swapchain");
+        auto& capabilities = device_caps.surface_capabilities;
+        uint32_t image_count = capabilities.minImageCount + 1;
+        if (capabilities.maxImageCount > 0 && image_count > capabilities.maxImageCount) {
+            image_count = capabilities.maxImageCount;
         }
-        
+
         vk::ImageUsageFlags image_usage_flags(vk::ImageUsageFlagBits::eColorAttachment);
-        std::vector<uint32_t> swap_info_queue_indicies{indicies.graphicsFamily.value(), indicies.presentFamily.value()};
-        
+        std::vector<uint32_t> swap_info_queue_indicies{ graphics_family, present_family };
+
         vk::SwapchainCreateFlagsKHR swap_flags{};
         uint32_t image_array_layers{1};
-        vk::SwapchainCreateInfoKHR swap_chain_info(swap_flags, surface.get(), image_count, chosen_format, chosen_color_space, chosen_extent, image_array_layers, image_usage_flags, vk::SharingMode::eExclusive, swap_info_queue_indicies, vk::SurfaceTransformFlagBitsKHR::eIdentity, vk::CompositeAlphaFlagBitsKHR::eOpaque, chosen_present_mode, true, nullptr);
-        
+        vk::SwapchainCreateInfoKHR swap_chain_info(swap_flags, surface.get(), image_count, swap_chain_format, swap_chain_color_space, swap_chain_extent, image_array_layers, image_usage_flags, vk::SharingMode::eExclusive, swap_info_queue_indicies, vk::SurfaceTransformFlagBitsKHR::eIdentity, vk::CompositeAlphaFlagBitsKHR::eOpaque, present_mode, true, old_swap_chain);
+
         swap_chain = device->createSwapchainKHRUnique(swap_chain_info);
         swap_chain_images = device->getSwapchainImagesKHR(swap_chain.get());
-        
+
         // Create ImageViews
         image_views.reserve(swap_chain_images.size());
         for (auto &&image : swap_chain_images)
@@ -323,55 +588,319 @@ namespace baas::game_engine
             vk::ImageViewType image_view_type = vk::ImageViewType::e2D;
             vk::ComponentMapping component_mapping{vk::ComponentSwizzle::eR, vk::ComponentSwizzle::eG, vk::ComponentSwizzle::eB, vk::ComponentSwizzle::eA};
             vk::ImageSubresourceRange sub_resource_range{ vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1 };
-            vk::ImageViewCreateInfo image_view_create_info(vk::ImageViewCreateFlags(), image, image_view_type, chosen_format, component_mapping, sub_resource_range);
+            vk::ImageViewCreateInfo image_view_create_info(vk::ImageViewCreateFlags(), image, image_view_type, swap_chain_format, component_mapping, sub_resource_range);
             image_views.push_back(device->createImageViewUnique(image_view_create_info));
         }
+    }
+
+    void GameEngine::create_depth_buffer()
+    {
+        profiler::Zone zone("create depth buffer");
+        auto depth_image_info = vk::ImageCreateInfo({}, vk::ImageType::e2D, depth_format, vk::Extent3D(swap_chain_extent, 1), 1, 1, vk::SampleCountFlagBits::e1, vk::ImageTiling::eOptimal, vk::ImageUsageFlagBits::eDepthStencilAttachment);
+        depth_image = gpu_allocator::Image(*allocator, depth_image_info, vk::MemoryPropertyFlagBits::eDeviceLocal);
+        auto depth_range = vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eDepth, 0, 1, 0, 1);
+        depth_view = device->createImageViewUnique(vk::ImageViewCreateInfo({}, depth_image.get(), vk::ImageViewType::e2D, depth_format, {}, depth_range));
+    }
 
-        // Create Render Pass
+    void GameEngine::create_render_pass()
+    {
+        profiler::Zone zone("create render pass");
         auto samples = vk::SampleCountFlagBits::e1;
         auto load_op = vk::AttachmentLoadOp::eClear;
         auto store_op = vk::AttachmentStoreOp::eStore;
         auto stencil_load_op = vk::AttachmentLoadOp::eDontCare;
         auto stencil_store_op = vk::AttachmentStoreOp::eDontCare;
         auto init_layout = vk::ImageLayout::eUndefined;
-        auto final_layout = vk::ImageLayout::ePresentSrcKHR;
-        auto color_attachment = vk::AttachmentDescription(vk::AttachmentDescriptionFlags(), chosen_format, samples, load_op, store_op, stencil_load_op, stencil_store_op, init_layout, final_layout);
+        // Headless targets are left ready for the readback copy in save_frame.
+        auto final_layout = config.headless ? vk::ImageLayout::eTransferSrcOptimal : vk::ImageLayout::ePresentSrcKHR;
+        auto color_attachment = vk::AttachmentDescription(vk::AttachmentDescriptionFlags(), swap_chain_format, samples, load_op, store_op, stencil_load_op, stencil_store_op, init_layout, final_layout);
         auto color_attachment_ref = vk::AttachmentReference(0U, vk::ImageLayout::eColorAttachmentOptimal);
+        auto depth_attachment = vk::AttachmentDescription(vk::AttachmentDescriptionFlags(), depth_format, samples, load_op, vk::AttachmentStoreOp::eDontCare, stencil_load_op, stencil_store_op, init_layout, vk::ImageLayout::eDepthStencilAttachmentOptimal);
+        auto depth_attachment_ref = vk::AttachmentReference(1U, vk::ImageLayout::eDepthStencilAttachmentOptimal);
+        std::array<vk::AttachmentDescription, 2> attachments{ color_attachment, depth_attachment };
 
         auto pipeline_bind_point = vk::PipelineBindPoint::eGraphics;
-        auto subpass_desc = vk::SubpassDescription(vk::SubpassDescriptionFlags(), pipeline_bind_point, 0U, nullptr, 1U, &color_attachment_ref);
-
-        auto pipeline_stage_flags= vk::PipelineStageFlags(vk::PipelineStageFlagBits::eColorAttachmentOutput);
-        auto src_access_flags = vk::AccessFlags();
-        auto dest_access_flags = vk::AccessFlags(vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite);
+        auto subpass_desc = vk::SubpassDescription(vk::SubpassDescriptionFlags(), pipeline_bind_point, 0U, nullptr, 1U, &color_attachment_ref, nullptr, &depth_attachment_ref);
+
+        // The single depth image is shared by every frame in flight, so the previous frame's depth
+        // writes have to finish before this one clears it.
+        using psf = vk::PipelineStageFlagBits;
+        auto pipeline_stage_flags= vk::PipelineStageFlags(psf::eColorAttachmentOutput | psf::eEarlyFragmentTests | psf::eLateFragmentTests);
+        auto src_access_flags = vk::AccessFlags(vk::AccessFlagBits::eDepthStencilAttachmentWrite);
+        auto dest_access_flags = vk::AccessFlags(vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite | vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite);
         auto subpass_dependency = vk::SubpassDependency(VK_SUBPASS_EXTERNAL, 0U, pipeline_stage_flags, pipeline_stage_flags, src_access_flags, dest_access_flags);
 
-        auto render_pass_create_info = vk::RenderPassCreateInfo(vk::RenderPassCreateFlags(), 1U, &color_attachment, 1U, &subpass_desc, 1U, &subpass_dependency);
+        auto render_pass_create_info = vk::RenderPassCreateInfo(vk::RenderPassCreateFlags(), static_cast<uint32_t>(attachments.size()), attachments.data(), 1U, &subpass_desc, 1U, &subpass_dependency);
         render_pass = device->createRenderPassUnique(render_pass_create_info);
+    }
+
+    void GameEngine::create_framebuffers()
+    {
+        profiler::Zone zone("create framebuffers");
+        framebuffers.reserve(image_views.size());
+        for (auto&& image_view : image_views)
+        {
+            std::array<vk::ImageView, 2> framebuffer_attachments{ *image_view, *depth_view };
+            framebuffers.push_back(device->createFramebufferUnique(vk::FramebufferCreateInfo({}, *render_pass, framebuffer_attachments, swap_chain_extent.width, swap_chain_extent.height, 1)));
+        }
+        // The rest of what is kept per swapchain image.
+        for (std::size_t i = 0; i < swap_chain_images.size() && !config.headless; ++i)
+        {
+            render_finished.push_back(device->createSemaphoreUnique(vk::SemaphoreCreateInfo()));
+        }
+        images_in_flight.assign(swap_chain_images.size(), vk::Fence());
+    }
 
-        // Create Graphics Pipeline
-        auto vertex_shader_code = file_ops::read_shader_code("shaders/vert.spv");
-        auto frag_shader_code = file_ops::read_shader_code("shaders/frag.spv");
+    bool GameEngine::recreate_targets()
+    {
+        profiler::Zone zone("recreate targets");
+        auto start_ns = profiler::now_ns();
+        vk::Extent2D extent = swap_chain_extent;
+        if (config.headless)
+        {
+            extent = requested_extent.value_or(extent);
+            if (extent.width == 0 || extent.height == 0)
+            {
+                // Stands in for a minimized window, frames are skipped until the next resize.
+                return false;
+            }
+        }
+        else
+        {
+            device_caps.surface_capabilities = physical_device.getSurfaceCapabilitiesKHR(*surface);
+            extent = choose_extent();
+            if (extent.width == 0 || extent.height == 0)
+            {
+                // Nothing can be presented to a minimized window, the flag stays so it's retried.
+                return false;
+            }
+        }
+        framebuffer_resized = false;
+        requested_extent.reset();
+        if (requested_present_mode)
+        {
+            present_mode = *requested_present_mode;
+            requested_present_mode.reset();
+        }
 
-        auto vertex_shader_module_create_info = vk::ShaderModuleCreateInfo(vk::ShaderModuleCreateFlags(), vertex_shader_code);
-        auto vertex_shader_module = device->createShaderModuleUnique(vertex_shader_module_create_info);
-        auto vertex_shader_stage_info = vk::PipelineShaderStageCreateInfo(vk::PipelineShaderStageCreateFlags(), vk::ShaderStageFlagBits::eVertex, vertex_shader_module.get(), "main");
+        // The render pass and pipelines only depend on the formats, which stay the same.
+        RetiredTargets retired{ std::move(swap_chain), std::move(image_views), std::move(offscreen_images), std::move(depth_image),
+            std::move(depth_view), std::move(framebuffers), std::move(render_finished), frame_number };
+        image_views.clear();
+        offscreen_images.clear();
+        framebuffers.clear();
+        render_finished.clear();
+        swap_chain_images.clear();
+        last_image_index.reset();
+        swap_chain_extent = extent;
+        if (config.headless)
+        {
+            create_offscreen_targets();
+        }
+        else
+        {
+            // The old swapchain can still finish presenting what was queued on it.
+            create_swap_chain(*retired.swap_chain);
+        }
+        create_depth_buffer();
+        create_framebuffers();
+        retired_targets.push_back(std::move(retired));
+        if (window_enabled())
+        {
+            auto title = std::string("Vulkan Model Loader (") + present_mode_name(present_mode) + ", V to switch)";
+            glfwSetWindowTitle(window, title.c_str());
+            std::cout << "Recreated the swapchain at " << extent.width << 'x' << extent.height << " (" << present_mode_name(present_mode) << ") in "
+                      << (profiler::now_ns() - start_ns) / 1e6 << " ms, " << retired_targets.size() << " old target sets wait for their frames\n";
+        }
+        return true;
+    }
+
+    void GameEngine::release_retired()
+    {
+        // Every frame submitted before the targets were retired is at least frames_in_flight frames old,
+        // so its fence has been waited on.
+        while (!retired_targets.empty() && retired_targets.front().frame + frames.size() <= frame_number)
+        {
+            retired_targets.pop_front();
+        }
+        // A reloaded model's old buffers and images may also still be the destination of a copy, the
+        // streamer's jobs can record theirs after the flush that was kept.
+        while (!retired_resources.empty() && retired_resources.front().frame + frames.size() <= frame_number &&
+            (!retired_resources.front().uploads || retired_resources.front().uploads.ready()) &&
+            (!retired_resources.front().textures || retired_resources.front().textures->idle()))
+        {
+            retired_resources.pop_front();
+        }
+    }
+
+    void GameEngine::resize(uint32_t width, uint32_t height)
+    {
+        if (!config.headless)
+        {
+            throw std::runtime_error("Only headless targets are resized explicitly, windows follow their framebuffer");
+        }
+        requested_extent = vk::Extent2D(width, height);
+    }
+
+    void GameEngine::cycle_present_mode()
+    {
+        std::array<vk::PresentModeKHR, 3> order{ vk::PresentModeKHR::eFifo, vk::PresentModeKHR::eMailbox, vk::PresentModeKHR::eImmediate };
+        auto current = requested_present_mode.value_or(present_mode);
+        auto position = std::find(order.begin(), order.end(), current) - order.begin();
+        for (std::size_t step = 1; step <= order.size(); ++step)
+        {
+            auto candidate = order[(position + step) % order.size()];
+            if (std::find(device_caps.present_modes.begin(), device_caps.present_modes.end(), candidate) != device_caps.present_modes.end())
+            {
+                set_present_mode(candidate);
+                return;
+            }
+        }
+    }
+
+    void GameEngine::set_present_mode(vk::PresentModeKHR mode)
+    {
+        if (config.headless)
+        {
+            return;
+        }
+        if (std::find(device_caps.present_modes.begin(), device_caps.present_modes.end(), mode) == device_caps.present_modes.end())
+        {
+            std::cout << "The surface has no " << present_mode_name(mode) << " present mode, using fifo\n";
+            mode = vk::PresentModeKHR::eFifo;
+        }
+        if (mode != present_mode)
+        {
+            requested_present_mode = mode;
+        }
+    }
+
+    void GameEngine::create_pipelines()
+    {
+        profiler::Zone zone("create pipelines");
+        using Clock = std::chrono::steady_clock;
+        auto pipeline_start = Clock::now();
+        pipeline_disk_cache = std::make_unique<pipeline_cache::PipelineCache>(physical_device, *device, config.pipeline_cache_path);
+
+        // Each shader is read and turned into a module as its own job. The modules are kept, a hot reload
+        // only replaces the one that changed.
+        shader_paths = { std::string(gpu_driven ? EngineVertex::indirect_vertex_shader : EngineVertex::vertex_shader), "shaders/frag.spv" };
+        if (gpu_driven)
+        {
+            shader_paths.push_back("shaders/cull.spv");
+        }
+        if (gpu_driven && config.meshlets)
+        {
+            shader_paths.push_back("shaders/cull_meshlets.spv");
+        }
+        shader_modules.resize(shader_paths.size());
+        job_system::shared().parallel_for(shader_paths.size(), [&](std::size_t begin, std::size_t end)
+            {
+                for (std::size_t i = begin; i < end; ++i)
+                {
+                    shader_modules[i] = load_shader(shader_paths[i]);
+                }
+            }, 1);
+
+        std::vector<vk::DescriptorSetLayout> set_layouts;
+        if (gpu_driven)
+        {
+            using sf = vk::ShaderStageFlagBits;
+            std::array<vk::DescriptorSetLayoutBinding, SCENE_BINDING_COUNT> scene_bindings{
+                vk::DescriptorSetLayoutBinding(0, vk::DescriptorType::eStorageBuffer, 1, sf::eVertex | sf::eCompute),
+                vk::DescriptorSetLayoutBinding(1, vk::DescriptorType::eStorageBuffer, 1, sf::eCompute),
+                vk::DescriptorSetLayoutBinding(2, vk::DescriptorType::eStorageBuffer, 1, sf::eCompute),
+                vk::DescriptorSetLayoutBinding(3, vk::DescriptorType::eStorageBuffer, 1, sf::eCompute),
+                vk::DescriptorSetLayoutBinding(4, vk::DescriptorType::eStorageBuffer, 1, sf::eCompute),
+                vk::DescriptorSetLayoutBinding(5, vk::DescriptorType::eStorageBuffer, 1, sf::eCompute),
+                vk::DescriptorSetLayoutBinding(6, vk::DescriptorType::eStorageBuffer, 1, sf::eVertex | sf::eCompute) };
+            scene_set_layout = device->createDescriptorSetLayoutUnique(vk::DescriptorSetLayoutCreateInfo({}, scene_bindings));
+            set_layouts.push_back(*scene_set_layout);
+            allocate_scene_set();
+
+            auto cull_push_range = vk::PushConstantRange(sf::eCompute, 0, sizeof(CullPushConstants));
+            cull_layout = device->createPipelineLayoutUnique(vk::PipelineLayoutCreateInfo({}, set_layouts, cull_push_range));
+            cull_pipeline = create_cull_pipeline(*shader_modules[2]);
+            if (shader_modules.size() > 3)
+            {
+                meshlet_cull_pipeline = create_cull_pipeline(*shader_modules[3]);
+            }
+        }
+        else
+        {
+            auto instance_binding = vk::DescriptorSetLayoutBinding(0, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eVertex);
+            instance_set_layout = device->createDescriptorSetLayoutUnique(vk::DescriptorSetLayoutCreateInfo({}, instance_binding));
+            set_layouts.push_back(*instance_set_layout);
+        }
+        // Every slot of the texture array is always written, unused ones with the default texture.
+        std::array<vk::DescriptorSetLayoutBinding, 2> material_bindings{
+            vk::DescriptorSetLayoutBinding(0, vk::DescriptorType::eCombinedImageSampler, MAX_TEXTURES, vk::ShaderStageFlagBits::eFragment),
+            vk::DescriptorSetLayoutBinding(1, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eFragment) };
+        material_set_layout = device->createDescriptorSetLayoutUnique(vk::DescriptorSetLayoutCreateInfo({}, material_bindings));
+        set_layouts.push_back(*material_set_layout);
+        auto push_constant_range = vk::PushConstantRange(vk::ShaderStageFlagBits::eVertex, 0, sizeof(PushConstants));
+        pipeline_layout = device->createPipelineLayoutUnique(vk::PipelineLayoutCreateInfo({}, set_layouts, push_constant_range));
+
+        pipelines = create_graphics_pipelines();
+        auto compiled = std::count_if(pipelines.begin(), pipelines.end(), [](const vk::UniquePipeline& pipeline) { return bool(pipeline); });
+        auto pipeline_ms = std::chrono::duration<double, std::milli>(Clock::now() - pipeline_start).count();
+        std::cout << "Compiled " << compiled << " pipelines in " << pipeline_ms << " ms with a "
+                  << (pipeline_disk_cache->warm() ? "warm" : "cold") << " pipeline cache";
+        if (pipeline_disk_cache->warm())
+        {
+            std::cout << " (" << pipeline_disk_cache->loaded_bytes() / 1024 << " KiB)";
+        }
+        else if (!pipeline_disk_cache->rejected_reason().empty())
+        {
+            std::cout << " (" << config.pipeline_cache_path << " was " << pipeline_disk_cache->rejected_reason() << ")";
+        }
+        std::cout << '\n';
+        pipeline_disk_cache->save();
+
+        if (config.wireframe && !wireframe_supported)
+        {
+            std::cout << "Wireframe isn't supported by this device, drawing filled\n";
+        }
+        pipeline_variant = (config.wireframe && wireframe_supported ? PIPELINE_WIREFRAME : 0) | (config.double_sided ? PIPELINE_DOUBLE_SIDED : 0);
+        graphics_pipeline = *pipelines[pipeline_variant];
+    }
+
+    vk::UniqueShaderModule GameEngine::load_shader(std::string_view path) const
+    {
+        profiler::Zone zone("load shader");
+        // A file caught halfway through being written fails here rather than in the driver.
+        constexpr uint32_t SPIRV_MAGIC = 0x07230203;
+        auto shader_file = file_ops::map_file(path);
+        auto shader_code = shader_file.words();
+        if (shader_code.size() < 5 || shader_code[0] != SPIRV_MAGIC)
+        {
+            throw std::runtime_error("Not a SPIR-V module: " + std::string(path));
+        }
+        // The mapping only needs to outlive the createShaderModule call.
+        return device->createShaderModuleUnique(vk::ShaderModuleCreateInfo(vk::ShaderModuleCreateFlags(), shader_code.size_bytes(), shader_code.data()));
+    }
 
-        auto frag_shader_create_info = vk::ShaderModuleCreateInfo(vk::ShaderModuleCreateFlags(), frag_shader_code);
-        auto frag_shader_module = device->createShaderModuleUnique(frag_shader_create_info);
+    std::array<vk::UniquePipeline, PIPELINE_VARIANT_COUNT> GameEngine::create_graphics_pipelines() const
+    {
+        auto& vertex_shader_module = shader_modules[0];
+        auto& frag_shader_module = shader_modules[1];
+        auto vertex_shader_stage_info = vk::PipelineShaderStageCreateInfo(vk::PipelineShaderStageCreateFlags(), vk::ShaderStageFlagBits::eVertex, vertex_shader_module.get(), "main");
         auto frag_shader_stage_info = vk::PipelineShaderStageCreateInfo(vk::PipelineShaderStageCreateFlags(), vk::ShaderStageFlagBits::eFragment, frag_shader_module.get(), "main");
 
         std::vector<vk::PipelineShaderStageCreateInfo> shader_stages{vertex_shader_stage_info, frag_shader_stage_info};
 
-        auto vertex_input_create_info = vk::PipelineVertexInputStateCreateInfo(vk::PipelineVertexInputStateCreateFlags(), 0, nullptr, 0, nullptr);
+        constexpr auto vertex_binding = EngineVertex::binding_description();
+        constexpr auto vertex_attributes = EngineVertex::attribute_descriptions();
+        auto vertex_input_create_info = vk::PipelineVertexInputStateCreateInfo(vk::PipelineVertexInputStateCreateFlags(), vertex_binding, vertex_attributes);
 
         auto topology = vk::PrimitiveTopology::eTriangleList;
         auto input_assembly_create_info = vk::PipelineInputAssemblyStateCreateInfo(vk::PipelineInputAssemblyStateCreateFlags(), topology, vk::False);
 
 
-        // TODO Idk why I'm explicitly defining viewport and scissor here. EDIT I apparently need them later 
-        auto viewport = vk::Viewport{ 0.0f, 0.0f, static_cast<float>(WIDTH), static_cast<float>(HEIGHT), 0.0f, 1.0f };
-        auto scissor = vk::Rect2D{ { 0, 0 }, chosen_extent };
+        // Both are dynamic state and set from swap_chain_extent when recording, so a resize doesn't need
+        // new pipelines. The values here only count them.
+        auto viewport = vk::Viewport{ 0.0f, 0.0f, static_cast<float>(swap_chain_extent.width), static_cast<float>(swap_chain_extent.height), 0.0f, 1.0f };
+        auto scissor = vk::Rect2D{ { 0, 0 }, swap_chain_extent };
         auto viewport_create_info = vk::PipelineViewportStateCreateInfo({}, viewport, scissor);
 
         auto rasterizer_state_flags = vk::PipelineRasterizationStateCreateFlags();
@@ -380,10 +909,18 @@ namespace baas::game_engine
         auto polygon_mode = vk::PolygonMode::eFill;
         float line_width = 1.0f;
         auto cull_mode = vk::CullModeFlagBits::eBack;
-        auto front_face = vk::FrontFace::eClockwise;
+        // transform::perspective flips y, which keeps the OBJ convention of counter clockwise front faces.
+        auto front_face = vk::FrontFace::eCounterClockwise;
         vk::Bool32 depth_bias_enabled = vk::False;
-        auto rasterizer_create_info = vk::PipelineRasterizationStateCreateInfo(rasterizer_state_flags, depth_clamp_enable, rasterizer_discard_enable, polygon_mode, cull_mode, front_face, depth_bias_enabled);
-        rasterizer_create_info.setLineWidth(line_width);
+        // One rasterizer state per variant, indexed like pipelines.
+        std::array<vk::PipelineRasterizationStateCreateInfo, PIPELINE_VARIANT_COUNT> rasterizer_create_infos;
+        for (uint32_t variant = 0; variant < PIPELINE_VARIANT_COUNT; ++variant)
+        {
+            auto variant_polygon_mode = variant & PIPELINE_WIREFRAME ? vk::PolygonMode::eLine : polygon_mode;
+            auto variant_cull_mode = variant & PIPELINE_DOUBLE_SIDED ? vk::CullModeFlagBits::eNone : cull_mode;
+            rasterizer_create_infos[variant] = vk::PipelineRasterizationStateCreateInfo(rasterizer_state_flags, depth_clamp_enable, rasterizer_discard_enable, variant_polygon_mode, variant_cull_mode, front_face, depth_bias_enabled);
+            rasterizer_create_infos[variant].setLineWidth(line_width);
+        }
 
 
         using cfb = vk::ColorComponentFlagBits;
@@ -399,26 +936,1274 @@ namespace baas::game_engine
         std::vector<vk::DynamicState> dynamic_states {vk::DynamicState::eViewport, vk::DynamicState::eScissor};
         auto dynamic_state_create_info = vk::PipelineDynamicStateCreateInfo({}, dynamic_states);
 
-        pipeline_layout = device->createPipelineLayoutUnique(vk::PipelineLayoutCreateInfo({}, {}, {}));
-
-
-    }
+        auto multisample_create_info = vk::PipelineMultisampleStateCreateInfo({}, vk::SampleCountFlagBits::e1);
+        auto depth_stencil_create_info = vk::PipelineDepthStencilStateCreateInfo({}, vk::True, vk::True, vk::CompareOp::eLess);
 
-    void GameEngine::main_loop()
-    {
-        while (!glfwWindowShouldClose(window))
+        std::vector<vk::GraphicsPipelineCreateInfo> pipeline_create_infos;
+        std::vector<uint32_t> pipeline_variants;
+        for (uint32_t variant = 0; variant < PIPELINE_VARIANT_COUNT; ++variant)
+        {
+            if ((variant & PIPELINE_WIREFRAME) && !wireframe_supported)
+            {
+                continue;
+            }
+            pipeline_variants.push_back(variant);
+            pipeline_create_infos.push_back(vk::GraphicsPipelineCreateInfo({}, shader_stages, &vertex_input_create_info, &input_assembly_create_info, nullptr, &viewport_create_info, &rasterizer_create_infos[variant], &multisample_create_info, &depth_stencil_create_info, &color_blending, &dynamic_state_create_info, *pipeline_layout, *render_pass, 0));
+        }
+        auto compiled = pipeline_cache::create_graphics_pipelines(*device, pipeline_disk_cache->get(), pipeline_create_infos);
+        std::array<vk::UniquePipeline, PIPELINE_VARIANT_COUNT> result;
+        for (std::size_t i = 0; i < compiled.size(); ++i)
         {
-            glfwPollEvents();
+            result[pipeline_variants[i]] = std::move(compiled[i]);
         }
-        
+        return result;
     }
 
-    std::vector<const char*> get_required_extensions()
+    vk::UniquePipeline GameEngine::create_cull_pipeline(vk::ShaderModule module) const
     {
-        uint32_t glfw_ext_count{0};
-        const char** glfw_ext = glfwGetRequiredInstanceExtensions(&glfw_ext_count);
+        auto stage = vk::PipelineShaderStageCreateInfo({}, vk::ShaderStageFlagBits::eCompute, module, "main");
+        return device->createComputePipelineUnique(pipeline_disk_cache->get(), vk::ComputePipelineCreateInfo({}, stage, *cull_layout)).value;
+    }
+
+    void GameEngine::allocate_scene_set()
+    {
+        // A set of its own pool, so a reloaded model gets a fresh one while frames in flight still read the old.
+        auto pool_size = vk::DescriptorPoolSize(vk::DescriptorType::eStorageBuffer, SCENE_BINDING_COUNT);
+        descriptor_pool = device->createDescriptorPoolUnique(vk::DescriptorPoolCreateInfo({}, 1, pool_size));
+        scene_set = device->allocateDescriptorSets(vk::DescriptorSetAllocateInfo(*descriptor_pool, *scene_set_layout)).front();
+    }
+
+    void GameEngine::create_frame_resources()
+    {
+        profiler::Zone zone("create frame resources");
+        if (config.frames_in_flight == 0)
+        {
+            throw std::runtime_error("At least one frame in flight is required");
+        }
+        frames.resize(config.frames_in_flight);
+        // The GPU driven path records a single indirect draw and never needs secondaries.
+        uint32_t record_slots = gpu_driven ? 1 : config.record_threads != 0 ? config.record_threads : job_system::shared().thread_count();
+        for (auto&& frame : frames)
+        {
+            // Transient since every buffer is rerecorded each frame, the pool itself is what gets reset.
+            frame.command_pool = device->createCommandPoolUnique(vk::CommandPoolCreateInfo(vk::CommandPoolCreateFlagBits::eTransient, graphics_family));
+            auto command_buffers = device->allocateCommandBuffersUnique(vk::CommandBufferAllocateInfo(*frame.command_pool, vk::CommandBufferLevel::ePrimary, 1));
+            frame.command_buffer = std::move(command_buffers.front());
+            // One pool per recording slot and frame, a pool is only ever touched by the job recording its
+            // slot. A single slot records straight into the primary buffer.
+            for (uint32_t slot = 0; record_slots > 1 && slot < record_slots; ++slot)
+            {
+                frame.secondary_pools.push_back(device->createCommandPoolUnique(vk::CommandPoolCreateInfo(vk::CommandPoolCreateFlagBits::eTransient, graphics_family)));
+                auto secondary_buffers = device->allocateCommandBuffersUnique(vk::CommandBufferAllocateInfo(*frame.secondary_pools.back(), vk::CommandBufferLevel::eSecondary, 1));
+                frame.secondary_buffers.push_back(std::move(secondary_buffers.front()));
+            }
+            frame.image_available = device->createSemaphoreUnique(vk::SemaphoreCreateInfo());
+            // Signalled so the first wait on each frame returns immediately.
+            frame.in_flight = device->createFenceUnique(vk::FenceCreateInfo(vk::FenceCreateFlagBits::eSignaled));
+            for (std::size_t arena = 0; config.frame_arenas && arena < frame.secondary_buffers.size() + 1; ++arena)
+            {
+                frame.arenas.push_back(std::make_unique<frame_memory::Arena>(FRAME_ARENA_BYTES));
+            }
+        }
+
+        // Its queries are split per frame in flight too.
+        if (profiler::Profiler::enabled())
+        {
+            gpu_zones = std::make_unique<gpu_profiler::GpuProfiler>(*vk_instance, physical_device, *device, graphics_queue, graphics_family, &queue_mutex,
+                config.frames_in_flight, calibrated_timestamps);
+            if (!gpu_zones->available())
+            {
+                std::cout << "The graphics queue has no timestamps, only CPU zones are recorded\n";
+            }
+        }
+    }
+
+    void GameEngine::create_material_resources()
+    {
+        profiler::Zone zone("create material resources");
+        bool anisotropy = device_caps.features.samplerAnisotropy == vk::True;
+        auto sampler_info = vk::SamplerCreateInfo({}, vk::Filter::eLinear, vk::Filter::eLinear, vk::SamplerMipmapMode::eLinear,
+            vk::SamplerAddressMode::eRepeat, vk::SamplerAddressMode::eRepeat, vk::SamplerAddressMode::eRepeat, 0.0f,
+            anisotropy ? vk::True : vk::False, anisotropy ? std::min(8.0f, device_caps.properties.limits.maxSamplerAnisotropy) : 1.0f,
+            vk::False, vk::CompareOp::eAlways, 0.0f, vk::LodClampNone);
+        texture_sampler = device->createSamplerUnique(sampler_info);
+
+        // 1x1 white, what materials without a texture and textures whose tail hasn't landed yet sample.
+        std::array<uint32_t, 2> families{ graphics_family, transfer_family };
+        auto sharing = graphics_family != transfer_family ? vk::SharingMode::eConcurrent : vk::SharingMode::eExclusive;
+        auto image_info = vk::ImageCreateInfo({}, vk::ImageType::e2D, vk::Format::eR8G8B8A8Unorm, vk::Extent3D(1, 1, 1), 1, 1, vk::SampleCountFlagBits::e1,
+            vk::ImageTiling::eOptimal, vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst, sharing, families);
+        default_texture = gpu_allocator::Image(*allocator, image_info, vk::MemoryPropertyFlagBits::eDeviceLocal);
+        auto color_range = vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1);
+        default_texture_view = device->createImageViewUnique(vk::ImageViewCreateInfo({}, default_texture.get(), vk::ImageViewType::e2D, vk::Format::eR8G8B8A8Unorm, {}, color_range));
+        std::array<uint8_t, 4> white{ 255, 255, 255, 255 };
+        // Nothing is drawn before the model's upload, which is flushed after this one.
+        uploads->upload_image(default_texture.get(), vk::Extent3D(1, 1, 1), 0, std::as_bytes(std::span(white)));
+
+        // Replaced by the model's materials in upload_textures.
+        MaterialData default_material{ { 1.0f, 1.0f, 1.0f, 1.0f }, 0, {} };
+        material_buffer = create_host_buffer(vk::BufferUsageFlagBits::eStorageBuffer, std::as_bytes(std::span(&default_material, 1)));
+
+        auto set_count = static_cast<uint32_t>(frames.size());
+        std::array<vk::DescriptorPoolSize, 2> pool_sizes{ vk::DescriptorPoolSize(vk::DescriptorType::eCombinedImageSampler, MAX_TEXTURES * set_count),
+            vk::DescriptorPoolSize(vk::DescriptorType::eStorageBuffer, set_count) };
+        material_pool = device->createDescriptorPoolUnique(vk::DescriptorPoolCreateInfo({}, set_count, pool_sizes));
+        std::vector<vk::DescriptorSetLayout> layouts(set_count, *material_set_layout);
+        auto sets = device->allocateDescriptorSets(vk::DescriptorSetAllocateInfo(*material_pool, layouts));
+        for (uint32_t i = 0; i < set_count; ++i)
+        {
+            frames[i].material_set = sets[i];
+        }
+    }
 
-        std::vector<const char*> extensions(glfw_ext, glfw_ext + glfw_ext_count);
+    void GameEngine::create_instance_resources()
+    {
+        // The GPU driven path reads the instances from the scene set.
+        if (gpu_driven)
+        {
+            return;
+        }
+        profiler::Zone zone("create instance resources");
+        auto set_count = static_cast<uint32_t>(frames.size());
+        auto pool_size = vk::DescriptorPoolSize(vk::DescriptorType::eStorageBuffer, set_count);
+        instance_pool = device->createDescriptorPoolUnique(vk::DescriptorPoolCreateInfo({}, set_count, pool_size));
+        std::vector<vk::DescriptorSetLayout> layouts(set_count, *instance_set_layout);
+        auto sets = device->allocateDescriptorSets(vk::DescriptorSetAllocateInfo(*instance_pool, layouts));
+        // Sized from the config since the model may still be parsing, every instance gets a slot.
+        auto bytes = vk::DeviceSize{ std::max(config.instance_count, 1u) } * sizeof(InstanceTransform);
+        for (uint32_t i = 0; i < set_count; ++i)
+        {
+            auto& frame = frames[i];
+            frame.instance_buffer = create_host_buffer(vk::BufferUsageFlagBits::eStorageBuffer, bytes);
+            frame.instance_set = sets[i];
+            auto buffer_info = vk::DescriptorBufferInfo(frame.instance_buffer.get(), 0, vk::WholeSize);
+            device->updateDescriptorSets(vk::WriteDescriptorSet(frame.instance_set, 0, 0, vk::DescriptorType::eStorageBuffer, {}, buffer_info), {});
+        }
+    }
+
+    void GameEngine::parse_model()
+    {
+        profiler::Zone zone("parse model");
+        profiler::Zone stage("load mesh");
+        model_files = { config.model_path };
+        model = mesh_cache::load_mesh(config.model_path, {}, config.cache_policy);
+        auto view = model.view();
+        if (view.vertices.empty() || view.indices.empty())
+        {
+            return;
+        }
+
+        // Frame the camera on the bounding box.
+        stage.next("prepare instances");
+        transform::Vec3 min = view.vertices.front().position;
+        transform::Vec3 max = min;
+        for (auto&& vertex : view.vertices)
+        {
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                min[axis] = std::min(min[axis], vertex.position[axis]);
+                max[axis] = std::max(max[axis], vertex.position[axis]);
+            }
+        }
+        auto extent = transform::subtract(max, min);
+        model_center = { min[0] + extent[0] * 0.5f, min[1] + extent[1] * 0.5f, min[2] + extent[2] * 0.5f };
+        model_radius = std::max(0.5f * std::sqrt(transform::dot(extent, extent)), 1e-3f);
+
+        // Copies of the model on a square grid around the origin, one draw list entry each.
+        auto instance_count = std::max(config.instance_count, 1u);
+        auto side = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(instance_count))));
+        float spacing = model_radius * 2.2f;
+        float half_extent = 0.5f * spacing * static_cast<float>(side - 1);
+        transforms = scene::TransformHierarchy();
+        transforms.reserve(instance_count + side + 1);
+        auto root = transforms.add_node();
+        std::vector<uint32_t> rows;
+        for (uint32_t row = 0; row * side < instance_count; ++row)
+        {
+            rows.push_back(transforms.add_node(root, { -half_extent, 0.0f, static_cast<float>(row) * spacing - half_extent }));
+        }
+        instance_nodes.clear();
+        for (uint32_t i = 0; i < instance_count; ++i)
+        {
+            instance_nodes.push_back(transforms.add_node(rows[i / side], { static_cast<float>(i % side) * spacing, 0.0f, 0.0f }));
+        }
+        transforms.update();
+        scene_radius = model_radius + half_extent * std::sqrt(2.0f);
+
+        auto bounds = vertex_format::make_encode_context(view.vertices);
+
+        // Full float positions are stored as is, the shader still applies offset + position * scale.
+        auto context = std::is_same_v<EngineVertex::Position, vertex_format::Float3Position> ? vertex_format::EncodeContext{} : bounds;
+        model_constants.position_offset = { context.position_offset[0], context.position_offset[1], context.position_offset[2], 0.0f };
+        model_constants.position_scale = { context.position_scale[0], context.position_scale[1], context.position_scale[2], 0.0f };
+
+        stage.next("load lods");
+        mesh_lod::LodChain lods;
+        if (config.lods)
+        {
+            lods = mesh_lod::load_lods(config.model_path, view, {}, config.cache_policy);
+        }
+        auto base_index_count = static_cast<uint32_t>(view.indices.size());
+        lod_errors = { 0.0f };
+        lod_ranges.assign(view.ranges.begin(), view.ranges.end());
+        for (auto&& level : lods.levels)
+        {
+            lod_errors.push_back(level.error);
+            for (auto range : level.ranges)
+            {
+                range.first_index += base_index_count;
+                lod_ranges.push_back(range);
+            }
+        }
+
+        // The device isn't known yet, so meshlets are loaded whenever the GPU driven path is asked for
+        // and dropped in upload_model if the device can't do it.
+        stage.next("load meshlets");
+        meshlet_draws.clear();
+        staged_meshlet_indices.clear();
+        if (config.meshlets && config.gpu_driven)
+        {
+            auto meshlets = meshlet::load_meshlets(config.model_path, view, config.cache_policy);
+            staged_meshlet_indices = meshlet::meshlet_indices(meshlets);
+            std::vector<uint32_t> meshlet_materials(meshlets.meshlets.size());
+            for (auto&& range : meshlets.ranges)
+            {
+                std::fill_n(meshlet_materials.begin() + range.first_meshlet, range.meshlet_count, range.material);
+            }
+            auto first_meshlet_index = static_cast<uint32_t>(view.indices.size() + lods.indices.size());
+            for (std::size_t m = 0; m < meshlets.meshlets.size(); ++m)
+            {
+                auto& meshlet = meshlets.meshlets[m];
+                auto& bounds = meshlets.bounds[m];
+                auto relative = [this](const std::array<float, 3>& point)
+                {
+                    return transform::Vec4{ point[0] - model_center[0], point[1] - model_center[1], point[2] - model_center[2], 0.0f };
+                };
+                auto sphere = relative(bounds.center);
+                sphere[3] = bounds.radius;
+                meshlet_draws.push_back({ sphere, relative(bounds.cone_apex), { bounds.cone_axis[0], bounds.cone_axis[1], bounds.cone_axis[2], bounds.cone_cutoff },
+                    first_meshlet_index + meshlet.triangle_offset * 3, meshlet.triangle_count * 3, meshlet_materials[m], 0 });
+            }
+        }
+
+        // Each distinct file is imported once, as its own job. A texture that fails to load only costs
+        // its materials their texture.
+        stage.next("import textures");
+        staged_textures.clear();
+        staged_material_textures.assign(view.materials.size(), std::numeric_limits<uint32_t>::max());
+        if (config.textures)
+        {
+            std::vector<std::string> texture_paths;
+            for (std::size_t m = 0; m < view.materials.size(); ++m)
+            {
+                auto path = texture::resolve_texture_path(config.model_path, view.materials[m].diffuse_texture);
+                if (path.empty())
+                {
+                    continue;
+                }
+                auto found = std::find(texture_paths.begin(), texture_paths.end(), path);
+                staged_material_textures[m] = static_cast<uint32_t>(found - texture_paths.begin());
+                if (found == texture_paths.end())
+                {
+                    texture_paths.push_back(std::move(path));
+                }
+            }
+            model_files.insert(model_files.end(), texture_paths.begin(), texture_paths.end());
+            staged_textures.resize(texture_paths.size());
+            texture::TextureOptions options{ config.texture_format, true };
+            job_system::shared().parallel_for(texture_paths.size(), [&](std::size_t begin, std::size_t end)
+                {
+                    for (std::size_t i = begin; i < end; ++i)
+                    {
+                        try
+                        {
+                            staged_textures[i] = texture::load_texture(texture_paths[i], options, config.cache_policy);
+                        }
+                        catch (std::exception& ex)
+                        {
+                            std::cerr << "Warning: " << ex.what() << '\n';
+                        }
+                    }
+                }, 1);
+        }
+
+        stage.next("encode vertices");
+        staged_vertices = vertex_format::encode_vertices<EngineVertex>(view.vertices, context);
+        staged_lod_indices = std::move(lods.indices);
+    }
+
+    void GameEngine::upload_model()
+    {
+        profiler::Zone zone("upload model");
+        auto view = model.view();
+        std::cout << "Loaded " << config.model_path << (model.from_cache() ? " from cache: " : ": ")
+                  << view.vertices.size() << " vertices, " << view.triangle_count() << " triangles\n";
+        if (view.vertices.empty() || view.indices.empty())
+        {
+            return;
+        }
+
+        // Meshlets only change what the cull shaders draw, so they need the GPU driven path.
+        if (config.meshlets && !gpu_driven)
+        {
+            std::cout << "Meshlet culling needs the GPU driven path, drawing whole ranges\n";
+            meshlet_draws.clear();
+            staged_meshlet_indices.clear();
+        }
+
+        auto vertex_bytes = std::as_bytes(std::span(staged_vertices));
+        auto index_bytes = std::as_bytes(view.indices);
+        auto lod_index_bytes = std::as_bytes(std::span(staged_lod_indices));
+        auto meshlet_index_bytes = std::as_bytes(std::span(staged_meshlet_indices));
+        // Shared by both families, so the transfer queue never has to hand ownership to the graphics queue.
+        std::array<uint32_t, 2> families{ graphics_family, transfer_family };
+        model_vertices = gpu_allocator::Buffer(*allocator, vertex_bytes.size(), vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eTransferDst,
+            vk::MemoryPropertyFlagBits::eDeviceLocal, {}, families);
+        model_indices = gpu_allocator::Buffer(*allocator, index_bytes.size() + lod_index_bytes.size() + meshlet_index_bytes.size(), vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eTransferDst,
+            vk::MemoryPropertyFlagBits::eDeviceLocal, {}, families);
+        uploads->upload_buffer(model_vertices.get(), 0, vertex_bytes);
+        uploads->upload_buffer(model_indices.get(), 0, index_bytes);
+        if (!lod_index_bytes.empty())
+        {
+            uploads->upload_buffer(model_indices.get(), index_bytes.size(), lod_index_bytes);
+        }
+        if (!meshlet_index_bytes.empty())
+        {
+            uploads->upload_buffer(model_indices.get(), index_bytes.size() + lod_index_bytes.size(), meshlet_index_bytes);
+        }
+        // Everything staged is in the staging buffer now.
+        staged_vertices = {};
+        staged_lod_indices = {};
+        staged_meshlet_indices = {};
+        if (gpu_driven)
+        {
+            create_scene_buffers();
+        }
+        upload_textures();
+        // The model is drawn from the first frame after the copy has landed, mip tails included.
+        model_upload = uploads->flush();
+        std::cout << allocator->report() << '\n';
+    }
+
+    void GameEngine::create_scene_buffers()
+    {
+        auto range_count = model.view().ranges.size();
+        auto& limits = device_caps.properties.limits;
+        // Every instance either draws its LOD's ranges or its visible meshlets. Meshlet draws add up fast,
+        // so those get a fixed budget and the shaders drop whatever doesn't fit.
+        uint64_t wanted_draws = uint64_t(instance_nodes.size()) * range_count;
+        if (!meshlet_draws.empty())
+        {
+            wanted_draws = std::min<uint64_t>(std::max<uint64_t>(wanted_draws, uint64_t(instance_nodes.size()) * meshlet_draws.size()), MAX_MESHLET_DRAWS);
+        }
+        max_draw_count = static_cast<uint32_t>(std::min<uint64_t>(wanted_draws, limits.maxDrawIndirectCount));
+        if (max_draw_count < wanted_draws)
+        {
+            std::cout << "Only the first " << max_draw_count << " of " << wanted_draws << " visible draws fit in one indirect draw\n";
+        }
+        max_meshlet_rows = std::max(limits.maxComputeWorkGroupCount[1], 1u);
+
+        // Where each instance's center lands and the radius culling tests against. Taken once, nodes
+        // moved later only reach the CPU recorded path.
+        std::vector<transform::Vec4> spheres;
+        spheres.reserve(instance_nodes.size());
+        for (auto node : instance_nodes)
+        {
+            auto& world = transforms.world(node);
+            spheres.push_back({ world[12], world[13], world[14], model_radius });
+        }
+        auto sphere_bytes = std::as_bytes(std::span(spheres));
+        auto range_bytes = std::as_bytes(std::span(lod_ranges));
+        auto lod_error_bytes = std::as_bytes(std::span(lod_errors));
+        // Storage buffers can't be empty, an unused binding still gets one zeroed meshlet.
+        auto meshlets = meshlet_draws.empty() ? std::vector<MeshletDraw>(1) : meshlet_draws;
+        auto meshlet_bytes = std::as_bytes(std::span(meshlets));
+
+        std::array<uint32_t, 2> families{ graphics_family, transfer_family };
+        using bu = vk::BufferUsageFlagBits;
+        auto device_local = vk::MemoryPropertyFlagBits::eDeviceLocal;
+        instance_buffer = gpu_allocator::Buffer(*allocator, sphere_bytes.size(), bu::eStorageBuffer | bu::eTransferDst, device_local, {}, families);
+        range_buffer = gpu_allocator::Buffer(*allocator, range_bytes.size(), bu::eStorageBuffer | bu::eTransferDst, device_local, {}, families);
+        lod_error_buffer = gpu_allocator::Buffer(*allocator, lod_error_bytes.size(), bu::eStorageBuffer | bu::eTransferDst, device_local, {}, families);
+        meshlet_buffer = gpu_allocator::Buffer(*allocator, meshlet_bytes.size(), bu::eStorageBuffer | bu::eTransferDst, device_local, {}, families);
+        draw_commands = gpu_allocator::Buffer(*allocator, std::max<vk::DeviceSize>(wanted_draws, 1) * sizeof(vk::DrawIndexedIndirectCommand),
+            bu::eStorageBuffer | bu::eIndirectBuffer, device_local);
+        draw_count = gpu_allocator::Buffer(*allocator, sizeof(uint32_t), bu::eStorageBuffer | bu::eIndirectBuffer | bu::eTransferDst, device_local);
+        draw_instances = gpu_allocator::Buffer(*allocator, std::max<vk::DeviceSize>(wanted_draws, 1) * sizeof(std::array<uint32_t, 2>), bu::eStorageBuffer, device_local);
+        uploads->upload_buffer(instance_buffer.get(), 0, sphere_bytes);
+        uploads->upload_buffer(range_buffer.get(), 0, range_bytes);
+        uploads->upload_buffer(lod_error_buffer.get(), 0, lod_error_bytes);
+        uploads->upload_buffer(meshlet_buffer.get(), 0, meshlet_bytes);
+
+        std::array<vk::DescriptorBufferInfo, SCENE_BINDING_COUNT> buffer_infos{ vk::DescriptorBufferInfo(instance_buffer.get(), 0, vk::WholeSize),
+            vk::DescriptorBufferInfo(range_buffer.get(), 0, vk::WholeSize), vk::DescriptorBufferInfo(draw_commands.get(), 0, vk::WholeSize),
+            vk::DescriptorBufferInfo(draw_count.get(), 0, vk::WholeSize), vk::DescriptorBufferInfo(lod_error_buffer.get(), 0, vk::WholeSize),
+            vk::DescriptorBufferInfo(meshlet_buffer.get(), 0, vk::WholeSize), vk::DescriptorBufferInfo(draw_instances.get(), 0, vk::WholeSize) };
+        std::vector<vk::WriteDescriptorSet> writes;
+        for (uint32_t binding = 0; binding < buffer_infos.size(); ++binding)
+        {
+            writes.push_back(vk::WriteDescriptorSet(scene_set, binding, 0, vk::DescriptorType::eStorageBuffer, {}, buffer_infos[binding]));
+        }
+        device->updateDescriptorSets(writes, {});
+    }
+
+    void GameEngine::upload_textures()
+    {
+        profiler::Zone zone("upload textures");
+        auto view = model.view();
+        // Every material index a range uses has an entry, even if the model's material list is short.
+        std::size_t material_count = std::max<std::size_t>(view.materials.size(), 1);
+        for (auto&& range : view.ranges)
+        {
+            material_count = std::max<std::size_t>(material_count, range.material + std::size_t{ 1 });
+        }
+        std::vector<MaterialData> materials(material_count, MaterialData{ { 1.0f, 1.0f, 1.0f, 1.0f }, 0, {} });
+        for (std::size_t m = 0; m < view.materials.size(); ++m)
+        {
+            auto& diffuse = view.materials[m].diffuse;
+            materials[m].diffuse = { diffuse[0], diffuse[1], diffuse[2], 1.0f };
+        }
+
+        bool any_texture = std::any_of(staged_textures.begin(), staged_textures.end(), [](auto& texture) { return texture.has_value(); });
+        if (any_texture && device_caps.features.shaderSampledImageArrayDynamicIndexing != vk::True)
+        {
+            std::cout << "Indexing sampler arrays isn't supported by this device, drawing without textures\n";
+            any_texture = false;
+        }
+        if (any_texture)
+        {
+            texture_streamer::StreamerConfig streamer_config;
+            streamer_config.budget_bytes = vk::DeviceSize{ config.texture_budget_mb } << 20;
+            streamer_config.frames_in_flight = config.frames_in_flight;
+            streamer_config.block_compression = device_caps.features.textureCompressionBC == vk::True;
+            if (!streamer_config.block_compression && config.texture_format != texture::Format::rgba8)
+            {
+                std::cout << "BC formats aren't supported by this device, textures are decoded to RGBA8 as they are uploaded\n";
+            }
+            std::array<uint32_t, 2> families{ graphics_family, transfer_family };
+            textures = std::make_unique<texture_streamer::TextureStreamer>(*device, *allocator, *uploads, families, streamer_config);
+
+            // Slot 0 of the texture array is the default, each imported texture gets the next one.
+            std::vector<uint32_t> slots(staged_textures.size(), 0);
+            for (std::size_t i = 0; i < staged_textures.size(); ++i)
+            {
+                if (!staged_textures[i])
+                {
+                    continue;
+                }
+                if (texture_slots.size() + 1 >= MAX_TEXTURES)
+                {
+                    std::cout << "Only the first " << MAX_TEXTURES - 1 << " textures are drawn\n";
+                    break;
+                }
+                texture_slots.push_back(textures->add(std::move(*staged_textures[i])));
+                slots[i] = static_cast<uint32_t>(texture_slots.size());
+            }
+            for (std::size_t m = 0; m < staged_material_textures.size(); ++m)
+            {
+                if (staged_material_textures[m] < slots.size())
+                {
+                    materials[m].texture = slots[staged_material_textures[m]];
+                }
+            }
+            auto stats = textures->stats();
+            std::cout << "Streaming " << stats.texture_count << " textures, mip tails " << stats.uploaded_bytes / 1024 << " KiB, budget "
+                      << config.texture_budget_mb << " MiB\n";
+        }
+        staged_textures = {};
+        staged_material_textures = {};
+        // No frame has been recorded yet, so the default buffer can go.
+        material_buffer = create_host_buffer(vk::BufferUsageFlagBits::eStorageBuffer, std::as_bytes(std::span(materials)));
+    }
+
+    void GameEngine::request_texture_detail(double time_seconds)
+    {
+        // Instance centers lie within scene_radius - model_radius of the origin, so this is the closest
+        // any instance's bounds can come to the eye. Textures are taken to span their model once, which
+        // holds for unwrapped models and overestimates for tiled ones.
+        auto eye = camera_position(time_seconds);
+        float distance = std::max(std::sqrt(transform::dot(eye, eye)) - scene_radius, model_radius * 0.05f);
+        float screen_size = 2.0f * model_radius * lod_projection_scale() / distance;
+        for (auto index : texture_slots)
+        {
+            textures->request(index, screen_size);
+        }
+    }
+
+    void GameEngine::write_material_set(FrameResources& frame)
+    {
+        std::pmr::vector<vk::DescriptorImageInfo> image_infos(MAX_TEXTURES,
+            vk::DescriptorImageInfo(*texture_sampler, *default_texture_view, vk::ImageLayout::eShaderReadOnlyOptimal), frame.scratch(0));
+        for (std::size_t slot = 0; slot < texture_slots.size(); ++slot)
+        {
+            if (auto view = textures->view(texture_slots[slot]))
+            {
+                image_infos[slot + 1].imageView = view;
+            }
+        }
+        auto material_info = vk::DescriptorBufferInfo(material_buffer.get(), 0, vk::WholeSize);
+        std::array<vk::WriteDescriptorSet, 2> writes{ vk::WriteDescriptorSet(frame.material_set, 0, 0, vk::DescriptorType::eCombinedImageSampler, image_infos),
+            vk::WriteDescriptorSet(frame.material_set, 1, 0, vk::DescriptorType::eStorageBuffer, {}, material_info) };
+        device->updateDescriptorSets(writes, {});
+        frame.material_set_version = textures ? textures->version() : 0;
+    }
+
+    void GameEngine::start_watching()
+    {
+        if (!config.hot_reload || config.headless)
+        {
+            return;
+        }
+        watcher = std::make_unique<file_watcher::FileWatcher>();
+        for (auto&& path : shader_paths)
+        {
+            watcher->watch(path);
+        }
+        for (auto&& path : model_files)
+        {
+            watcher->watch(path);
+        }
+        if (watcher->available())
+        {
+            std::cout << "Watching " << shader_paths.size() + model_files.size() << " files for changes\n";
+        }
+    }
+
+    void GameEngine::apply_file_changes()
+    {
+        for (auto&& change : watcher->poll_changes())
+        {
+            auto shader = std::find(shader_paths.begin(), shader_paths.end(), change.path);
+            if (shader == shader_paths.end())
+            {
+                // The model or one of its textures, either way the whole model is reloaded. Latency counts
+                // from the first change.
+                if (!model_change)
+                {
+                    model_change = change;
+                }
+                model_files_changed = true;
+                continue;
+            }
+            try
+            {
+                reload_shader(static_cast<std::size_t>(shader - shader_paths.begin()));
+                applied_changes.push_back(change);
+            }
+            catch (std::exception& ex)
+            {
+                std::cout << "Keeping the previous " << change.path << ": " << ex.what() << '\n';
+            }
+        }
+
+        // Only picked up once a worker has finished it. The render thread never runs the load itself:
+        // record_commands' parallel_for only helps with its own group and this waits on a finished job.
+        auto& jobs = job_system::shared();
+        if (model_reload && jobs.is_done(model_reload))
+        {
+            auto job = std::move(model_reload);
+            model_reload = {};
+            // Files that changed again while it was loading make it stale, the next load replaces it.
+            bool stale = model_files_changed;
+            try
+            {
+                jobs.wait(job);
+                if (!stale)
+                {
+                    reload_model();
+                    applied_changes.push_back(*model_change);
+                }
+            }
+            catch (std::exception& ex)
+            {
+                std::cout << "Failed to reload " << config.model_path << ": " << ex.what() << '\n';
+            }
+            if (!stale)
+            {
+                model_change.reset();
+            }
+        }
+        if (model_files_changed && !model_reload)
+        {
+            model_files_changed = false;
+            // Loads what parse_model will, so the swap itself only reads caches. The job gets copies, the
+            // engine keeps rendering while it runs.
+            model_reload = jobs.run([path = config.model_path, policy = config.cache_policy, lods = config.lods, meshlets = config.meshlets && config.gpu_driven,
+                load_textures = config.textures, texture_format = config.texture_format]
+                {
+                    profiler::Zone zone("load changed model");
+                    auto loaded = mesh_cache::load_mesh(path, {}, policy);
+                    if (lods)
+                    {
+                        mesh_lod::load_lods(path, loaded.view(), {}, policy);
+                    }
+                    if (meshlets)
+                    {
+                        meshlet::load_meshlets(path, loaded.view(), policy);
+                    }
+                    std::vector<std::string> texture_paths;
+                    for (auto&& material : load_textures ? loaded.view().materials : std::span<const mesh::Material>())
+                    {
+                        auto texture_path = texture::resolve_texture_path(path, material.diffuse_texture);
+                        if (!texture_path.empty() && std::find(texture_paths.begin(), texture_paths.end(), texture_path) == texture_paths.end())
+                        {
+                            texture_paths.push_back(texture_path);
+                            texture::load_texture(texture_path, { texture_format, true }, policy);
+                        }
+                    }
+                });
+        }
+    }
+
+    void GameEngine::reload_shader(std::size_t index)
+    {
+        profiler::Zone zone("reload shader");
+        auto start_ns = profiler::now_ns();
+        // Modules aren't needed once their pipelines exist, the previous one only has to come back if
+        // the new one doesn't compile.
+        auto previous = std::exchange(shader_modules[index], load_shader(shader_paths[index]));
+        RetiredResources retired;
+        try
+        {
+            if (index < 2)
+            {
+                auto rebuilt = create_graphics_pipelines();
+                for (uint32_t variant = 0; variant < PIPELINE_VARIANT_COUNT; ++variant)
+                {
+                    if (rebuilt[variant])
+                    {
+                        retired.pipelines.push_back(std::exchange(pipelines[variant], std::move(rebuilt[variant])));
+                    }
+                }
+                graphics_pipeline = *pipelines[pipeline_variant];
+            }
+            else
+            {
+                auto& pipeline = index == 2 ? cull_pipeline : meshlet_cull_pipeline;
+                retired.pipelines.push_back(std::exchange(pipeline, create_cull_pipeline(*shader_modules[index])));
+            }
+        }
+        catch (...)
+        {
+            shader_modules[index] = std::move(previous);
+            throw;
+        }
+        std::cout << "Rebuilt " << retired.pipelines.size() << (retired.pipelines.size() == 1 ? " pipeline" : " pipelines") << " for "
+                  << shader_paths[index] << " in " << (profiler::now_ns() - start_ns) / 1e6 << " ms\n";
+        // Frames in flight may still be executing the old ones.
+        retired.frame = frame_number;
+        retired_resources.push_back(std::move(retired));
+        pipeline_disk_cache->save();
+    }
+
+    void GameEngine::reload_model()
+    {
+        profiler::Zone zone("reload model");
+        auto start_ns = profiler::now_ns();
+        // Frames in flight still read the old buffers, textures and scene set, and the last upload may
+        // still be copying into them. The model isn't drawn again until the new upload lands.
+        RetiredResources retired;
+        for (auto* buffer : { &model_vertices, &model_indices, &material_buffer, &instance_buffer, &range_buffer, &lod_error_buffer,
+                 &meshlet_buffer, &draw_commands, &draw_count, &draw_instances })
+        {
+            if (*buffer)
+            {
+                retired.buffers.push_back(std::exchange(*buffer, {}));
+            }
+        }
+        retired.textures = std::move(textures);
+        retired.descriptor_pool = std::move(descriptor_pool);
+        retired.uploads = uploads->flush();
+        retired.frame = frame_number;
+        retired_resources.push_back(std::move(retired));
+        texture_slots.clear();
+        // The scene set is bound by frames in flight, so the new buffers go into a new one.
+        if (gpu_driven)
+        {
+            allocate_scene_set();
+        }
+        for (auto&& frame : frames)
+        {
+            frame.material_set_version.reset();
+        }
+
+        // The load job brought the caches up to date, so rebuilding them again is skipped.
+        auto policy = config.cache_policy;
+        if (policy == mesh_cache::CachePolicy::rebuild)
+        {
+            config.cache_policy = mesh_cache::CachePolicy::use_cache;
+        }
+        try
+        {
+            parse_model();
+            upload_model();
+        }
+        catch (...)
+        {
+            config.cache_policy = policy;
+            throw;
+        }
+        config.cache_policy = policy;
+        // An empty model never gets its materials, the sets still need a buffer.
+        if (!material_buffer)
+        {
+            MaterialData default_material{ { 1.0f, 1.0f, 1.0f, 1.0f }, 0, {} };
+            material_buffer = create_host_buffer(vk::BufferUsageFlagBits::eStorageBuffer, std::as_bytes(std::span(&default_material, 1)));
+        }
+        // Textures it didn't use before.
+        for (auto&& path : model_files)
+        {
+            watcher->watch(path);
+        }
+        std::cout << "Swapped in " << config.model_path << " in " << (profiler::now_ns() - start_ns) / 1e6 << " ms, "
+                  << retired_resources.size() << " retired resource sets wait for their frames\n";
+    }
+
+    gpu_allocator::Buffer GameEngine::create_host_buffer(vk::BufferUsageFlags usage, vk::DeviceSize size) const
+    {
+        return gpu_allocator::Buffer(*allocator, size, usage, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
+    }
+
+    gpu_allocator::Buffer GameEngine::create_host_buffer(vk::BufferUsageFlags usage, std::span<const std::byte> data) const
+    {
+        auto result = create_host_buffer(usage, data.size());
+        std::memcpy(result.mapped(), data.data(), data.size());
+        return result;
+    }
+
+    void GameEngine::create_offscreen_targets()
+    {
+        profiler::Zone zone("create offscreen targets");
+        // Format and size were picked in choose_swap_chain_settings.
+        auto image_info = vk::ImageCreateInfo({}, vk::ImageType::e2D, swap_chain_format, vk::Extent3D(swap_chain_extent, 1), 1, 1, vk::SampleCountFlagBits::e1, vk::ImageTiling::eOptimal, vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferSrc);
+        auto color_range = vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1);
+        // One target per frame in flight, so a frame never renders into an image the GPU is still using.
+        for (uint32_t i = 0; i < config.frames_in_flight; ++i)
+        {
+            auto image = gpu_allocator::Image(*allocator, image_info, vk::MemoryPropertyFlagBits::eDeviceLocal);
+            image_views.push_back(device->createImageViewUnique(vk::ImageViewCreateInfo({}, image.get(), vk::ImageViewType::e2D, swap_chain_format, {}, color_range)));
+            swap_chain_images.push_back(image.get());
+            offscreen_images.push_back(std::move(image));
+        }
+    }
+
+    void GameEngine::save_frame(std::string_view path)
+    {
+        if (!config.headless || !last_image_index.has_value())
+        {
+            throw std::runtime_error("save_frame needs headless mode and at least one rendered frame");
+        }
+        auto width = swap_chain_extent.width;
+        auto height = swap_chain_extent.height;
+        auto readback = create_host_buffer(vk::BufferUsageFlagBits::eTransferDst, vk::DeviceSize(width) * height * 4);
+
+        auto command_pool = device->createCommandPoolUnique(vk::CommandPoolCreateInfo(vk::CommandPoolCreateFlagBits::eTransient, graphics_family));
+        auto command_buffers = device->allocateCommandBuffersUnique(vk::CommandBufferAllocateInfo(*command_pool, vk::CommandBufferLevel::ePrimary, 1));
+        auto& command_buffer = command_buffers.front();
+        command_buffer->begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+
+        // The render pass already left the image in transfer src layout, this only orders the
+        // attachment writes before the copy.
+        auto image = swap_chain_images[*last_image_index];
+        auto color_range = vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1);
+        auto image_barrier = vk::ImageMemoryBarrier(vk::AccessFlagBits::eColorAttachmentWrite, vk::AccessFlagBits::eTransferRead, vk::ImageLayout::eTransferSrcOptimal, vk::ImageLayout::eTransferSrcOptimal, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, image, color_range);
+        command_buffer->pipelineBarrier(vk::PipelineStageFlagBits::eColorAttachmentOutput, vk::PipelineStageFlagBits::eTransfer, {}, nullptr, nullptr, image_barrier);
+        auto region = vk::BufferImageCopy(0, 0, 0, vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, 0, 0, 1), vk::Offset3D(0, 0, 0), vk::Extent3D(swap_chain_extent, 1));
+        command_buffer->copyImageToBuffer(image, vk::ImageLayout::eTransferSrcOptimal, readback.get(), region);
+        auto host_barrier = vk::BufferMemoryBarrier(vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eHostRead, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, readback.get(), 0, VK_WHOLE_SIZE);
+        command_buffer->pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eHost, {}, nullptr, host_barrier, nullptr);
+        command_buffer->end();
+
+        auto fence = device->createFenceUnique(vk::FenceCreateInfo());
+        {
+            std::lock_guard lock(queue_mutex);
+            graphics_queue.submit(vk::SubmitInfo({}, {}, *command_buffer), *fence);
+        }
+        if (device->waitForFences(*fence, vk::True, std::numeric_limits<uint64_t>::max()) != vk::Result::eSuccess)
+        {
+            throw std::runtime_error("Failed waiting for the frame readback");
+        }
+
+        std::vector<uint8_t> pixels(readback.size());
+        std::memcpy(pixels.data(), readback.mapped(), pixels.size());
+        image_io::write_image(path, width, height, pixels);
+    }
+
+    void GameEngine::main_loop()
+    {
+        using Clock = std::chrono::steady_clock;
+        auto start = Clock::now();
+        auto frame_start = start;
+        auto last_report = start;
+        uint32_t frame_count{ 0 };
+        // Headless has no window to close, so it always stops after max_frames (at least one).
+        uint32_t max_frames = config.headless ? std::max(config.max_frames, 1u) : config.max_frames;
+        // Headless runs are short and usually captured, don't let them render before the model is there.
+        if (config.headless)
+        {
+            model_upload.wait();
+        }
+        while ((!window_enabled() || !glfwWindowShouldClose(window)) && (max_frames == 0 || frame_count < max_frames))
+        {
+            if (window_enabled())
+            {
+                glfwPollEvents();
+            }
+
+            frame_stats::FrameTiming timing{};
+            double time_seconds = std::chrono::duration<double>(frame_start - start).count();
+            if (render_frame(time_seconds, timing))
+            {
+                ++frame_count;
+            }
+            else if (window_enabled() && glfwGetWindowAttrib(window, GLFW_ICONIFIED))
+            {
+                // Minimized, sleep until the window comes back instead of spinning on a zero sized surface.
+                glfwWaitEvents();
+            }
+
+            auto now = Clock::now();
+            timing.frame_ms = std::chrono::duration<double, std::milli>(now - frame_start).count();
+            frame_start = now;
+            frame_timings.add(timing);
+            if (now - last_report > std::chrono::seconds(2))
+            {
+                std::cout << frame_timings.report() << '\n';
+                if (textures)
+                {
+                    auto stats = textures->stats();
+                    std::cout << "Textures: " << stats.satisfied_count << '/' << stats.texture_count << " at the wanted detail, "
+                              << (stats.resident_bytes >> 20) << " of " << (stats.budget_bytes >> 20) << " MiB resident, "
+                              << stats.upgrades << " upgrades, " << stats.downgrades << " downgrades\n";
+                }
+                if (config.profile)
+                {
+                    std::cout << profiler::Profiler::shared().stats_report() << '\n';
+                }
+                frame_timings.clear();
+                last_report = now;
+            }
+        }
+        if (frame_timings.size() > 0)
+        {
+            std::cout << frame_timings.report() << '\n';
+        }
+        device->waitIdle();
+        if (!config.trace_path.empty())
+        {
+            profiler::Profiler::shared().write_chrome_trace(config.trace_path);
+            std::cout << "Wrote " << config.trace_path << '\n';
+        }
+        if (!config.capture_path.empty())
+        {
+            save_frame(config.capture_path);
+            std::cout << "Saved " << config.capture_path << '\n';
+        }
+    }
+
+    bool GameEngine::render_frame(double time_seconds, frame_stats::FrameTiming& timing, bool wait_for_gpu)
+    {
+        using Clock = std::chrono::steady_clock;
+        auto& frame = frames[current_frame];
+
+        // Only blocks when the GPU is more than frames_in_flight frames behind.
+        profiler::Zone stage("wait for frame");
+        auto wait_start = Clock::now();
+        if (device->waitForFences(*frame.in_flight, vk::True, std::numeric_limits<uint64_t>::max()) != vk::Result::eSuccess)
+        {
+            throw std::runtime_error("Failed waiting for a frame fence");
+        }
+        release_retired();
+        if (watcher)
+        {
+            stage.next("hot reload");
+            apply_file_changes();
+        }
+
+        // Old targets stay alive until the frames using them are done, nothing waits for the device.
+        if (framebuffer_resized || requested_extent || requested_present_mode)
+        {
+            stage.next("resize");
+            auto resize_start = Clock::now();
+            bool recreated = recreate_targets();
+            timing.resize_ms = std::chrono::duration<double, std::milli>(Clock::now() - resize_start).count();
+            if (!recreated)
+            {
+                return false;
+            }
+        }
+
+        // Headless frames each own their target image, so there is nothing to acquire.
+        auto image_index = static_cast<uint32_t>(current_frame);
+        if (!config.headless)
+        {
+            stage.next("acquire image");
+            try
+            {
+                auto acquired = device->acquireNextImageKHR(*swap_chain, std::numeric_limits<uint64_t>::max(), *frame.image_available, nullptr);
+                image_index = acquired.value;
+                // Still presentable, draw this one and recreate before the next.
+                framebuffer_resized |= acquired.result == vk::Result::eSuboptimalKHR;
+            }
+            catch (vk::OutOfDateKHRError&)
+            {
+                // Nothing was acquired and the semaphore stays unsignaled, the next frame recreates first.
+                framebuffer_resized = true;
+                return false;
+            }
+        }
+
+        // A smaller frames_in_flight than image count can hand back an image an older frame still renders to.
+        if (images_in_flight[image_index] && images_in_flight[image_index] != *frame.in_flight)
+        {
+            if (device->waitForFences(images_in_flight[image_index], vk::True, std::numeric_limits<uint64_t>::max()) != vk::Result::eSuccess)
+            {
+                throw std::runtime_error("Failed waiting for a swap chain image fence");
+            }
+        }
+        images_in_flight[image_index] = *frame.in_flight;
+        stage.next("record");
+        auto record_start = Clock::now();
+        timing.wait_ms = std::chrono::duration<double, std::milli>(record_start - wait_start).count();
+
+        // The fence has passed, so nothing allocated from this frame's pool is still in use.
+        device->resetFences(*frame.in_flight);
+        device->resetCommandPool(*frame.command_pool);
+        for (auto&& arena : frame.arenas)
+        {
+            arena->reset();
+        }
+        auto scratch = frame.scratch(0);
+        // A counter read, the render thread never waits for a load.
+        bool draw_model = model_indices && model_upload.ready();
+        // Once per submitted frame, the streamer counts frames to know when replaced images are unused.
+        if (textures)
+        {
+            request_texture_detail(time_seconds);
+            textures->update(scratch);
+        }
+        // Only nodes moved since the last frame are recomputed, a static scene costs a single check.
+        if (draw_model)
+        {
+            transforms.update();
+        }
+        if (frame.material_set_version != (textures ? textures->version() : 0))
+        {
+            write_material_set(frame);
+        }
+        record_commands(*frame.command_buffer, image_index, time_seconds, draw_model, timing);
+
+        // The upload already completed on the host's view, the GPU side wait on the timeline makes
+        // the transfer queue's writes visible to vertex input.
+        std::pmr::vector<vk::Semaphore> wait_semaphores(scratch);
+        std::pmr::vector<vk::PipelineStageFlags> wait_stages(scratch);
+        std::pmr::vector<uint64_t> wait_values(scratch);
+        if (!config.headless)
+        {
+            wait_semaphores.push_back(*frame.image_available);
+            wait_stages.push_back(vk::PipelineStageFlagBits::eColorAttachmentOutput);
+            wait_values.push_back(0);
+        }
+        if (draw_model)
+        {
+            wait_semaphores.push_back(uploads->timeline());
+            // Culling and the vertex shader read the instance buffer, which came with the same upload.
+            // Streamed textures landed later, one wait covers both.
+            wait_stages.push_back(vk::PipelineStageFlagBits::eVertexInput | vk::PipelineStageFlagBits::eVertexShader | vk::PipelineStageFlagBits::eComputeShader |
+                vk::PipelineStageFlagBits::eFragmentShader);
+            wait_values.push_back(std::max(model_upload.timeline_value(), textures ? textures->timeline_value() : 0));
+        }
+        std::pmr::vector<vk::Semaphore> signal_semaphores(scratch);
+        if (!config.headless)
+        {
+            signal_semaphores.push_back(*render_finished[image_index]);
+        }
+        std::pmr::vector<uint64_t> signal_values(signal_semaphores.size(), 0, scratch);
+        stage.next("submit");
+        auto timeline_info = vk::TimelineSemaphoreSubmitInfo(wait_values, signal_values);
+        auto submit_info = vk::SubmitInfo(wait_semaphores, wait_stages, *frame.command_buffer, signal_semaphores, &timeline_info);
+        {
+            std::lock_guard lock(queue_mutex);
+            graphics_queue.submit(submit_info, *frame.in_flight);
+        }
+        auto submit_end = Clock::now();
+        timing.record_ms = std::chrono::duration<double, std::milli>(submit_end - record_start).count();
+        // Time to first frame, from the start of the constructor to the first submit, and again once the model is in.
+        if (!first_frame_submitted || (draw_model && !model_frame_submitted))
+        {
+            std::cout << (draw_model ? "First frame with the model" : "First frame") << " submitted "
+                      << (profiler::now_ns() - startup_ns) / 1e6 << " ms after startup\n";
+            first_frame_submitted = true;
+            model_frame_submitted = draw_model;
+        }
+        // Hot reload latency, from the first event the watcher saw to the first frame submitted with the change.
+        if (!applied_changes.empty() && (draw_model || !model_indices))
+        {
+            auto now = file_watcher::Clock::now();
+            for (auto&& change : applied_changes)
+            {
+                std::cout << "Reloaded " << change.path << " (" << change.event_count << (change.event_count == 1 ? " event" : " events")
+                          << "), first frame with it submitted " << std::chrono::duration<double, std::milli>(now - change.first_event).count()
+                          << " ms after the change\n";
+            }
+            applied_changes.clear();
+        }
+
+        if (!config.headless)
+        {
+            stage.next("present");
+            auto present_info = vk::PresentInfoKHR(*render_finished[image_index], *swap_chain, image_index);
+            try
+            {
+                std::lock_guard lock(queue_mutex);
+                framebuffer_resized |= present_queue.presentKHR(present_info) == vk::Result::eSuboptimalKHR;
+            }
+            catch (vk::OutOfDateKHRError&)
+            {
+                framebuffer_resized = true;
+            }
+        }
+
+        if (wait_for_gpu)
+        {
+            stage.next("wait for gpu");
+            if (device->waitForFences(*frame.in_flight, vk::True, std::numeric_limits<uint64_t>::max()) != vk::Result::eSuccess)
+            {
+                throw std::runtime_error("Failed waiting for a frame fence");
+            }
+            timing.submit_to_fence_ms = std::chrono::duration<double, std::milli>(Clock::now() - submit_end).count();
+        }
+
+        last_image_index = image_index;
+        current_frame = (current_frame + 1) % frames.size();
+        ++frame_number;
+        stage.end();
+        profiler::Profiler::shared().end_frame();
+        return true;
+    }
+
+    void GameEngine::record_commands(vk::CommandBuffer command_buffer, uint32_t image_index, double time_seconds, bool draw_model, frame_stats::FrameTiming& timing)
+    {
+        command_buffer.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+        // The frame's fence has passed, so last time's timestamps in this slot are ready.
+        if (gpu_zones)
+        {
+            gpu_zones->begin_frame(command_buffer, static_cast<uint32_t>(current_frame));
+        }
+        gpu_profiler::GpuZone frame_zone(gpu_zones.get(), command_buffer, "frame");
+
+        auto& frame = frames[current_frame];
+        auto instance_count = static_cast<uint32_t>(instance_nodes.size());
+        auto slot_count = std::min(static_cast<uint32_t>(frame.secondary_buffers.size()), instance_count);
+        bool parallel = draw_model && !gpu_driven && slot_count > 1;
+
+        // Culling has to happen outside the render pass, the draws depend on what it wrote.
+        auto record_start = std::chrono::steady_clock::now();
+        auto scene_view_projection = view_projection(time_seconds);
+        if (draw_model && gpu_driven)
+        {
+            gpu_profiler::GpuZone culling_zone(gpu_zones.get(), command_buffer, "culling");
+            record_culling(command_buffer, scene_view_projection, time_seconds);
+        }
+
+        std::array<vk::ClearValue, 2> clear_values{ vk::ClearColorValue(std::array<float, 4>{ 0.02f, 0.02f, 0.03f, 1.0f }), vk::ClearDepthStencilValue(1.0f, 0) };
+        auto render_area = vk::Rect2D({ 0, 0 }, swap_chain_extent);
+        auto contents = parallel ? vk::SubpassContents::eSecondaryCommandBuffers : vk::SubpassContents::eInline;
+        // Around the render pass rather than inside it, a subpass of secondaries can't take timestamps.
+        gpu_profiler::GpuZone render_pass_zone(gpu_zones.get(), command_buffer, "render pass");
+        command_buffer.beginRenderPass(vk::RenderPassBeginInfo(*render_pass, *framebuffers[image_index], render_area, clear_values), contents);
+
+        if (draw_model && gpu_driven)
+        {
+            record_indirect_draws(command_buffer, frame.material_set, scene_view_projection);
+        }
+        else if (parallel)
+        {
+            // Each slot owns its pool for this frame, so whichever thread records it needs no locking.
+            auto inheritance = vk::CommandBufferInheritanceInfo(*render_pass, 0, *framebuffers[image_index]);
+            job_system::shared().parallel_for(slot_count, [&](std::size_t begin, std::size_t end)
+                {
+                    for (std::size_t slot = begin; slot < end; ++slot)
+                    {
+                        profiler::Zone slot_zone("record secondary");
+                        device->resetCommandPool(*frame.secondary_pools[slot]);
+                        auto secondary = *frame.secondary_buffers[slot];
+                        secondary.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit | vk::CommandBufferUsageFlagBits::eRenderPassContinue, &inheritance));
+                        auto first = static_cast<uint32_t>(uint64_t(instance_count) * slot / slot_count);
+                        auto last = static_cast<uint32_t>(uint64_t(instance_count) * (slot + 1) / slot_count);
+                        record_draws(secondary, frame, first, last, time_seconds, frame.scratch(slot + 1));
+                        secondary.end();
+                    }
+                }, 1);
+            std::pmr::vector<vk::CommandBuffer> secondaries(frame.scratch(0));
+            secondaries.reserve(slot_count);
+            for (uint32_t slot = 0; slot < slot_count; ++slot)
+            {
+                secondaries.push_back(*frame.secondary_buffers[slot]);
+            }
+            command_buffer.executeCommands(secondaries);
+        }
+        else if (draw_model)
+        {
+            record_draws(command_buffer, frame, 0, instance_count, time_seconds, frame.scratch(0));
+        }
+        timing.draw_record_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - record_start).count();
+
+        command_buffer.endRenderPass();
+        render_pass_zone.end();
+        frame_zone.end();
+        command_buffer.end();
+    }
+
+    void GameEngine::record_draws(vk::CommandBuffer command_buffer, const FrameResources& frame, uint32_t first_instance, uint32_t last_instance, double time_seconds,
+        std::pmr::memory_resource* scratch) const
+    {
+        auto render_area = vk::Rect2D({ 0, 0 }, swap_chain_extent);
+        command_buffer.bindPipeline(vk::PipelineBindPoint::eGraphics, graphics_pipeline);
+        command_buffer.setViewport(0, vk::Viewport(0.0f, 0.0f, static_cast<float>(swap_chain_extent.width), static_cast<float>(swap_chain_extent.height), 0.0f, 1.0f));
+        command_buffer.setScissor(0, render_area);
+        command_buffer.bindVertexBuffers(0, model_vertices.get(), vk::DeviceSize{ 0 });
+        command_buffer.bindIndexBuffer(model_indices.get(), 0, vk::IndexType::eUint32);
+        std::array<vk::DescriptorSet, 2> sets{ frame.instance_set, frame.material_set };
+        command_buffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *pipeline_layout, 0, sets, {});
+
+        // The instance's world matrix comes from the buffer, the model's own centering goes into the position offset.
+        auto constants = model_constants;
+        constants.model_view_projection = view_projection(time_seconds);
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            constants.position_offset[axis] -= model_center[axis];
+        }
+        command_buffer.pushConstants(*pipeline_layout, vk::ShaderStageFlagBits::eVertex, 0, sizeof(PushConstants), &constants);
+
+        // Pick every instance's LOD, then lay the instances out in the buffer sorted by it with a counting
+        // sort, so each level's instances are one contiguous run.
+        auto eye = camera_position(time_seconds);
+        auto projection_scale = lod_projection_scale();
+        std::pmr::vector<uint32_t> levels(last_instance - first_instance, scratch);
+        std::pmr::vector<uint32_t> level_starts(lod_errors.size() + 1, 0, scratch);
+        for (uint32_t instance = first_instance; instance < last_instance; ++instance)
+        {
+            auto& world = transforms.world(instance_nodes[instance]);
+            auto to_eye = transform::subtract(eye, { world[12], world[13], world[14] });
+            float distance = std::sqrt(transform::dot(to_eye, to_eye)) - model_radius;
+            auto level = static_cast<uint32_t>(mesh_lod::select_level(lod_errors, distance, projection_scale, config.lod_pixel_error));
+            levels[instance - first_instance] = level;
+            ++level_starts[level + 1];
+        }
+        for (std::size_t level = 1; level < level_starts.size(); ++level)
+        {
+            level_starts[level] += level_starts[level - 1];
+        }
+        auto instances = reinterpret_cast<InstanceTransform*>(frame.instance_buffer.mapped()) + first_instance;
+        std::pmr::vector<uint32_t> next(level_starts.begin(), level_starts.end() - 1, scratch);
+        for (uint32_t instance = first_instance; instance < last_instance; ++instance)
+        {
+            auto& world = transforms.world(instance_nodes[instance]);
+            instances[next[levels[instance - first_instance]]++] = InstanceTransform{ { transform::Vec4{ world[0], world[4], world[8], world[12] },
+                transform::Vec4{ world[1], world[5], world[9], world[13] }, transform::Vec4{ world[2], world[6], world[10], world[14] } } };
+        }
+
+        auto range_count = model.view().ranges.size();
+        for (std::size_t level = 0; level < lod_errors.size(); ++level)
+        {
+            auto count = level_starts[level + 1] - level_starts[level];
+            if (count == 0)
+            {
+                continue;
+            }
+            for (auto&& range : std::span(lod_ranges).subspan(level * range_count, range_count))
+            {
+                // Only the material changes between the ranges of a level.
+                command_buffer.pushConstants(*pipeline_layout, vk::ShaderStageFlagBits::eVertex, offsetof(PushConstants, material), sizeof(uint32_t), &range.material);
+                command_buffer.drawIndexed(range.index_count, count, range.first_index, 0, first_instance + level_starts[level]);
+            }
+        }
+    }
+
+    void GameEngine::record_culling(vk::CommandBuffer command_buffer, const transform::Mat4& view_projection, double time_seconds) const
+    {
+        using psf = vk::PipelineStageFlagBits;
+        using af = vk::AccessFlagBits;
+        // One set of draw buffers serves every frame in flight, so the previous frame's indirect draw
+        // has to be done reading them before the count is cleared and the commands rewritten.
+        command_buffer.pipelineBarrier(psf::eDrawIndirect | psf::eVertexShader, psf::eTransfer | psf::eComputeShader, {}, {}, {}, {});
+        command_buffer.fillBuffer(draw_count.get(), 0, sizeof(uint32_t), 0);
+        command_buffer.pipelineBarrier(psf::eTransfer, psf::eComputeShader, {},
+            vk::MemoryBarrier(af::eTransferWrite, af::eShaderRead | af::eShaderWrite), {}, {});
+
+        auto eye = camera_position(time_seconds);
+        CullPushConstants constants{ transform::frustum_planes(view_projection), { eye[0], eye[1], eye[2], lod_projection_scale() / config.lod_pixel_error },
+            static_cast<uint32_t>(instance_nodes.size()), static_cast<uint32_t>(model.view().ranges.size()), static_cast<uint32_t>(lod_errors.size()),
+            static_cast<uint32_t>(meshlet_draws.size()) };
+        command_buffer.bindPipeline(vk::PipelineBindPoint::eCompute, *cull_pipeline);
+        command_buffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, *cull_layout, 0, scene_set, {});
+        command_buffer.pushConstants(*cull_layout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(CullPushConstants), &constants);
+        command_buffer.dispatch((constants.instance_count + 63) / 64, 1, 1);
+
+        if (constants.meshlet_count > 0)
+        {
+            // Both passes append to the same draw list and count.
+            command_buffer.pipelineBarrier(psf::eComputeShader, psf::eComputeShader, {},
+                vk::MemoryBarrier(af::eShaderWrite, af::eShaderRead | af::eShaderWrite), {}, {});
+            command_buffer.bindPipeline(vk::PipelineBindPoint::eCompute, *meshlet_cull_pipeline);
+            command_buffer.dispatch((constants.meshlet_count + 63) / 64, std::min(constants.instance_count, max_meshlet_rows), 1);
+        }
+
+        command_buffer.pipelineBarrier(psf::eComputeShader, psf::eDrawIndirect, {},
+            vk::MemoryBarrier(af::eShaderWrite, af::eIndirectCommandRead), {}, {});
+    }
+
+    void GameEngine::record_indirect_draws(vk::CommandBuffer command_buffer, vk::DescriptorSet material_set, const transform::Mat4& view_projection) const
+    {
+        command_buffer.bindPipeline(vk::PipelineBindPoint::eGraphics, graphics_pipeline);
+        command_buffer.setViewport(0, vk::Viewport(0.0f, 0.0f, static_cast<float>(swap_chain_extent.width), static_cast<float>(swap_chain_extent.height), 0.0f, 1.0f));
+        command_buffer.setScissor(0, vk::Rect2D({ 0, 0 }, swap_chain_extent));
+        command_buffer.bindVertexBuffers(0, model_vertices.get(), vk::DeviceSize{ 0 });
+        command_buffer.bindIndexBuffer(model_indices.get(), 0, vk::IndexType::eUint32);
+        std::array<vk::DescriptorSet, 2> sets{ scene_set, material_set };
+        command_buffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, *pipeline_layout, 0, sets, {});
+
+        // The shader adds each instance's offset, the model's own centering goes into the position offset.
+        auto constants = model_constants;
+        constants.model_view_projection = view_projection;
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            constants.position_offset[axis] -= model_center[axis];
+        }
+        command_buffer.pushConstants(*pipeline_layout, vk::ShaderStageFlagBits::eVertex, 0, sizeof(PushConstants), &constants);
+        command_buffer.drawIndexedIndirectCount(draw_commands.get(), 0, draw_count.get(), 0, max_draw_count, sizeof(vk::DrawIndexedIndirectCommand));
+    }
+
+    transform::Mat4 GameEngine::view_projection(double time_seconds) const
+    {
+        // Slowly orbit the scene so there is something to look at.
+        float aspect = static_cast<float>(swap_chain_extent.width) / static_cast<float>(swap_chain_extent.height);
+        auto projection = transform::perspective(FIELD_OF_VIEW, aspect, model_radius * 0.05f, scene_radius * 10.0f);
+        auto camera = transform::look_at({ 0.0f, scene_radius * 0.5f, scene_radius * 2.5f }, { 0.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f });
+        return transform::multiply(projection, transform::multiply(camera, transform::rotation_y(static_cast<float>(time_seconds) * 0.5f)));
+    }
+
+    transform::Vec3 GameEngine::camera_position(double time_seconds) const
+    {
+        // The eye view_projection looks from, with the scene's rotation undone.
+        return transform::transform_point(transform::rotation_y(static_cast<float>(time_seconds) * -0.5f), { 0.0f, scene_radius * 0.5f, scene_radius * 2.5f });
+    }
+
+    float GameEngine::lod_projection_scale() const
+    {
+        return static_cast<float>(swap_chain_extent.height) / (2.0f * std::tan(FIELD_OF_VIEW * 0.5f));
+    }
+
+    std::vector<const char*> get_required_extensions(bool headless)
+    {
+        std::vector<const char*> extensions;
+        if (!headless)
+        {
+            uint32_t glfw_ext_count{0};
+            const char** glfw_ext = glfwGetRequiredInstanceExtensions(&glfw_ext_count);
+            extensions.assign(glfw_ext, glfw_ext + glfw_ext_count);
+        }
         if (enable_validation_layers)
         {
             extensions.push_back(vk::EXTDebugUtilsExtensionName);
@@ -429,6 +2214,10 @@ namespace baas::game_engine
     // This is ripped from the tutorial. Eventually figure out how to do this in a cpp sort of way
     VKAPI_ATTR VkBool32 VKAPI_CALL debug_callback(VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity, VkDebugUtilsMessageTypeFlagsEXT messageType, const VkDebugUtilsMessengerCallbackDataEXT* pCallbackData, void* pUserData) {
         std::cerr << "validation layer: " << pCallbackData->pMessage << '\n';
+        if (messageSeverity >= VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT)
+        {
+            static_cast<std::atomic<uint32_t>*>(pUserData)->fetch_add(1);
+        }
 
         return VK_FALSE;
     } 
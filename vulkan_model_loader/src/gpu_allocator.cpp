@@ -0,0 +1,255 @@
+#include "gpu_allocator.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+
+namespace baas::gpu_allocator
+{
+    GpuAllocator::GpuAllocator(vk::PhysicalDevice physical_device, vk::Device device, vk::DeviceSize block_size)
+        : device(device), memory_properties(physical_device.getMemoryProperties()), block_size(block_size)
+    {
+    }
+
+    uint32_t GpuAllocator::find_memory_type(uint32_t type_bits, vk::MemoryPropertyFlags properties) const
+    {
+        for (uint32_t i = 0; i < memory_properties.memoryTypeCount; ++i)
+        {
+            if ((type_bits & (1u << i)) != 0 && (memory_properties.memoryTypes[i].propertyFlags & properties) == properties)
+            {
+                return i;
+            }
+        }
+        return UINT32_MAX;
+    }
+
+    GpuAllocator::MemoryBlock& GpuAllocator::add_block(Pool& pool, vk::DeviceSize size, bool dedicated)
+    {
+        auto memory = device.allocateMemoryUnique(vk::MemoryAllocateInfo(size, pool.memory_type));
+        std::byte* mapped{ nullptr };
+        if (memory_properties.memoryTypes[pool.memory_type].propertyFlags & vk::MemoryPropertyFlagBits::eHostVisible)
+        {
+            mapped = static_cast<std::byte*>(device.mapMemory(*memory, 0, VK_WHOLE_SIZE));
+        }
+        pool.blocks.push_back(std::make_unique<MemoryBlock>(MemoryBlock{ std::move(memory), mapped, tlsf_allocator::TlsfAllocator(size), dedicated }));
+        return *pool.blocks.back();
+    }
+
+    Allocation GpuAllocator::allocate(const vk::MemoryRequirements& requirements, vk::MemoryPropertyFlags required,
+        ResourceKind kind, vk::MemoryPropertyFlags preferred)
+    {
+        uint32_t memory_type = find_memory_type(requirements.memoryTypeBits, required | preferred);
+        if (memory_type == UINT32_MAX)
+        {
+            memory_type = find_memory_type(requirements.memoryTypeBits, required);
+        }
+        if (memory_type == UINT32_MAX)
+        {
+            throw std::runtime_error("Failed to find a suitable memory type");
+        }
+
+        std::lock_guard lock(mutex);
+        auto pool_it = std::find_if(pools.begin(), pools.end(), [&](const Pool& pool)
+            { return pool.memory_type == memory_type && pool.kind == kind; });
+        if (pool_it == pools.end())
+        {
+            pools.push_back(Pool{ memory_type, kind, {} });
+            pool_it = pools.end() - 1;
+        }
+        auto& pool = *pool_it;
+
+        // Anything over half a block would mostly waste the rest of it.
+        MemoryBlock* block{ nullptr };
+        std::optional<tlsf_allocator::Allocation> range;
+        if (requirements.size > block_size / 2)
+        {
+            block = &add_block(pool, requirements.size, true);
+            range = block->ranges.allocate(requirements.size, requirements.alignment);
+        }
+        else
+        {
+            for (auto&& candidate : pool.blocks)
+            {
+                if (!candidate->dedicated && (range = candidate->ranges.allocate(requirements.size, requirements.alignment)))
+                {
+                    block = candidate.get();
+                    break;
+                }
+            }
+            if (block == nullptr)
+            {
+                block = &add_block(pool, block_size, false);
+                range = block->ranges.allocate(requirements.size, requirements.alignment);
+            }
+        }
+        if (!range)
+        {
+            throw std::runtime_error("GPU allocation of " + std::to_string(requirements.size) + " bytes failed");
+        }
+
+        Allocation allocation;
+        allocation.memory = *block->memory;
+        allocation.offset = range->offset;
+        allocation.size = range->size;
+        allocation.mapped = block->mapped != nullptr ? block->mapped + range->offset : nullptr;
+        allocation.pool = static_cast<uint32_t>(pool_it - pools.begin());
+        allocation.block = block;
+        allocation.range = *range;
+        return allocation;
+    }
+
+    void GpuAllocator::free(Allocation& allocation)
+    {
+        if (!allocation)
+        {
+            return;
+        }
+        std::lock_guard lock(mutex);
+        auto& pool = pools.at(allocation.pool);
+        auto block_it = std::find_if(pool.blocks.begin(), pool.blocks.end(), [&](const std::unique_ptr<MemoryBlock>& block)
+            { return block.get() == allocation.block; });
+        if (block_it == pool.blocks.end())
+        {
+            throw std::runtime_error("Freeing a GPU allocation from an unknown block");
+        }
+        auto& block = **block_it;
+        block.ranges.free(allocation.range);
+        // Keep one empty shared block per pool around so a free/allocate pair doesn't hit the driver.
+        bool last_shared = !block.dedicated && std::count_if(pool.blocks.begin(), pool.blocks.end(),
+            [](const std::unique_ptr<MemoryBlock>& other) { return !other->dedicated; }) == 1;
+        if (block.ranges.empty() && !last_shared)
+        {
+            pool.blocks.erase(block_it);
+        }
+        allocation = Allocation{};
+    }
+
+    Stats GpuAllocator::stats() const
+    {
+        std::lock_guard lock(mutex);
+        Stats result{};
+        vk::DeviceSize bytes_free{ 0 };
+        for (auto&& pool : pools)
+        {
+            for (auto&& block : pool.blocks)
+            {
+                auto block_stats = block->ranges.stats();
+                result.bytes_used += block_stats.bytes_used;
+                result.bytes_reserved += block_stats.capacity;
+                result.largest_free_block = std::max(result.largest_free_block, block_stats.largest_free_block);
+                result.allocation_count += block_stats.allocation_count;
+                bytes_free += block_stats.bytes_free;
+                ++result.block_count;
+            }
+        }
+        if (bytes_free > 0)
+        {
+            result.fragmentation = 1.0 - static_cast<double>(result.largest_free_block) / bytes_free;
+        }
+        return result;
+    }
+
+    std::string GpuAllocator::report() const
+    {
+        auto current = stats();
+        char line[256];
+        std::snprintf(line, sizeof(line), "GPU memory: %.1f of %.1f MiB used, %u allocations in %u blocks, fragmentation %.3f",
+            current.bytes_used / 1048576.0, current.bytes_reserved / 1048576.0, current.allocation_count,
+            current.block_count, current.fragmentation);
+        return line;
+    }
+
+    Buffer::Buffer(GpuAllocator& allocator, vk::DeviceSize size, vk::BufferUsageFlags usage,
+        vk::MemoryPropertyFlags required, vk::MemoryPropertyFlags preferred, std::span<const uint32_t> queue_families)
+        : owner(&allocator), buffer_size(size)
+    {
+        auto device = allocator.get_device();
+        auto create_info = vk::BufferCreateInfo({}, size, usage, vk::SharingMode::eExclusive);
+        std::vector<uint32_t> families(queue_families.begin(), queue_families.end());
+        std::sort(families.begin(), families.end());
+        families.erase(std::unique(families.begin(), families.end()), families.end());
+        if (families.size() > 1)
+        {
+            create_info.setSharingMode(vk::SharingMode::eConcurrent).setQueueFamilyIndices(families);
+        }
+        buffer = device.createBufferUnique(create_info);
+        allocation = allocator.allocate(device.getBufferMemoryRequirements(*buffer), required, ResourceKind::buffer, preferred);
+        device.bindBufferMemory(*buffer, allocation.memory, allocation.offset);
+    }
+
+    Buffer::Buffer(Buffer&& other) noexcept
+        : owner(other.owner), buffer(std::move(other.buffer)), allocation(std::exchange(other.allocation, {})),
+          buffer_size(other.buffer_size)
+    {
+    }
+
+    Buffer& Buffer::operator=(Buffer&& other) noexcept
+    {
+        if (this != &other)
+        {
+            release();
+            owner = other.owner;
+            buffer = std::move(other.buffer);
+            allocation = std::exchange(other.allocation, {});
+            buffer_size = other.buffer_size;
+        }
+        return *this;
+    }
+
+    Buffer::~Buffer()
+    {
+        release();
+    }
+
+    void Buffer::release()
+    {
+        buffer.reset();
+        if (owner != nullptr)
+        {
+            owner->free(allocation);
+        }
+    }
+
+    Image::Image(GpuAllocator& allocator, const vk::ImageCreateInfo& create_info, vk::MemoryPropertyFlags required)
+        : owner(&allocator)
+    {
+        auto device = allocator.get_device();
+        image = device.createImageUnique(create_info);
+        auto kind = create_info.tiling == vk::ImageTiling::eLinear ? ResourceKind::buffer : ResourceKind::image;
+        allocation = allocator.allocate(device.getImageMemoryRequirements(*image), required, kind);
+        device.bindImageMemory(*image, allocation.memory, allocation.offset);
+    }
+
+    Image::Image(Image&& other) noexcept
+        : owner(other.owner), image(std::move(other.image)), allocation(std::exchange(other.allocation, {}))
+    {
+    }
+
+    Image& Image::operator=(Image&& other) noexcept
+    {
+        if (this != &other)
+        {
+            release();
+            owner = other.owner;
+            image = std::move(other.image);
+            allocation = std::exchange(other.allocation, {});
+        }
+        return *this;
+    }
+
+    Image::~Image()
+    {
+        release();
+    }
+
+    void Image::release()
+    {
+        image.reset();
+        if (owner != nullptr)
+        {
+            owner->free(allocation);
+        }
+    }
+}
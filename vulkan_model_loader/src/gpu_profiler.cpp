@@ -0,0 +1,178 @@
+#include "gpu_profiler.h"
+
+#include <stdexcept>
+
+#include "profiler.h"
+
+namespace baas::gpu_profiler
+{
+    GpuProfiler::GpuProfiler(vk::Instance instance, vk::PhysicalDevice physical_device, vk::Device device, vk::Queue queue, uint32_t queue_family,
+        std::mutex* queue_mutex, uint32_t frames_in_flight, bool calibrated_timestamps, uint32_t zones_per_frame)
+        : instance(instance), physical_device(physical_device), device(device), queue(queue), queue_family(queue_family), queue_mutex(queue_mutex),
+          calibrated_timestamps(calibrated_timestamps), zones_per_frame(zones_per_frame)
+    {
+        uint32_t valid_bits = physical_device.getQueueFamilyProperties()[queue_family].timestampValidBits;
+        if (valid_bits == 0)
+        {
+            return;
+        }
+        tick_mask = valid_bits >= 64 ? ~uint64_t{ 0 } : (uint64_t{ 1 } << valid_bits) - 1;
+        nanoseconds_per_tick = physical_device.getProperties().limits.timestampPeriod;
+        // Two queries per zone, begin and end.
+        query_pool = device.createQueryPoolUnique(vk::QueryPoolCreateInfo({}, vk::QueryType::eTimestamp, frames_in_flight * zones_per_frame * 2));
+        slots.resize(frames_in_flight);
+        calibrate();
+    }
+
+    void GpuProfiler::begin_frame(vk::CommandBuffer command_buffer, uint32_t frame_slot)
+    {
+        if (!available())
+        {
+            return;
+        }
+        current_slot = frame_slot;
+        auto& slot = slots[frame_slot];
+        uint32_t first_query = frame_slot * zones_per_frame * 2;
+        if (!slot.names.empty())
+        {
+            auto query_count = static_cast<uint32_t>(slot.names.size() * 2);
+            // No wait flag, the fence has passed. A frame that never got submitted reads as not ready and is dropped.
+            auto results = device.getQueryPoolResults<uint64_t>(*query_pool, first_query, query_count, query_count * sizeof(uint64_t), sizeof(uint64_t),
+                vk::QueryResultFlagBits::e64);
+            if (results.result == vk::Result::eSuccess)
+            {
+                auto to_ns = [this](uint64_t ticks)
+                {
+                    auto elapsed = static_cast<int64_t>(((ticks & tick_mask) - base_ticks) & tick_mask);
+                    // Ticks before the calibration point wrap around to the top of the mask.
+                    if (tick_mask != ~uint64_t{ 0 } && uint64_t(elapsed) > tick_mask / 2)
+                    {
+                        elapsed -= static_cast<int64_t>(tick_mask) + 1;
+                    }
+                    return base_ns + static_cast<int64_t>(static_cast<double>(elapsed) * nanoseconds_per_tick);
+                };
+                for (std::size_t zone = 0; zone < slot.names.size(); ++zone)
+                {
+                    profiler::Profiler::shared().record_gpu(slot.names[zone], to_ns(results.value[zone * 2]), to_ns(results.value[zone * 2 + 1]));
+                }
+            }
+            slot.names.clear();
+        }
+        command_buffer.resetQueryPool(*query_pool, first_query, zones_per_frame * 2);
+    }
+
+    uint32_t GpuProfiler::begin_zone(vk::CommandBuffer command_buffer, const char* name)
+    {
+        if (!available() || !profiler::Profiler::enabled())
+        {
+            return INVALID_ZONE;
+        }
+        auto& slot = slots[current_slot];
+        if (slot.names.size() >= zones_per_frame)
+        {
+            return INVALID_ZONE;
+        }
+        auto zone = static_cast<uint32_t>(slot.names.size());
+        slot.names.push_back(name);
+        command_buffer.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, *query_pool, (current_slot * zones_per_frame + zone) * 2);
+        return zone;
+    }
+
+    void GpuProfiler::end_zone(vk::CommandBuffer command_buffer, uint32_t zone)
+    {
+        if (zone == INVALID_ZONE)
+        {
+            return;
+        }
+        command_buffer.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, *query_pool, (current_slot * zones_per_frame + zone) * 2 + 1);
+    }
+
+    void GpuProfiler::calibrate()
+    {
+        if (!available())
+        {
+            return;
+        }
+        if (!calibrated_timestamps || !calibrate_with_extension())
+        {
+            calibrate_with_submit();
+        }
+    }
+
+    bool GpuProfiler::calibrate_with_extension()
+    {
+#ifdef __linux__
+        // Extension functions aren't exported by the loader, they are looked up like the debug messenger's.
+        auto get_time_domains = reinterpret_cast<PFN_vkGetPhysicalDeviceCalibrateableTimeDomainsEXT>(
+            instance.getProcAddr("vkGetPhysicalDeviceCalibrateableTimeDomainsEXT"));
+        auto get_timestamps = reinterpret_cast<PFN_vkGetCalibratedTimestampsEXT>(device.getProcAddr("vkGetCalibratedTimestampsEXT"));
+        if (get_time_domains == nullptr || get_timestamps == nullptr)
+        {
+            return false;
+        }
+        uint32_t domain_count{ 0 };
+        get_time_domains(physical_device, &domain_count, nullptr);
+        std::vector<VkTimeDomainEXT> domains(domain_count);
+        get_time_domains(physical_device, &domain_count, domains.data());
+        bool has_device{ false };
+        bool has_monotonic{ false };
+        for (auto domain : domains)
+        {
+            has_device |= domain == VK_TIME_DOMAIN_DEVICE_EXT;
+            has_monotonic |= domain == VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT;
+        }
+        if (!has_device || !has_monotonic)
+        {
+            return false;
+        }
+
+        // CLOCK_MONOTONIC is what steady_clock reads on Linux.
+        VkCalibratedTimestampInfoEXT infos[2] = { { VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT, nullptr, VK_TIME_DOMAIN_DEVICE_EXT },
+            { VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT, nullptr, VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT } };
+        uint64_t timestamps[2];
+        uint64_t max_deviation;
+        if (get_timestamps(device, 2, infos, timestamps, &max_deviation) != VK_SUCCESS)
+        {
+            return false;
+        }
+        base_ticks = timestamps[0] & tick_mask;
+        base_ns = static_cast<int64_t>(timestamps[1]);
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    void GpuProfiler::calibrate_with_submit()
+    {
+        // Writes one timestamp and takes the middle of the CPU time around the submit as the same moment.
+        // Off by up to half the round trip, which is still far below a frame.
+        auto pool = device.createCommandPoolUnique(vk::CommandPoolCreateInfo(vk::CommandPoolCreateFlagBits::eTransient, queue_family));
+        auto command_buffers = device.allocateCommandBuffersUnique(vk::CommandBufferAllocateInfo(*pool, vk::CommandBufferLevel::ePrimary, 1));
+        auto query = device.createQueryPoolUnique(vk::QueryPoolCreateInfo({}, vk::QueryType::eTimestamp, 1));
+        auto command_buffer = *command_buffers.front();
+        command_buffer.begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+        command_buffer.resetQueryPool(*query, 0, 1);
+        command_buffer.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, *query, 0);
+        command_buffer.end();
+        auto fence = device.createFenceUnique(vk::FenceCreateInfo());
+
+        auto before = profiler::now_ns();
+        {
+            std::unique_lock<std::mutex> lock;
+            if (queue_mutex != nullptr)
+            {
+                lock = std::unique_lock(*queue_mutex);
+            }
+            queue.submit(vk::SubmitInfo({}, {}, command_buffer), *fence);
+        }
+        if (device.waitForFences(*fence, vk::True, std::numeric_limits<uint64_t>::max()) != vk::Result::eSuccess)
+        {
+            throw std::runtime_error("Failed waiting for the timestamp calibration submit");
+        }
+        auto after = profiler::now_ns();
+        auto result = device.getQueryPoolResults<uint64_t>(*query, 0, 1, sizeof(uint64_t), sizeof(uint64_t), vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWait);
+        base_ticks = result.value.front() & tick_mask;
+        base_ns = before + (after - before) / 2;
+    }
+}
@@ -0,0 +1,188 @@
+#include "image_io.h"
+
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "file_ops.h"
+
+namespace baas::image_io
+{
+    namespace
+    {
+        void check_size(uint32_t width, uint32_t height, std::span<const uint8_t> rgba)
+        {
+            if (width == 0 || height == 0 || rgba.size() != static_cast<std::size_t>(width) * height * 4)
+            {
+                throw std::runtime_error("Image data doesn't match its size");
+            }
+        }
+
+        std::ofstream open_output(std::string_view path)
+        {
+            std::ofstream file(std::string(path), std::ios::binary | std::ios::trunc);
+            if (!file.is_open())
+            {
+                throw std::runtime_error("Failed to open file: " + std::string(path));
+            }
+            return file;
+        }
+
+        const std::array<uint32_t, 256>& crc_table()
+        {
+            static const std::array<uint32_t, 256> table = []
+            {
+                std::array<uint32_t, 256> result{};
+                for (uint32_t n = 0; n < 256; ++n)
+                {
+                    uint32_t c = n;
+                    for (int k = 0; k < 8; ++k)
+                    {
+                        c = (c & 1u) != 0 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                    }
+                    result[n] = c;
+                }
+                return result;
+            }();
+            return table;
+        }
+
+        void append_u32(std::vector<uint8_t>& out, uint32_t value)
+        {
+            out.insert(out.end(), { static_cast<uint8_t>(value >> 24), static_cast<uint8_t>(value >> 16),
+                static_cast<uint8_t>(value >> 8), static_cast<uint8_t>(value) });
+        }
+
+        void append_chunk(std::vector<uint8_t>& out, const char (&type)[5], std::span<const uint8_t> data)
+        {
+            append_u32(out, static_cast<uint32_t>(data.size()));
+            std::size_t crc_start = out.size();
+            out.insert(out.end(), type, type + 4);
+            out.insert(out.end(), data.begin(), data.end());
+            uint32_t crc = 0xFFFFFFFFu;
+            for (std::size_t i = crc_start; i < out.size(); ++i)
+            {
+                crc = crc_table()[(crc ^ out[i]) & 0xFFu] ^ (crc >> 8);
+            }
+            append_u32(out, crc ^ 0xFFFFFFFFu);
+        }
+    }
+
+    void write_ppm(std::string_view path, uint32_t width, uint32_t height, std::span<const uint8_t> rgba)
+    {
+        check_size(width, height, rgba);
+        std::vector<uint8_t> rgb;
+        rgb.reserve(static_cast<std::size_t>(width) * height * 3);
+        for (std::size_t i = 0; i < rgba.size(); i += 4)
+        {
+            rgb.insert(rgb.end(), { rgba[i], rgba[i + 1], rgba[i + 2] });
+        }
+        auto file = open_output(path);
+        file << "P6\n" << width << ' ' << height << "\n255\n";
+        file.write(reinterpret_cast<const char*>(rgb.data()), static_cast<std::streamsize>(rgb.size()));
+        if (!file)
+        {
+            throw std::runtime_error("Failed to write image: " + std::string(path));
+        }
+    }
+
+    void write_png(std::string_view path, uint32_t width, uint32_t height, std::span<const uint8_t> rgba)
+    {
+        check_size(width, height, rgba);
+
+        // Each RGB row is prefixed with filter type 0.
+        std::vector<uint8_t> raw;
+        raw.reserve(static_cast<std::size_t>(width * 3 + 1) * height);
+        for (uint32_t y = 0; y < height; ++y)
+        {
+            raw.push_back(0);
+            const uint8_t* row = rgba.data() + static_cast<std::size_t>(y) * width * 4;
+            for (uint32_t x = 0; x < width; ++x)
+            {
+                raw.insert(raw.end(), { row[x * 4], row[x * 4 + 1], row[x * 4 + 2] });
+            }
+        }
+
+        // zlib stream made of stored deflate blocks, at most 65535 bytes each.
+        std::vector<uint8_t> zlib{ 0x78, 0x01 };
+        for (std::size_t offset = 0; offset < raw.size() || offset == 0; offset += 65535)
+        {
+            auto length = static_cast<uint16_t>(std::min<std::size_t>(65535, raw.size() - offset));
+            bool last = offset + length >= raw.size();
+            zlib.insert(zlib.end(), { static_cast<uint8_t>(last ? 1 : 0), static_cast<uint8_t>(length),
+                static_cast<uint8_t>(length >> 8), static_cast<uint8_t>(~length), static_cast<uint8_t>(~length >> 8) });
+            zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + length);
+        }
+        uint32_t a{ 1 };
+        uint32_t b{ 0 };
+        for (uint8_t byte : raw)
+        {
+            a = (a + byte) % 65521u;
+            b = (b + a) % 65521u;
+        }
+        append_u32(zlib, (b << 16) | a);
+
+        std::vector<uint8_t> png{ 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+        std::vector<uint8_t> header;
+        append_u32(header, width);
+        append_u32(header, height);
+        // 8 bit depth, truecolor, deflate, adaptive filtering, no interlace.
+        header.insert(header.end(), { 8, 2, 0, 0, 0 });
+        append_chunk(png, "IHDR", header);
+        append_chunk(png, "IDAT", zlib);
+        append_chunk(png, "IEND", {});
+
+        auto file = open_output(path);
+        file.write(reinterpret_cast<const char*>(png.data()), static_cast<std::streamsize>(png.size()));
+        if (!file)
+        {
+            throw std::runtime_error("Failed to write image: " + std::string(path));
+        }
+    }
+
+    void write_image(std::string_view path, uint32_t width, uint32_t height, std::span<const uint8_t> rgba)
+    {
+        if (path.ends_with(".png"))
+        {
+            write_png(path, width, height, rgba);
+        }
+        else if (path.ends_with(".ppm"))
+        {
+            write_ppm(path, width, height, rgba);
+        }
+        else
+        {
+            throw std::runtime_error("Unsupported image extension: " + std::string(path));
+        }
+    }
+
+    DecodedImage decode_image(std::span<const std::byte> data)
+    {
+        auto bytes = reinterpret_cast<const uint8_t*>(data.data());
+        if (data.size() >= 8 && bytes[0] == 0x89 && bytes[1] == 'P' && bytes[2] == 'N' && bytes[3] == 'G')
+        {
+            return decode_png(data);
+        }
+        if (data.size() >= 3 && bytes[0] == 0xFF && bytes[1] == 0xD8 && bytes[2] == 0xFF)
+        {
+            return decode_jpeg(data);
+        }
+        throw std::runtime_error("Unsupported image format, only PNG and JPEG can be read");
+    }
+
+    DecodedImage read_image(std::string_view path)
+    {
+        auto file = file_ops::map_file(path, file_ops::AccessHint::sequential);
+        try
+        {
+            return decode_image(file.bytes());
+        }
+        catch (std::exception& ex)
+        {
+            throw std::runtime_error(std::string(ex.what()) + ": " + std::string(path));
+        }
+    }
+}
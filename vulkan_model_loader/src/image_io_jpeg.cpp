@@ -0,0 +1,745 @@
+#include "image_io.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+// Huffman coded JPEG decoding, sequential and progressive. Every scan adds to the quantized coefficients
+// of the whole image, the IDCT runs once they are complete.
+namespace baas::image_io
+{
+    namespace
+    {
+        constexpr uint8_t ZIGZAG[64] = { 0, 1, 8, 16, 9, 2, 3, 10, 17, 24, 32, 25, 18, 11, 4, 5, 12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6, 7, 14,
+            21, 28, 35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51, 58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63 };
+
+        // Entropy coded data is read most significant bit first, with the 0xFF00 byte stuffing removed.
+        // Hitting a marker feeds zeros until the decoder resyncs on it.
+        class ScanReader
+        {
+        public:
+            ScanReader(std::span<const uint8_t> data, std::size_t position)
+                : data(data), position(position)
+            {
+            }
+
+            uint32_t peek(uint32_t count)
+            {
+                if (bit_count < count)
+                {
+                    refill();
+                }
+                return bits >> (32 - count);
+            }
+
+            void consume(uint32_t count)
+            {
+                bits <<= count;
+                bit_count -= count;
+            }
+
+            uint32_t read(uint32_t count)
+            {
+                if (count == 0)
+                {
+                    return 0;
+                }
+                uint32_t value = peek(count);
+                consume(count);
+                return value;
+            }
+
+            // Drops the buffered bits and steps over the RSTn marker that has to follow. The last byte before
+            // it may not have been buffered yet if all it held was padding.
+            void restart()
+            {
+                bits = 0;
+                bit_count = 0;
+                at_marker = false;
+                while (position + 1 < data.size() && !(data[position] == 0xFF && (data[position + 1] & 0xF8u) == 0xD0))
+                {
+                    ++position;
+                }
+                if (position + 1 >= data.size())
+                {
+                    throw std::runtime_error("Missing JPEG restart marker");
+                }
+                position += 2;
+            }
+
+            // Where the marker parser picks up after the scan.
+            std::size_t end_position() const { return position; }
+
+        private:
+            std::span<const uint8_t> data;
+            std::size_t position;
+            uint32_t bits{ 0 };
+            uint32_t bit_count{ 0 };
+            bool at_marker{ false };
+            uint32_t padding{ 0 };
+
+            void refill()
+            {
+                while (bit_count <= 24)
+                {
+                    uint32_t byte{ 0 };
+                    if (!at_marker && position < data.size())
+                    {
+                        byte = data[position];
+                        if (byte == 0xFF)
+                        {
+                            uint8_t next = position + 1 < data.size() ? data[position + 1] : 0xD9;
+                            if (next == 0)
+                            {
+                                position += 2;
+                            }
+                            else
+                            {
+                                at_marker = true;
+                                byte = 0;
+                            }
+                        }
+                        else
+                        {
+                            ++position;
+                        }
+                    }
+                    else if (++padding > 1024)
+                    {
+                        // Some padding is normal at the end of a scan, this much means the data is broken.
+                        throw std::runtime_error("JPEG scan data is truncated");
+                    }
+                    bits |= byte << (24 - bit_count);
+                    bit_count += 8;
+                }
+            }
+        };
+
+        class JpegHuffman
+        {
+        public:
+            static constexpr uint32_t FAST_BITS = 9;
+
+            void build(const uint8_t* counts, std::span<const uint8_t> symbols)
+            {
+                std::copy(symbols.begin(), symbols.end(), values.begin());
+                fast.fill(0);
+                uint32_t code{ 0 };
+                uint32_t index{ 0 };
+                for (uint32_t length = 1; length <= 16; ++length)
+                {
+                    value_offset[length] = static_cast<int>(index) - static_cast<int>(code);
+                    for (uint32_t i = 0; i < counts[length - 1]; ++i, ++code, ++index)
+                    {
+                        if (length <= FAST_BITS)
+                        {
+                            uint32_t first = code << (FAST_BITS - length);
+                            for (uint32_t entry = 0; entry < 1u << (FAST_BITS - length); ++entry)
+                            {
+                                fast[first + entry] = static_cast<uint16_t>(values[index] << 8 | length);
+                            }
+                        }
+                    }
+                    // One past the largest code of this length, codes of the next length start above it.
+                    max_code[length] = static_cast<int>(code);
+                    if (code > 1u << length)
+                    {
+                        throw std::runtime_error("Invalid JPEG Huffman table");
+                    }
+                    code <<= 1;
+                }
+            }
+
+            uint32_t decode(ScanReader& reader) const
+            {
+                uint32_t bits = reader.peek(16);
+                uint16_t entry = fast[bits >> (16 - FAST_BITS)];
+                if (entry != 0)
+                {
+                    reader.consume(entry & 0xFFu);
+                    return entry >> 8;
+                }
+                for (uint32_t length = FAST_BITS + 1; length <= 16; ++length)
+                {
+                    auto code = static_cast<int>(bits >> (16 - length));
+                    if (code < max_code[length])
+                    {
+                        reader.consume(length);
+                        return values[static_cast<std::size_t>(code + value_offset[length]) & 0xFFu];
+                    }
+                }
+                throw std::runtime_error("Invalid JPEG Huffman code");
+            }
+
+        private:
+            std::array<uint16_t, 1u << FAST_BITS> fast{};
+            std::array<int, 17> max_code{};
+            std::array<int, 17> value_offset{};
+            std::array<uint8_t, 256> values{};
+        };
+
+        struct Component
+        {
+            uint8_t id;
+            uint32_t h;
+            uint32_t v;
+            uint32_t quantization;
+            uint32_t dc_table{ 0 };
+            uint32_t ac_table{ 0 };
+            int dc_prediction{ 0 };
+            // Whole MCUs worth of blocks, cropped when the pixels are assembled. Coefficients are in natural
+            // order and still quantized.
+            uint32_t blocks_x{ 0 };
+            uint32_t blocks_y{ 0 };
+            std::vector<int16_t> coefficients;
+            std::vector<uint8_t> samples;
+        };
+
+        int extend(uint32_t value, uint32_t bits)
+        {
+            return bits == 0 || value >= 1u << (bits - 1) ? static_cast<int>(value) : static_cast<int>(value) - static_cast<int>((1u << bits) - 1);
+        }
+
+        // Rounds half up rather than calling lround, which is measurably slower per sample.
+        uint8_t clamp_byte(float value)
+        {
+            return static_cast<uint8_t>(std::clamp(value, 0.0f, 255.0f) + 0.5f);
+        }
+
+        // AAN's scale factors cos(k pi / 16) sqrt(2), folded into the dequantization.
+        constexpr float AAN_SCALE[8] = { 1.0f, 1.387039845f, 1.306562965f, 1.175875602f, 1.0f, 0.785694958f, 0.541196100f, 0.275899379f };
+
+        // One dimensional 8 point IDCT of the AAN factorization (as in libjpeg's jidctflt), in place on
+        // values step apart.
+        void idct_8(float* values, int step)
+        {
+            float even0 = values[0];
+            float even1 = values[2 * step];
+            float even2 = values[4 * step];
+            float even3 = values[6 * step];
+            float sum02 = even0 + even2;
+            float difference02 = even0 - even2;
+            float sum13 = even1 + even3;
+            float rotated13 = (even1 - even3) * 1.414213562f - sum13;
+            even0 = sum02 + sum13;
+            even3 = sum02 - sum13;
+            even1 = difference02 + rotated13;
+            even2 = difference02 - rotated13;
+
+            float odd0 = values[step];
+            float odd1 = values[3 * step];
+            float odd2 = values[5 * step];
+            float odd3 = values[7 * step];
+            float z13 = odd2 + odd1;
+            float z10 = odd2 - odd1;
+            float z11 = odd0 + odd3;
+            float z12 = odd0 - odd3;
+            float sum = z11 + z13;
+            float rotated = (z11 - z13) * 1.414213562f;
+            float z5 = (z10 + z12) * 1.847759065f;
+            float part10 = 1.082392200f * z12 - z5;
+            float part12 = -2.613125930f * z10 + z5;
+            float out6 = part12 - sum;
+            float out5 = rotated - out6;
+            float out4 = part10 + out5;
+
+            values[0] = even0 + sum;
+            values[7 * step] = even0 - sum;
+            values[step] = even1 + out6;
+            values[6 * step] = even1 - out6;
+            values[2 * step] = even2 + out5;
+            values[5 * step] = even2 - out5;
+            values[4 * step] = even3 + out4;
+            values[3 * step] = even3 - out4;
+        }
+
+        // Coefficients in natural order, dequantized with the AAN scale factors. Overwritten.
+        void inverse_dct(float* coefficients, uint8_t* out, uint32_t stride)
+        {
+            for (int column = 0; column < 8; ++column)
+            {
+                idct_8(coefficients + column, 8);
+            }
+            for (int row = 0; row < 8; ++row)
+            {
+                float* values = coefficients + row * 8;
+                idct_8(values, 1);
+                for (int x = 0; x < 8; ++x)
+                {
+                    // Both passes together scale by 8.
+                    out[row * stride + x] = clamp_byte(values[x] * 0.125f + 128.0f);
+                }
+            }
+        }
+
+    }
+
+    DecodedImage decode_jpeg(std::span<const std::byte> data)
+    {
+        auto bytes = std::span(reinterpret_cast<const uint8_t*>(data.data()), data.size());
+        if (bytes.size() < 4 || bytes[0] != 0xFF || bytes[1] != 0xD8)
+        {
+            throw std::runtime_error("Not a JPEG file");
+        }
+
+        std::array<std::array<uint16_t, 64>, 4> quantization{};
+        std::array<JpegHuffman, 4> dc_tables;
+        std::array<JpegHuffman, 4> ac_tables;
+        std::vector<Component> components;
+        uint32_t width{ 0 };
+        uint32_t height{ 0 };
+        uint32_t restart_interval{ 0 };
+        int adobe_transform{ -1 };
+        uint32_t mcus_x{ 0 };
+        uint32_t mcus_y{ 0 };
+        uint32_t max_h{ 1 };
+        uint32_t max_v{ 1 };
+        bool progressive{ false };
+        bool decoded_scan{ false };
+
+        std::size_t position{ 2 };
+        auto read_u16 = [&](std::size_t at) { return static_cast<uint32_t>(bytes[at] << 8 | bytes[at + 1]); };
+        while (true)
+        {
+            // Markers may be preceded by any number of 0xFF fill bytes.
+            while (position < bytes.size() && bytes[position] != 0xFF)
+            {
+                ++position;
+            }
+            while (position < bytes.size() && bytes[position] == 0xFF)
+            {
+                ++position;
+            }
+            if (position >= bytes.size())
+            {
+                throw std::runtime_error("JPEG file is truncated");
+            }
+            uint8_t marker = bytes[position++];
+            if (marker == 0xD9)
+            {
+                break;
+            }
+            // Stuffed zero bytes of the scan's last few bits and stray restart markers.
+            if (marker == 0x00 || (marker >= 0xD0 && marker <= 0xD7))
+            {
+                continue;
+            }
+            if (position + 2 > bytes.size() || read_u16(position) < 2 || position + read_u16(position) > bytes.size())
+            {
+                throw std::runtime_error("JPEG file is truncated");
+            }
+            auto segment = bytes.subspan(position + 2, read_u16(position) - 2);
+            position += read_u16(position);
+
+            if (marker == 0xDB)
+            {
+                for (std::size_t offset = 0; offset < segment.size();)
+                {
+                    uint32_t precision = segment[offset] >> 4;
+                    uint32_t table = segment[offset] & 3u;
+                    std::size_t size = precision == 0 ? 64 : 128;
+                    if (offset + 1 + size > segment.size())
+                    {
+                        throw std::runtime_error("Invalid JPEG quantization table");
+                    }
+                    for (std::size_t i = 0; i < 64; ++i)
+                    {
+                        quantization[table][i] = precision == 0 ? segment[offset + 1 + i]
+                                                                : static_cast<uint16_t>(segment[offset + 1 + i * 2] << 8 | segment[offset + 2 + i * 2]);
+                    }
+                    offset += 1 + size;
+                }
+            }
+            else if (marker == 0xC4)
+            {
+                for (std::size_t offset = 0; offset < segment.size();)
+                {
+                    if (offset + 17 > segment.size())
+                    {
+                        throw std::runtime_error("Invalid JPEG Huffman table");
+                    }
+                    uint32_t table_class = segment[offset] >> 4;
+                    uint32_t table = segment[offset] & 3u;
+                    const uint8_t* counts = segment.data() + offset + 1;
+                    std::size_t symbol_count{ 0 };
+                    for (int i = 0; i < 16; ++i)
+                    {
+                        symbol_count += counts[i];
+                    }
+                    if (symbol_count > 256 || offset + 17 + symbol_count > segment.size())
+                    {
+                        throw std::runtime_error("Invalid JPEG Huffman table");
+                    }
+                    (table_class == 0 ? dc_tables : ac_tables)[table].build(counts, segment.subspan(offset + 17, symbol_count));
+                    offset += 17 + symbol_count;
+                }
+            }
+            else if (marker == 0xDD)
+            {
+                if (segment.size() < 2)
+                {
+                    throw std::runtime_error("Invalid JPEG restart interval");
+                }
+                restart_interval = static_cast<uint32_t>(segment[0] << 8 | segment[1]);
+            }
+            else if (marker == 0xEE)
+            {
+                if (segment.size() >= 12 && std::memcmp(segment.data(), "Adobe", 5) == 0)
+                {
+                    adobe_transform = segment[11];
+                }
+            }
+            else if (marker == 0xC0 || marker == 0xC1 || marker == 0xC2)
+            {
+                progressive = marker == 0xC2;
+                if (segment.size() < 6 || segment[0] != 8)
+                {
+                    throw std::runtime_error("Only 8 bit JPEG files are supported");
+                }
+                height = static_cast<uint32_t>(segment[1] << 8 | segment[2]);
+                width = static_cast<uint32_t>(segment[3] << 8 | segment[4]);
+                uint32_t count = segment[5];
+                if (width == 0 || height == 0 || width > 1u << 16 || height > 1u << 16)
+                {
+                    throw std::runtime_error("Unsupported JPEG size");
+                }
+                if ((count != 1 && count != 3) || segment.size() < 6 + count * 3)
+                {
+                    throw std::runtime_error("Only grayscale and three component JPEG files are supported");
+                }
+                components.clear();
+                for (uint32_t i = 0; i < count; ++i)
+                {
+                    auto* info = segment.data() + 6 + i * 3;
+                    Component component{};
+                    component.id = info[0];
+                    component.h = info[1] >> 4u;
+                    component.v = info[1] & 15u;
+                    component.quantization = info[2] & 3u;
+                    if (component.h == 0 || component.h > 4 || component.v == 0 || component.v > 4)
+                    {
+                        throw std::runtime_error("Invalid JPEG sampling factors");
+                    }
+                    max_h = std::max(max_h, component.h);
+                    max_v = std::max(max_v, component.v);
+                    components.push_back(std::move(component));
+                }
+                mcus_x = (width + max_h * 8 - 1) / (max_h * 8);
+                mcus_y = (height + max_v * 8 - 1) / (max_v * 8);
+                for (auto&& component : components)
+                {
+                    component.blocks_x = mcus_x * component.h;
+                    component.blocks_y = mcus_y * component.v;
+                    component.coefficients.assign(std::size_t{ component.blocks_x } * component.blocks_y * 64, 0);
+                }
+            }
+            else if ((marker >= 0xC3 && marker <= 0xCF) && marker != 0xC4 && marker != 0xC8 && marker != 0xCC)
+            {
+                throw std::runtime_error("Lossless and arithmetic coded JPEG files are not supported");
+            }
+            else if (marker == 0xDA)
+            {
+                if (components.empty())
+                {
+                    throw std::runtime_error("JPEG scan before the frame header");
+                }
+                uint32_t count = segment.empty() ? 0 : segment[0];
+                if (count == 0 || count > components.size() || segment.size() < 1 + count * 2 + 3)
+                {
+                    throw std::runtime_error("Invalid JPEG scan header");
+                }
+                std::vector<Component*> scan;
+                for (uint32_t i = 0; i < count; ++i)
+                {
+                    uint8_t id = segment[1 + i * 2];
+                    auto found = std::find_if(components.begin(), components.end(), [&](const Component& c) { return c.id == id; });
+                    if (found == components.end())
+                    {
+                        throw std::runtime_error("JPEG scan references an unknown component");
+                    }
+                    found->dc_table = segment[2 + i * 2] >> 4 & 3u;
+                    found->ac_table = segment[2 + i * 2] & 3u;
+                    found->dc_prediction = 0;
+                    scan.push_back(&*found);
+                }
+
+                uint32_t spectral_start = segment[1 + count * 2];
+                uint32_t spectral_end = segment[2 + count * 2];
+                uint32_t high_bit = segment[3 + count * 2] >> 4;
+                uint32_t low_bit = segment[3 + count * 2] & 15u;
+                bool valid = progressive ? spectral_start <= spectral_end && spectral_end < 64 && low_bit < 14 && (spectral_start == 0) == (spectral_end == 0) &&
+                        (spectral_start == 0 || count == 1)
+                                         : spectral_start == 0 && spectral_end == 63 && high_bit == 0 && low_bit == 0;
+                if (!valid)
+                {
+                    throw std::runtime_error("Invalid JPEG scan parameters");
+                }
+
+                ScanReader reader(bytes, position);
+                uint32_t end_of_band_run{ 0 };
+                auto decode_dc = [&](Component& component, int16_t* block)
+                {
+                    if (high_bit != 0)
+                    {
+                        // Refinement, one more bit of the DC value.
+                        if (reader.read(1) != 0)
+                        {
+                            block[0] = static_cast<int16_t>(block[0] | 1 << low_bit);
+                        }
+                        return;
+                    }
+                    uint32_t size = dc_tables[component.dc_table].decode(reader);
+                    if (size > 11)
+                    {
+                        throw std::runtime_error("Invalid JPEG DC coefficient");
+                    }
+                    component.dc_prediction += extend(reader.read(size), size);
+                    block[0] = static_cast<int16_t>(component.dc_prediction * (1 << low_bit));
+                };
+                auto decode_ac = [&](Component& component, int16_t* block)
+                {
+                    auto& table = ac_tables[component.ac_table];
+                    if (high_bit == 0)
+                    {
+                        // Sequential blocks and first progressive passes, run length coded values with a run of
+                        // empty bands after the end of band code.
+                        if (end_of_band_run > 0)
+                        {
+                            --end_of_band_run;
+                            return;
+                        }
+                        // Sequential scans cover DC and AC in one band.
+                        for (uint32_t k = std::max(spectral_start, 1u); k <= spectral_end;)
+                        {
+                            uint32_t run_size = table.decode(reader);
+                            uint32_t run = run_size >> 4;
+                            uint32_t bits = run_size & 15u;
+                            if (bits == 0)
+                            {
+                                if (run != 15)
+                                {
+                                    end_of_band_run = (1u << run) - 1 + reader.read(run);
+                                    break;
+                                }
+                                k += 16;
+                                continue;
+                            }
+                            k += run;
+                            if (k > spectral_end)
+                            {
+                                throw std::runtime_error("Invalid JPEG AC coefficient run");
+                            }
+                            block[ZIGZAG[k]] = static_cast<int16_t>(extend(reader.read(bits), bits) * (1 << low_bit));
+                            ++k;
+                        }
+                        return;
+                    }
+
+                    // Refinement, every coefficient that is already set gets a correction bit, new ones are
+                    // placed by counting runs of zeros.
+                    int bit = 1 << low_bit;
+                    auto refine = [&](int16_t& coefficient)
+                    {
+                        if (reader.read(1) != 0 && (coefficient & bit) == 0)
+                        {
+                            coefficient = static_cast<int16_t>(coefficient + (coefficient >= 0 ? bit : -bit));
+                        }
+                    };
+                    uint32_t k = spectral_start;
+                    if (end_of_band_run == 0)
+                    {
+                        while (k <= spectral_end)
+                        {
+                            uint32_t run_size = table.decode(reader);
+                            int run = static_cast<int>(run_size >> 4);
+                            int value{ 0 };
+                            if ((run_size & 15u) == 0)
+                            {
+                                if (run != 15)
+                                {
+                                    end_of_band_run = (1u << run) + reader.read(static_cast<uint32_t>(run));
+                                    break;
+                                }
+                            }
+                            else
+                            {
+                                value = reader.read(1) != 0 ? bit : -bit;
+                            }
+                            while (k <= spectral_end)
+                            {
+                                auto& coefficient = block[ZIGZAG[k++]];
+                                if (coefficient != 0)
+                                {
+                                    refine(coefficient);
+                                }
+                                else if (run-- == 0)
+                                {
+                                    coefficient = static_cast<int16_t>(value);
+                                    break;
+                                }
+                            }
+                        }
+                    }
+                    if (end_of_band_run > 0)
+                    {
+                        for (; k <= spectral_end; ++k)
+                        {
+                            auto& coefficient = block[ZIGZAG[k]];
+                            if (coefficient != 0)
+                            {
+                                refine(coefficient);
+                            }
+                        }
+                        --end_of_band_run;
+                    }
+                };
+                auto decode_block = [&](Component& component, uint32_t block_x, uint32_t block_y)
+                {
+                    int16_t* block = component.coefficients.data() + (std::size_t{ block_y } * component.blocks_x + block_x) * 64;
+                    if (spectral_start == 0)
+                    {
+                        decode_dc(component, block);
+                    }
+                    if (spectral_end != 0)
+                    {
+                        decode_ac(component, block);
+                    }
+                };
+
+                // Interleaved scans go MCU by MCU, a scan of one component goes block by block over just the
+                // blocks that cover the image.
+                uint32_t units_x{ mcus_x };
+                uint32_t units_y{ mcus_y };
+                if (scan.size() == 1)
+                {
+                    units_x = ((width * scan[0]->h + max_h - 1) / max_h + 7) / 8;
+                    units_y = ((height * scan[0]->v + max_v - 1) / max_v + 7) / 8;
+                }
+                uint32_t units_left = restart_interval;
+                for (uint32_t unit_y = 0; unit_y < units_y; ++unit_y)
+                {
+                    for (uint32_t unit_x = 0; unit_x < units_x; ++unit_x)
+                    {
+                        if (restart_interval != 0 && units_left == 0)
+                        {
+                            reader.restart();
+                            units_left = restart_interval;
+                            end_of_band_run = 0;
+                            for (auto* component : scan)
+                            {
+                                component->dc_prediction = 0;
+                            }
+                        }
+                        if (scan.size() == 1)
+                        {
+                            decode_block(*scan[0], unit_x, unit_y);
+                        }
+                        else
+                        {
+                            for (auto* component : scan)
+                            {
+                                for (uint32_t y = 0; y < component->v; ++y)
+                                {
+                                    for (uint32_t x = 0; x < component->h; ++x)
+                                    {
+                                        decode_block(*component, unit_x * component->h + x, unit_y * component->v + y);
+                                    }
+                                }
+                            }
+                        }
+                        --units_left;
+                    }
+                }
+                position = reader.end_position();
+                decoded_scan = true;
+            }
+        }
+        if (!decoded_scan)
+        {
+            throw std::runtime_error("JPEG file has no image data");
+        }
+
+        float coefficients[64];
+        for (auto&& component : components)
+        {
+            // Quantization in natural order with the IDCT's scale factors applied.
+            float dequantize[64];
+            for (uint32_t k = 0; k < 64; ++k)
+            {
+                uint32_t natural = ZIGZAG[k];
+                dequantize[natural] = quantization[component.quantization][k] * AAN_SCALE[natural / 8] * AAN_SCALE[natural % 8];
+            }
+            uint32_t stride = component.blocks_x * 8;
+            component.samples.resize(std::size_t{ stride } * component.blocks_y * 8);
+            for (uint32_t block_y = 0; block_y < component.blocks_y; ++block_y)
+            {
+                for (uint32_t block_x = 0; block_x < component.blocks_x; ++block_x)
+                {
+                    const int16_t* block = component.coefficients.data() + (std::size_t{ block_y } * component.blocks_x + block_x) * 64;
+                    for (uint32_t i = 0; i < 64; ++i)
+                    {
+                        coefficients[i] = block[i] * dequantize[i];
+                    }
+                    inverse_dct(coefficients, component.samples.data() + std::size_t{ block_y } * 8 * stride + block_x * 8, stride);
+                }
+            }
+        }
+
+        DecodedImage image;
+        image.width = width;
+        image.height = height;
+        image.rgba.resize(std::size_t{ width } * height * 4);
+        // Adobe's marker says whether three components are YCbCr, without it only components named R, G and B are taken as RGB.
+        bool rgb = components.size() == 3 &&
+            (adobe_transform == 0 || (adobe_transform == -1 && components[0].id == 'R' && components[1].id == 'G' && components[2].id == 'B'));
+        // Sample column of every pixel per component, subsampled components repeat theirs.
+        std::vector<std::vector<uint32_t>> columns(components.size());
+        for (std::size_t c = 0; c < components.size(); ++c)
+        {
+            columns[c].resize(width);
+            for (uint32_t x = 0; x < width; ++x)
+            {
+                columns[c][x] = x * components[c].h / max_h;
+            }
+        }
+        for (uint32_t y = 0; y < height; ++y)
+        {
+            uint8_t* out = image.rgba.data() + std::size_t{ y } * width * 4;
+            const uint8_t* rows[3];
+            for (std::size_t c = 0; c < components.size(); ++c)
+            {
+                rows[c] = components[c].samples.data() + std::size_t{ y * components[c].v / max_v } * components[c].blocks_x * 8;
+            }
+            for (uint32_t x = 0; x < width; ++x, out += 4)
+            {
+                uint8_t samples[3];
+                for (std::size_t c = 0; c < components.size(); ++c)
+                {
+                    samples[c] = rows[c][columns[c][x]];
+                }
+                if (components.size() == 1)
+                {
+                    out[0] = out[1] = out[2] = samples[0];
+                }
+                else if (rgb)
+                {
+                    std::memcpy(out, samples, 3);
+                }
+                else
+                {
+                    float luma = samples[0];
+                    float cb = samples[1] - 128.0f;
+                    float cr = samples[2] - 128.0f;
+                    out[0] = clamp_byte(luma + 1.402f * cr);
+                    out[1] = clamp_byte(luma - 0.344136f * cb - 0.714136f * cr);
+                    out[2] = clamp_byte(luma + 1.772f * cb);
+                }
+                out[3] = 255;
+            }
+        }
+        return image;
+    }
+}
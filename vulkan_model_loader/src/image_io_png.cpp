@@ -0,0 +1,657 @@
+#include "image_io.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+// PNG decoding with its own inflate, so textures load without pulling in zlib.
+namespace baas::image_io
+{
+    namespace
+    {
+        // Deflate streams are read least significant bit first, 64 bits are buffered at a time.
+        class BitReader
+        {
+        public:
+            explicit BitReader(std::span<const uint8_t> data)
+                : data(data)
+            {
+            }
+
+            uint32_t peek(uint32_t count)
+            {
+                if (bit_count < count)
+                {
+                    refill();
+                }
+                return static_cast<uint32_t>(bits & ((uint64_t{ 1 } << count) - 1));
+            }
+
+            void consume(uint32_t count)
+            {
+                bits >>= count;
+                bit_count -= count;
+            }
+
+            uint32_t read(uint32_t count)
+            {
+                if (count == 0)
+                {
+                    return 0;
+                }
+                uint32_t value = peek(count);
+                consume(count);
+                return value;
+            }
+
+            void align_to_byte() { consume(bit_count % 8); }
+
+            // Whole bytes past the end that were consumed, only zeros are read there.
+            bool overran() const { return position > data.size() + bit_count / 8; }
+
+        private:
+            std::span<const uint8_t> data;
+            std::size_t position{ 0 };
+            uint64_t bits{ 0 };
+            uint32_t bit_count{ 0 };
+
+            void refill()
+            {
+                while (bit_count <= 56)
+                {
+                    uint64_t byte = position < data.size() ? data[position] : 0;
+                    // A code can look up to 8 bytes ahead of what it uses, anything further means the data ran out.
+                    if (position >= data.size() + 8)
+                    {
+                        throw std::runtime_error("Compressed data is truncated");
+                    }
+                    bits |= byte << bit_count;
+                    bit_count += 8;
+                    ++position;
+                }
+            }
+        };
+
+        // Canonical Huffman code. Codes up to FAST_BITS long decode with one table lookup, longer ones
+        // walk the code lengths.
+        class Huffman
+        {
+        public:
+            static constexpr uint32_t FAST_BITS = 10;
+            static constexpr uint32_t MAX_BITS = 15;
+
+            void build(const uint8_t* lengths, uint32_t count)
+            {
+                counts.fill(0);
+                fast.fill(0);
+                for (uint32_t symbol = 0; symbol < count; ++symbol)
+                {
+                    ++counts[lengths[symbol]];
+                }
+                counts[0] = 0;
+                int left = 1;
+                for (uint32_t length = 1; length <= MAX_BITS; ++length)
+                {
+                    left = left * 2 - counts[length];
+                    if (left < 0)
+                    {
+                        throw std::runtime_error("Over-subscribed Huffman code");
+                    }
+                }
+
+                std::array<uint16_t, MAX_BITS + 2> offsets{};
+                for (uint32_t length = 1; length <= MAX_BITS; ++length)
+                {
+                    offsets[length + 1] = static_cast<uint16_t>(offsets[length] + counts[length]);
+                }
+                std::array<uint32_t, MAX_BITS + 1> next_code{};
+                for (uint32_t length = 2; length <= MAX_BITS; ++length)
+                {
+                    next_code[length] = (next_code[length - 1] + counts[length - 1]) << 1;
+                }
+                for (uint32_t symbol = 0; symbol < count; ++symbol)
+                {
+                    uint32_t length = lengths[symbol];
+                    if (length == 0)
+                    {
+                        continue;
+                    }
+                    symbols[offsets[length]++] = static_cast<uint16_t>(symbol);
+                    uint32_t symbol_code = next_code[length]++;
+                    if (length <= FAST_BITS)
+                    {
+                        // The stream holds codes most significant bit first, the table is indexed by the reversed bits.
+                        uint32_t reversed{ 0 };
+                        for (uint32_t bit = 0; bit < length; ++bit)
+                        {
+                            reversed |= ((symbol_code >> bit) & 1u) << (length - 1 - bit);
+                        }
+                        for (uint32_t entry = reversed; entry < (1u << FAST_BITS); entry += 1u << length)
+                        {
+                            fast[entry] = static_cast<uint16_t>(symbol << 4 | length);
+                        }
+                    }
+                }
+            }
+
+            uint32_t decode(BitReader& reader) const
+            {
+                uint32_t bits = reader.peek(MAX_BITS);
+                uint16_t entry = fast[bits & ((1u << FAST_BITS) - 1)];
+                if (entry != 0)
+                {
+                    reader.consume(entry & 15u);
+                    return entry >> 4;
+                }
+                int code{ 0 };
+                int first{ 0 };
+                int index{ 0 };
+                for (uint32_t length = 1; length <= MAX_BITS; ++length)
+                {
+                    code |= static_cast<int>((bits >> (length - 1)) & 1u);
+                    int count = counts[length];
+                    if (code - first < count)
+                    {
+                        reader.consume(length);
+                        return symbols[index + code - first];
+                    }
+                    index += count;
+                    first = (first + count) << 1;
+                    code <<= 1;
+                }
+                throw std::runtime_error("Invalid Huffman code");
+            }
+
+        private:
+            std::array<uint16_t, 1u << FAST_BITS> fast{};
+            std::array<uint16_t, MAX_BITS + 1> counts{};
+            std::array<uint16_t, 288> symbols{};
+        };
+
+        constexpr uint16_t LENGTH_BASE[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115,
+            131, 163, 195, 227, 258 };
+        constexpr uint8_t LENGTH_EXTRA[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+        constexpr uint16_t DISTANCE_BASE[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537,
+            2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+        constexpr uint8_t DISTANCE_EXTRA[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+        void inflate_codes(BitReader& reader, const Huffman& literals, const Huffman& distances, std::vector<uint8_t>& out, std::size_t limit)
+        {
+            while (true)
+            {
+                uint32_t symbol = literals.decode(reader);
+                if (symbol < 256)
+                {
+                    if (out.size() >= limit)
+                    {
+                        throw std::runtime_error("Compressed data is larger than expected");
+                    }
+                    out.push_back(static_cast<uint8_t>(symbol));
+                    continue;
+                }
+                if (symbol == 256)
+                {
+                    return;
+                }
+                symbol -= 257;
+                if (symbol >= 29)
+                {
+                    throw std::runtime_error("Invalid deflate length code");
+                }
+                std::size_t length = LENGTH_BASE[symbol] + reader.read(LENGTH_EXTRA[symbol]);
+                uint32_t distance_symbol = distances.decode(reader);
+                if (distance_symbol >= 30)
+                {
+                    throw std::runtime_error("Invalid deflate distance code");
+                }
+                std::size_t distance = DISTANCE_BASE[distance_symbol] + reader.read(DISTANCE_EXTRA[distance_symbol]);
+                if (distance > out.size() || out.size() + length > limit)
+                {
+                    throw std::runtime_error("Invalid deflate back reference");
+                }
+                // Byte by byte, the copy may overlap what it writes.
+                std::size_t from = out.size() - distance;
+                for (std::size_t i = 0; i < length; ++i)
+                {
+                    out.push_back(out[from + i]);
+                }
+            }
+        }
+
+        const std::pair<Huffman, Huffman>& fixed_codes()
+        {
+            static const std::pair<Huffman, Huffman> codes = []
+            {
+                std::array<uint8_t, 288> lengths{};
+                std::memset(lengths.data(), 8, 144);
+                std::memset(lengths.data() + 144, 9, 112);
+                std::memset(lengths.data() + 256, 7, 24);
+                std::memset(lengths.data() + 280, 8, 8);
+                std::pair<Huffman, Huffman> result;
+                result.first.build(lengths.data(), 288);
+                std::array<uint8_t, 30> distance_lengths;
+                distance_lengths.fill(5);
+                result.second.build(distance_lengths.data(), 30);
+                return result;
+            }();
+            return codes;
+        }
+
+        void read_dynamic_codes(BitReader& reader, Huffman& literals, Huffman& distances)
+        {
+            constexpr uint8_t ORDER[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+            uint32_t literal_count = reader.read(5) + 257;
+            uint32_t distance_count = reader.read(5) + 1;
+            uint32_t length_count = reader.read(4) + 4;
+            std::array<uint8_t, 19> code_lengths{};
+            for (uint32_t i = 0; i < length_count; ++i)
+            {
+                code_lengths[ORDER[i]] = static_cast<uint8_t>(reader.read(3));
+            }
+            Huffman lengths_code;
+            lengths_code.build(code_lengths.data(), 19);
+
+            std::array<uint8_t, 288 + 32> lengths{};
+            uint32_t total = literal_count + distance_count;
+            for (uint32_t i = 0; i < total;)
+            {
+                uint32_t symbol = lengths_code.decode(reader);
+                if (symbol < 16)
+                {
+                    lengths[i++] = static_cast<uint8_t>(symbol);
+                    continue;
+                }
+                uint8_t value{ 0 };
+                uint32_t repeat;
+                if (symbol == 16)
+                {
+                    if (i == 0)
+                    {
+                        throw std::runtime_error("Deflate length repeat without a previous length");
+                    }
+                    value = lengths[i - 1];
+                    repeat = 3 + reader.read(2);
+                }
+                else if (symbol == 17)
+                {
+                    repeat = 3 + reader.read(3);
+                }
+                else
+                {
+                    repeat = 11 + reader.read(7);
+                }
+                if (i + repeat > total)
+                {
+                    throw std::runtime_error("Deflate code lengths overflow");
+                }
+                std::memset(lengths.data() + i, value, repeat);
+                i += repeat;
+            }
+            literals.build(lengths.data(), literal_count);
+            distances.build(lengths.data() + literal_count, distance_count);
+        }
+
+        // zlib stream to exactly expected_size bytes.
+        std::vector<uint8_t> inflate_zlib(std::span<const uint8_t> data, std::size_t expected_size)
+        {
+            if (data.size() < 6 || (data[0] & 0x0Fu) != 8 || ((data[0] << 8) | data[1]) % 31 != 0 || (data[1] & 0x20u) != 0)
+            {
+                throw std::runtime_error("Invalid zlib header");
+            }
+            std::vector<uint8_t> out;
+            out.reserve(expected_size);
+            BitReader reader(data.subspan(2));
+            Huffman literals;
+            Huffman distances;
+            bool last{ false };
+            while (!last)
+            {
+                last = reader.read(1) != 0;
+                uint32_t type = reader.read(2);
+                if (type == 0)
+                {
+                    reader.align_to_byte();
+                    uint32_t length = reader.read(16);
+                    if ((length ^ 0xFFFFu) != reader.read(16))
+                    {
+                        throw std::runtime_error("Invalid stored deflate block");
+                    }
+                    if (out.size() + length > expected_size)
+                    {
+                        throw std::runtime_error("Compressed data is larger than expected");
+                    }
+                    for (uint32_t i = 0; i < length; ++i)
+                    {
+                        out.push_back(static_cast<uint8_t>(reader.read(8)));
+                    }
+                }
+                else if (type == 1)
+                {
+                    inflate_codes(reader, fixed_codes().first, fixed_codes().second, out, expected_size);
+                }
+                else if (type == 2)
+                {
+                    read_dynamic_codes(reader, literals, distances);
+                    inflate_codes(reader, literals, distances, out, expected_size);
+                }
+                else
+                {
+                    throw std::runtime_error("Invalid deflate block type");
+                }
+                if (reader.overran())
+                {
+                    throw std::runtime_error("Compressed data is truncated");
+                }
+            }
+            if (out.size() != expected_size)
+            {
+                throw std::runtime_error("Compressed data is smaller than expected");
+            }
+            reader.align_to_byte();
+            uint32_t checksum{ 0 };
+            for (int i = 0; i < 4; ++i)
+            {
+                checksum = checksum << 8 | reader.read(8);
+            }
+            if (reader.overran())
+            {
+                throw std::runtime_error("Compressed data is truncated");
+            }
+            uint32_t a{ 1 };
+            uint32_t b{ 0 };
+            // Deferring the modulo for 5552 bytes can't overflow 32 bits.
+            for (std::size_t offset = 0; offset < out.size(); offset += 5552)
+            {
+                std::size_t end = std::min(out.size(), offset + 5552);
+                for (std::size_t i = offset; i < end; ++i)
+                {
+                    a += out[i];
+                    b += a;
+                }
+                a %= 65521u;
+                b %= 65521u;
+            }
+            if (((b << 16) | a) != checksum)
+            {
+                throw std::runtime_error("zlib checksum mismatch");
+            }
+            return out;
+        }
+
+        uint32_t read_u32(const uint8_t* bytes)
+        {
+            return uint32_t{ bytes[0] } << 24 | uint32_t{ bytes[1] } << 16 | uint32_t{ bytes[2] } << 8 | bytes[3];
+        }
+
+        uint8_t paeth(int a, int b, int c)
+        {
+            int p = a + b - c;
+            int pa = std::abs(p - a);
+            int pb = std::abs(p - b);
+            int pc = std::abs(p - c);
+            if (pa <= pb && pa <= pc)
+            {
+                return static_cast<uint8_t>(a);
+            }
+            return static_cast<uint8_t>(pb <= pc ? b : c);
+        }
+
+        // Undoes the filter of one row in place, previous is empty for the first row of a pass.
+        void unfilter_row(uint8_t filter, uint8_t* row, const uint8_t* previous, std::size_t length, std::size_t stride)
+        {
+            switch (filter)
+            {
+            case 0:
+                break;
+            case 1:
+                for (std::size_t i = stride; i < length; ++i)
+                {
+                    row[i] = static_cast<uint8_t>(row[i] + row[i - stride]);
+                }
+                break;
+            case 2:
+                for (std::size_t i = 0; previous != nullptr && i < length; ++i)
+                {
+                    row[i] = static_cast<uint8_t>(row[i] + previous[i]);
+                }
+                break;
+            case 3:
+                for (std::size_t i = 0; i < length; ++i)
+                {
+                    int left = i >= stride ? row[i - stride] : 0;
+                    int up = previous != nullptr ? previous[i] : 0;
+                    row[i] = static_cast<uint8_t>(row[i] + ((left + up) >> 1));
+                }
+                break;
+            case 4:
+                for (std::size_t i = 0; i < length; ++i)
+                {
+                    int left = i >= stride ? row[i - stride] : 0;
+                    int up = previous != nullptr ? previous[i] : 0;
+                    int up_left = i >= stride && previous != nullptr ? previous[i - stride] : 0;
+                    row[i] = static_cast<uint8_t>(row[i] + paeth(left, up, up_left));
+                }
+                break;
+            default:
+                throw std::runtime_error("Invalid PNG filter type");
+            }
+        }
+
+        struct PngHeader
+        {
+            uint32_t width;
+            uint32_t height;
+            uint32_t bit_depth;
+            uint32_t color_type;
+            bool interlaced;
+            uint32_t channels;
+        };
+
+        // One unfiltered row to RGBA, writing every step'th pixel of the output row.
+        void expand_row(const PngHeader& header, const uint8_t* row, uint32_t pixel_count, uint8_t* out, uint32_t step,
+            std::span<const uint8_t> palette, std::span<const uint8_t> transparency)
+        {
+            uint32_t depth = header.bit_depth;
+            uint32_t max_value = (1u << depth) - 1;
+            auto sample = [&](uint32_t index) -> uint32_t
+            {
+                if (depth == 8)
+                {
+                    return row[index];
+                }
+                if (depth == 16)
+                {
+                    return uint32_t{ row[index * 2] } << 8 | row[index * 2 + 1];
+                }
+                uint32_t bit = index * depth;
+                return (row[bit / 8] >> (8 - depth - bit % 8)) & max_value;
+            };
+            auto to_byte = [&](uint32_t value) { return static_cast<uint8_t>(depth == 16 ? value >> 8 : value * 255 / max_value); };
+            bool has_key = !transparency.empty() && header.color_type != 3;
+            auto key = [&](uint32_t channel) { return uint32_t{ transparency[channel * 2] } << 8 | transparency[channel * 2 + 1]; };
+
+            for (uint32_t x = 0; x < pixel_count; ++x, out += step * 4)
+            {
+                uint32_t base = x * header.channels;
+                switch (header.color_type)
+                {
+                case 0:
+                {
+                    uint32_t gray = sample(base);
+                    out[0] = out[1] = out[2] = to_byte(gray);
+                    out[3] = has_key && gray == key(0) ? 0 : 255;
+                    break;
+                }
+                case 2:
+                {
+                    uint32_t r = sample(base);
+                    uint32_t g = sample(base + 1);
+                    uint32_t b = sample(base + 2);
+                    out[0] = to_byte(r);
+                    out[1] = to_byte(g);
+                    out[2] = to_byte(b);
+                    out[3] = has_key && r == key(0) && g == key(1) && b == key(2) ? 0 : 255;
+                    break;
+                }
+                case 3:
+                {
+                    uint32_t index = sample(base);
+                    if (index * 3 + 2 >= palette.size())
+                    {
+                        throw std::runtime_error("PNG palette index out of range");
+                    }
+                    std::memcpy(out, palette.data() + index * 3, 3);
+                    out[3] = index < transparency.size() ? transparency[index] : 255;
+                    break;
+                }
+                case 4:
+                    out[0] = out[1] = out[2] = to_byte(sample(base));
+                    out[3] = to_byte(sample(base + 1));
+                    break;
+                default:
+                    for (uint32_t channel = 0; channel < 4; ++channel)
+                    {
+                        out[channel] = to_byte(sample(base + channel));
+                    }
+                    break;
+                }
+            }
+        }
+    }
+
+    DecodedImage decode_png(std::span<const std::byte> data)
+    {
+        constexpr uint8_t SIGNATURE[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+        auto bytes = std::span(reinterpret_cast<const uint8_t*>(data.data()), data.size());
+        if (bytes.size() < 8 || std::memcmp(bytes.data(), SIGNATURE, 8) != 0)
+        {
+            throw std::runtime_error("Not a PNG file");
+        }
+
+        PngHeader header{};
+        bool has_header{ false };
+        std::span<const uint8_t> palette;
+        std::span<const uint8_t> transparency;
+        std::vector<uint8_t> compressed;
+        std::size_t offset{ 8 };
+        while (true)
+        {
+            if (offset + 12 > bytes.size())
+            {
+                throw std::runtime_error("PNG file is truncated");
+            }
+            uint32_t length = read_u32(bytes.data() + offset);
+            auto type = std::string_view(reinterpret_cast<const char*>(bytes.data() + offset + 4), 4);
+            if (length > bytes.size() - offset - 12)
+            {
+                throw std::runtime_error("PNG file is truncated");
+            }
+            auto chunk = bytes.subspan(offset + 8, length);
+            offset += 12 + std::size_t{ length };
+            if (type == "IHDR")
+            {
+                if (length != 13)
+                {
+                    throw std::runtime_error("Invalid PNG header");
+                }
+                header.width = read_u32(chunk.data());
+                header.height = read_u32(chunk.data() + 4);
+                header.bit_depth = chunk[8];
+                header.color_type = chunk[9];
+                header.interlaced = chunk[12] == 1;
+                has_header = true;
+            }
+            else if (type == "PLTE")
+            {
+                palette = chunk;
+            }
+            else if (type == "tRNS")
+            {
+                transparency = chunk;
+            }
+            else if (type == "IDAT")
+            {
+                compressed.insert(compressed.end(), chunk.begin(), chunk.end());
+            }
+            else if (type == "IEND")
+            {
+                break;
+            }
+            else if ((type[0] & 0x20) == 0)
+            {
+                throw std::runtime_error("Unknown critical PNG chunk " + std::string(type));
+            }
+        }
+
+        constexpr uint32_t CHANNELS[7] = { 1, 0, 3, 1, 2, 0, 4 };
+        uint32_t depth = header.bit_depth;
+        bool valid_depth = depth == 1 || depth == 2 || depth == 4 || depth == 8 || depth == 16;
+        if (!has_header || header.width == 0 || header.height == 0 || header.color_type > 6 || CHANNELS[header.color_type] == 0 || !valid_depth ||
+            (header.color_type == 3 && depth == 16) || (header.color_type != 0 && header.color_type != 3 && depth < 8) ||
+            (header.color_type == 3 && palette.empty()))
+        {
+            throw std::runtime_error("Unsupported PNG header");
+        }
+        if (header.width > 1u << 16 || header.height > 1u << 16)
+        {
+            throw std::runtime_error("PNG image is too large");
+        }
+        header.channels = CHANNELS[header.color_type];
+        uint32_t bits_per_pixel = header.channels * depth;
+        std::size_t stride = std::max(1u, bits_per_pixel / 8);
+
+        // Adam7 passes as first x, first y, x step, y step. Non interlaced images are one pass over everything.
+        struct Pass
+        {
+            uint32_t x, y, dx, dy;
+        };
+        constexpr Pass ADAM7[7] = { { 0, 0, 8, 8 }, { 4, 0, 8, 8 }, { 0, 4, 4, 8 }, { 2, 0, 4, 4 }, { 0, 2, 2, 4 }, { 1, 0, 2, 2 }, { 0, 1, 1, 2 } };
+        constexpr Pass SINGLE[1] = { { 0, 0, 1, 1 } };
+        auto passes = header.interlaced ? std::span<const Pass>(ADAM7) : std::span<const Pass>(SINGLE);
+        auto pass_size = [&](const Pass& pass)
+        {
+            uint32_t width = header.width > pass.x ? (header.width - pass.x + pass.dx - 1) / pass.dx : 0;
+            uint32_t height = header.height > pass.y ? (header.height - pass.y + pass.dy - 1) / pass.dy : 0;
+            return std::pair{ width, height };
+        };
+        std::size_t raw_size{ 0 };
+        for (auto&& pass : passes)
+        {
+            auto [width, height] = pass_size(pass);
+            if (width != 0 && height != 0)
+            {
+                raw_size += std::size_t{ height } * (1 + (std::size_t{ width } * bits_per_pixel + 7) / 8);
+            }
+        }
+        auto raw = inflate_zlib(compressed, raw_size);
+
+        DecodedImage image;
+        image.width = header.width;
+        image.height = header.height;
+        image.rgba.resize(std::size_t{ header.width } * header.height * 4);
+        uint8_t* position = raw.data();
+        for (auto&& pass : passes)
+        {
+            auto [width, height] = pass_size(pass);
+            if (width == 0 || height == 0)
+            {
+                continue;
+            }
+            std::size_t row_length = (std::size_t{ width } * bits_per_pixel + 7) / 8;
+            const uint8_t* previous = nullptr;
+            for (uint32_t y = 0; y < height; ++y)
+            {
+                uint8_t* row = position + 1;
+                unfilter_row(position[0], row, previous, row_length, stride);
+                uint8_t* out = image.rgba.data() + (std::size_t{ pass.y + y * pass.dy } * header.width + pass.x) * 4;
+                expand_row(header, row, width, out, pass.dx, palette, transparency);
+                previous = row;
+                position += 1 + row_length;
+            }
+        }
+        return image;
+    }
+}
@@ -0,0 +1,408 @@
+#include "job_system.h"
+
+#include <algorithm>
+#include <string>
+
+#include "frame_memory.h"
+#include "profiler.h"
+
+namespace baas::job_system
+{
+    namespace
+    {
+        // Which worker of which scheduler the current thread is, if any.
+        thread_local const JobSystem* current_system{ nullptr };
+        thread_local int current_index{ -1 };
+        // Spreads the first victim of threads that aren't workers.
+        thread_local unsigned steal_start{ 0 };
+        // Group of the job the current thread runs, 0 outside of jobs.
+        thread_local uint64_t current_group{ 0 };
+
+        // Shared by every scheduler, a job may create jobs on another one.
+        std::atomic<uint64_t> next_group{ 1 };
+
+        constexpr unsigned SPINS_BEFORE_SLEEP = 64;
+
+        // Room for a Job and the control block allocate_shared puts in front of it.
+        constexpr std::size_t JOB_BLOCK_SIZE = sizeof(Job) + 64;
+
+        // Handles can outlive any scheduler and the statics that would destroy this, so it is never freed.
+        frame_memory::BlockPool& job_pool()
+        {
+            static auto pool = new frame_memory::BlockPool(JOB_BLOCK_SIZE, alignof(std::max_align_t), 256);
+            return *pool;
+        }
+
+        void record_error(Job* job, std::exception_ptr error)
+        {
+            bool expected{ false };
+            if (job->failed.compare_exchange_strong(expected, true))
+            {
+                job->error = std::move(error);
+            }
+        }
+    }
+
+    bool JobSystem::WorkDeque::push(Job* job)
+    {
+        int64_t b = bottom.load(std::memory_order_relaxed);
+        int64_t t = top.load(std::memory_order_acquire);
+        if (b - t >= CAPACITY)
+        {
+            return false;
+        }
+        buffer[b & (CAPACITY - 1)].store(job, std::memory_order_relaxed);
+        groups[b & (CAPACITY - 1)].store(job->group, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom.store(b + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    Job* JobSystem::WorkDeque::pop(uint64_t group)
+    {
+        int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+        bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = top.load(std::memory_order_relaxed);
+        if (t > b || (group != 0 && groups[b & (CAPACITY - 1)].load(std::memory_order_relaxed) != group))
+        {
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        Job* job = buffer[b & (CAPACITY - 1)].load(std::memory_order_relaxed);
+        if (t == b)
+        {
+            // Last job, race the thieves for it.
+            if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            {
+                job = nullptr;
+            }
+            bottom.store(b + 1, std::memory_order_relaxed);
+        }
+        return job;
+    }
+
+    Job* JobSystem::WorkDeque::steal(uint64_t group)
+    {
+        int64_t t = top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = bottom.load(std::memory_order_acquire);
+        if (t >= b)
+        {
+            return nullptr;
+        }
+        Job* job = buffer[t & (CAPACITY - 1)].load(std::memory_order_relaxed);
+        // Like the job, the group is only what was pushed there if the CAS below would succeed.
+        if (group != 0 && groups[t & (CAPACITY - 1)].load(std::memory_order_relaxed) != group)
+        {
+            return nullptr;
+        }
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+        {
+            return nullptr;
+        }
+        return job;
+    }
+
+    JobSystem::JobSystem(unsigned worker_count)
+    {
+        if (worker_count == 0)
+        {
+            worker_count = std::max(std::thread::hardware_concurrency(), 2U) - 1;
+        }
+        for (unsigned i = 0; i < worker_count; ++i)
+        {
+            deques.push_back(std::make_unique<WorkDeque>());
+        }
+        for (unsigned i = 0; i < worker_count; ++i)
+        {
+            workers.emplace_back(&JobSystem::worker_main, this, i);
+        }
+        // Registering with the profiler allocates, done lazily it could show up in any later frame.
+        for (auto started = started_workers.load(); started < worker_count; started = started_workers.load())
+        {
+            started_workers.wait(started);
+        }
+    }
+
+    JobSystem::~JobSystem()
+    {
+        stopping.store(true);
+        work_epoch.fetch_add(1);
+        work_epoch.notify_all();
+        for (auto&& worker : workers)
+        {
+            worker.join();
+        }
+    }
+
+    JobHandle JobSystem::create(std::function<void()> work, const JobHandle& parent)
+    {
+        auto job = allocate_job(parent);
+        job->work = std::move(work);
+        return job;
+    }
+
+    JobHandle JobSystem::allocate_job(const JobHandle& parent)
+    {
+        auto job = std::allocate_shared<Job>(std::pmr::polymorphic_allocator<Job>(&job_pool()));
+        if (parent)
+        {
+            parent->unfinished.fetch_add(1, std::memory_order_relaxed);
+            job->parent = parent;
+            job->group = parent->group;
+        }
+        else
+        {
+            job->group = current_group != 0 ? current_group : next_group.fetch_add(1, std::memory_order_relaxed);
+        }
+        return job;
+    }
+
+    void JobSystem::submit(const JobHandle& job)
+    {
+        job->self = job;
+        int index = current_worker();
+        if (index >= 0)
+        {
+            if (!deques[index]->push(job.get()))
+            {
+                // Deque is full, which only happens with deep fan out. Running it here is always correct.
+                execute(job.get());
+                return;
+            }
+        }
+        else
+        {
+            std::lock_guard lock(injected_mutex);
+            auto count = injected_count.load(std::memory_order_relaxed);
+            if (count == injected.size())
+            {
+                std::vector<Job*> grown(std::max<std::size_t>(injected.size() * 2, 64));
+                for (std::size_t i = 0; i < count; ++i)
+                {
+                    grown[i] = injected[(injected_head + i) % injected.size()];
+                }
+                injected = std::move(grown);
+                injected_head = 0;
+            }
+            injected[(injected_head + count) % injected.size()] = job.get();
+            injected_count.store(count + 1, std::memory_order_release);
+        }
+        wake_one();
+    }
+
+    JobHandle JobSystem::run(std::function<void()> work, const JobHandle& parent)
+    {
+        auto job = create(std::move(work), parent);
+        submit(job);
+        return job;
+    }
+
+    void JobSystem::wait(const JobHandle& job)
+    {
+        int index = current_worker();
+        while (job->unfinished.load(std::memory_order_acquire) > 0)
+        {
+            if (Job* next = find_job(index, job->group))
+            {
+                execute(next);
+            }
+            else
+            {
+                std::this_thread::yield();
+            }
+        }
+        if (job->failed.load(std::memory_order_acquire))
+        {
+            std::rethrow_exception(job->error);
+        }
+    }
+
+    bool JobSystem::is_done(const JobHandle& job) const
+    {
+        return job->unfinished.load(std::memory_order_acquire) == 0;
+    }
+
+    void JobSystem::parallel_for(std::size_t count, RangeFunction body, std::size_t grain)
+    {
+        if (count == 0)
+        {
+            return;
+        }
+        if (grain == 0)
+        {
+            grain = std::max<std::size_t>(count / (thread_count() * 4), 1);
+        }
+        if (grain >= count)
+        {
+            body(0, count);
+            return;
+        }
+        auto group = allocate_job({});
+        for (std::size_t begin = 0; begin < count; begin += grain)
+        {
+            auto chunk = allocate_job(group);
+            chunk->range = &body;
+            chunk->begin = begin;
+            chunk->end = std::min(begin + grain, count);
+            submit(chunk);
+        }
+        submit(group);
+        wait(group);
+    }
+
+    void JobSystem::worker_main(unsigned index)
+    {
+        current_system = this;
+        current_index = static_cast<int>(index);
+        profiler::Profiler::shared().set_thread_name("job worker " + std::to_string(index + 1));
+        started_workers.fetch_add(1);
+        started_workers.notify_all();
+        unsigned idle{ 0 };
+        while (!stopping.load(std::memory_order_acquire))
+        {
+            if (Job* job = find_job(current_index, 0))
+            {
+                execute(job);
+                idle = 0;
+                continue;
+            }
+            if (++idle < SPINS_BEFORE_SLEEP)
+            {
+                std::this_thread::yield();
+                continue;
+            }
+
+            // Registering as a sleeper before the last look means a submit either sees the sleeper and
+            // notifies, or happened early enough for that look to find its job.
+            sleeping.fetch_add(1);
+            auto epoch = work_epoch.load();
+            if (Job* job = find_job(current_index, 0))
+            {
+                sleeping.fetch_sub(1);
+                execute(job);
+                idle = 0;
+                continue;
+            }
+            if (!stopping.load())
+            {
+                work_epoch.wait(epoch);
+            }
+            sleeping.fetch_sub(1);
+            idle = 0;
+        }
+    }
+
+    Job* JobSystem::find_job(int worker_index, uint64_t group)
+    {
+        if (worker_index >= 0)
+        {
+            if (Job* job = deques[worker_index]->pop(group))
+            {
+                return job;
+            }
+        }
+        if (injected_count.load(std::memory_order_acquire) > 0)
+        {
+            std::lock_guard lock(injected_mutex);
+            auto count = injected_count.load(std::memory_order_relaxed);
+            auto size = injected.size();
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                Job* job = injected[(injected_head + i) % size];
+                if (group != 0 && job->group != group)
+                {
+                    continue;
+                }
+                // Closes the gap so the rest keep their order, a waiter rarely has to skip far.
+                for (std::size_t j = i; j > 0; --j)
+                {
+                    injected[(injected_head + j) % size] = injected[(injected_head + j - 1) % size];
+                }
+                injected_head = (injected_head + 1) % size;
+                injected_count.store(count - 1, std::memory_order_relaxed);
+                return job;
+            }
+        }
+        auto deque_count = static_cast<unsigned>(deques.size());
+        unsigned start = worker_index >= 0 ? static_cast<unsigned>(worker_index) + 1 : steal_start++;
+        for (unsigned i = 0; i < deque_count; ++i)
+        {
+            unsigned victim = (start + i) % deque_count;
+            if (static_cast<int>(victim) == worker_index)
+            {
+                continue;
+            }
+            if (Job* job = deques[victim]->steal(group))
+            {
+                return job;
+            }
+        }
+        return nullptr;
+    }
+
+    void JobSystem::execute(Job* job)
+    {
+        // Restored after, a waiting thread runs jobs inside the one it is running.
+        auto outer_group = current_group;
+        current_group = job->group;
+        try
+        {
+            if (job->range != nullptr)
+            {
+                (*job->range)(job->begin, job->end);
+            }
+            else if (job->work)
+            {
+                job->work();
+            }
+        }
+        catch (...)
+        {
+            record_error(job, std::current_exception());
+        }
+        // The job may be released by its last handle as soon as it finishes, hold on to it until then.
+        auto keep_alive = std::move(job->self);
+        current_group = outer_group;
+        finish(job);
+    }
+
+    void JobSystem::finish(Job* job)
+    {
+        // Each parent is kept alive by its child's parent pointer while this walks up.
+        while (job != nullptr)
+        {
+            if (job->unfinished.fetch_sub(1, std::memory_order_acq_rel) != 1)
+            {
+                return;
+            }
+            Job* parent = job->parent.get();
+            if (parent != nullptr && job->failed.load(std::memory_order_acquire))
+            {
+                record_error(parent, job->error);
+            }
+            job = parent;
+        }
+    }
+
+    void JobSystem::wake_one()
+    {
+        work_epoch.fetch_add(1);
+        if (sleeping.load() > 0)
+        {
+            work_epoch.notify_one();
+        }
+    }
+
+    int JobSystem::current_worker() const
+    {
+        return current_system == this ? current_index : -1;
+    }
+
+    JobSystem& shared()
+    {
+        static JobSystem system;
+        return system;
+    }
+}
@@ -1,13 +1,266 @@
+#include <algorithm>
+#include <charconv>
+#include <filesystem>
 #include <iostream>
+#include <string_view>
+#include <vector>
 
 #include "game_engine.h"
+#include "mesh_cache.h"
+#include "mesh_lod.h"
+#include "meshlet.h"
+#include "texture.h"
+
+namespace
+{
+    void print_usage(const char* program)
+    {
+        std::cout << "Usage: " << program << " [options] [model.obj]\n"
+                  << "  --rebuild-cache   Reparse the model and overwrite its cache\n"
+                  << "  --no-cache        Never read or write mesh caches\n"
+                  << "  --build-caches    Build caches, LOD chains, meshlets and textures for every model file or directory given and exit\n"
+                  << "  --frames-in-flight <n>  Frames the CPU may record ahead of the GPU (default 2)\n"
+                  << "  --frames <n>      Exit after rendering n frames\n"
+                  << "  --headless        Render offscreen without a window (1 frame unless --frames is given)\n"
+                  << "  --present-mode <mailbox|immediate|fifo>  How frames reach the window (default mailbox), V switches at runtime\n"
+                  << "  --width <n>, --height <n>  Headless render size (default 800x600)\n"
+                  << "  --capture <file>  Headless only, save the last frame as .png or .ppm\n"
+                  << "  --no-pipeline-cache  Compile pipelines from scratch and don't write pipeline_cache.bin\n"
+                  << "  --wireframe       Draw the model as lines\n"
+                  << "  --double-sided    Don't cull back faces\n"
+                  << "  --instances <n>   Draw n copies of the model on a grid (default 1)\n"
+                  << "  --record-threads <n>  Threads recording the draw list, 1 records inline (default all)\n"
+                  << "  --gpu-driven      Cull instances on the GPU and draw them with one indirect draw\n"
+                  << "  --no-lod          Always draw the full model, don't build or load its LOD chain\n"
+                  << "  --meshlets        With --gpu-driven, cull full detail instances per meshlet by frustum and normal cone\n"
+                  << "  --no-textures     Don't import or draw the materials' diffuse textures\n"
+                  << "  --texture-format <bc7|bc1|rgba8>  What textures are imported into and cached as (default bc7)\n"
+                  << "  --texture-budget <MiB>  Device memory for streamed texture mips (default 256)\n"
+                  << "  --no-hot-reload   Don't watch the shaders, the model and its textures for changes\n"
+                  << "  --frame-arenas    Take per frame scratch from arenas rewound every frame instead of the heap\n"
+                  << "  --profile         Print the startup breakdown and per zone CPU and GPU timings\n"
+                  << "  --trace <file>    Write the startup and the last frames as a Chrome trace (chrome://tracing, ui.perfetto.dev)\n"
+                  << "  --help            Show this message\n";
+    }
+
+    bool parse_count(std::string_view text, uint32_t& value)
+    {
+        auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), value);
+        return error == std::errc() && end == text.data() + text.size();
+    }
+
+    // Offline mode, no window or Vulkan instance is created.
+    int build_caches(const std::vector<std::string>& inputs, baas::mesh_cache::CachePolicy policy, bool lods, bool textures,
+        baas::texture::Format texture_format)
+    {
+        std::vector<std::string> models;
+        for (auto&& input : inputs)
+        {
+            if (std::filesystem::is_directory(input))
+            {
+                for (auto&& entry : std::filesystem::recursive_directory_iterator(input))
+                {
+                    if (entry.is_regular_file() && entry.path().extension() == ".obj")
+                    {
+                        models.push_back(entry.path().string());
+                    }
+                }
+            }
+            else
+            {
+                models.push_back(input);
+            }
+        }
+
+        int failures{ 0 };
+        for (auto&& model : models)
+        {
+            try
+            {
+                auto loaded = baas::mesh_cache::load_mesh(model, {}, policy);
+                std::cout << (loaded.from_cache() ? "Up to date: " : "Built: ") << baas::mesh_cache::cache_path_for(model) << '\n';
+                if (lods)
+                {
+                    // Every range of the model is simplified as its own job.
+                    baas::mesh_lod::load_lods(model, loaded.view(), {}, policy);
+                }
+                baas::meshlet::load_meshlets(model, loaded.view(), policy);
+                // Materials sharing a file only import it once.
+                std::vector<std::string> texture_paths;
+                for (auto&& material : textures ? loaded.view().materials : std::span<const baas::mesh::Material>())
+                {
+                    auto path = baas::texture::resolve_texture_path(model, material.diffuse_texture);
+                    if (!path.empty() && std::find(texture_paths.begin(), texture_paths.end(), path) == texture_paths.end())
+                    {
+                        texture_paths.push_back(path);
+                        baas::texture::load_texture(path, { texture_format, true }, policy);
+                    }
+                }
+            }
+            catch (std::exception& ex)
+            {
+                std::cout << "Error: " << model << ": " << ex.what() << '\n';
+                ++failures;
+            }
+        }
+        return failures == 0 ? 0 : 1;
+    }
+}
 
 int main(int argc, char** argv)
 {
+    baas::game_engine::EngineConfig config;
+    bool offline_build{ false };
+    std::vector<std::string> positional;
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string_view arg = argv[i];
+        if (arg == "--rebuild-cache")
+        {
+            config.cache_policy = baas::mesh_cache::CachePolicy::rebuild;
+        }
+        else if (arg == "--no-cache")
+        {
+            config.cache_policy = baas::mesh_cache::CachePolicy::bypass;
+        }
+        else if (arg == "--build-caches")
+        {
+            offline_build = true;
+        }
+        else if (arg == "--headless")
+        {
+            config.headless = true;
+        }
+        else if (arg == "--no-pipeline-cache")
+        {
+            config.pipeline_cache_path.clear();
+        }
+        else if (arg == "--wireframe")
+        {
+            config.wireframe = true;
+        }
+        else if (arg == "--double-sided")
+        {
+            config.double_sided = true;
+        }
+        else if (arg == "--gpu-driven")
+        {
+            config.gpu_driven = true;
+        }
+        else if (arg == "--no-lod")
+        {
+            config.lods = false;
+        }
+        else if (arg == "--meshlets")
+        {
+            config.meshlets = true;
+        }
+        else if (arg == "--no-textures")
+        {
+            config.textures = false;
+        }
+        else if (arg == "--no-hot-reload")
+        {
+            config.hot_reload = false;
+        }
+        else if (arg == "--frame-arenas")
+        {
+            config.frame_arenas = true;
+        }
+        else if (arg == "--texture-format" && i + 1 < argc)
+        {
+            auto format = baas::texture::parse_format(argv[++i]);
+            if (!format)
+            {
+                std::cout << "Expected bc7, bc1 or rgba8 after " << arg << '\n';
+                return 1;
+            }
+            config.texture_format = *format;
+        }
+        else if (arg == "--present-mode" && i + 1 < argc)
+        {
+            std::string_view mode = argv[++i];
+            if (mode == "mailbox")
+            {
+                config.present_mode = vk::PresentModeKHR::eMailbox;
+            }
+            else if (mode == "immediate")
+            {
+                config.present_mode = vk::PresentModeKHR::eImmediate;
+            }
+            else if (mode == "fifo")
+            {
+                config.present_mode = vk::PresentModeKHR::eFifo;
+            }
+            else
+            {
+                std::cout << "Expected mailbox, immediate or fifo after " << arg << '\n';
+                return 1;
+            }
+        }
+        else if (arg == "--profile")
+        {
+            config.profile = true;
+        }
+        else if (arg == "--capture" && i + 1 < argc)
+        {
+            config.capture_path = argv[++i];
+        }
+        else if (arg == "--trace" && i + 1 < argc)
+        {
+            config.trace_path = argv[++i];
+        }
+        else if ((arg == "--frames-in-flight" || arg == "--frames" || arg == "--width" || arg == "--height" ||
+                     arg == "--instances" || arg == "--record-threads" || arg == "--texture-budget") && i + 1 < argc)
+        {
+            uint32_t& value = arg == "--frames" ? config.max_frames
+                : arg == "--width"              ? config.width
+                : arg == "--height"             ? config.height
+                : arg == "--instances"          ? config.instance_count
+                : arg == "--record-threads"     ? config.record_threads
+                : arg == "--texture-budget"     ? config.texture_budget_mb
+                                                : config.frames_in_flight;
+            if (!parse_count(argv[++i], value))
+            {
+                std::cout << "Expected a number after " << arg << '\n';
+                return 1;
+            }
+        }
+        else if (arg == "--help" || arg == "-h")
+        {
+            print_usage(argv[0]);
+            return 0;
+        }
+        else if (arg.starts_with("--"))
+        {
+            std::cout << "Unknown option: " << arg << '\n';
+            print_usage(argv[0]);
+            return 1;
+        }
+        else
+        {
+            positional.emplace_back(arg);
+        }
+    }
+
+    if (offline_build)
+    {
+        return build_caches(positional, config.cache_policy, config.lods, config.textures, config.texture_format);
+    }
+    if (!positional.empty())
+    {
+        config.model_path = positional.front();
+    }
+    if (!config.capture_path.empty() && !config.headless)
+    {
+        std::cout << "--capture needs --headless\n";
+        return 1;
+    }
+
     std::cout << "Hello Vulkan" << '\n';
     try
     {
-        baas::game_engine::GameEngine engine = baas::game_engine::GameEngine();
+        baas::game_engine::GameEngine engine = baas::game_engine::GameEngine(config);
         engine.main_loop();
     }
     catch (std::runtime_error re)
@@ -22,4 +275,4 @@ int main(int argc, char** argv)
     }
 
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,351 @@
+#include "mesh_cache.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <type_traits>
+
+#include "mesh_kernels.h"
+#include "mesh_optimizer.h"
+
+namespace baas::mesh_cache
+{
+    namespace
+    {
+        constexpr char CACHE_MAGIC[8] = { 'V', 'M', 'L', 'M', 'E', 'S', 'H', '\0' };
+        constexpr uint64_t BLOB_ALIGNMENT = 64;
+
+        // OBJ files without vn lines leave every normal at zero.
+        bool has_normals(const mesh::Mesh& mesh)
+        {
+            for (auto&& vertex : mesh.vertices)
+            {
+                if (vertex.normal[0] != 0.0f || vertex.normal[1] != 0.0f || vertex.normal[2] != 0.0f)
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        // Everything is little endian and laid out exactly as it is in memory so a
+        // mapped cache can be used without any decoding.
+        struct CacheHeader
+        {
+            char magic[8];
+            uint32_t version;
+            uint32_t header_size;
+            SourceStamp stamp;
+            uint32_t vertex_stride;
+            uint32_t vertex_count;
+            uint32_t index_count;
+            uint32_t range_count;
+            uint32_t material_count;
+            uint32_t reserved;
+            uint64_t vertex_offset;
+            uint64_t index_offset;
+            uint64_t range_offset;
+            uint64_t material_offset;
+            uint64_t file_size;
+        };
+        static_assert(std::is_trivially_copyable_v<CacheHeader>);
+        static_assert(std::is_trivially_copyable_v<mesh::Vertex> && sizeof(mesh::Vertex) == 32);
+        static_assert(std::is_trivially_copyable_v<mesh::MeshRange> && sizeof(mesh::MeshRange) == 12);
+
+        // Materials have strings so they get a small length prefixed encoding after the blobs.
+        struct MaterialRecord
+        {
+            float diffuse[3];
+            uint32_t name_length;
+            uint32_t texture_length;
+        };
+
+        uint64_t align_up(uint64_t value, uint64_t alignment)
+        {
+            return (value + alignment - 1) / alignment * alignment;
+        }
+
+        int64_t modified_time(const std::string& path)
+        {
+            return static_cast<int64_t>(std::filesystem::last_write_time(path).time_since_epoch().count());
+        }
+
+        void write_padding(std::ofstream& out, uint64_t target)
+        {
+            static constexpr char zeros[BLOB_ALIGNMENT] = {};
+            uint64_t position = static_cast<uint64_t>(out.tellp());
+            out.write(zeros, static_cast<std::streamsize>(target - position));
+        }
+
+        template <typename T>
+        std::span<const T> blob(const file_ops::MappedFile& file, uint64_t offset, uint32_t count)
+        {
+            if (offset % alignof(T) != 0 || offset > file.size() || uint64_t{ count } * sizeof(T) > file.size() - offset)
+            {
+                throw std::runtime_error("Mesh cache blob out of bounds");
+            }
+            return { reinterpret_cast<const T*>(file.bytes().data() + offset), count };
+        }
+
+        std::vector<mesh::Material> read_materials(const file_ops::MappedFile& file, const CacheHeader& header)
+        {
+            std::vector<mesh::Material> materials(header.material_count);
+            auto bytes = file.bytes();
+            uint64_t offset = header.material_offset;
+            for (auto&& material : materials)
+            {
+                MaterialRecord record;
+                if (offset > bytes.size() || sizeof(record) > bytes.size() - offset)
+                {
+                    throw std::runtime_error("Mesh cache material table out of bounds");
+                }
+                std::memcpy(&record, bytes.data() + offset, sizeof(record));
+                offset += sizeof(record);
+                if (offset + record.name_length + record.texture_length > bytes.size())
+                {
+                    throw std::runtime_error("Mesh cache material table out of bounds");
+                }
+                const char* text = reinterpret_cast<const char*>(bytes.data() + offset);
+                material.name.assign(text, record.name_length);
+                material.diffuse_texture.assign(text + record.name_length, record.texture_length);
+                material.diffuse = { record.diffuse[0], record.diffuse[1], record.diffuse[2] };
+                offset += record.name_length + record.texture_length;
+            }
+            return materials;
+        }
+
+        // The renderer indexes straight into the blobs, so a corrupt cache has to be caught here.
+        bool valid_mesh(const mesh::MeshView& mesh)
+        {
+            uint32_t largest{ 0 };
+            for (auto index : mesh.indices)
+            {
+                largest = std::max(largest, index);
+            }
+            if (!mesh.indices.empty() && largest >= mesh.vertices.size())
+            {
+                return false;
+            }
+            return std::all_of(mesh.ranges.begin(), mesh.ranges.end(), [&](const mesh::MeshRange& range)
+                {
+                    return uint64_t{ range.first_index } + range.index_count <= mesh.indices.size() &&
+                        range.material < mesh.materials.size();
+                });
+        }
+
+        // Only the time changed, so the header is patched in place instead of writing the blobs again.
+        void write_modified_time(const std::string& cache_path, int64_t time)
+        {
+            std::fstream file(cache_path, std::ios::binary | std::ios::in | std::ios::out);
+            file.seekp(offsetof(CacheHeader, stamp) + offsetof(SourceStamp, modified_time));
+            file.write(reinterpret_cast<const char*>(&time), sizeof(time));
+            if (!file.good())
+            {
+                throw std::runtime_error("Failed to update mesh cache stamp: " + cache_path);
+            }
+        }
+    }
+
+    LoadedMesh::LoadedMesh(mesh::Mesh parsed_mesh)
+        : parsed(std::move(parsed_mesh))
+    {
+        mesh_view = parsed.view();
+    }
+
+    LoadedMesh::LoadedMesh(file_ops::MappedFile mapped_file, mesh::MeshView mapped_view, std::vector<mesh::Material> mapped_materials)
+        : cache_file(std::move(mapped_file)), materials(std::move(mapped_materials)), mesh_view(mapped_view)
+    {
+        mesh_view.materials = materials;
+    }
+
+    std::string cache_path_for(const std::string_view source_path)
+    {
+        return std::string(source_path) + std::string(CACHE_EXTENSION);
+    }
+
+    SourceStamp stamp_source(const std::string_view source_path, const BuildOptions& options, bool hash_content)
+    {
+        const std::string path(source_path);
+        SourceStamp stamp{};
+        stamp.size = static_cast<uint64_t>(std::filesystem::file_size(path));
+        stamp.modified_time = modified_time(path);
+        stamp.options_hash = obj_loader::options_hash(options.load) ^ (options.optimize ? 0x6F7074ull : 0ull);
+        if (hash_content)
+        {
+            stamp.content_hash = file_ops::hash_bytes(file_ops::map_file(path, file_ops::AccessHint::sequential).bytes());
+        }
+        return stamp;
+    }
+
+    void write_cache(const std::string_view cache_path, const mesh::MeshView& mesh, const SourceStamp& stamp)
+    {
+        CacheHeader header{};
+        std::memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+        header.version = CACHE_VERSION;
+        header.header_size = sizeof(CacheHeader);
+        header.stamp = stamp;
+        header.vertex_stride = sizeof(mesh::Vertex);
+        header.vertex_count = static_cast<uint32_t>(mesh.vertices.size());
+        header.index_count = static_cast<uint32_t>(mesh.indices.size());
+        header.range_count = static_cast<uint32_t>(mesh.ranges.size());
+        header.material_count = static_cast<uint32_t>(mesh.materials.size());
+        header.vertex_offset = align_up(sizeof(CacheHeader), BLOB_ALIGNMENT);
+        header.index_offset = align_up(header.vertex_offset + mesh.vertices.size_bytes(), BLOB_ALIGNMENT);
+        header.range_offset = align_up(header.index_offset + mesh.indices.size_bytes(), BLOB_ALIGNMENT);
+        header.material_offset = align_up(header.range_offset + mesh.ranges.size_bytes(), BLOB_ALIGNMENT);
+        header.file_size = header.material_offset;
+        for (auto&& material : mesh.materials)
+        {
+            header.file_size += sizeof(MaterialRecord) + material.name.size() + material.diffuse_texture.size();
+        }
+
+        // Written to the side and renamed so a crash never leaves a half written cache behind.
+        const std::string final_path(cache_path);
+        const std::string temp_path = final_path + ".tmp";
+        {
+            std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+            if (!out.is_open())
+            {
+                throw std::runtime_error("Failed to open mesh cache for writing: " + temp_path);
+            }
+            out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            write_padding(out, header.vertex_offset);
+            out.write(reinterpret_cast<const char*>(mesh.vertices.data()), static_cast<std::streamsize>(mesh.vertices.size_bytes()));
+            write_padding(out, header.index_offset);
+            out.write(reinterpret_cast<const char*>(mesh.indices.data()), static_cast<std::streamsize>(mesh.indices.size_bytes()));
+            write_padding(out, header.range_offset);
+            out.write(reinterpret_cast<const char*>(mesh.ranges.data()), static_cast<std::streamsize>(mesh.ranges.size_bytes()));
+            write_padding(out, header.material_offset);
+            for (auto&& material : mesh.materials)
+            {
+                MaterialRecord record{ { material.diffuse[0], material.diffuse[1], material.diffuse[2] },
+                    static_cast<uint32_t>(material.name.size()), static_cast<uint32_t>(material.diffuse_texture.size()) };
+                out.write(reinterpret_cast<const char*>(&record), sizeof(record));
+                out.write(material.name.data(), static_cast<std::streamsize>(material.name.size()));
+                out.write(material.diffuse_texture.data(), static_cast<std::streamsize>(material.diffuse_texture.size()));
+            }
+            if (!out.good())
+            {
+                throw std::runtime_error("Failed to write mesh cache: " + temp_path);
+            }
+        }
+        std::filesystem::rename(temp_path, final_path);
+    }
+
+    std::optional<LoadedMesh> try_load_cache(const std::string_view source_path, const BuildOptions& options)
+    {
+        const std::string path = cache_path_for(source_path);
+        if (!std::filesystem::exists(path))
+        {
+            return std::nullopt;
+        }
+
+        auto cache_file = file_ops::map_file(path, file_ops::AccessHint::sequential);
+        CacheHeader header;
+        if (cache_file.size() < sizeof(header))
+        {
+            return std::nullopt;
+        }
+        std::memcpy(&header, cache_file.bytes().data(), sizeof(header));
+        if (std::memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 || header.version != CACHE_VERSION ||
+            header.header_size != sizeof(CacheHeader) || header.vertex_stride != sizeof(mesh::Vertex) ||
+            header.file_size != cache_file.size())
+        {
+            return std::nullopt;
+        }
+
+        SourceStamp current = stamp_source(source_path, options, false);
+        if (current.options_hash != header.stamp.options_hash || current.size != header.stamp.size)
+        {
+            return std::nullopt;
+        }
+        // A touched but otherwise identical file keeps its cache, and the new time is remembered so the
+        // next start doesn't hash it again.
+        if (current.modified_time != header.stamp.modified_time)
+        {
+            if (stamp_source(source_path, options, true).content_hash != header.stamp.content_hash)
+            {
+                return std::nullopt;
+            }
+            // Not while it is mapped, Windows doesn't share a mapped file for writing.
+            cache_file = {};
+            try
+            {
+                write_modified_time(path, current.modified_time);
+            }
+            catch (std::exception& ex)
+            {
+                std::cerr << "Warning: " << ex.what() << '\n';
+            }
+            cache_file = file_ops::map_file(path, file_ops::AccessHint::sequential);
+            if (cache_file.size() != header.file_size)
+            {
+                return std::nullopt;
+            }
+        }
+
+        // A corrupt cache is rebuilt just like a stale one.
+        mesh::MeshView view;
+        std::vector<mesh::Material> materials;
+        try
+        {
+            view.vertices = blob<mesh::Vertex>(cache_file, header.vertex_offset, header.vertex_count);
+            view.indices = blob<uint32_t>(cache_file, header.index_offset, header.index_count);
+            view.ranges = blob<mesh::MeshRange>(cache_file, header.range_offset, header.range_count);
+            materials = read_materials(cache_file, header);
+        }
+        catch (std::runtime_error&)
+        {
+            return std::nullopt;
+        }
+        view.materials = materials;
+        if (!valid_mesh(view))
+        {
+            return std::nullopt;
+        }
+        return LoadedMesh(std::move(cache_file), view, std::move(materials));
+    }
+
+    LoadedMesh load_mesh(const std::string_view source_path, const BuildOptions& options, CachePolicy policy)
+    {
+        if (policy == CachePolicy::use_cache)
+        {
+            if (auto cached = try_load_cache(source_path, options))
+            {
+                return std::move(*cached);
+            }
+        }
+
+        mesh::Mesh parsed = obj_loader::load_obj(source_path, options.load);
+        if (!has_normals(parsed))
+        {
+            auto streams = mesh_kernels::to_streams(parsed.vertices);
+            mesh_kernels::generate_normals(streams, parsed.indices);
+            mesh_kernels::copy_normals(streams, parsed.vertices);
+        }
+        if (options.optimize)
+        {
+            auto report = mesh_optimizer::optimize_mesh(parsed);
+            std::cout << "Optimized " << source_path << ": ACMR " << report.before.acmr << " -> " << report.after.acmr
+                      << ", ATVR " << report.before.atvr << " -> " << report.after.atvr << '\n';
+        }
+        LoadedMesh loaded(std::move(parsed));
+        if (policy != CachePolicy::bypass)
+        {
+            try
+            {
+                write_cache(cache_path_for(source_path), loaded.view(), stamp_source(source_path, options, true));
+            }
+            catch (std::exception& ex)
+            {
+                // A read only asset directory just means every start is a cold start.
+                std::cerr << "Warning: " << ex.what() << '\n';
+            }
+        }
+        return loaded;
+    }
+}
@@ -0,0 +1,346 @@
+#include "mesh_kernels.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+#include "mesh_kernels_impl.h"
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <immintrin.h>
+#include <intrin.h>
+#endif
+
+namespace baas::mesh_kernels
+{
+    namespace
+    {
+        // Face kernels write per triangle results into scratch buffers of this many triangles,
+        // which are then scattered to the vertices serially so the sums happen in a fixed order.
+        constexpr std::size_t FACE_BLOCK = 4096;
+
+        bool cpu_has_avx2()
+        {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+            int info[4];
+            __cpuid(info, 1);
+            bool os_saves_ymm = (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 0x6) == 0x6;
+            __cpuidex(info, 7, 0);
+            return os_saves_ymm && (info[1] & (1 << 5)) != 0;
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+            return __builtin_cpu_supports("avx2");
+#else
+            return false;
+#endif
+        }
+
+        const detail::KernelTable* table_for(Isa isa)
+        {
+            switch (isa)
+            {
+            case Isa::scalar: return detail::scalar_kernels();
+            case Isa::sse2: return detail::sse2_kernels();
+            case Isa::avx2: return cpu_has_avx2() ? detail::avx2_kernels() : nullptr;
+            case Isa::neon: return detail::neon_kernels();
+            }
+            return nullptr;
+        }
+
+        const detail::KernelTable& kernels(Isa isa)
+        {
+            const detail::KernelTable* table = table_for(isa);
+            if (table == nullptr)
+            {
+                throw std::runtime_error("Mesh kernel instruction set not supported: " + std::string(isa_name(isa)));
+            }
+            return *table;
+        }
+
+        void check_indices(std::span<const uint32_t> indices, std::size_t vertex_count)
+        {
+            for (uint32_t index : indices)
+            {
+                if (index >= vertex_count)
+                {
+                    throw std::runtime_error("Mesh kernel index out of range");
+                }
+            }
+        }
+
+        std::vector<const float*> present_streams(const VertexStreams& streams)
+        {
+            std::vector<const float*> result;
+            for (auto* stream : { &streams.position_x, &streams.position_y, &streams.position_z, &streams.normal_x,
+                     &streams.normal_y, &streams.normal_z, &streams.u, &streams.v, &streams.tangent_x, &streams.tangent_y,
+                     &streams.tangent_z, &streams.tangent_w })
+            {
+                if (stream->size() == streams.size() && !stream->empty())
+                {
+                    result.push_back(stream->data());
+                }
+            }
+            return result;
+        }
+    }
+
+    std::string_view isa_name(Isa isa)
+    {
+        switch (isa)
+        {
+        case Isa::scalar: return "scalar";
+        case Isa::sse2: return "sse2";
+        case Isa::avx2: return "avx2";
+        case Isa::neon: return "neon";
+        }
+        return "unknown";
+    }
+
+    bool isa_supported(Isa isa)
+    {
+        return table_for(isa) != nullptr;
+    }
+
+    std::vector<Isa> supported_isas()
+    {
+        std::vector<Isa> result;
+        for (Isa isa : { Isa::scalar, Isa::sse2, Isa::avx2, Isa::neon })
+        {
+            if (isa_supported(isa))
+            {
+                result.push_back(isa);
+            }
+        }
+        return result;
+    }
+
+    Isa best_isa()
+    {
+        static const Isa best = []
+        {
+            for (Isa isa : { Isa::avx2, Isa::neon, Isa::sse2 })
+            {
+                if (isa_supported(isa))
+                {
+                    return isa;
+                }
+            }
+            return Isa::scalar;
+        }();
+        return best;
+    }
+
+    VertexStreams to_streams(std::span<const mesh::Vertex> vertices)
+    {
+        VertexStreams streams;
+        for (auto* stream : { &streams.position_x, &streams.position_y, &streams.position_z, &streams.normal_x,
+                 &streams.normal_y, &streams.normal_z, &streams.u, &streams.v })
+        {
+            stream->resize(vertices.size());
+        }
+        for (std::size_t i = 0; i < vertices.size(); ++i)
+        {
+            const auto& vertex = vertices[i];
+            streams.position_x[i] = vertex.position[0];
+            streams.position_y[i] = vertex.position[1];
+            streams.position_z[i] = vertex.position[2];
+            streams.normal_x[i] = vertex.normal[0];
+            streams.normal_y[i] = vertex.normal[1];
+            streams.normal_z[i] = vertex.normal[2];
+            streams.u[i] = vertex.uv[0];
+            streams.v[i] = vertex.uv[1];
+        }
+        return streams;
+    }
+
+    void copy_normals(const VertexStreams& streams, std::span<mesh::Vertex> vertices)
+    {
+        for (std::size_t i = 0; i < vertices.size(); ++i)
+        {
+            vertices[i].normal = { streams.normal_x[i], streams.normal_y[i], streams.normal_z[i] };
+        }
+    }
+
+    Aabb compute_aabb(const VertexStreams& streams, Isa isa)
+    {
+        Aabb aabb{};
+        kernels(isa).compute_aabb(streams.position_x.data(), streams.position_y.data(), streams.position_z.data(),
+            streams.size(), aabb);
+        return aabb;
+    }
+
+    void generate_normals(VertexStreams& streams, std::span<const uint32_t> indices, Isa isa)
+    {
+        const auto& table = kernels(isa);
+        std::size_t vertex_count = streams.size();
+        check_indices(indices, vertex_count);
+        streams.normal_x.assign(vertex_count, 0.0f);
+        streams.normal_y.assign(vertex_count, 0.0f);
+        streams.normal_z.assign(vertex_count, 0.0f);
+
+        const float* positions[3] = { streams.position_x.data(), streams.position_y.data(), streams.position_z.data() };
+        std::vector<float> face(FACE_BLOCK * 3);
+        float* face_normals[3] = { face.data(), face.data() + FACE_BLOCK, face.data() + FACE_BLOCK * 2 };
+        std::size_t triangle_count = indices.size() / 3;
+        for (std::size_t first = 0; first < triangle_count; first += FACE_BLOCK)
+        {
+            std::size_t count = std::min(FACE_BLOCK, triangle_count - first);
+            const uint32_t* block_indices = indices.data() + first * 3;
+            table.face_normals(positions, block_indices, count, face_normals);
+            for (std::size_t t = 0; t < count; ++t)
+            {
+                for (std::size_t k = 0; k < 3; ++k)
+                {
+                    uint32_t vertex = block_indices[t * 3 + k];
+                    streams.normal_x[vertex] += face_normals[0][t];
+                    streams.normal_y[vertex] += face_normals[1][t];
+                    streams.normal_z[vertex] += face_normals[2][t];
+                }
+            }
+        }
+        table.normalize(streams.normal_x.data(), streams.normal_y.data(), streams.normal_z.data(), vertex_count);
+    }
+
+    void generate_tangents(VertexStreams& streams, std::span<const uint32_t> indices, Isa isa)
+    {
+        const auto& table = kernels(isa);
+        std::size_t vertex_count = streams.size();
+        check_indices(indices, vertex_count);
+        if (streams.normal_x.size() != vertex_count || streams.u.size() != vertex_count)
+        {
+            throw std::runtime_error("Tangent generation needs normals and uvs");
+        }
+        streams.tangent_x.assign(vertex_count, 0.0f);
+        streams.tangent_y.assign(vertex_count, 0.0f);
+        streams.tangent_z.assign(vertex_count, 0.0f);
+        streams.tangent_w.assign(vertex_count, 0.0f);
+        std::vector<float> bitangents(vertex_count * 3, 0.0f);
+        float* bitangent[3] = { bitangents.data(), bitangents.data() + vertex_count, bitangents.data() + vertex_count * 2 };
+        float* tangent[3] = { streams.tangent_x.data(), streams.tangent_y.data(), streams.tangent_z.data() };
+
+        const float* attributes[5] = { streams.position_x.data(), streams.position_y.data(), streams.position_z.data(),
+            streams.u.data(), streams.v.data() };
+        std::vector<float> face(FACE_BLOCK * 6);
+        float* face_frames[6];
+        for (std::size_t i = 0; i < 6; ++i)
+        {
+            face_frames[i] = face.data() + FACE_BLOCK * i;
+        }
+
+        std::size_t triangle_count = indices.size() / 3;
+        for (std::size_t first = 0; first < triangle_count; first += FACE_BLOCK)
+        {
+            std::size_t count = std::min(FACE_BLOCK, triangle_count - first);
+            const uint32_t* block_indices = indices.data() + first * 3;
+            table.face_tangents(attributes, block_indices, count, face_frames);
+            for (std::size_t t = 0; t < count; ++t)
+            {
+                for (std::size_t k = 0; k < 3; ++k)
+                {
+                    uint32_t vertex = block_indices[t * 3 + k];
+                    for (std::size_t axis = 0; axis < 3; ++axis)
+                    {
+                        tangent[axis][vertex] += face_frames[axis][t];
+                        bitangent[axis][vertex] += face_frames[3 + axis][t];
+                    }
+                }
+            }
+        }
+
+        float* frames[10] = { streams.normal_x.data(), streams.normal_y.data(), streams.normal_z.data(), tangent[0],
+            tangent[1], tangent[2], bitangent[0], bitangent[1], bitangent[2], streams.tangent_w.data() };
+        table.orthonormalize(frames, vertex_count);
+    }
+
+    void quantize_positions(const VertexStreams& streams, const vertex_format::EncodeContext& context,
+        std::span<std::array<uint16_t, 4>> output, Isa isa)
+    {
+        if (output.size() < streams.size())
+        {
+            throw std::runtime_error("Quantized position output is too small");
+        }
+        const float* positions[3] = { streams.position_x.data(), streams.position_y.data(), streams.position_z.data() };
+        kernels(isa).quantize(positions, streams.size(), context.position_offset.data(), context.position_scale.data(),
+            output.data()->data());
+    }
+
+    void hash_vertices(const VertexStreams& streams, std::span<uint32_t> output, Isa isa)
+    {
+        if (output.size() < streams.size())
+        {
+            throw std::runtime_error("Vertex hash output is too small");
+        }
+        auto present = present_streams(streams);
+        kernels(isa).hash(present.data(), present.size(), streams.size(), output.data());
+    }
+
+    std::vector<uint32_t> deduplicate(VertexStreams& streams, std::span<uint32_t> indices, Isa isa)
+    {
+        constexpr uint32_t empty = std::numeric_limits<uint32_t>::max();
+        std::size_t vertex_count = streams.size();
+        check_indices(indices, vertex_count);
+        std::vector<uint32_t> hashes(vertex_count);
+        hash_vertices(streams, hashes, isa);
+        auto present = present_streams(streams);
+
+        auto same_bits = [&](uint32_t a, uint32_t b)
+        {
+            for (const float* stream : present)
+            {
+                if (std::memcmp(stream + a, stream + b, sizeof(float)) != 0)
+                {
+                    return false;
+                }
+            }
+            return true;
+        };
+
+        std::size_t capacity = 64;
+        while (capacity < vertex_count * 2)
+        {
+            capacity *= 2;
+        }
+        std::vector<uint32_t> table(capacity, empty);
+        std::vector<uint32_t> remap(vertex_count);
+        std::vector<uint32_t> unique_vertices;
+        for (uint32_t vertex = 0; vertex < vertex_count; ++vertex)
+        {
+            std::size_t slot = hashes[vertex] & (capacity - 1);
+            while (table[slot] != empty && !(hashes[table[slot]] == hashes[vertex] && same_bits(table[slot], vertex)))
+            {
+                slot = (slot + 1) & (capacity - 1);
+            }
+            if (table[slot] == empty)
+            {
+                table[slot] = vertex;
+                remap[vertex] = static_cast<uint32_t>(unique_vertices.size());
+                unique_vertices.push_back(vertex);
+            }
+            else
+            {
+                remap[vertex] = remap[table[slot]];
+            }
+        }
+
+        for (auto* stream : { &streams.position_x, &streams.position_y, &streams.position_z, &streams.normal_x,
+                 &streams.normal_y, &streams.normal_z, &streams.u, &streams.v, &streams.tangent_x, &streams.tangent_y,
+                 &streams.tangent_z, &streams.tangent_w })
+        {
+            if (stream->size() != vertex_count)
+            {
+                continue;
+            }
+            std::vector<float> compacted(unique_vertices.size());
+            for (std::size_t i = 0; i < unique_vertices.size(); ++i)
+            {
+                compacted[i] = (*stream)[unique_vertices[i]];
+            }
+            *stream = std::move(compacted);
+        }
+        for (uint32_t& index : indices)
+        {
+            index = remap[index];
+        }
+        return remap;
+    }
+}
@@ -0,0 +1,69 @@
+#include "mesh_kernels_impl.h"
+
+// Only built with AVX2 code generation on x86, see CMakeLists.txt. Nothing in here may run
+// before the dispatcher has checked the CPU.
+#if defined(__AVX2__)
+#define MESH_KERNELS_AVX2
+#include <immintrin.h>
+#endif
+
+namespace baas::mesh_kernels::detail
+{
+#ifdef MESH_KERNELS_AVX2
+    namespace
+    {
+        struct Avx2Ops
+        {
+            using F = __m256;
+            using M = __m256;
+            using I = __m256i;
+            static constexpr std::size_t width = 8;
+
+            static F load(const float* p) { return _mm256_loadu_ps(p); }
+            static void store(float* p, F v) { _mm256_storeu_ps(p, v); }
+            static F set1(float v) { return _mm256_set1_ps(v); }
+            // Plain loads rather than vgatherdps, which is microcoded and much slower on Intel
+            // parts with the gather data sampling mitigation.
+            static F gather(const float* base, const uint32_t* index)
+            {
+                return _mm256_setr_ps(base[index[0]], base[index[1]], base[index[2]], base[index[3]], base[index[4]],
+                    base[index[5]], base[index[6]], base[index[7]]);
+            }
+            static F add(F a, F b) { return _mm256_add_ps(a, b); }
+            static F sub(F a, F b) { return _mm256_sub_ps(a, b); }
+            static F mul(F a, F b) { return _mm256_mul_ps(a, b); }
+            static F div(F a, F b) { return _mm256_div_ps(a, b); }
+            static F sqrt(F a) { return _mm256_sqrt_ps(a); }
+            static F min(F a, F b) { return _mm256_min_ps(a, b); }
+            static F max(F a, F b) { return _mm256_max_ps(a, b); }
+            static M gt(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+            static M lt(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+            static F select(M m, F a, F b) { return _mm256_blendv_ps(b, a, m); }
+            static void reduce(F v, float* lanes) { _mm256_storeu_ps(lanes, v); }
+
+            static I bits(F v) { return _mm256_castps_si256(v); }
+            static I set1_u32(uint32_t v) { return _mm256_set1_epi32(static_cast<int>(v)); }
+            static I mul_u32(I a, I b) { return _mm256_mullo_epi32(a, b); }
+            static I add_u32(I a, I b) { return _mm256_add_epi32(a, b); }
+            static I xor_u32(I a, I b) { return _mm256_xor_si256(a, b); }
+            template <int N>
+            static I rotl(I v) { return _mm256_or_si256(_mm256_slli_epi32(v, N), _mm256_srli_epi32(v, 32 - N)); }
+            template <int N>
+            static I shr(I v) { return _mm256_srli_epi32(v, N); }
+            static I truncate(F v) { return _mm256_cvttps_epi32(v); }
+            static void store_u32(uint32_t* p, I v) { _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), v); }
+        };
+    }
+
+    const KernelTable* avx2_kernels()
+    {
+        static const KernelTable table = make_kernel_table<Avx2Ops>();
+        return &table;
+    }
+#else
+    const KernelTable* avx2_kernels()
+    {
+        return nullptr;
+    }
+#endif
+}
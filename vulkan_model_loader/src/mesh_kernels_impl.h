@@ -0,0 +1,381 @@
+#ifndef MESH_KERNELS_IMPL_H
+#define MESH_KERNELS_IMPL_H
+
+// Shared kernel bodies, written once against a small set of vector operations and
+// instantiated by each mesh_kernels_<isa>.cpp with that file's compiler flags.
+//
+// Everything below the KernelTable lives in an unnamed namespace on purpose: each
+// instruction set file gets its own private copy, so the linker can never pick an AVX2
+// instantiation of a shared template for the scalar path. For the same reason the kernels
+// avoid std:: function templates such as std::min.
+
+#include <math.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "mesh_kernels.h"
+
+namespace baas::mesh_kernels::detail
+{
+    struct KernelTable
+    {
+        void (*compute_aabb)(const float* x, const float* y, const float* z, std::size_t count, Aabb& aabb);
+        // Unnormalized (area weighted) normal per triangle.
+        void (*face_normals)(const float* const* positions, const uint32_t* indices, std::size_t triangle_count,
+            float* const* normals);
+        void (*normalize)(float* x, float* y, float* z, std::size_t count);
+        // positions x, y, z, u, v in, tangent xyz and bitangent xyz per triangle out.
+        void (*face_tangents)(const float* const* attributes, const uint32_t* indices, std::size_t triangle_count,
+            float* const* tangents);
+        // normal xyz, tangent xyz (in/out), bitangent xyz, tangent w (out).
+        void (*orthonormalize)(float* const* frames, std::size_t count);
+        void (*quantize)(const float* const* positions, std::size_t count, const float* offset, const float* scale,
+            uint16_t* output);
+        void (*hash)(const float* const* streams, std::size_t stream_count, std::size_t count, uint32_t* output);
+    };
+
+    // nullptr when the instruction set isn't compiled in for this architecture.
+    const KernelTable* scalar_kernels();
+    const KernelTable* sse2_kernels();
+    const KernelTable* avx2_kernels();
+    const KernelTable* neon_kernels();
+}
+
+namespace baas::mesh_kernels::detail
+{
+    namespace
+    {
+        // Width 1 reference. Also used for the tails of the vector loops.
+        struct ScalarOps
+        {
+            using F = float;
+            using M = bool;
+            using I = uint32_t;
+            static constexpr std::size_t width = 1;
+
+            static F load(const float* p) { return *p; }
+            static void store(float* p, F v) { *p = v; }
+            static F set1(float v) { return v; }
+            static F gather(const float* base, const uint32_t* index) { return base[index[0]]; }
+            static F add(F a, F b) { return a + b; }
+            static F sub(F a, F b) { return a - b; }
+            static F mul(F a, F b) { return a * b; }
+            static F div(F a, F b) { return a / b; }
+            static F sqrt(F a) { return sqrtf(a); }
+            // Same operand order as minps/maxps.
+            static F min(F a, F b) { return a < b ? a : b; }
+            static F max(F a, F b) { return a > b ? a : b; }
+            static M gt(F a, F b) { return a > b; }
+            static M lt(F a, F b) { return a < b; }
+            static F select(M m, F a, F b) { return m ? a : b; }
+            static void reduce(F v, float* lanes) { lanes[0] = v; }
+
+            static I bits(F v)
+            {
+                I result;
+                std::memcpy(&result, &v, sizeof(result));
+                return result;
+            }
+            static I set1_u32(uint32_t v) { return v; }
+            static I mul_u32(I a, I b) { return a * b; }
+            static I add_u32(I a, I b) { return a + b; }
+            static I xor_u32(I a, I b) { return a ^ b; }
+            template <int N>
+            static I rotl(I v) { return (v << N) | (v >> (32 - N)); }
+            template <int N>
+            static I shr(I v) { return v >> N; }
+            static I truncate(F v) { return static_cast<uint32_t>(static_cast<int32_t>(v)); }
+            static void store_u32(uint32_t* p, I v) { *p = v; }
+        };
+
+        // Loads lane l's index from indices[(first + l) * 3 + corner].
+        template <typename Ops>
+        typename Ops::F gather_corner(const float* base, const uint32_t* indices, std::size_t first, std::size_t corner)
+        {
+            uint32_t lane_index[Ops::width];
+            for (std::size_t l = 0; l < Ops::width; ++l)
+            {
+                lane_index[l] = indices[(first + l) * 3 + corner];
+            }
+            return Ops::gather(base, lane_index);
+        }
+
+        template <typename Ops>
+        void aabb_kernel(const float* x, const float* y, const float* z, std::size_t count, Aabb& aabb)
+        {
+            const float* streams[3] = { x, y, z };
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                const float* s = streams[axis];
+                float lo = HUGE_VALF;
+                float hi = -HUGE_VALF;
+                std::size_t i{ 0 };
+                if constexpr (Ops::width > 1)
+                {
+                    typename Ops::F vlo = Ops::set1(HUGE_VALF);
+                    typename Ops::F vhi = Ops::set1(-HUGE_VALF);
+                    for (; i + Ops::width <= count; i += Ops::width)
+                    {
+                        typename Ops::F value = Ops::load(s + i);
+                        vlo = Ops::min(vlo, value);
+                        vhi = Ops::max(vhi, value);
+                    }
+                    float lanes[Ops::width];
+                    Ops::reduce(vlo, lanes);
+                    for (std::size_t l = 0; l < Ops::width; ++l)
+                    {
+                        lo = ScalarOps::min(lo, lanes[l]);
+                    }
+                    Ops::reduce(vhi, lanes);
+                    for (std::size_t l = 0; l < Ops::width; ++l)
+                    {
+                        hi = ScalarOps::max(hi, lanes[l]);
+                    }
+                }
+                for (; i < count; ++i)
+                {
+                    lo = ScalarOps::min(lo, s[i]);
+                    hi = ScalarOps::max(hi, s[i]);
+                }
+                aabb.min[axis] = lo;
+                aabb.max[axis] = hi;
+            }
+        }
+
+        template <typename Ops>
+        void face_normals_range(const float* const* p, const uint32_t* indices, std::size_t begin, std::size_t end,
+            float* const* n)
+        {
+            using F = typename Ops::F;
+            for (std::size_t t = begin; t + Ops::width <= end; t += Ops::width)
+            {
+                F p0[3], p1[3], p2[3];
+                for (int axis = 0; axis < 3; ++axis)
+                {
+                    p0[axis] = gather_corner<Ops>(p[axis], indices, t, 0);
+                    p1[axis] = gather_corner<Ops>(p[axis], indices, t, 1);
+                    p2[axis] = gather_corner<Ops>(p[axis], indices, t, 2);
+                }
+                F e1x = Ops::sub(p1[0], p0[0]), e1y = Ops::sub(p1[1], p0[1]), e1z = Ops::sub(p1[2], p0[2]);
+                F e2x = Ops::sub(p2[0], p0[0]), e2y = Ops::sub(p2[1], p0[1]), e2z = Ops::sub(p2[2], p0[2]);
+                Ops::store(n[0] + t, Ops::sub(Ops::mul(e1y, e2z), Ops::mul(e1z, e2y)));
+                Ops::store(n[1] + t, Ops::sub(Ops::mul(e1z, e2x), Ops::mul(e1x, e2z)));
+                Ops::store(n[2] + t, Ops::sub(Ops::mul(e1x, e2y), Ops::mul(e1y, e2x)));
+            }
+        }
+
+        template <typename Ops>
+        void face_normals_kernel(const float* const* positions, const uint32_t* indices, std::size_t triangle_count,
+            float* const* normals)
+        {
+            std::size_t vector_end = triangle_count / Ops::width * Ops::width;
+            face_normals_range<Ops>(positions, indices, 0, vector_end, normals);
+            face_normals_range<ScalarOps>(positions, indices, vector_end, triangle_count, normals);
+        }
+
+        template <typename Ops>
+        void normalize_range(float* x, float* y, float* z, std::size_t begin, std::size_t end)
+        {
+            using F = typename Ops::F;
+            const F zero = Ops::set1(0.0f);
+            for (std::size_t i = begin; i + Ops::width <= end; i += Ops::width)
+            {
+                F vx = Ops::load(x + i), vy = Ops::load(y + i), vz = Ops::load(z + i);
+                F length = Ops::sqrt(Ops::add(Ops::add(Ops::mul(vx, vx), Ops::mul(vy, vy)), Ops::mul(vz, vz)));
+                auto valid = Ops::gt(length, zero);
+                Ops::store(x + i, Ops::select(valid, Ops::div(vx, length), zero));
+                Ops::store(y + i, Ops::select(valid, Ops::div(vy, length), zero));
+                Ops::store(z + i, Ops::select(valid, Ops::div(vz, length), zero));
+            }
+        }
+
+        template <typename Ops>
+        void normalize_kernel(float* x, float* y, float* z, std::size_t count)
+        {
+            std::size_t vector_end = count / Ops::width * Ops::width;
+            normalize_range<Ops>(x, y, z, 0, vector_end);
+            normalize_range<ScalarOps>(x, y, z, vector_end, count);
+        }
+
+        template <typename Ops>
+        void face_tangents_range(const float* const* a, const uint32_t* indices, std::size_t begin, std::size_t end,
+            float* const* out)
+        {
+            using F = typename Ops::F;
+            const F zero = Ops::set1(0.0f);
+            const F one = Ops::set1(1.0f);
+            for (std::size_t t = begin; t + Ops::width <= end; t += Ops::width)
+            {
+                F c0[5], c1[5], c2[5];
+                for (int attribute = 0; attribute < 5; ++attribute)
+                {
+                    c0[attribute] = gather_corner<Ops>(a[attribute], indices, t, 0);
+                    c1[attribute] = gather_corner<Ops>(a[attribute], indices, t, 1);
+                    c2[attribute] = gather_corner<Ops>(a[attribute], indices, t, 2);
+                }
+                F e1[3], e2[3];
+                for (int axis = 0; axis < 3; ++axis)
+                {
+                    e1[axis] = Ops::sub(c1[axis], c0[axis]);
+                    e2[axis] = Ops::sub(c2[axis], c0[axis]);
+                }
+                F du1 = Ops::sub(c1[3], c0[3]), dv1 = Ops::sub(c1[4], c0[4]);
+                F du2 = Ops::sub(c2[3], c0[3]), dv2 = Ops::sub(c2[4], c0[4]);
+                F determinant = Ops::sub(Ops::mul(du1, dv2), Ops::mul(du2, dv1));
+                // Degenerate uv mappings contribute nothing instead of infinities.
+                auto valid = Ops::gt(Ops::max(determinant, Ops::sub(zero, determinant)), zero);
+                F r = Ops::select(valid, Ops::div(one, determinant), zero);
+                for (int axis = 0; axis < 3; ++axis)
+                {
+                    F tangent = Ops::mul(Ops::sub(Ops::mul(e1[axis], dv2), Ops::mul(e2[axis], dv1)), r);
+                    F bitangent = Ops::mul(Ops::sub(Ops::mul(e2[axis], du1), Ops::mul(e1[axis], du2)), r);
+                    Ops::store(out[axis] + t, tangent);
+                    Ops::store(out[3 + axis] + t, bitangent);
+                }
+            }
+        }
+
+        template <typename Ops>
+        void face_tangents_kernel(const float* const* attributes, const uint32_t* indices, std::size_t triangle_count,
+            float* const* tangents)
+        {
+            std::size_t vector_end = triangle_count / Ops::width * Ops::width;
+            face_tangents_range<Ops>(attributes, indices, 0, vector_end, tangents);
+            face_tangents_range<ScalarOps>(attributes, indices, vector_end, triangle_count, tangents);
+        }
+
+        template <typename Ops>
+        void orthonormalize_range(float* const* f, std::size_t begin, std::size_t end)
+        {
+            using F = typename Ops::F;
+            const F zero = Ops::set1(0.0f);
+            const F one = Ops::set1(1.0f);
+            const F minus_one = Ops::set1(-1.0f);
+            for (std::size_t i = begin; i + Ops::width <= end; i += Ops::width)
+            {
+                F nx = Ops::load(f[0] + i), ny = Ops::load(f[1] + i), nz = Ops::load(f[2] + i);
+                F tx = Ops::load(f[3] + i), ty = Ops::load(f[4] + i), tz = Ops::load(f[5] + i);
+                F bx = Ops::load(f[6] + i), by = Ops::load(f[7] + i), bz = Ops::load(f[8] + i);
+
+                // Gram-Schmidt against the normal.
+                F d = Ops::add(Ops::add(Ops::mul(nx, tx), Ops::mul(ny, ty)), Ops::mul(nz, tz));
+                tx = Ops::sub(tx, Ops::mul(nx, d));
+                ty = Ops::sub(ty, Ops::mul(ny, d));
+                tz = Ops::sub(tz, Ops::mul(nz, d));
+                F length = Ops::sqrt(Ops::add(Ops::add(Ops::mul(tx, tx), Ops::mul(ty, ty)), Ops::mul(tz, tz)));
+                auto valid = Ops::gt(length, zero);
+                tx = Ops::select(valid, Ops::div(tx, length), zero);
+                ty = Ops::select(valid, Ops::div(ty, length), zero);
+                tz = Ops::select(valid, Ops::div(tz, length), zero);
+
+                F cx = Ops::sub(Ops::mul(ny, tz), Ops::mul(nz, ty));
+                F cy = Ops::sub(Ops::mul(nz, tx), Ops::mul(nx, tz));
+                F cz = Ops::sub(Ops::mul(nx, ty), Ops::mul(ny, tx));
+                F handedness = Ops::add(Ops::add(Ops::mul(cx, bx), Ops::mul(cy, by)), Ops::mul(cz, bz));
+
+                Ops::store(f[3] + i, tx);
+                Ops::store(f[4] + i, ty);
+                Ops::store(f[5] + i, tz);
+                Ops::store(f[9] + i, Ops::select(Ops::lt(handedness, zero), minus_one, one));
+            }
+        }
+
+        template <typename Ops>
+        void orthonormalize_kernel(float* const* frames, std::size_t count)
+        {
+            std::size_t vector_end = count / Ops::width * Ops::width;
+            orthonormalize_range<Ops>(frames, 0, vector_end);
+            orthonormalize_range<ScalarOps>(frames, vector_end, count);
+        }
+
+        template <typename Ops>
+        void quantize_range(const float* const* p, std::size_t begin, std::size_t end, const float* offset,
+            const float* scale, uint16_t* output)
+        {
+            using F = typename Ops::F;
+            const F zero = Ops::set1(0.0f);
+            const F one = Ops::set1(1.0f);
+            const F max_value = Ops::set1(65535.0f);
+            const F half = Ops::set1(0.5f);
+            for (std::size_t i = begin; i + Ops::width <= end; i += Ops::width)
+            {
+                for (int axis = 0; axis < 3; ++axis)
+                {
+                    F normalized = Ops::div(Ops::sub(Ops::load(p[axis] + i), Ops::set1(offset[axis])), Ops::set1(scale[axis]));
+                    normalized = Ops::min(Ops::max(normalized, zero), one);
+                    // Round half up by truncation, the value is never negative. Same as encode_unorm16.
+                    auto quantized = Ops::truncate(Ops::add(Ops::mul(normalized, max_value), half));
+                    uint32_t lanes[Ops::width];
+                    Ops::store_u32(lanes, quantized);
+                    for (std::size_t l = 0; l < Ops::width; ++l)
+                    {
+                        output[(i + l) * 4 + axis] = static_cast<uint16_t>(lanes[l]);
+                    }
+                }
+                for (std::size_t l = 0; l < Ops::width; ++l)
+                {
+                    output[(i + l) * 4 + 3] = 65535;
+                }
+            }
+        }
+
+        template <typename Ops>
+        void quantize_kernel(const float* const* positions, std::size_t count, const float* offset, const float* scale,
+            uint16_t* output)
+        {
+            std::size_t vector_end = count / Ops::width * Ops::width;
+            quantize_range<Ops>(positions, 0, vector_end, offset, scale, output);
+            quantize_range<ScalarOps>(positions, vector_end, count, offset, scale, output);
+        }
+
+        template <typename Ops>
+        void hash_range(const float* const* streams, std::size_t stream_count, std::size_t begin, std::size_t end,
+            uint32_t* output)
+        {
+            using I = typename Ops::I;
+            const I c1 = Ops::set1_u32(0xCC9E2D51u);
+            const I c2 = Ops::set1_u32(0x1B873593u);
+            const I five = Ops::set1_u32(5u);
+            const I n = Ops::set1_u32(0xE6546B64u);
+            for (std::size_t i = begin; i + Ops::width <= end; i += Ops::width)
+            {
+                I h = Ops::set1_u32(0x9747B28Cu);
+                for (std::size_t s = 0; s < stream_count; ++s)
+                {
+                    I k = Ops::bits(Ops::load(streams[s] + i));
+                    k = Ops::mul_u32(k, c1);
+                    k = Ops::template rotl<15>(k);
+                    k = Ops::mul_u32(k, c2);
+                    h = Ops::xor_u32(h, k);
+                    h = Ops::template rotl<13>(h);
+                    h = Ops::add_u32(Ops::mul_u32(h, five), n);
+                }
+                h = Ops::xor_u32(h, Ops::set1_u32(static_cast<uint32_t>(stream_count * 4)));
+                h = Ops::xor_u32(h, Ops::template shr<16>(h));
+                h = Ops::mul_u32(h, Ops::set1_u32(0x85EBCA6Bu));
+                h = Ops::xor_u32(h, Ops::template shr<13>(h));
+                h = Ops::mul_u32(h, Ops::set1_u32(0xC2B2AE35u));
+                h = Ops::xor_u32(h, Ops::template shr<16>(h));
+                Ops::store_u32(output + i, h);
+            }
+        }
+
+        template <typename Ops>
+        void hash_kernel(const float* const* streams, std::size_t stream_count, std::size_t count, uint32_t* output)
+        {
+            std::size_t vector_end = count / Ops::width * Ops::width;
+            hash_range<Ops>(streams, stream_count, 0, vector_end, output);
+            hash_range<ScalarOps>(streams, stream_count, vector_end, count, output);
+        }
+
+        template <typename Ops>
+        KernelTable make_kernel_table()
+        {
+            return { &aabb_kernel<Ops>, &face_normals_kernel<Ops>, &normalize_kernel<Ops>, &face_tangents_kernel<Ops>,
+                &orthonormalize_kernel<Ops>, &quantize_kernel<Ops>, &hash_kernel<Ops> };
+        }
+    }
+}
+#endif // !MESH_KERNELS_IMPL_H
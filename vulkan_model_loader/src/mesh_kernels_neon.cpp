@@ -0,0 +1,67 @@
+#include "mesh_kernels_impl.h"
+
+// AArch64 only, 32 bit ARM has no vector divide or square root.
+#if defined(__aarch64__) || defined(_M_ARM64)
+#define MESH_KERNELS_NEON
+#include <arm_neon.h>
+#endif
+
+namespace baas::mesh_kernels::detail
+{
+#ifdef MESH_KERNELS_NEON
+    namespace
+    {
+        struct NeonOps
+        {
+            using F = float32x4_t;
+            using M = uint32x4_t;
+            using I = uint32x4_t;
+            static constexpr std::size_t width = 4;
+
+            static F load(const float* p) { return vld1q_f32(p); }
+            static void store(float* p, F v) { vst1q_f32(p, v); }
+            static F set1(float v) { return vdupq_n_f32(v); }
+            static F gather(const float* base, const uint32_t* index)
+            {
+                float lanes[4] = { base[index[0]], base[index[1]], base[index[2]], base[index[3]] };
+                return vld1q_f32(lanes);
+            }
+            static F add(F a, F b) { return vaddq_f32(a, b); }
+            static F sub(F a, F b) { return vsubq_f32(a, b); }
+            static F mul(F a, F b) { return vmulq_f32(a, b); }
+            static F div(F a, F b) { return vdivq_f32(a, b); }
+            static F sqrt(F a) { return vsqrtq_f32(a); }
+            // vminq/vmaxq treat signed zeros and NaNs differently from the x86 reference, compare and select instead.
+            static F min(F a, F b) { return vbslq_f32(vcltq_f32(a, b), a, b); }
+            static F max(F a, F b) { return vbslq_f32(vcgtq_f32(a, b), a, b); }
+            static M gt(F a, F b) { return vcgtq_f32(a, b); }
+            static M lt(F a, F b) { return vcltq_f32(a, b); }
+            static F select(M m, F a, F b) { return vbslq_f32(m, a, b); }
+            static void reduce(F v, float* lanes) { vst1q_f32(lanes, v); }
+
+            static I bits(F v) { return vreinterpretq_u32_f32(v); }
+            static I set1_u32(uint32_t v) { return vdupq_n_u32(v); }
+            static I mul_u32(I a, I b) { return vmulq_u32(a, b); }
+            static I add_u32(I a, I b) { return vaddq_u32(a, b); }
+            static I xor_u32(I a, I b) { return veorq_u32(a, b); }
+            template <int N>
+            static I rotl(I v) { return vorrq_u32(vshlq_n_u32(v, N), vshrq_n_u32(v, 32 - N)); }
+            template <int N>
+            static I shr(I v) { return vshrq_n_u32(v, N); }
+            static I truncate(F v) { return vreinterpretq_u32_s32(vcvtq_s32_f32(v)); }
+            static void store_u32(uint32_t* p, I v) { vst1q_u32(p, v); }
+        };
+    }
+
+    const KernelTable* neon_kernels()
+    {
+        static const KernelTable table = make_kernel_table<NeonOps>();
+        return &table;
+    }
+#else
+    const KernelTable* neon_kernels()
+    {
+        return nullptr;
+    }
+#endif
+}
@@ -0,0 +1,10 @@
+#include "mesh_kernels_impl.h"
+
+namespace baas::mesh_kernels::detail
+{
+    const KernelTable* scalar_kernels()
+    {
+        static const KernelTable table = make_kernel_table<ScalarOps>();
+        return &table;
+    }
+}
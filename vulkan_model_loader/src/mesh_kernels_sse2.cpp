@@ -0,0 +1,71 @@
+#include "mesh_kernels_impl.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define MESH_KERNELS_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace baas::mesh_kernels::detail
+{
+#ifdef MESH_KERNELS_SSE2
+    namespace
+    {
+        struct Sse2Ops
+        {
+            using F = __m128;
+            using M = __m128;
+            using I = __m128i;
+            static constexpr std::size_t width = 4;
+
+            static F load(const float* p) { return _mm_loadu_ps(p); }
+            static void store(float* p, F v) { _mm_storeu_ps(p, v); }
+            static F set1(float v) { return _mm_set1_ps(v); }
+            static F gather(const float* base, const uint32_t* index)
+            {
+                return _mm_setr_ps(base[index[0]], base[index[1]], base[index[2]], base[index[3]]);
+            }
+            static F add(F a, F b) { return _mm_add_ps(a, b); }
+            static F sub(F a, F b) { return _mm_sub_ps(a, b); }
+            static F mul(F a, F b) { return _mm_mul_ps(a, b); }
+            static F div(F a, F b) { return _mm_div_ps(a, b); }
+            static F sqrt(F a) { return _mm_sqrt_ps(a); }
+            static F min(F a, F b) { return _mm_min_ps(a, b); }
+            static F max(F a, F b) { return _mm_max_ps(a, b); }
+            static M gt(F a, F b) { return _mm_cmpgt_ps(a, b); }
+            static M lt(F a, F b) { return _mm_cmplt_ps(a, b); }
+            static F select(M m, F a, F b) { return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); }
+            static void reduce(F v, float* lanes) { _mm_storeu_ps(lanes, v); }
+
+            static I bits(F v) { return _mm_castps_si128(v); }
+            static I set1_u32(uint32_t v) { return _mm_set1_epi32(static_cast<int>(v)); }
+            // SSE2 has no 32 bit mullo, multiply the even and odd lanes separately and interleave.
+            static I mul_u32(I a, I b)
+            {
+                __m128i even = _mm_mul_epu32(a, b);
+                __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+                return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+                    _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+            }
+            static I add_u32(I a, I b) { return _mm_add_epi32(a, b); }
+            static I xor_u32(I a, I b) { return _mm_xor_si128(a, b); }
+            template <int N>
+            static I rotl(I v) { return _mm_or_si128(_mm_slli_epi32(v, N), _mm_srli_epi32(v, 32 - N)); }
+            template <int N>
+            static I shr(I v) { return _mm_srli_epi32(v, N); }
+            static I truncate(F v) { return _mm_cvttps_epi32(v); }
+            static void store_u32(uint32_t* p, I v) { _mm_storeu_si128(reinterpret_cast<__m128i*>(p), v); }
+        };
+    }
+
+    const KernelTable* sse2_kernels()
+    {
+        static const KernelTable table = make_kernel_table<Sse2Ops>();
+        return &table;
+    }
+#else
+    const KernelTable* sse2_kernels()
+    {
+        return nullptr;
+    }
+#endif
+}
@@ -0,0 +1,750 @@
+#include "mesh_lod.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#include "file_ops.h"
+#include "mesh_optimizer.h"
+
+namespace baas::mesh_lod
+{
+    namespace
+    {
+        constexpr char LOD_MAGIC[8] = { 'V', 'M', 'L', 'L', 'O', 'D', '\0', '\0' };
+        // Border edges get a plane at a right angle to their face, weighted so outlines mostly stay put.
+        constexpr double BORDER_WEIGHT = 10.0;
+        constexpr uint32_t INVALID = std::numeric_limits<uint32_t>::max();
+
+        // Symmetric 4x4 matrix summing squared distances to a set of planes.
+        struct Quadric
+        {
+            double a00, a01, a02, a03, a11, a12, a13, a22, a23, a33;
+
+            void add_plane(double a, double b, double c, double d, double weight)
+            {
+                a00 += weight * a * a;
+                a01 += weight * a * b;
+                a02 += weight * a * c;
+                a03 += weight * a * d;
+                a11 += weight * b * b;
+                a12 += weight * b * c;
+                a13 += weight * b * d;
+                a22 += weight * c * c;
+                a23 += weight * c * d;
+                a33 += weight * d * d;
+            }
+
+            Quadric& operator+=(const Quadric& other)
+            {
+                a00 += other.a00;
+                a01 += other.a01;
+                a02 += other.a02;
+                a03 += other.a03;
+                a11 += other.a11;
+                a12 += other.a12;
+                a13 += other.a13;
+                a22 += other.a22;
+                a23 += other.a23;
+                a33 += other.a33;
+                return *this;
+            }
+
+            double evaluate(const std::array<float, 3>& p) const
+            {
+                double x = p[0], y = p[1], z = p[2];
+                double result = a00 * x * x + 2.0 * a01 * x * y + 2.0 * a02 * x * z + 2.0 * a03 * x + a11 * y * y +
+                    2.0 * a12 * y * z + 2.0 * a13 * y + a22 * z * z + 2.0 * a23 * z + a33;
+                // Rounding can take a perfect fit slightly below zero.
+                return std::max(result, 0.0);
+            }
+        };
+
+        using Vec3 = std::array<double, 3>;
+
+        Vec3 to_vec(const std::array<float, 3>& p)
+        {
+            return { p[0], p[1], p[2] };
+        }
+
+        Vec3 sub(const Vec3& a, const Vec3& b)
+        {
+            return { a[0] - b[0], a[1] - b[1], a[2] - b[2] };
+        }
+
+        Vec3 cross(const Vec3& a, const Vec3& b)
+        {
+            return { a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0] };
+        }
+
+        double dot(const Vec3& a, const Vec3& b)
+        {
+            return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+        }
+
+        struct Collapse
+        {
+            float cost;
+            uint32_t from;
+            uint32_t to;
+        };
+
+        // Each pass aims to collapse half the edges still needed, and stops early at this multiple
+        // of the goal's cost so the order stays close to a strict cheapest first.
+        constexpr double PASS_ERROR_BOUND = 1.5;
+
+        // Working state for one triangle list, vertices are renumbered to the ones it uses.
+        class Simplifier
+        {
+        public:
+            Simplifier(std::span<const uint32_t> indices, std::span<const mesh::Vertex> vertices, std::span<const uint8_t> locked_vertices)
+            {
+                std::vector<uint32_t> local(vertices.size(), INVALID);
+                triangles.resize(indices.size() / 3);
+                for (std::size_t i = 0; i < triangles.size() * 3; ++i)
+                {
+                    uint32_t index = indices[i];
+                    if (local[index] == INVALID)
+                    {
+                        local[index] = static_cast<uint32_t>(global.size());
+                        global.push_back(index);
+                    }
+                    triangles[i / 3][i % 3] = local[index];
+                }
+
+                auto count = global.size();
+                positions.resize(count);
+                locked.assign(count, 0);
+                for (std::size_t v = 0; v < count; ++v)
+                {
+                    positions[v] = vertices[global[v]].position;
+                    locked[v] = !locked_vertices.empty() && locked_vertices[global[v]];
+                }
+                lock_seams();
+
+                alive.assign(triangles.size(), 1);
+                alive_count = triangles.size();
+                vertex_triangles.resize(count);
+                for (uint32_t t = 0; t < triangles.size(); ++t)
+                {
+                    auto& triangle = triangles[t];
+                    // Degenerate input triangles don't contribute a plane and can't become anything.
+                    if (triangle[0] == triangle[1] || triangle[1] == triangle[2] || triangle[0] == triangle[2])
+                    {
+                        alive[t] = 0;
+                        --alive_count;
+                        continue;
+                    }
+                    for (uint32_t corner : triangle)
+                    {
+                        vertex_triangles[corner].push_back(t);
+                    }
+                }
+
+                quadrics.assign(count, Quadric{});
+                border.assign(count, 0);
+                for (uint32_t t = 0; t < triangles.size(); ++t)
+                {
+                    if (!alive[t])
+                    {
+                        continue;
+                    }
+                    auto& triangle = triangles[t];
+                    Vec3 normal = face_normal(triangle[0], triangle[1], triangle[2]);
+                    double length = std::sqrt(dot(normal, normal));
+                    if (length == 0.0)
+                    {
+                        continue;
+                    }
+                    normal = { normal[0] / length, normal[1] / length, normal[2] / length };
+                    double d = -dot(normal, to_vec(positions[triangle[0]]));
+                    for (uint32_t corner : triangle)
+                    {
+                        quadrics[corner].add_plane(normal[0], normal[1], normal[2], d, 1.0);
+                    }
+                    for (int e = 0; e < 3; ++e)
+                    {
+                        uint32_t a = triangle[e];
+                        uint32_t b = triangle[(e + 1) % 3];
+                        if (!is_border_edge(a, b))
+                        {
+                            continue;
+                        }
+                        border[a] = border[b] = 1;
+                        Vec3 edge = sub(to_vec(positions[b]), to_vec(positions[a]));
+                        Vec3 side = cross(edge, normal);
+                        double side_length = std::sqrt(dot(side, side));
+                        if (side_length == 0.0)
+                        {
+                            continue;
+                        }
+                        side = { side[0] / side_length, side[1] / side_length, side[2] / side_length };
+                        double side_d = -dot(side, to_vec(positions[a]));
+                        quadrics[a].add_plane(side[0], side[1], side[2], side_d, BORDER_WEIGHT);
+                        quadrics[b].add_plane(side[0], side[1], side[2], side_d, BORDER_WEIGHT);
+                    }
+                }
+
+                removed.assign(count, 0);
+                touched.assign(count, 0);
+            }
+
+            // Works in passes instead of one global queue: all candidate collapses are costed and sorted,
+            // then applied cheapest first as long as they don't touch a vertex an earlier collapse of the
+            // same pass moved. Costs of untouched vertices can't have changed, so the order is still
+            // right, and sorting a flat array is far cheaper than keeping a heap of stale entries.
+            std::vector<SimplifiedLevel> run(std::span<const std::size_t> target_index_counts, float max_error)
+            {
+                std::vector<SimplifiedLevel> levels;
+                double max_cost = static_cast<double>(max_error) * max_error;
+                double worst_cost = 0.0;
+                bool stuck{ false };
+                std::vector<Collapse> candidates;
+                for (std::size_t target : target_index_counts)
+                {
+                    std::size_t target_triangles = target / 3;
+                    while (!stuck && alive_count > target_triangles)
+                    {
+                        collect_candidates(candidates, max_cost);
+                        if (candidates.empty())
+                        {
+                            stuck = true;
+                            break;
+                        }
+                        // Every collapse removes about two triangles. Only the part of the list the pass can
+                        // get to needs sorting.
+                        auto by_cost = [](const Collapse& a, const Collapse& b) { return a.cost < b.cost; };
+                        std::size_t goal = std::max<std::size_t>((alive_count - target_triangles) / 2, 1);
+                        double pass_limit = max_cost;
+                        if (goal < candidates.size())
+                        {
+                            std::nth_element(candidates.begin(), candidates.begin() + goal, candidates.end(), by_cost);
+                            pass_limit = candidates[goal].cost * PASS_ERROR_BOUND;
+                            candidates.erase(std::partition(candidates.begin(), candidates.end(),
+                                [pass_limit](const Collapse& c) { return c.cost <= pass_limit; }), candidates.end());
+                        }
+                        std::sort(candidates.begin(), candidates.end(), by_cost);
+                        std::fill(touched.begin(), touched.end(), 0);
+                        std::size_t applied{ 0 };
+                        for (auto&& collapse : candidates)
+                        {
+                            if (alive_count <= target_triangles)
+                            {
+                                break;
+                            }
+                            if (touched[collapse.from] || touched[collapse.to] || removed[collapse.from] || removed[collapse.to] ||
+                                !valid(collapse.from, collapse.to))
+                            {
+                                continue;
+                            }
+                            worst_cost = std::max(worst_cost, static_cast<double>(collapse.cost));
+                            apply(collapse.from, collapse.to);
+                            ++applied;
+                        }
+                        stuck = applied == 0;
+                    }
+                    levels.push_back({ current_indices(), static_cast<float>(std::sqrt(worst_cost)) });
+                }
+                return levels;
+            }
+
+        private:
+            std::vector<uint32_t> global;
+            std::vector<std::array<float, 3>> positions;
+            std::vector<std::array<uint32_t, 3>> triangles;
+            std::vector<uint8_t> alive;
+            std::size_t alive_count{ 0 };
+            std::vector<std::vector<uint32_t>> vertex_triangles;
+            std::vector<Quadric> quadrics;
+            std::vector<uint8_t> locked;
+            std::vector<uint8_t> border;
+            std::vector<uint8_t> removed;
+            // Moved or grown by a collapse in the current pass.
+            std::vector<uint8_t> touched;
+
+            Vec3 face_normal(uint32_t a, uint32_t b, uint32_t c) const
+            {
+                Vec3 pa = to_vec(positions[a]);
+                return cross(sub(to_vec(positions[b]), pa), sub(to_vec(positions[c]), pa));
+            }
+
+            // Vertices that share a position with another vertex sit on an attribute seam. Moving them
+            // would tear the seam open, so they stay where they are.
+            void lock_seams()
+            {
+                std::vector<uint32_t> order(positions.size());
+                for (uint32_t v = 0; v < order.size(); ++v)
+                {
+                    order[v] = v;
+                }
+                std::sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) { return positions[a] < positions[b]; });
+                for (std::size_t i = 1; i < order.size(); ++i)
+                {
+                    if (positions[order[i]] == positions[order[i - 1]])
+                    {
+                        locked[order[i]] = locked[order[i - 1]] = 1;
+                    }
+                }
+            }
+
+            bool is_border_edge(uint32_t a, uint32_t b) const
+            {
+                int shared{ 0 };
+                for (uint32_t t : vertex_triangles[a])
+                {
+                    if (alive[t] && (triangles[t][0] == b || triangles[t][1] == b || triangles[t][2] == b))
+                    {
+                        ++shared;
+                    }
+                }
+                return shared == 1;
+            }
+
+            // Moving from onto to must not fold or flatten any triangle that survives the collapse.
+            bool valid(uint32_t from, uint32_t to) const
+            {
+                if (locked[from])
+                {
+                    return false;
+                }
+                // Border vertices may only slide along the border.
+                if (border[from] && !is_border_edge(from, to))
+                {
+                    return false;
+                }
+                for (uint32_t t : vertex_triangles[from])
+                {
+                    if (!alive[t])
+                    {
+                        continue;
+                    }
+                    auto triangle = triangles[t];
+                    if (triangle[0] == to || triangle[1] == to || triangle[2] == to)
+                    {
+                        continue;
+                    }
+                    Vec3 before = face_normal(triangle[0], triangle[1], triangle[2]);
+                    for (auto&& corner : triangle)
+                    {
+                        corner = corner == from ? to : corner;
+                    }
+                    Vec3 after = face_normal(triangle[0], triangle[1], triangle[2]);
+                    double before_length = std::sqrt(dot(before, before));
+                    double after_length = std::sqrt(dot(after, after));
+                    if (after_length <= before_length * 1e-6 || dot(before, after) < 0.2 * before_length * after_length)
+                    {
+                        return false;
+                    }
+                }
+                return true;
+            }
+
+            double cost(uint32_t from, uint32_t to) const
+            {
+                Quadric combined = quadrics[from];
+                combined += quadrics[to];
+                return combined.evaluate(positions[to]);
+            }
+
+            void collect_candidates(std::vector<Collapse>& candidates, double max_cost) const
+            {
+                candidates.clear();
+                for (uint32_t t = 0; t < triangles.size(); ++t)
+                {
+                    if (!alive[t])
+                    {
+                        continue;
+                    }
+                    auto& triangle = triangles[t];
+                    for (int e = 0; e < 3; ++e)
+                    {
+                        uint32_t a = triangle[e];
+                        uint32_t b = triangle[(e + 1) % 3];
+                        // An interior edge shows up once in each direction, only take it from one side. Only
+                        // an edge between two border vertices can be a border edge.
+                        if (a > b && !(border[a] && border[b] && is_border_edge(a, b)))
+                        {
+                            continue;
+                        }
+                        // The cheaper direction that can be made, flips are checked again when applying.
+                        std::optional<Collapse> best;
+                        for (auto [from, to] : { std::pair{ a, b }, std::pair{ b, a } })
+                        {
+                            if (locked[from] || (border[from] && !border[to]))
+                            {
+                                continue;
+                            }
+                            auto c = static_cast<float>(cost(from, to));
+                            if (c <= max_cost && (!best || c < best->cost))
+                            {
+                                best = Collapse{ c, from, to };
+                            }
+                        }
+                        if (best)
+                        {
+                            candidates.push_back(*best);
+                        }
+                    }
+                }
+            }
+
+            void apply(uint32_t from, uint32_t to)
+            {
+                for (uint32_t t : vertex_triangles[from])
+                {
+                    if (!alive[t])
+                    {
+                        continue;
+                    }
+                    auto& triangle = triangles[t];
+                    if (triangle[0] == to || triangle[1] == to || triangle[2] == to)
+                    {
+                        alive[t] = 0;
+                        --alive_count;
+                        continue;
+                    }
+                    for (auto&& corner : triangle)
+                    {
+                        corner = corner == from ? to : corner;
+                    }
+                    vertex_triangles[to].push_back(t);
+                }
+                vertex_triangles[from].clear();
+                vertex_triangles[from].shrink_to_fit();
+                removed[from] = 1;
+                quadrics[to] += quadrics[from];
+                // Every edge at to now has a stale cost. Neighbours keep theirs, only their flip checks
+                // changed and valid() runs again right before each collapse.
+                touched[from] = touched[to] = 1;
+
+                auto& around = vertex_triangles[to];
+                around.erase(std::remove_if(around.begin(), around.end(), [this](uint32_t t) { return !alive[t]; }), around.end());
+            }
+
+            std::vector<uint32_t> current_indices() const
+            {
+                std::vector<uint32_t> result;
+                result.reserve(alive_count * 3);
+                for (uint32_t t = 0; t < triangles.size(); ++t)
+                {
+                    if (alive[t])
+                    {
+                        for (uint32_t corner : triangles[t])
+                        {
+                            result.push_back(global[corner]);
+                        }
+                    }
+                }
+                return result;
+            }
+        };
+
+        struct LodFileHeader
+        {
+            char magic[8];
+            uint32_t version;
+            uint32_t header_size;
+            uint64_t key;
+            uint32_t level_count;
+            uint32_t range_count;
+            uint32_t index_count;
+            // 2 when every index fits in 16 bits, which halves the file for most scanned assets' LODs.
+            uint32_t index_size;
+            uint64_t file_size;
+        };
+        static_assert(std::is_trivially_copyable_v<LodFileHeader>);
+
+        std::size_t expected_file_size(const LodFileHeader& header)
+        {
+            return sizeof(LodFileHeader) + std::size_t{ header.level_count } * sizeof(float) +
+                std::size_t{ header.level_count } * header.range_count * sizeof(mesh::MeshRange) +
+                std::size_t{ header.index_count } * header.index_size;
+        }
+    }
+
+    std::vector<SimplifiedLevel> simplify(std::span<const uint32_t> indices, std::span<const mesh::Vertex> vertices,
+        std::span<const std::size_t> target_index_counts, float max_error, std::span<const uint8_t> locked)
+    {
+        Simplifier simplifier(indices, vertices, locked);
+        return simplifier.run(target_index_counts, max_error);
+    }
+
+    LodChain build_lod_chain(const mesh::MeshView& mesh, const LodOptions& options, job_system::JobSystem& jobs)
+    {
+        LodChain chain;
+        if (mesh.vertices.empty() || mesh.indices.empty() || options.triangle_ratios.empty())
+        {
+            return chain;
+        }
+
+        std::array<float, 3> min = mesh.vertices.front().position;
+        std::array<float, 3> max = min;
+        for (auto&& vertex : mesh.vertices)
+        {
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                min[axis] = std::min(min[axis], vertex.position[axis]);
+                max[axis] = std::max(max[axis], vertex.position[axis]);
+            }
+        }
+        float radius = 0.5f * std::sqrt((max[0] - min[0]) * (max[0] - min[0]) + (max[1] - min[1]) * (max[1] - min[1]) +
+            (max[2] - min[2]) * (max[2] - min[2]));
+        float max_error = options.max_relative_error * radius;
+
+        // Vertices used by more than one range are where the ranges meet.
+        std::vector<uint32_t> owner(mesh.vertices.size(), INVALID);
+        std::vector<uint8_t> locked(mesh.vertices.size(), 0);
+        for (uint32_t r = 0; r < mesh.ranges.size(); ++r)
+        {
+            auto& range = mesh.ranges[r];
+            for (uint32_t index : mesh.indices.subspan(range.first_index, range.index_count))
+            {
+                if (owner[index] != INVALID && owner[index] != r)
+                {
+                    locked[index] = 1;
+                }
+                owner[index] = r;
+            }
+        }
+
+        std::vector<std::vector<SimplifiedLevel>> per_range(mesh.ranges.size());
+        jobs.parallel_for(mesh.ranges.size(), [&](std::size_t begin, std::size_t end)
+            {
+                for (std::size_t r = begin; r < end; ++r)
+                {
+                    auto& range = mesh.ranges[r];
+                    std::vector<std::size_t> targets;
+                    for (float ratio : options.triangle_ratios)
+                    {
+                        targets.push_back(static_cast<std::size_t>(range.index_count / 3 * static_cast<double>(ratio)) * 3);
+                    }
+                    per_range[r] = simplify(mesh.indices.subspan(range.first_index, range.index_count), mesh.vertices, targets, max_error, locked);
+                    // Collapses leave the triangle order scattered, every level gets the same reordering as the full mesh.
+                    for (auto&& level : per_range[r])
+                    {
+                        mesh_optimizer::optimize_vertex_cache(level.indices, mesh.vertices.size());
+                    }
+                }
+            }, 1);
+
+        std::size_t previous_count = mesh.indices.size();
+        for (std::size_t l = 0; l < options.triangle_ratios.size(); ++l)
+        {
+            LodLevel level{ 0.0f, {} };
+            std::size_t count{ 0 };
+            for (auto&& range_levels : per_range)
+            {
+                count += range_levels[l].indices.size();
+            }
+            // A level that didn't get any smaller than the one before it isn't worth drawing.
+            if (count >= previous_count)
+            {
+                continue;
+            }
+            previous_count = count;
+            for (std::size_t r = 0; r < per_range.size(); ++r)
+            {
+                auto& simplified = per_range[r][l];
+                level.error = std::max(level.error, simplified.error);
+                level.ranges.push_back({ static_cast<uint32_t>(chain.indices.size()), static_cast<uint32_t>(simplified.indices.size()), mesh.ranges[r].material });
+                chain.indices.insert(chain.indices.end(), simplified.indices.begin(), simplified.indices.end());
+            }
+            if (!chain.levels.empty())
+            {
+                level.error = std::max(level.error, chain.levels.back().error);
+            }
+            chain.levels.push_back(std::move(level));
+        }
+        return chain;
+    }
+
+    std::size_t select_level(std::span<const float> level_errors, float distance, float projection_scale, float pixel_error)
+    {
+        float clamped = std::max(distance, 1e-6f);
+        std::size_t level{ 0 };
+        for (std::size_t i = 1; i < level_errors.size(); ++i)
+        {
+            if (level_errors[i] * projection_scale / clamped > pixel_error)
+            {
+                break;
+            }
+            level = i;
+        }
+        return level;
+    }
+
+    std::string lod_path_for(const std::string_view source_path)
+    {
+        return std::string(source_path) + std::string(LOD_EXTENSION);
+    }
+
+    uint64_t lod_key(const mesh::MeshView& mesh, const LodOptions& options)
+    {
+        uint64_t key = file_ops::hash_bytes(std::as_bytes(std::span(options.triangle_ratios)), LOD_VERSION);
+        key = file_ops::hash_bytes(std::as_bytes(std::span(&options.max_relative_error, 1)), key);
+        key = file_ops::hash_bytes(std::as_bytes(mesh.vertices), key);
+        key = file_ops::hash_bytes(std::as_bytes(mesh.ranges), key);
+        return file_ops::hash_bytes(std::as_bytes(mesh.indices), key);
+    }
+
+    void write_lod_file(const std::string_view path, const LodChain& chain, uint64_t key)
+    {
+        LodFileHeader header{};
+        std::memcpy(header.magic, LOD_MAGIC, sizeof(LOD_MAGIC));
+        header.version = LOD_VERSION;
+        header.header_size = sizeof(LodFileHeader);
+        header.key = key;
+        header.level_count = static_cast<uint32_t>(chain.levels.size());
+        header.range_count = chain.levels.empty() ? 0 : static_cast<uint32_t>(chain.levels.front().ranges.size());
+        header.index_count = static_cast<uint32_t>(chain.indices.size());
+        bool narrow = std::all_of(chain.indices.begin(), chain.indices.end(), [](uint32_t index) { return index <= 0xFFFF; });
+        header.index_size = narrow ? 2 : 4;
+        header.file_size = expected_file_size(header);
+
+        // Same write and rename as the mesh cache.
+        const std::string final_path(path);
+        const std::string temp_path = final_path + ".tmp";
+        {
+            std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+            if (!out.is_open())
+            {
+                throw std::runtime_error("Failed to open LOD file for writing: " + temp_path);
+            }
+            out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            for (auto&& level : chain.levels)
+            {
+                out.write(reinterpret_cast<const char*>(&level.error), sizeof(level.error));
+            }
+            for (auto&& level : chain.levels)
+            {
+                out.write(reinterpret_cast<const char*>(level.ranges.data()), static_cast<std::streamsize>(level.ranges.size() * sizeof(mesh::MeshRange)));
+            }
+            if (narrow)
+            {
+                std::vector<uint16_t> narrowed(chain.indices.begin(), chain.indices.end());
+                out.write(reinterpret_cast<const char*>(narrowed.data()), static_cast<std::streamsize>(narrowed.size() * sizeof(uint16_t)));
+            }
+            else
+            {
+                out.write(reinterpret_cast<const char*>(chain.indices.data()), static_cast<std::streamsize>(chain.indices.size() * sizeof(uint32_t)));
+            }
+            if (!out.good())
+            {
+                throw std::runtime_error("Failed to write LOD file: " + temp_path);
+            }
+        }
+        std::filesystem::rename(temp_path, final_path);
+    }
+
+    std::optional<LodChain> read_lod_file(const std::string_view path, uint64_t key)
+    {
+        if (!std::filesystem::exists(path))
+        {
+            return std::nullopt;
+        }
+        auto file = file_ops::map_file(path, file_ops::AccessHint::sequential);
+        auto bytes = file.bytes();
+        LodFileHeader header;
+        if (bytes.size() < sizeof(header))
+        {
+            return std::nullopt;
+        }
+        std::memcpy(&header, bytes.data(), sizeof(header));
+        if (std::memcmp(header.magic, LOD_MAGIC, sizeof(LOD_MAGIC)) != 0 || header.version != LOD_VERSION ||
+            header.header_size != sizeof(LodFileHeader) || header.key != key || (header.index_size != 2 && header.index_size != 4) ||
+            header.file_size != bytes.size() || expected_file_size(header) != bytes.size())
+        {
+            return std::nullopt;
+        }
+
+        LodChain chain;
+        std::size_t offset = sizeof(header);
+        chain.levels.resize(header.level_count);
+        for (auto&& level : chain.levels)
+        {
+            std::memcpy(&level.error, bytes.data() + offset, sizeof(level.error));
+            offset += sizeof(level.error);
+        }
+        for (auto&& level : chain.levels)
+        {
+            level.ranges.resize(header.range_count);
+            std::memcpy(level.ranges.data(), bytes.data() + offset, header.range_count * sizeof(mesh::MeshRange));
+            offset += header.range_count * sizeof(mesh::MeshRange);
+        }
+        chain.indices.resize(header.index_count);
+        if (header.index_size == 2)
+        {
+            for (auto&& index : chain.indices)
+            {
+                uint16_t narrow;
+                std::memcpy(&narrow, bytes.data() + offset, sizeof(narrow));
+                index = narrow;
+                offset += sizeof(narrow);
+            }
+        }
+        else
+        {
+            std::memcpy(chain.indices.data(), bytes.data() + offset, chain.indices.size() * sizeof(uint32_t));
+        }
+        for (auto&& level : chain.levels)
+        {
+            for (auto&& range : level.ranges)
+            {
+                if (uint64_t{ range.first_index } + range.index_count > chain.indices.size())
+                {
+                    return std::nullopt;
+                }
+            }
+        }
+        return chain;
+    }
+
+    LodChain load_lods(const std::string_view source_path, const mesh::MeshView& mesh, const LodOptions& options, mesh_cache::CachePolicy policy)
+    {
+        auto path = lod_path_for(source_path);
+        auto key = lod_key(mesh, options);
+        if (policy == mesh_cache::CachePolicy::use_cache)
+        {
+            if (auto cached = read_lod_file(path, key))
+            {
+                return std::move(*cached);
+            }
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        auto chain = build_lod_chain(mesh, options);
+        auto build_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "Built " << chain.levels.size() << " LODs for " << source_path << " in " << build_ms << " ms:";
+        for (auto&& level : chain.levels)
+        {
+            std::size_t count{ 0 };
+            for (auto&& range : level.ranges)
+            {
+                count += range.index_count;
+            }
+            std::cout << ' ' << count / 3 << " (error " << level.error << ')';
+        }
+        std::cout << '\n';
+        if (policy != mesh_cache::CachePolicy::bypass)
+        {
+            try
+            {
+                write_lod_file(path, chain, key);
+            }
+            catch (std::exception& ex)
+            {
+                std::cerr << "Warning: " << ex.what() << '\n';
+            }
+        }
+        return chain;
+    }
+}
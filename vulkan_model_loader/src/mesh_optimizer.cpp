@@ -0,0 +1,437 @@
+#include "mesh_optimizer.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+namespace baas::mesh_optimizer
+{
+    namespace
+    {
+        constexpr uint32_t invalid_index = std::numeric_limits<uint32_t>::max();
+
+        // Tuning constants from Tom Forsyth's "Linear-Speed Vertex Cache Optimisation".
+        constexpr uint32_t FORSYTH_CACHE_SIZE = 32;
+        constexpr uint32_t MAX_VALENCE_SCORE = 64;
+        constexpr float CACHE_DECAY_POWER = 1.5f;
+        constexpr float LAST_TRIANGLE_SCORE = 0.75f;
+        constexpr float VALENCE_BOOST_SCALE = 2.0f;
+        constexpr float VALENCE_BOOST_POWER = 0.5f;
+
+        struct ScoreTables
+        {
+            std::array<float, FORSYTH_CACHE_SIZE> cache;
+            std::array<float, MAX_VALENCE_SCORE> valence;
+
+            ScoreTables()
+            {
+                for (uint32_t i = 0; i < FORSYTH_CACHE_SIZE; ++i)
+                {
+                    if (i < 3)
+                    {
+                        // The last triangle's vertices are deliberately not the best choice,
+                        // otherwise the optimizer produces strips that thrash the rest of the cache.
+                        cache[i] = LAST_TRIANGLE_SCORE;
+                    }
+                    else
+                    {
+                        float scaler = 1.0f / (FORSYTH_CACHE_SIZE - 3);
+                        cache[i] = std::pow(1.0f - (i - 3) * scaler, CACHE_DECAY_POWER);
+                    }
+                }
+                valence[0] = 0.0f;
+                for (uint32_t i = 1; i < MAX_VALENCE_SCORE; ++i)
+                {
+                    valence[i] = VALENCE_BOOST_SCALE * std::pow(static_cast<float>(i), -VALENCE_BOOST_POWER);
+                }
+            }
+
+            float score(int32_t cache_position, uint32_t remaining_valence) const
+            {
+                if (remaining_valence == 0)
+                {
+                    return -1.0f;
+                }
+                float result = cache_position >= 0 ? cache[cache_position] : 0.0f;
+                return result + valence[std::min(remaining_valence, MAX_VALENCE_SCORE - 1)];
+            }
+        };
+
+        struct Float3
+        {
+            float x, y, z;
+        };
+
+        Float3 sub(const std::array<float, 3>& a, const std::array<float, 3>& b)
+        {
+            return { a[0] - b[0], a[1] - b[1], a[2] - b[2] };
+        }
+
+        Float3 cross(const Float3& a, const Float3& b)
+        {
+            return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+        }
+
+        // Cache misses per triangle for a FIFO cache. Timestamps avoid keeping the cache itself.
+        std::vector<uint8_t> simulate_fifo(std::span<const uint32_t> indices, std::size_t vertex_count, uint32_t cache_size)
+        {
+            std::vector<uint32_t> timestamps(vertex_count, 0);
+            std::vector<uint8_t> misses(indices.size() / 3, 0);
+            uint32_t time = cache_size + 1;
+            for (std::size_t i = 0; i < indices.size(); ++i)
+            {
+                uint32_t vertex = indices[i];
+                if (time - timestamps[vertex] > cache_size)
+                {
+                    timestamps[vertex] = time++;
+                    ++misses[i / 3];
+                }
+            }
+            return misses;
+        }
+    }
+
+    VertexCacheStats analyze_vertex_cache(std::span<const uint32_t> indices, std::size_t vertex_count, uint32_t cache_size)
+    {
+        VertexCacheStats stats{};
+        auto misses = simulate_fifo(indices, vertex_count, cache_size);
+        stats.transformed_vertices = std::accumulate(misses.begin(), misses.end(), std::size_t{ 0 });
+
+        std::vector<bool> used(vertex_count, false);
+        std::size_t unique_vertices{ 0 };
+        for (uint32_t index : indices)
+        {
+            if (!used[index])
+            {
+                used[index] = true;
+                ++unique_vertices;
+            }
+        }
+
+        std::size_t triangle_count = indices.size() / 3;
+        stats.acmr = triangle_count == 0 ? 0.0f : static_cast<float>(stats.transformed_vertices) / triangle_count;
+        stats.atvr = unique_vertices == 0 ? 0.0f : static_cast<float>(stats.transformed_vertices) / unique_vertices;
+        return stats;
+    }
+
+    void optimize_vertex_cache(std::span<uint32_t> indices, std::size_t vertex_count)
+    {
+        static const ScoreTables tables;
+        std::size_t triangle_count = indices.size() / 3;
+        if (triangle_count <= 1)
+        {
+            return;
+        }
+
+        // Vertex to triangle adjacency in CSR form. The live triangles of each vertex
+        // are kept at the front of its range so removing one is a swap.
+        std::vector<uint32_t> remaining(vertex_count, 0);
+        for (uint32_t index : indices)
+        {
+            ++remaining[index];
+        }
+        std::vector<uint32_t> offsets(vertex_count + 1, 0);
+        for (std::size_t v = 0; v < vertex_count; ++v)
+        {
+            offsets[v + 1] = offsets[v] + remaining[v];
+        }
+        std::vector<uint32_t> adjacency(indices.size());
+        {
+            std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+            for (std::size_t i = 0; i < indices.size(); ++i)
+            {
+                adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+            }
+        }
+
+        std::vector<int32_t> cache_position(vertex_count, -1);
+        std::vector<float> vertex_score(vertex_count);
+        for (std::size_t v = 0; v < vertex_count; ++v)
+        {
+            vertex_score[v] = tables.score(-1, remaining[v]);
+        }
+        std::vector<float> triangle_score(triangle_count);
+        for (std::size_t t = 0; t < triangle_count; ++t)
+        {
+            triangle_score[t] = vertex_score[indices[t * 3]] + vertex_score[indices[t * 3 + 1]] + vertex_score[indices[t * 3 + 2]];
+        }
+
+        std::vector<bool> emitted(triangle_count, false);
+        std::vector<uint32_t> output;
+        output.reserve(indices.size());
+
+        std::array<uint32_t, FORSYTH_CACHE_SIZE + 3> cache{};
+        std::array<uint32_t, FORSYTH_CACHE_SIZE + 3> new_cache{};
+        uint32_t cache_count{ 0 };
+        std::size_t input_cursor{ 0 };
+        uint32_t best_triangle = static_cast<uint32_t>(std::max_element(triangle_score.begin(), triangle_score.end()) - triangle_score.begin());
+
+        for (std::size_t emitted_count = 0; emitted_count < triangle_count; ++emitted_count)
+        {
+            if (best_triangle == invalid_index)
+            {
+                // Nothing in the cache is connected to anything left, restart from the next unemitted triangle.
+                while (emitted[input_cursor])
+                {
+                    ++input_cursor;
+                }
+                best_triangle = static_cast<uint32_t>(input_cursor);
+            }
+
+            const uint32_t tri[3] = { indices[best_triangle * 3], indices[best_triangle * 3 + 1], indices[best_triangle * 3 + 2] };
+            output.insert(output.end(), tri, tri + 3);
+            emitted[best_triangle] = true;
+
+            for (uint32_t vertex : tri)
+            {
+                uint32_t* first = &adjacency[offsets[vertex]];
+                uint32_t* last = first + remaining[vertex];
+                uint32_t* found = std::find(first, last, best_triangle);
+                std::swap(*found, *(last - 1));
+                --remaining[vertex];
+            }
+
+            // The emitted triangle moves to the front of the LRU cache.
+            uint32_t new_count{ 0 };
+            for (uint32_t vertex : tri)
+            {
+                new_cache[new_count++] = vertex;
+            }
+            for (uint32_t i = 0; i < cache_count; ++i)
+            {
+                uint32_t vertex = cache[i];
+                if (vertex != tri[0] && vertex != tri[1] && vertex != tri[2])
+                {
+                    new_cache[new_count++] = vertex;
+                }
+            }
+
+            // Rescore everything that was touched, including vertices that just fell out.
+            for (uint32_t i = 0; i < new_count; ++i)
+            {
+                uint32_t vertex = new_cache[i];
+                int32_t position = i < FORSYTH_CACHE_SIZE ? static_cast<int32_t>(i) : -1;
+                cache_position[vertex] = position;
+                float score = tables.score(position, remaining[vertex]);
+                float delta = score - vertex_score[vertex];
+                vertex_score[vertex] = score;
+                for (uint32_t a = offsets[vertex]; a < offsets[vertex] + remaining[vertex]; ++a)
+                {
+                    triangle_score[adjacency[a]] += delta;
+                }
+            }
+
+            best_triangle = invalid_index;
+            float best_score = -1.0f;
+            cache_count = std::min(new_count, FORSYTH_CACHE_SIZE);
+            for (uint32_t i = 0; i < cache_count; ++i)
+            {
+                uint32_t vertex = new_cache[i];
+                cache[i] = vertex;
+                for (uint32_t a = offsets[vertex]; a < offsets[vertex] + remaining[vertex]; ++a)
+                {
+                    uint32_t triangle = adjacency[a];
+                    if (triangle_score[triangle] > best_score)
+                    {
+                        best_score = triangle_score[triangle];
+                        best_triangle = triangle;
+                    }
+                }
+            }
+        }
+
+        std::copy(output.begin(), output.end(), indices.begin());
+    }
+
+    void optimize_overdraw(std::span<uint32_t> indices, std::span<const mesh::Vertex> vertices, float threshold)
+    {
+        std::size_t triangle_count = indices.size() / 3;
+        if (triangle_count <= 1)
+        {
+            return;
+        }
+
+        // Hard boundaries are where the cache optimized order already starts over (every vertex missed),
+        // so cutting there costs nothing.
+        auto misses = simulate_fifo(indices, vertices.size(), DEFAULT_CACHE_SIZE);
+        std::vector<std::size_t> hard_starts;
+        for (std::size_t t = 0; t < triangle_count; ++t)
+        {
+            if (t == 0 || misses[t] == 3)
+            {
+                hard_starts.push_back(t);
+            }
+        }
+        hard_starts.push_back(triangle_count);
+
+        // Soft boundaries split hard clusters further wherever the cluster so far, with a cold cache,
+        // is still within threshold of the cluster's own ACMR.
+        std::vector<std::size_t> cluster_starts;
+        std::vector<uint32_t> timestamps(vertices.size(), 0);
+        uint32_t time = DEFAULT_CACHE_SIZE + 1;
+        for (std::size_t h = 0; h + 1 < hard_starts.size(); ++h)
+        {
+            std::size_t begin = hard_starts[h];
+            std::size_t end = hard_starts[h + 1];
+            std::size_t cluster_misses{ 0 };
+            for (std::size_t t = begin; t < end; ++t)
+            {
+                cluster_misses += misses[t];
+            }
+            float cluster_acmr = static_cast<float>(cluster_misses) / (end - begin);
+
+            std::size_t soft_start = begin;
+            std::size_t soft_misses{ 0 };
+            time += DEFAULT_CACHE_SIZE + 1;
+            cluster_starts.push_back(begin);
+            for (std::size_t t = begin; t < end; ++t)
+            {
+                for (std::size_t k = 0; k < 3; ++k)
+                {
+                    uint32_t vertex = indices[t * 3 + k];
+                    if (time - timestamps[vertex] > DEFAULT_CACHE_SIZE)
+                    {
+                        timestamps[vertex] = time++;
+                        ++soft_misses;
+                    }
+                }
+                std::size_t soft_size = t - soft_start + 1;
+                if (t + 1 < end && soft_misses <= soft_size * cluster_acmr * threshold)
+                {
+                    cluster_starts.push_back(t + 1);
+                    soft_start = t + 1;
+                    soft_misses = 0;
+                    time += DEFAULT_CACHE_SIZE + 1; // Cold cache for the next cluster.
+                }
+            }
+        }
+        cluster_starts.push_back(triangle_count);
+
+        // Sort clusters by how much they face away from the mesh center, outer shells first.
+        std::size_t cluster_count = cluster_starts.size() - 1;
+        std::vector<Float3> centroids(cluster_count);
+        std::vector<Float3> normals(cluster_count);
+        Float3 mesh_centroid{ 0.0f, 0.0f, 0.0f };
+        float mesh_area{ 0.0f };
+        for (std::size_t c = 0; c < cluster_count; ++c)
+        {
+            Float3 centroid{ 0.0f, 0.0f, 0.0f };
+            Float3 normal{ 0.0f, 0.0f, 0.0f };
+            float cluster_area{ 0.0f };
+            for (std::size_t t = cluster_starts[c]; t < cluster_starts[c + 1]; ++t)
+            {
+                const auto& p0 = vertices[indices[t * 3]].position;
+                const auto& p1 = vertices[indices[t * 3 + 1]].position;
+                const auto& p2 = vertices[indices[t * 3 + 2]].position;
+                Float3 n = cross(sub(p1, p0), sub(p2, p0));
+                float area = std::sqrt(n.x * n.x + n.y * n.y + n.z * n.z);
+                centroid.x += (p0[0] + p1[0] + p2[0]) * area;
+                centroid.y += (p0[1] + p1[1] + p2[1]) * area;
+                centroid.z += (p0[2] + p1[2] + p2[2]) * area;
+                normal.x += n.x;
+                normal.y += n.y;
+                normal.z += n.z;
+                cluster_area += area;
+            }
+            mesh_centroid.x += centroid.x;
+            mesh_centroid.y += centroid.y;
+            mesh_centroid.z += centroid.z;
+            mesh_area += cluster_area;
+
+            float inverse_area = cluster_area > 0.0f ? 1.0f / (3.0f * cluster_area) : 0.0f;
+            centroids[c] = { centroid.x * inverse_area, centroid.y * inverse_area, centroid.z * inverse_area };
+            float length = std::sqrt(normal.x * normal.x + normal.y * normal.y + normal.z * normal.z);
+            float inverse_length = length > 0.0f ? 1.0f / length : 0.0f;
+            normals[c] = { normal.x * inverse_length, normal.y * inverse_length, normal.z * inverse_length };
+        }
+        float inverse_mesh_area = mesh_area > 0.0f ? 1.0f / (3.0f * mesh_area) : 0.0f;
+        mesh_centroid = { mesh_centroid.x * inverse_mesh_area, mesh_centroid.y * inverse_mesh_area, mesh_centroid.z * inverse_mesh_area };
+
+        std::vector<float> sort_keys(cluster_count);
+        for (std::size_t c = 0; c < cluster_count; ++c)
+        {
+            sort_keys[c] = (centroids[c].x - mesh_centroid.x) * normals[c].x + (centroids[c].y - mesh_centroid.y) * normals[c].y +
+                           (centroids[c].z - mesh_centroid.z) * normals[c].z;
+        }
+        std::vector<uint32_t> order(cluster_count);
+        std::iota(order.begin(), order.end(), 0U);
+        std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return sort_keys[a] > sort_keys[b]; });
+
+        std::vector<uint32_t> output;
+        output.reserve(indices.size());
+        for (uint32_t c : order)
+        {
+            output.insert(output.end(), indices.begin() + cluster_starts[c] * 3, indices.begin() + cluster_starts[c + 1] * 3);
+        }
+        std::copy(output.begin(), output.end(), indices.begin());
+    }
+
+    std::vector<uint32_t> optimize_vertex_fetch(std::span<uint32_t> indices, std::vector<mesh::Vertex>& vertices)
+    {
+        std::vector<uint32_t> remap(vertices.size(), invalid_index);
+        std::vector<mesh::Vertex> reordered;
+        reordered.reserve(vertices.size());
+        for (uint32_t& index : indices)
+        {
+            if (remap[index] == invalid_index)
+            {
+                remap[index] = static_cast<uint32_t>(reordered.size());
+                reordered.push_back(vertices[index]);
+            }
+            index = remap[index];
+        }
+        vertices = std::move(reordered);
+        return remap;
+    }
+
+    OptimizationReport optimize_mesh(mesh::Mesh& mesh, float overdraw_threshold)
+    {
+        OptimizationReport report{};
+        report.before = analyze_vertex_cache(mesh.indices, mesh.vertices.size());
+
+        std::vector<mesh::MeshRange> ranges = mesh.ranges;
+        if (ranges.empty())
+        {
+            ranges.push_back({ 0, static_cast<uint32_t>(mesh.indices.size()), 0 });
+        }
+
+        // Each range is compacted to its own vertices first so the passes cost O(range) rather than O(mesh).
+        std::vector<uint32_t> local_id(mesh.vertices.size(), invalid_index);
+        std::vector<uint32_t> global_id;
+        std::vector<mesh::Vertex> local_vertices;
+        for (auto&& range : ranges)
+        {
+            std::span<uint32_t> range_indices(mesh.indices.data() + range.first_index, range.index_count);
+            global_id.clear();
+            local_vertices.clear();
+            for (uint32_t& index : range_indices)
+            {
+                if (local_id[index] == invalid_index)
+                {
+                    local_id[index] = static_cast<uint32_t>(global_id.size());
+                    global_id.push_back(index);
+                    local_vertices.push_back(mesh.vertices[index]);
+                }
+                index = local_id[index];
+            }
+
+            optimize_vertex_cache(range_indices, local_vertices.size());
+            optimize_overdraw(range_indices, local_vertices, overdraw_threshold);
+
+            for (uint32_t& index : range_indices)
+            {
+                index = global_id[index];
+            }
+            for (uint32_t vertex : global_id)
+            {
+                local_id[vertex] = invalid_index;
+            }
+        }
+
+        optimize_vertex_fetch(mesh.indices, mesh.vertices);
+        report.after = analyze_vertex_cache(mesh.indices, mesh.vertices.size());
+        return report;
+    }
+}
@@ -0,0 +1,629 @@
+#include "meshlet.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#include "file_ops.h"
+
+namespace baas::meshlet
+{
+    namespace
+    {
+        constexpr char MESHLET_MAGIC[8] = { 'V', 'M', 'L', 'M', 'S', 'H', 'L', 'T' };
+        constexpr uint32_t INVALID = std::numeric_limits<uint32_t>::max();
+        constexpr uint8_t NOT_IN_MESHLET = 0xFF;
+        // Share of a candidate's secondary score that comes from its normal, the rest is its distance.
+        // Weighting the normal heavily gives narrower cones and, on scanned meshes, fuller meshlets too.
+        constexpr float CONE_WEIGHT = 0.75f;
+        // Normals spread wider than about 84 degrees make a cone that culls almost nothing.
+        constexpr float MIN_CONE_DOT = 0.1f;
+
+        using Float3 = std::array<float, 3>;
+
+        Float3 subtract(const Float3& a, const Float3& b)
+        {
+            return { a[0] - b[0], a[1] - b[1], a[2] - b[2] };
+        }
+
+        float dot(const Float3& a, const Float3& b)
+        {
+            return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+        }
+
+        // Unit normal, or zero for a degenerate triangle.
+        Float3 triangle_normal(const Float3& a, const Float3& b, const Float3& c)
+        {
+            auto e0 = subtract(b, a);
+            auto e1 = subtract(c, a);
+            Float3 n{ e0[1] * e1[2] - e0[2] * e1[1], e0[2] * e1[0] - e0[0] * e1[2], e0[0] * e1[1] - e0[1] * e1[0] };
+            float length = std::sqrt(dot(n, n));
+            if (length <= 0.0f)
+            {
+                return { 0.0f, 0.0f, 0.0f };
+            }
+            return { n[0] / length, n[1] / length, n[2] / length };
+        }
+
+        struct RangeMeshlets
+        {
+            std::vector<Meshlet> meshlets;
+            std::vector<uint32_t> vertices;
+            std::vector<uint8_t> triangles;
+        };
+
+        // Grows one meshlet at a time from the triangles touching its vertices, starting a new one when
+        // nothing fits anymore.
+        class Builder
+        {
+        public:
+            Builder(std::span<const uint32_t> indices, std::span<const mesh::Vertex> mesh_vertices)
+                : triangle_count(indices.size() / 3)
+            {
+                // Compact vertex ids so the per vertex arrays only cover this range.
+                global.assign(indices.begin(), indices.end());
+                std::sort(global.begin(), global.end());
+                global.erase(std::unique(global.begin(), global.end()), global.end());
+                corners.resize(triangle_count * 3);
+                for (std::size_t i = 0; i < corners.size(); ++i)
+                {
+                    corners[i] = static_cast<uint32_t>(std::lower_bound(global.begin(), global.end(), indices[i]) - global.begin());
+                }
+
+                offsets.assign(global.size() + 1, 0);
+                for (uint32_t corner : corners)
+                {
+                    ++offsets[corner + 1];
+                }
+                for (std::size_t v = 0; v < global.size(); ++v)
+                {
+                    offsets[v + 1] += offsets[v];
+                }
+                live.resize(global.size());
+                for (std::size_t v = 0; v < global.size(); ++v)
+                {
+                    live[v] = offsets[v + 1] - offsets[v];
+                }
+                adjacency.resize(corners.size());
+                std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+                for (uint32_t t = 0; t < triangle_count; ++t)
+                {
+                    for (int k = 0; k < 3; ++k)
+                    {
+                        adjacency[fill[corners[t * 3 + k]]++] = t;
+                    }
+                }
+
+                normals.resize(triangle_count);
+                centroids.resize(triangle_count);
+                double area{ 0.0 };
+                for (uint32_t t = 0; t < triangle_count; ++t)
+                {
+                    auto& a = mesh_vertices[indices[t * 3]].position;
+                    auto& b = mesh_vertices[indices[t * 3 + 1]].position;
+                    auto& c = mesh_vertices[indices[t * 3 + 2]].position;
+                    normals[t] = triangle_normal(a, b, c);
+                    centroids[t] = { (a[0] + b[0] + c[0]) / 3.0f, (a[1] + b[1] + c[1]) / 3.0f, (a[2] + b[2] + c[2]) / 3.0f };
+                    auto e0 = subtract(b, a);
+                    auto e1 = subtract(c, a);
+                    Float3 n{ e0[1] * e1[2] - e0[2] * e1[1], e0[2] * e1[0] - e0[0] * e1[2], e0[0] * e1[1] - e0[1] * e1[0] };
+                    area += 0.5 * std::sqrt(dot(n, n));
+                }
+                // Radius of a disc made of a full meshlet's worth of average triangles.
+                expected_radius = static_cast<float>(std::sqrt(area / std::max<std::size_t>(triangle_count, 1) * MAX_TRIANGLES / 3.14159265));
+                if (!(expected_radius > 0.0f))
+                {
+                    expected_radius = 1.0f;
+                }
+                emitted.assign(triangle_count, 0);
+                queued.assign(triangle_count, 0);
+                slot.assign(global.size(), NOT_IN_MESHLET);
+            }
+
+            RangeMeshlets run()
+            {
+                std::size_t remaining = triangle_count;
+                std::size_t cursor{ 0 };
+                while (remaining > 0)
+                {
+                    uint32_t next = best_neighbour();
+                    if (next == INVALID)
+                    {
+                        if (!current_vertices.empty())
+                        {
+                            flush();
+                            continue;
+                        }
+                        // Start next to the previous meshlet so consecutive meshlets stay close together.
+                        next = neighbour_of_previous();
+                        if (next == INVALID)
+                        {
+                            while (emitted[cursor])
+                            {
+                                ++cursor;
+                            }
+                            next = static_cast<uint32_t>(cursor);
+                        }
+                    }
+                    add(next);
+                    --remaining;
+                    if (current_triangles.size() == std::size_t{ MAX_TRIANGLES } * 3)
+                    {
+                        flush();
+                    }
+                }
+                if (!current_vertices.empty())
+                {
+                    flush();
+                }
+                return std::move(result);
+            }
+
+        private:
+            std::size_t triangle_count;
+            std::vector<uint32_t> global;
+            std::vector<uint32_t> corners;
+            std::vector<uint32_t> offsets;
+            std::vector<uint32_t> adjacency;
+            // Triangles of each vertex not in a meshlet yet.
+            std::vector<uint32_t> live;
+            std::vector<Float3> normals;
+            std::vector<Float3> centroids;
+            float expected_radius{ 1.0f };
+            std::vector<uint8_t> emitted;
+            // Triangles touching the current meshlet, emitted ones are dropped lazily.
+            std::vector<uint32_t> candidates;
+            std::vector<uint8_t> queued;
+            // Where a vertex is in the current meshlet.
+            std::vector<uint8_t> slot;
+
+            std::vector<uint32_t> current_vertices;
+            std::vector<uint8_t> current_triangles;
+            Float3 normal_sum{ 0.0f, 0.0f, 0.0f };
+            Float3 centroid_sum{ 0.0f, 0.0f, 0.0f };
+            std::vector<uint32_t> previous_vertices;
+            RangeMeshlets result;
+
+            uint32_t best_neighbour()
+            {
+                if (current_vertices.empty())
+                {
+                    return INVALID;
+                }
+                float length = std::sqrt(dot(normal_sum, normal_sum));
+                Float3 axis = length > 0.0f ? Float3{ normal_sum[0] / length, normal_sum[1] / length, normal_sum[2] / length } : Float3{ 0.0f, 0.0f, 0.0f };
+                float scale = 1.0f / static_cast<float>(current_triangles.size() / 3);
+                Float3 center{ centroid_sum[0] * scale, centroid_sum[1] * scale, centroid_sum[2] * scale };
+                uint32_t best{ INVALID };
+                uint32_t best_extra{ INVALID };
+                float best_score = std::numeric_limits<float>::max();
+                for (std::size_t i = 0; i < candidates.size();)
+                {
+                    uint32_t t = candidates[i];
+                    if (emitted[t])
+                    {
+                        candidates[i] = candidates.back();
+                        candidates.pop_back();
+                        continue;
+                    }
+                    ++i;
+                    uint32_t extra = (slot[corners[t * 3]] == NOT_IN_MESHLET) + (slot[corners[t * 3 + 1]] == NOT_IN_MESHLET) +
+                        (slot[corners[t * 3 + 2]] == NOT_IN_MESHLET);
+                    if (current_vertices.size() + extra > MAX_VERTICES)
+                    {
+                        continue;
+                    }
+                    // Fewest new vertices first. A triangle that is the last one left at one of its vertices
+                    // goes first too, otherwise it ends up as a scrap in some later, emptier meshlet.
+                    uint32_t priority = (live[corners[t * 3]] == 1 || live[corners[t * 3 + 1]] == 1 || live[corners[t * 3 + 2]] == 1) ? 0 : extra;
+                    auto offset = subtract(centroids[t], center);
+                    float score = (1.0f - CONE_WEIGHT) * std::sqrt(dot(offset, offset)) / expected_radius + CONE_WEIGHT * (1.0f - dot(normals[t], axis));
+                    if (priority < best_extra || (priority == best_extra && score < best_score))
+                    {
+                        best_extra = priority;
+                        best_score = score;
+                        best = t;
+                    }
+                }
+                return best;
+            }
+
+            uint32_t neighbour_of_previous() const
+            {
+                for (uint32_t v : previous_vertices)
+                {
+                    if (live[v] == 0)
+                    {
+                        continue;
+                    }
+                    for (uint32_t i = offsets[v]; i < offsets[v + 1]; ++i)
+                    {
+                        if (!emitted[adjacency[i]])
+                        {
+                            return adjacency[i];
+                        }
+                    }
+                }
+                return INVALID;
+            }
+
+            void add(uint32_t t)
+            {
+                for (int k = 0; k < 3; ++k)
+                {
+                    uint32_t v = corners[t * 3 + k];
+                    if (slot[v] == NOT_IN_MESHLET)
+                    {
+                        slot[v] = static_cast<uint8_t>(current_vertices.size());
+                        current_vertices.push_back(v);
+                        for (uint32_t i = offsets[v]; i < offsets[v + 1]; ++i)
+                        {
+                            uint32_t neighbour = adjacency[i];
+                            if (!emitted[neighbour] && !queued[neighbour])
+                            {
+                                queued[neighbour] = 1;
+                                candidates.push_back(neighbour);
+                            }
+                        }
+                    }
+                    current_triangles.push_back(slot[v]);
+                    --live[v];
+                }
+                emitted[t] = 1;
+                for (int axis = 0; axis < 3; ++axis)
+                {
+                    normal_sum[axis] += normals[t][axis];
+                    centroid_sum[axis] += centroids[t][axis];
+                }
+            }
+
+            void flush()
+            {
+                result.meshlets.push_back({ static_cast<uint32_t>(result.vertices.size()), static_cast<uint32_t>(result.triangles.size() / 3),
+                    static_cast<uint32_t>(current_vertices.size()), static_cast<uint32_t>(current_triangles.size() / 3) });
+                for (uint32_t v : current_vertices)
+                {
+                    result.vertices.push_back(global[v]);
+                    slot[v] = NOT_IN_MESHLET;
+                }
+                result.triangles.insert(result.triangles.end(), current_triangles.begin(), current_triangles.end());
+                for (uint32_t t : candidates)
+                {
+                    queued[t] = 0;
+                }
+                candidates.clear();
+                previous_vertices.swap(current_vertices);
+                current_vertices.clear();
+                current_triangles.clear();
+                normal_sum = { 0.0f, 0.0f, 0.0f };
+                centroid_sum = { 0.0f, 0.0f, 0.0f };
+            }
+        };
+
+        struct MeshletFileHeader
+        {
+            char magic[8];
+            uint32_t version;
+            uint32_t header_size;
+            uint64_t key;
+            uint32_t range_count;
+            uint32_t meshlet_count;
+            uint32_t vertex_count;
+            uint32_t triangle_count;
+            uint64_t file_size;
+        };
+        static_assert(std::is_trivially_copyable_v<MeshletFileHeader>);
+        static_assert(std::is_trivially_copyable_v<Bounds>);
+
+        std::size_t expected_file_size(const MeshletFileHeader& header)
+        {
+            return sizeof(MeshletFileHeader) + std::size_t{ header.range_count } * sizeof(MeshletRange) +
+                std::size_t{ header.meshlet_count } * (sizeof(Meshlet) + sizeof(Bounds)) + std::size_t{ header.vertex_count } * sizeof(uint32_t) +
+                std::size_t{ header.triangle_count } * 3;
+        }
+
+        template <typename T>
+        void write_span(std::ofstream& out, std::span<const T> values)
+        {
+            out.write(reinterpret_cast<const char*>(values.data()), static_cast<std::streamsize>(values.size_bytes()));
+        }
+
+        template <typename T>
+        void read_vector(std::span<const std::byte> bytes, std::size_t& offset, std::vector<T>& values, std::size_t count)
+        {
+            values.resize(count);
+            std::memcpy(values.data(), bytes.data() + offset, count * sizeof(T));
+            offset += count * sizeof(T);
+        }
+    }
+
+    MeshletData build_meshlets(const mesh::MeshView& mesh, job_system::JobSystem& jobs)
+    {
+        MeshletData data;
+        std::vector<RangeMeshlets> per_range(mesh.ranges.size());
+        jobs.parallel_for(mesh.ranges.size(), [&](std::size_t begin, std::size_t end)
+            {
+                for (std::size_t r = begin; r < end; ++r)
+                {
+                    auto& range = mesh.ranges[r];
+                    Builder builder(mesh.indices.subspan(range.first_index, range.index_count), mesh.vertices);
+                    per_range[r] = builder.run();
+                }
+            }, 1);
+
+        for (std::size_t r = 0; r < per_range.size(); ++r)
+        {
+            auto& built = per_range[r];
+            data.ranges.push_back({ static_cast<uint32_t>(data.meshlets.size()), static_cast<uint32_t>(built.meshlets.size()), mesh.ranges[r].material });
+            auto vertex_base = static_cast<uint32_t>(data.vertices.size());
+            auto triangle_base = static_cast<uint32_t>(data.triangles.size() / 3);
+            for (auto meshlet : built.meshlets)
+            {
+                meshlet.vertex_offset += vertex_base;
+                meshlet.triangle_offset += triangle_base;
+                data.meshlets.push_back(meshlet);
+            }
+            data.vertices.insert(data.vertices.end(), built.vertices.begin(), built.vertices.end());
+            data.triangles.insert(data.triangles.end(), built.triangles.begin(), built.triangles.end());
+        }
+
+        data.bounds.resize(data.meshlets.size());
+        jobs.parallel_for(data.meshlets.size(), [&](std::size_t begin, std::size_t end)
+            {
+                for (std::size_t m = begin; m < end; ++m)
+                {
+                    auto& meshlet = data.meshlets[m];
+                    data.bounds[m] = compute_bounds(mesh.vertices, std::span(data.vertices).subspan(meshlet.vertex_offset, meshlet.vertex_count),
+                        std::span(data.triangles).subspan(std::size_t{ meshlet.triangle_offset } * 3, std::size_t{ meshlet.triangle_count } * 3));
+                }
+            });
+        return data;
+    }
+
+    Bounds compute_bounds(std::span<const mesh::Vertex> vertices, std::span<const uint32_t> meshlet_vertices,
+        std::span<const uint8_t> meshlet_triangles)
+    {
+        Bounds bounds{};
+        if (meshlet_vertices.empty())
+        {
+            bounds.cone_cutoff = 1.0f;
+            return bounds;
+        }
+
+        // Sphere around the box center, a little looser than the smallest sphere but cheap and stable.
+        Float3 min = vertices[meshlet_vertices.front()].position;
+        Float3 max = min;
+        for (uint32_t v : meshlet_vertices)
+        {
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                min[axis] = std::min(min[axis], vertices[v].position[axis]);
+                max[axis] = std::max(max[axis], vertices[v].position[axis]);
+            }
+        }
+        bounds.center = { (min[0] + max[0]) * 0.5f, (min[1] + max[1]) * 0.5f, (min[2] + max[2]) * 0.5f };
+        float radius_squared{ 0.0f };
+        for (uint32_t v : meshlet_vertices)
+        {
+            auto offset = subtract(vertices[v].position, bounds.center);
+            radius_squared = std::max(radius_squared, dot(offset, offset));
+        }
+        bounds.radius = std::sqrt(radius_squared);
+
+        // The cone's axis is the average normal and its opening the widest normal around it. The apex
+        // sits far enough back along the axis that it is behind every triangle's plane.
+        std::vector<std::pair<Float3, Float3>> planes;
+        Float3 normal_sum{ 0.0f, 0.0f, 0.0f };
+        for (std::size_t i = 0; i + 2 < meshlet_triangles.size(); i += 3)
+        {
+            auto& a = vertices[meshlet_vertices[meshlet_triangles[i]]].position;
+            auto normal = triangle_normal(a, vertices[meshlet_vertices[meshlet_triangles[i + 1]]].position,
+                vertices[meshlet_vertices[meshlet_triangles[i + 2]]].position);
+            if (dot(normal, normal) == 0.0f)
+            {
+                continue;
+            }
+            planes.emplace_back(a, normal);
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                normal_sum[axis] += normal[axis];
+            }
+        }
+        bounds.cone_apex = bounds.center;
+        bounds.cone_cutoff = 1.0f;
+        float length = std::sqrt(dot(normal_sum, normal_sum));
+        if (planes.empty() || length <= 0.0f)
+        {
+            return bounds;
+        }
+        Float3 axis{ normal_sum[0] / length, normal_sum[1] / length, normal_sum[2] / length };
+        float min_dot{ 1.0f };
+        for (auto&& [point, normal] : planes)
+        {
+            min_dot = std::min(min_dot, dot(normal, axis));
+        }
+        if (min_dot <= MIN_CONE_DOT)
+        {
+            return bounds;
+        }
+        float apex_distance{ 0.0f };
+        for (auto&& [point, normal] : planes)
+        {
+            apex_distance = std::max(apex_distance, dot(subtract(bounds.center, point), normal) / dot(axis, normal));
+        }
+        bounds.cone_axis = axis;
+        bounds.cone_apex = { bounds.center[0] - axis[0] * apex_distance, bounds.center[1] - axis[1] * apex_distance,
+            bounds.center[2] - axis[2] * apex_distance };
+        bounds.cone_cutoff = std::sqrt(1.0f - min_dot * min_dot);
+        return bounds;
+    }
+
+    bool cone_culled(const Bounds& bounds, const std::array<float, 3>& eye)
+    {
+        auto direction = subtract(bounds.cone_apex, eye);
+        float length = std::sqrt(dot(direction, direction));
+        if (length <= 0.0f)
+        {
+            return false;
+        }
+        return dot(direction, bounds.cone_axis) >= bounds.cone_cutoff * length;
+    }
+
+    std::vector<uint32_t> meshlet_indices(const MeshletData& data)
+    {
+        std::vector<uint32_t> indices(data.triangles.size());
+        for (auto&& meshlet : data.meshlets)
+        {
+            std::size_t first = std::size_t{ meshlet.triangle_offset } * 3;
+            for (std::size_t i = first; i < first + std::size_t{ meshlet.triangle_count } * 3; ++i)
+            {
+                indices[i] = data.vertices[meshlet.vertex_offset + data.triangles[i]];
+            }
+        }
+        return indices;
+    }
+
+    std::string meshlet_path_for(const std::string_view source_path)
+    {
+        return std::string(source_path) + std::string(MESHLET_EXTENSION);
+    }
+
+    uint64_t meshlet_key(const mesh::MeshView& mesh)
+    {
+        const uint32_t limits[2] = { MAX_VERTICES, MAX_TRIANGLES };
+        uint64_t key = file_ops::hash_bytes(std::as_bytes(std::span(limits)), MESHLET_VERSION);
+        key = file_ops::hash_bytes(std::as_bytes(mesh.vertices), key);
+        key = file_ops::hash_bytes(std::as_bytes(mesh.ranges), key);
+        return file_ops::hash_bytes(std::as_bytes(mesh.indices), key);
+    }
+
+    void write_meshlet_file(const std::string_view path, const MeshletData& data, uint64_t key)
+    {
+        MeshletFileHeader header{};
+        std::memcpy(header.magic, MESHLET_MAGIC, sizeof(MESHLET_MAGIC));
+        header.version = MESHLET_VERSION;
+        header.header_size = sizeof(MeshletFileHeader);
+        header.key = key;
+        header.range_count = static_cast<uint32_t>(data.ranges.size());
+        header.meshlet_count = static_cast<uint32_t>(data.meshlets.size());
+        header.vertex_count = static_cast<uint32_t>(data.vertices.size());
+        header.triangle_count = static_cast<uint32_t>(data.triangle_count());
+        header.file_size = expected_file_size(header);
+
+        // Same write and rename as the mesh cache.
+        const std::string final_path(path);
+        const std::string temp_path = final_path + ".tmp";
+        {
+            std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+            if (!out.is_open())
+            {
+                throw std::runtime_error("Failed to open meshlet file for writing: " + temp_path);
+            }
+            out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            write_span(out, std::span(data.ranges));
+            write_span(out, std::span(data.meshlets));
+            write_span(out, std::span(data.bounds));
+            write_span(out, std::span(data.vertices));
+            write_span(out, std::span(data.triangles));
+            if (!out.good())
+            {
+                throw std::runtime_error("Failed to write meshlet file: " + temp_path);
+            }
+        }
+        std::filesystem::rename(temp_path, final_path);
+    }
+
+    std::optional<MeshletData> read_meshlet_file(const std::string_view path, uint64_t key)
+    {
+        if (!std::filesystem::exists(path))
+        {
+            return std::nullopt;
+        }
+        auto file = file_ops::map_file(path, file_ops::AccessHint::sequential);
+        auto bytes = file.bytes();
+        MeshletFileHeader header;
+        if (bytes.size() < sizeof(header))
+        {
+            return std::nullopt;
+        }
+        std::memcpy(&header, bytes.data(), sizeof(header));
+        if (std::memcmp(header.magic, MESHLET_MAGIC, sizeof(MESHLET_MAGIC)) != 0 || header.version != MESHLET_VERSION ||
+            header.header_size != sizeof(MeshletFileHeader) || header.key != key || header.file_size != bytes.size() ||
+            expected_file_size(header) != bytes.size())
+        {
+            return std::nullopt;
+        }
+
+        MeshletData data;
+        std::size_t offset = sizeof(header);
+        read_vector(bytes, offset, data.ranges, header.range_count);
+        read_vector(bytes, offset, data.meshlets, header.meshlet_count);
+        read_vector(bytes, offset, data.bounds, header.meshlet_count);
+        read_vector(bytes, offset, data.vertices, header.vertex_count);
+        read_vector(bytes, offset, data.triangles, std::size_t{ header.triangle_count } * 3);
+
+        // Everything indexes something else, a damaged file must not turn into reads out of bounds.
+        for (auto&& range : data.ranges)
+        {
+            if (uint64_t{ range.first_meshlet } + range.meshlet_count > data.meshlets.size())
+            {
+                return std::nullopt;
+            }
+        }
+        for (auto&& meshlet : data.meshlets)
+        {
+            if (meshlet.vertex_count > MAX_VERTICES || meshlet.triangle_count > MAX_TRIANGLES ||
+                uint64_t{ meshlet.vertex_offset } + meshlet.vertex_count > data.vertices.size() ||
+                uint64_t{ meshlet.triangle_offset } + meshlet.triangle_count > header.triangle_count)
+            {
+                return std::nullopt;
+            }
+            auto triangles = std::span(data.triangles).subspan(std::size_t{ meshlet.triangle_offset } * 3, std::size_t{ meshlet.triangle_count } * 3);
+            if (std::any_of(triangles.begin(), triangles.end(), [&](uint8_t local) { return local >= meshlet.vertex_count; }))
+            {
+                return std::nullopt;
+            }
+        }
+        return data;
+    }
+
+    MeshletData load_meshlets(const std::string_view source_path, const mesh::MeshView& mesh, mesh_cache::CachePolicy policy)
+    {
+        auto path = meshlet_path_for(source_path);
+        auto key = meshlet_key(mesh);
+        if (policy == mesh_cache::CachePolicy::use_cache)
+        {
+            if (auto cached = read_meshlet_file(path, key))
+            {
+                return std::move(*cached);
+            }
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        auto data = build_meshlets(mesh);
+        auto build_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "Built " << data.meshlets.size() << " meshlets for " << source_path << " in " << build_ms << " ms, "
+                  << (data.meshlets.empty() ? 0.0 : static_cast<double>(data.vertices.size()) / data.meshlets.size()) << " vertices and "
+                  << (data.meshlets.empty() ? 0.0 : static_cast<double>(data.triangle_count()) / data.meshlets.size()) << " triangles each\n";
+        if (policy != mesh_cache::CachePolicy::bypass)
+        {
+            try
+            {
+                write_meshlet_file(path, data, key);
+            }
+            catch (std::exception& ex)
+            {
+                std::cerr << "Warning: " << ex.what() << '\n';
+            }
+        }
+        return data;
+    }
+}
@@ -0,0 +1,604 @@
+#include "obj_loader.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <filesystem>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "file_ops.h"
+#include "job_system.h"
+
+namespace baas::obj_loader
+{
+    namespace
+    {
+        constexpr uint32_t missing_index = std::numeric_limits<uint32_t>::max();
+
+        // 0 based indices into the file wide position, uv and normal arrays.
+        struct Corner
+        {
+            uint32_t position;
+            uint32_t uv;
+            uint32_t normal;
+
+            bool operator==(const Corner&) const = default;
+        };
+
+        // Negative (relative) indices can only be resolved once the chunk's base offsets are known.
+        // They are rare in practice so they are patched afterwards instead of widening every corner.
+        struct RelativeFixup
+        {
+            std::size_t slot; // corner * 3 + attribute
+            int64_t local_index;
+        };
+
+        struct MaterialSwitch
+        {
+            std::size_t first_triangle;
+            std::string name;
+        };
+
+        struct ChunkData
+        {
+            std::vector<float> positions;
+            std::vector<float> uvs;
+            std::vector<float> normals;
+            std::vector<Corner> corners;
+            std::vector<RelativeFixup> fixups;
+            std::vector<MaterialSwitch> material_switches;
+            std::vector<std::string> material_libs;
+        };
+
+        bool is_space(char c)
+        {
+            return c == ' ' || c == '\t' || c == '\r';
+        }
+
+        const char* skip_spaces(const char* p, const char* end)
+        {
+            while (p < end && is_space(*p))
+            {
+                ++p;
+            }
+            return p;
+        }
+
+        const char* parse_float(const char* p, const char* end, float& value)
+        {
+            p = skip_spaces(p, end);
+            if (p < end && *p == '+')
+            {
+                ++p;
+            }
+            auto [ptr, ec] = std::from_chars(p, end, value);
+            if (ec != std::errc())
+            {
+                throw std::runtime_error("Malformed number in OBJ file");
+            }
+            return ptr;
+        }
+
+        const char* parse_index(const char* p, const char* end, int64_t& value)
+        {
+            auto [ptr, ec] = std::from_chars(p, end, value);
+            if (ec != std::errc())
+            {
+                throw std::runtime_error("Malformed face index in OBJ file");
+            }
+            return ptr;
+        }
+
+        std::string_view rest_of_line(const char* p, const char* end)
+        {
+            p = skip_spaces(p, end);
+            const char* last = end;
+            while (last > p && is_space(*(last - 1)))
+            {
+                --last;
+            }
+            return { p, static_cast<std::size_t>(last - p) };
+        }
+
+        uint32_t resolve_index(int64_t raw, std::size_t local_count, std::size_t slot, std::vector<RelativeFixup>& fixups)
+        {
+            if (raw > 0)
+            {
+                // missing_index is taken, so the largest usable index is one below it.
+                if (raw - 1 >= missing_index)
+                {
+                    throw std::runtime_error("OBJ face index out of range");
+                }
+                return static_cast<uint32_t>(raw - 1);
+            }
+            if (raw < 0)
+            {
+                fixups.push_back({ slot, static_cast<int64_t>(local_count) + raw });
+                return 0;
+            }
+            throw std::runtime_error("OBJ face index 0 is invalid");
+        }
+
+        void parse_face(const char* p, const char* end, ChunkData& chunk, std::vector<Corner>& polygon,
+            std::vector<RelativeFixup>& polygon_fixups)
+        {
+            polygon.clear();
+            polygon_fixups.clear();
+            while (true)
+            {
+                p = skip_spaces(p, end);
+                if (p >= end || *p == '#')
+                {
+                    break;
+                }
+
+                // Slots are relative to the polygon until the triangles are emitted.
+                std::size_t slot = polygon.size() * 3;
+                Corner corner{ missing_index, missing_index, missing_index };
+                int64_t raw{ 0 };
+                p = parse_index(p, end, raw);
+                corner.position = resolve_index(raw, chunk.positions.size() / 3, slot, polygon_fixups);
+                if (p < end && *p == '/')
+                {
+                    ++p;
+                    if (p < end && *p != '/')
+                    {
+                        p = parse_index(p, end, raw);
+                        corner.uv = resolve_index(raw, chunk.uvs.size() / 2, slot + 1, polygon_fixups);
+                    }
+                    if (p < end && *p == '/')
+                    {
+                        ++p;
+                        p = parse_index(p, end, raw);
+                        corner.normal = resolve_index(raw, chunk.normals.size() / 3, slot + 2, polygon_fixups);
+                    }
+                }
+                if (p < end && !is_space(*p))
+                {
+                    throw std::runtime_error("Malformed face in OBJ file");
+                }
+                polygon.push_back(corner);
+            }
+
+            if (polygon.size() < 3)
+            {
+                throw std::runtime_error("OBJ face with fewer than 3 vertices");
+            }
+
+            // Fan triangulation, the corner at position 0 is shared by every triangle.
+            for (std::size_t i = 1; i + 1 < polygon.size(); ++i)
+            {
+                for (std::size_t polygon_corner : { std::size_t{ 0 }, i, i + 1 })
+                {
+                    std::size_t out_slot = chunk.corners.size() * 3;
+                    for (auto&& fixup : polygon_fixups)
+                    {
+                        if (fixup.slot / 3 == polygon_corner)
+                        {
+                            chunk.fixups.push_back({ out_slot + fixup.slot % 3, fixup.local_index });
+                        }
+                    }
+                    chunk.corners.push_back(polygon[polygon_corner]);
+                }
+            }
+        }
+
+        ChunkData parse_chunk(const char* p, const char* end, const LoadOptions& options)
+        {
+            ChunkData chunk;
+            std::vector<Corner> polygon;
+            std::vector<RelativeFixup> polygon_fixups;
+
+            while (p < end)
+            {
+                const char* line_end = static_cast<const char*>(std::memchr(p, '\n', static_cast<std::size_t>(end - p)));
+                if (line_end == nullptr)
+                {
+                    line_end = end;
+                }
+                const char* c = skip_spaces(p, line_end);
+                std::size_t length = static_cast<std::size_t>(line_end - c);
+
+                if (length >= 2 && c[0] == 'v' && is_space(c[1]))
+                {
+                    float x, y, z;
+                    const char* q = parse_float(c + 2, line_end, x);
+                    q = parse_float(q, line_end, y);
+                    parse_float(q, line_end, z);
+                    chunk.positions.insert(chunk.positions.end(), { x, y, z });
+                }
+                else if (length >= 3 && c[0] == 'v' && c[1] == 't' && is_space(c[2]))
+                {
+                    float u, v{ 0.0f };
+                    const char* q = parse_float(c + 3, line_end, u);
+                    if (skip_spaces(q, line_end) != line_end)
+                    {
+                        parse_float(q, line_end, v);
+                    }
+                    chunk.uvs.insert(chunk.uvs.end(), { u, options.flip_v ? 1.0f - v : v });
+                }
+                else if (length >= 3 && c[0] == 'v' && c[1] == 'n' && is_space(c[2]))
+                {
+                    float x, y, z;
+                    const char* q = parse_float(c + 3, line_end, x);
+                    q = parse_float(q, line_end, y);
+                    parse_float(q, line_end, z);
+                    chunk.normals.insert(chunk.normals.end(), { x, y, z });
+                }
+                else if (length >= 2 && c[0] == 'f' && is_space(c[1]))
+                {
+                    parse_face(c + 2, line_end, chunk, polygon, polygon_fixups);
+                }
+                else if (length > 7 && std::string_view(c, 7) == "usemtl ")
+                {
+                    chunk.material_switches.push_back({ chunk.corners.size() / 3, std::string(rest_of_line(c + 7, line_end)) });
+                }
+                else if (length > 7 && std::string_view(c, 7) == "mtllib ")
+                {
+                    chunk.material_libs.emplace_back(rest_of_line(c + 7, line_end));
+                }
+                // Everything else (comments, groups, smoothing groups, ...) is ignored.
+
+                p = line_end + 1;
+            }
+            return chunk;
+        }
+
+        // Open addressing table from a corner to its output vertex. Much cheaper than
+        // std::unordered_map for the tens of millions of corners in a scan.
+        class VertexDedupTable
+        {
+        public:
+            explicit VertexDedupTable(std::size_t expected_count)
+            {
+                std::size_t capacity = 64;
+                while (capacity < expected_count * 2)
+                {
+                    capacity *= 2;
+                }
+                keys.resize(capacity);
+                values.assign(capacity, missing_index);
+            }
+
+            // Returns the existing vertex for the corner or assigns it next_vertex.
+            uint32_t find_or_insert(const Corner& corner, uint32_t next_vertex)
+            {
+                if ((count + 1) * 2 > values.size())
+                {
+                    grow();
+                }
+                std::size_t mask = values.size() - 1;
+                for (std::size_t i = hash(corner) & mask;; i = (i + 1) & mask)
+                {
+                    if (values[i] == missing_index)
+                    {
+                        keys[i] = corner;
+                        values[i] = next_vertex;
+                        ++count;
+                        return next_vertex;
+                    }
+                    if (keys[i] == corner)
+                    {
+                        return values[i];
+                    }
+                }
+            }
+
+        private:
+            std::vector<Corner> keys;
+            std::vector<uint32_t> values;
+            std::size_t count{ 0 };
+
+            static std::size_t hash(const Corner& corner)
+            {
+                uint64_t h = corner.position * 0x9E3779B97F4A7C15ull;
+                h ^= (corner.uv + 0x632BE59BD9B4E019ull) * 0xC2B2AE3D27D4EB4Full;
+                h ^= (corner.normal + 0x85EBCA77C2B2AE63ull) * 0x165667B19E3779F9ull;
+                h ^= h >> 29;
+                return static_cast<std::size_t>(h);
+            }
+
+            void grow()
+            {
+                std::vector<Corner> old_keys = std::move(keys);
+                std::vector<uint32_t> old_values = std::move(values);
+                keys.assign(old_keys.size() * 2, Corner{});
+                values.assign(old_values.size() * 2, missing_index);
+                std::size_t mask = values.size() - 1;
+                for (std::size_t i = 0; i < old_values.size(); ++i)
+                {
+                    if (old_values[i] == missing_index)
+                    {
+                        continue;
+                    }
+                    std::size_t j = hash(old_keys[i]) & mask;
+                    while (values[j] != missing_index)
+                    {
+                        j = (j + 1) & mask;
+                    }
+                    keys[j] = old_keys[i];
+                    values[j] = old_values[i];
+                }
+            }
+        };
+
+        uint32_t apply_base(int64_t local_index, std::size_t base)
+        {
+            int64_t index = static_cast<int64_t>(base) + local_index;
+            if (index < 0)
+            {
+                throw std::runtime_error("OBJ relative index points before the start of the file");
+            }
+            if (index >= missing_index)
+            {
+                throw std::runtime_error("OBJ face index out of range");
+            }
+            return static_cast<uint32_t>(index);
+        }
+
+        // Stitches the chunks back together in file order so the output is identical for any thread count.
+        mesh::Mesh merge_chunks(std::vector<ChunkData>& chunks, std::vector<mesh::Material> materials)
+        {
+            std::size_t position_count{ 0 };
+            std::size_t uv_count{ 0 };
+            std::size_t normal_count{ 0 };
+            std::size_t corner_count{ 0 };
+            for (auto&& chunk : chunks)
+            {
+                // Relative indices are resolved against everything that came before this chunk.
+                for (auto&& fixup : chunk.fixups)
+                {
+                    Corner& corner = chunk.corners[fixup.slot / 3];
+                    switch (fixup.slot % 3)
+                    {
+                    case 0: corner.position = apply_base(fixup.local_index, position_count); break;
+                    case 1: corner.uv = apply_base(fixup.local_index, uv_count); break;
+                    default: corner.normal = apply_base(fixup.local_index, normal_count); break;
+                    }
+                }
+                position_count += chunk.positions.size() / 3;
+                uv_count += chunk.uvs.size() / 2;
+                normal_count += chunk.normals.size() / 3;
+                corner_count += chunk.corners.size();
+            }
+
+            std::vector<float> positions;
+            std::vector<float> uvs;
+            std::vector<float> normals;
+            positions.reserve(position_count * 3);
+            uvs.reserve(uv_count * 2);
+            normals.reserve(normal_count * 3);
+            for (auto&& chunk : chunks)
+            {
+                positions.insert(positions.end(), chunk.positions.begin(), chunk.positions.end());
+                uvs.insert(uvs.end(), chunk.uvs.begin(), chunk.uvs.end());
+                normals.insert(normals.end(), chunk.normals.begin(), chunk.normals.end());
+                std::vector<float>().swap(chunk.positions);
+                std::vector<float>().swap(chunk.uvs);
+                std::vector<float>().swap(chunk.normals);
+            }
+
+            std::unordered_map<std::string, uint32_t> material_lookup;
+            for (uint32_t i = 0; i < materials.size(); ++i)
+            {
+                material_lookup.emplace(materials[i].name, i);
+            }
+            auto material_index = [&](const std::string& name)
+            {
+                auto [it, inserted] = material_lookup.emplace(name, static_cast<uint32_t>(materials.size()));
+                if (inserted)
+                {
+                    mesh::Material material;
+                    material.name = name;
+                    materials.push_back(material);
+                }
+                return it->second;
+            };
+
+            mesh::Mesh result;
+            result.indices.reserve(corner_count);
+            result.vertices.reserve(std::max(position_count, corner_count / 6));
+            VertexDedupTable dedup(result.vertices.capacity());
+
+            uint32_t current_material{ 0 };
+            bool has_material{ false };
+            std::size_t triangle_base{ 0 };
+            auto switch_material = [&](std::size_t first_triangle, uint32_t material)
+            {
+                uint32_t first_index = static_cast<uint32_t>(first_triangle * 3);
+                if (!result.ranges.empty() && result.ranges.back().first_index == first_index)
+                {
+                    result.ranges.pop_back();
+                }
+                if (!result.ranges.empty() && result.ranges.back().material == material)
+                {
+                    return;
+                }
+                result.ranges.push_back({ first_index, 0, material });
+            };
+
+            for (auto&& chunk : chunks)
+            {
+                for (auto&& material_switch : chunk.material_switches)
+                {
+                    current_material = material_index(material_switch.name);
+                    has_material = true;
+                    switch_material(triangle_base + material_switch.first_triangle, current_material);
+                }
+
+                for (auto&& corner : chunk.corners)
+                {
+                    if (corner.position >= position_count ||
+                        (corner.uv != missing_index && corner.uv >= uv_count) ||
+                        (corner.normal != missing_index && corner.normal >= normal_count))
+                    {
+                        throw std::runtime_error("OBJ face index out of range");
+                    }
+
+                    uint32_t next_vertex = static_cast<uint32_t>(result.vertices.size());
+                    uint32_t vertex_index = dedup.find_or_insert(corner, next_vertex);
+                    if (vertex_index == next_vertex)
+                    {
+                        mesh::Vertex vertex{};
+                        const float* p = &positions[corner.position * std::size_t{ 3 }];
+                        vertex.position = { p[0], p[1], p[2] };
+                        if (corner.normal != missing_index)
+                        {
+                            const float* n = &normals[corner.normal * std::size_t{ 3 }];
+                            vertex.normal = { n[0], n[1], n[2] };
+                        }
+                        if (corner.uv != missing_index)
+                        {
+                            const float* t = &uvs[corner.uv * std::size_t{ 2 }];
+                            vertex.uv = { t[0], t[1] };
+                        }
+                        result.vertices.push_back(vertex);
+                    }
+                    result.indices.push_back(vertex_index);
+                }
+                triangle_base += chunk.corners.size() / 3;
+                std::vector<Corner>().swap(chunk.corners);
+            }
+
+            if (!has_material && !result.indices.empty())
+            {
+                // Faces before any usemtl get a default material.
+                result.ranges.push_back({ 0, 0, material_index("default") });
+            }
+            else if (!result.ranges.empty() && result.ranges.front().first_index != 0)
+            {
+                result.ranges.insert(result.ranges.begin(), { 0, 0, material_index("default") });
+            }
+            for (std::size_t i = 0; i < result.ranges.size(); ++i)
+            {
+                uint32_t range_end = i + 1 < result.ranges.size() ? result.ranges[i + 1].first_index
+                                                                  : static_cast<uint32_t>(result.indices.size());
+                result.ranges[i].index_count = range_end - result.ranges[i].first_index;
+            }
+            std::erase_if(result.ranges, [](const mesh::MeshRange& range) { return range.index_count == 0; });
+
+            result.materials = std::move(materials);
+            return result;
+        }
+
+        // Splits the text into roughly equal pieces that start and end on line boundaries.
+        std::vector<std::string_view> split_chunks(const std::string_view text, std::size_t chunk_count)
+        {
+            std::vector<std::string_view> chunks;
+            std::size_t target = text.size() / std::max<std::size_t>(chunk_count, 1) + 1;
+            std::size_t begin{ 0 };
+            while (begin < text.size())
+            {
+                std::size_t end = std::min(begin + target, text.size());
+                if (end < text.size())
+                {
+                    std::size_t newline = text.find('\n', end);
+                    end = newline == std::string_view::npos ? text.size() : newline + 1;
+                }
+                chunks.push_back(text.substr(begin, end - begin));
+                begin = end;
+            }
+            return chunks;
+        }
+
+        std::vector<ChunkData> parse_chunks(const std::string_view text, const LoadOptions& options)
+        {
+            unsigned thread_count = options.thread_count != 0 ? options.thread_count : job_system::shared().thread_count();
+            thread_count = std::max(thread_count, 1U);
+            std::size_t chunk_count = std::min<std::size_t>(thread_count, text.size() / std::max<std::size_t>(options.min_chunk_size, 1) + 1);
+            auto pieces = split_chunks(text, chunk_count);
+
+            std::vector<ChunkData> chunks(pieces.size());
+            // The job system rethrows the first parse error once every chunk is done.
+            job_system::shared().parallel_for(pieces.size(), [&](std::size_t begin, std::size_t end)
+                {
+                    for (std::size_t i = begin; i < end; ++i)
+                    {
+                        chunks[i] = parse_chunk(pieces[i].data(), pieces[i].data() + pieces[i].size(), options);
+                    }
+                }, 1);
+            return chunks;
+        }
+    }
+
+    mesh::Mesh load_obj(const std::string_view file_path, const LoadOptions& options)
+    {
+        auto obj_file = file_ops::map_file(file_path, file_ops::AccessHint::sequential);
+        auto chunks = parse_chunks(obj_file.text(), options);
+
+        std::vector<mesh::Material> materials;
+        if (options.load_materials)
+        {
+            auto directory = std::filesystem::path(file_path).parent_path();
+            for (auto&& chunk : chunks)
+            {
+                for (auto&& library : chunk.material_libs)
+                {
+                    auto mtl_path = (directory / library).string();
+                    if (!std::filesystem::exists(mtl_path))
+                    {
+                        continue; // A missing material library shouldn't stop the geometry from loading.
+                    }
+                    auto mtl_file = file_ops::map_file(mtl_path);
+                    auto library_materials = parse_mtl(mtl_file.text());
+                    std::move(library_materials.begin(), library_materials.end(), std::back_inserter(materials));
+                }
+            }
+        }
+        return merge_chunks(chunks, std::move(materials));
+    }
+
+    mesh::Mesh parse_obj(const std::string_view obj_text, const LoadOptions& options)
+    {
+        auto chunks = parse_chunks(obj_text, options);
+        return merge_chunks(chunks, {});
+    }
+
+    uint64_t options_hash(const LoadOptions& options)
+    {
+        // thread_count and min_chunk_size only change how fast the result is produced.
+        uint64_t flags = (options.flip_v ? 1u : 0u) | (options.load_materials ? 2u : 0u);
+        return file_ops::hash_bytes(std::as_bytes(std::span(&flags, 1)), 0x6F626A);
+    }
+
+    std::vector<mesh::Material> parse_mtl(const std::string_view mtl_text)
+    {
+        std::vector<mesh::Material> materials;
+        const char* p = mtl_text.data();
+        const char* end = p + mtl_text.size();
+        while (p < end)
+        {
+            const char* line_end = static_cast<const char*>(std::memchr(p, '\n', static_cast<std::size_t>(end - p)));
+            if (line_end == nullptr)
+            {
+                line_end = end;
+            }
+            const char* c = skip_spaces(p, line_end);
+            std::string_view line(c, static_cast<std::size_t>(line_end - c));
+
+            if (line.starts_with("newmtl "))
+            {
+                mesh::Material material;
+                material.name = rest_of_line(c + 7, line_end);
+                materials.push_back(material);
+            }
+            else if (!materials.empty() && line.starts_with("Kd "))
+            {
+                auto& diffuse = materials.back().diffuse;
+                const char* q = parse_float(c + 3, line_end, diffuse[0]);
+                q = parse_float(q, line_end, diffuse[1]);
+                parse_float(q, line_end, diffuse[2]);
+            }
+            else if (!materials.empty() && line.starts_with("map_Kd "))
+            {
+                materials.back().diffuse_texture = rest_of_line(c + 7, line_end);
+            }
+            p = line_end + 1;
+        }
+        return materials;
+    }
+}
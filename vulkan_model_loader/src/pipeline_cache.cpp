@@ -0,0 +1,138 @@
+#include "pipeline_cache.h"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+#include "file_ops.h"
+
+namespace baas::pipeline_cache
+{
+    namespace
+    {
+        constexpr char CACHE_MAGIC[4] = { 'V', 'M', 'L', 'P' };
+
+        std::string describe_mismatch(const CacheFileHeader& found, const CacheFileHeader& expected)
+        {
+            if (std::memcmp(found.magic, expected.magic, sizeof(found.magic)) != 0 || found.version != expected.version)
+            {
+                return "not a pipeline cache of this version";
+            }
+            if (found.vendor_id != expected.vendor_id || found.device_id != expected.device_id ||
+                std::memcmp(found.device_uuid, expected.device_uuid, VK_UUID_SIZE) != 0)
+            {
+                return "written for a different device";
+            }
+            if (found.driver_version != expected.driver_version || std::memcmp(found.driver_uuid, expected.driver_uuid, VK_UUID_SIZE) != 0 ||
+                std::memcmp(found.pipeline_cache_uuid, expected.pipeline_cache_uuid, VK_UUID_SIZE) != 0)
+            {
+                return "written by a different driver version";
+            }
+            return {};
+        }
+    }
+
+    PipelineCache::PipelineCache(vk::PhysicalDevice physical_device, vk::Device device, std::string_view path)
+        : device(device), path(path)
+    {
+        auto properties = physical_device.getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceIDProperties>();
+        auto& device_properties = properties.get<vk::PhysicalDeviceProperties2>().properties;
+        auto& id_properties = properties.get<vk::PhysicalDeviceIDProperties>();
+        std::memcpy(expected.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+        expected.version = PIPELINE_CACHE_VERSION;
+        expected.vendor_id = device_properties.vendorID;
+        expected.device_id = device_properties.deviceID;
+        expected.driver_version = device_properties.driverVersion;
+        std::memcpy(expected.pipeline_cache_uuid, device_properties.pipelineCacheUUID.data(), VK_UUID_SIZE);
+        std::memcpy(expected.device_uuid, id_properties.deviceUUID.data(), VK_UUID_SIZE);
+        std::memcpy(expected.driver_uuid, id_properties.driverUUID.data(), VK_UUID_SIZE);
+
+        std::span<const std::byte> initial_data;
+        file_ops::MappedFile file;
+        if (!this->path.empty() && std::filesystem::exists(this->path))
+        {
+            file = file_ops::map_file(this->path, file_ops::AccessHint::sequential);
+            CacheFileHeader found{};
+            if (file.size() < sizeof(CacheFileHeader))
+            {
+                reject_reason = "truncated";
+            }
+            else
+            {
+                std::memcpy(&found, file.bytes().data(), sizeof(found));
+                reject_reason = describe_mismatch(found, expected);
+            }
+            if (reject_reason.empty())
+            {
+                auto data = file.bytes().subspan(sizeof(CacheFileHeader));
+                if (found.data_size != data.size() || found.data_hash != file_ops::hash_bytes(data))
+                {
+                    reject_reason = "corrupt";
+                }
+                else
+                {
+                    initial_data = data;
+                    loaded_hash = found.data_hash;
+                }
+            }
+        }
+
+        // A driver may still refuse the data, in which case the cache just starts out empty.
+        cache = device.createPipelineCacheUnique(vk::PipelineCacheCreateInfo({}, initial_data.size(), initial_data.data()));
+        loaded_size = initial_data.size();
+    }
+
+    std::size_t PipelineCache::save()
+    {
+        if (path.empty())
+        {
+            return 0;
+        }
+        auto data = device.getPipelineCacheData(*cache);
+        auto bytes = std::as_bytes(std::span(data));
+        auto hash = file_ops::hash_bytes(bytes);
+        if (loaded_size == data.size() && loaded_hash == hash)
+        {
+            return 0;
+        }
+
+        CacheFileHeader header = expected;
+        header.data_size = data.size();
+        header.data_hash = hash;
+        // Same write and rename as the mesh cache, a crash never leaves a half written file behind.
+        const std::string temp_path = path + ".tmp";
+        {
+            std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+            if (!out.is_open())
+            {
+                throw std::runtime_error("Failed to open pipeline cache for writing: " + temp_path);
+            }
+            out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            out.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+            if (!out.good())
+            {
+                throw std::runtime_error("Failed to write pipeline cache: " + temp_path);
+            }
+        }
+        std::filesystem::rename(temp_path, path);
+        loaded_size = data.size();
+        loaded_hash = hash;
+        return sizeof(header) + data.size();
+    }
+
+    std::vector<vk::UniquePipeline> create_graphics_pipelines(vk::Device device, vk::PipelineCache cache,
+        std::span<const vk::GraphicsPipelineCreateInfo> create_infos, job_system::JobSystem& jobs)
+    {
+        // Pipeline caches are internally synchronized, every job can share one.
+        std::vector<vk::UniquePipeline> pipelines(create_infos.size());
+        jobs.parallel_for(create_infos.size(), [&](std::size_t begin, std::size_t end)
+            {
+                for (std::size_t i = begin; i < end; ++i)
+                {
+                    pipelines[i] = device.createGraphicsPipelineUnique(cache, create_infos[i]).value;
+                }
+            }, 1);
+        return pipelines;
+    }
+}
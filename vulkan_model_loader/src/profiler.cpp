@@ -0,0 +1,307 @@
+#include "profiler.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <span>
+#include <sstream>
+#include <stdexcept>
+
+#include "frame_stats.h"
+
+namespace baas::profiler
+{
+    namespace
+    {
+        std::string escape_json(std::string_view text)
+        {
+            std::string escaped;
+            for (char c : text)
+            {
+                if (c == '"' || c == '\\')
+                {
+                    escaped += '\\';
+                    escaped += c;
+                }
+                else if (static_cast<unsigned char>(c) < 0x20)
+                {
+                    char code[8];
+                    std::snprintf(code, sizeof(code), "\\u%04x", c);
+                    escaped += code;
+                }
+                else
+                {
+                    escaped += c;
+                }
+            }
+            return escaped;
+        }
+
+        struct ZoneTotals
+        {
+            std::vector<double> milliseconds;
+            std::size_t calls{ 0 };
+        };
+
+        // Milliseconds per frame for every zone name, frames without the zone don't count.
+        std::map<std::string, ZoneTotals> totals_by_name(std::span<const FrameRecord> frames, bool gpu)
+        {
+            std::map<std::string, ZoneTotals> totals;
+            for (auto&& frame : frames)
+            {
+                std::map<std::string_view, double> frame_totals;
+                for (auto&& event : frame.events)
+                {
+                    if ((event.thread == GPU_THREAD) != gpu)
+                    {
+                        continue;
+                    }
+                    frame_totals[event.name] += (event.end_ns - event.start_ns) / 1e6;
+                    ++totals[event.name].calls;
+                }
+                for (auto&& [name, milliseconds] : frame_totals)
+                {
+                    totals[std::string(name)].milliseconds.push_back(milliseconds);
+                }
+            }
+            return totals;
+        }
+
+        void append_totals(std::ostringstream& out, const std::map<std::string, ZoneTotals>& totals, std::size_t frame_count, const char* label)
+        {
+            std::vector<std::pair<frame_stats::Summary, const std::string*>> rows;
+            for (auto&& [name, zone] : totals)
+            {
+                rows.emplace_back(frame_stats::summarize(zone.milliseconds), &name);
+            }
+            std::sort(rows.begin(), rows.end(), [](auto& a, auto& b) { return a.first.mean > b.first.mean; });
+            for (auto&& [summary, name] : rows)
+            {
+                char line[160];
+                std::snprintf(line, sizeof(line), "\n  %-3s %-24s mean %7.3f  p95 %7.3f  max %7.3f ms  %5.1f calls/frame", label, name->c_str(),
+                    summary.mean, summary.p95, summary.max, static_cast<double>(totals.at(*name).calls) / std::max<std::size_t>(frame_count, 1));
+                out << line;
+            }
+        }
+    }
+
+    Profiler::Profiler()
+        : epoch_ns(now_ns()), frame_start_ns(epoch_ns)
+    {
+        startup.start_ns = epoch_ns;
+        gpu_events.reserve(256);
+    }
+
+    void Profiler::set_enabled(bool enable)
+    {
+        if (enable)
+        {
+            std::lock_guard lock(mutex);
+            if (history.empty())
+            {
+                history.resize(FRAME_HISTORY);
+                for (auto&& record : history)
+                {
+                    record.events.reserve(256);
+                }
+            }
+        }
+        active.store(enable, std::memory_order_relaxed);
+    }
+
+    Profiler::ThreadBuffer& Profiler::thread_buffer()
+    {
+        // The profiler holds on to the buffer too, so zones from threads that have exited still get reported.
+        thread_local std::shared_ptr<ThreadBuffer> buffer;
+        if (!buffer)
+        {
+            buffer = std::make_shared<ThreadBuffer>();
+            std::lock_guard lock(mutex);
+            buffer->index = static_cast<uint32_t>(threads.size());
+            buffer->name = "thread " + std::to_string(buffer->index);
+            threads.push_back(buffer);
+        }
+        return *buffer;
+    }
+
+    void Profiler::set_thread_name(std::string name)
+    {
+        auto& buffer = thread_buffer();
+        std::lock_guard lock(mutex);
+        buffer.name = std::move(name);
+    }
+
+    void Profiler::record(const char* name, int64_t start_ns, int64_t end_ns)
+    {
+        auto& buffer = thread_buffer();
+        std::lock_guard lock(buffer.mutex);
+        if (buffer.count == THREAD_EVENT_CAPACITY)
+        {
+            buffer.head = (buffer.head + 1) % THREAD_EVENT_CAPACITY;
+            --buffer.count;
+            dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+        buffer.events[(buffer.head + buffer.count) % THREAD_EVENT_CAPACITY] = { name, start_ns, end_ns, buffer.index };
+        ++buffer.count;
+    }
+
+    void Profiler::record_gpu(const char* name, int64_t start_ns, int64_t end_ns)
+    {
+        std::lock_guard lock(mutex);
+        gpu_events.push_back({ name, start_ns, end_ns, GPU_THREAD });
+    }
+
+    void Profiler::collect(std::vector<ZoneEvent>& events)
+    {
+        auto first = events.size();
+        for (auto&& thread : threads)
+        {
+            std::lock_guard thread_lock(thread->mutex);
+            for (std::size_t i = 0; i < thread->count; ++i)
+            {
+                events.push_back(thread->events[(thread->head + i) % THREAD_EVENT_CAPACITY]);
+            }
+            thread->head = 0;
+            thread->count = 0;
+        }
+        events.insert(events.end(), gpu_events.begin(), gpu_events.end());
+        gpu_events.clear();
+        std::sort(events.begin() + first, events.end(), [](const ZoneEvent& a, const ZoneEvent& b) { return a.start_ns < b.start_ns; });
+    }
+
+    void Profiler::end_startup()
+    {
+        std::lock_guard lock(mutex);
+        collect(startup.events);
+        auto now = now_ns();
+        startup.end_ns = now;
+        frame_start_ns = now;
+    }
+
+    void Profiler::end_frame()
+    {
+        if (!enabled())
+        {
+            return;
+        }
+        std::lock_guard lock(mutex);
+        // The slot keeps its capacity, it only grows for a frame with more zones than it has held before.
+        auto& record = history[frame_count % FRAME_HISTORY];
+        record.events.clear();
+        collect(record.events);
+        auto now = now_ns();
+        record.frame = frame_count;
+        record.start_ns = frame_start_ns;
+        record.end_ns = now;
+        ++frame_count;
+        frame_start_ns = now;
+    }
+
+    std::string Profiler::stats_report() const
+    {
+        std::lock_guard lock(mutex);
+        std::ostringstream out;
+        auto frames = std::span<const FrameRecord>(history).first(recorded_frames());
+        out << "Zones over the last " << frames.size() << " frames:";
+        append_totals(out, totals_by_name(frames, false), frames.size(), "cpu");
+        append_totals(out, totals_by_name(frames, true), frames.size(), "gpu");
+        if (auto lost = dropped.load(std::memory_order_relaxed); lost > 0)
+        {
+            out << "\n  " << lost << " zones dropped, more than " << THREAD_EVENT_CAPACITY << " on a thread in one frame";
+        }
+        return out.str();
+    }
+
+    std::string Profiler::startup_report() const
+    {
+        std::lock_guard lock(mutex);
+        std::ostringstream out;
+        char line[160];
+        std::snprintf(line, sizeof(line), "Startup took %.1f ms:", (startup.end_ns - startup.start_ns) / 1e6);
+        out << line;
+        // In start order, nested zones are indented under the ones containing them.
+        std::vector<const ZoneEvent*> open;
+        for (auto&& event : startup.events)
+        {
+            while (!open.empty() && (open.back()->end_ns <= event.start_ns || open.back()->thread != event.thread))
+            {
+                open.pop_back();
+            }
+            std::snprintf(line, sizeof(line), "\n  %*s%-*s %8.2f ms", static_cast<int>(open.size() * 2), "", static_cast<int>(28 - open.size() * 2),
+                event.name, (event.end_ns - event.start_ns) / 1e6);
+            out << line;
+            open.push_back(&event);
+        }
+        return out.str();
+    }
+
+    void Profiler::write_chrome_trace(const std::string_view path) const
+    {
+        std::lock_guard lock(mutex);
+        std::ofstream out{ std::string(path) };
+        if (!out.is_open())
+        {
+            throw std::runtime_error("Failed to open trace file for writing: " + std::string(path));
+        }
+
+        // Timestamps are microseconds since the profiler started, the GPU gets a track of its own.
+        constexpr uint32_t GPU_TRACK = 1000;
+        constexpr uint32_t FRAME_TRACK = 1001;
+        bool first{ true };
+        auto separator = [&]() -> const char*
+        {
+            bool was_first = first;
+            first = false;
+            return was_first ? "\n" : ",\n";
+        };
+        auto write_event = [&](const char* name, const char* category, uint32_t track, int64_t start_ns, int64_t end_ns)
+        {
+            char timing[96];
+            std::snprintf(timing, sizeof(timing), "\"ts\":%.3f,\"dur\":%.3f", (start_ns - epoch_ns) / 1e3, (end_ns - start_ns) / 1e3);
+            out << separator() << "{\"name\":\"" << escape_json(name) << "\",\"cat\":\"" << category << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << track << ','
+                << timing << '}';
+        };
+        auto write_track_name = [&](uint32_t track, std::string_view name)
+        {
+            out << separator() << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << track << ",\"args\":{\"name\":\"" << escape_json(name) << "\"}}";
+        };
+
+        out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+        for (auto&& thread : threads)
+        {
+            write_track_name(thread->index, thread->name);
+        }
+        write_track_name(GPU_TRACK, "GPU");
+        write_track_name(FRAME_TRACK, "Frames");
+
+        auto write_record = [&](const FrameRecord& record, const char* label)
+        {
+            write_event(label, "frame", FRAME_TRACK, record.start_ns, record.end_ns);
+            for (auto&& event : record.events)
+            {
+                bool gpu = event.thread == GPU_THREAD;
+                write_event(event.name, gpu ? "gpu" : "cpu", gpu ? GPU_TRACK : event.thread, event.start_ns, event.end_ns);
+            }
+        };
+        write_record(startup, "startup");
+        // Oldest frame first.
+        std::size_t recorded = recorded_frames();
+        std::size_t oldest = recorded < FRAME_HISTORY ? 0 : frame_count % FRAME_HISTORY;
+        for (std::size_t i = 0; i < recorded; ++i)
+        {
+            write_record(history[(oldest + i) % FRAME_HISTORY], "frame");
+        }
+        out << "\n]}\n";
+        if (!out.good())
+        {
+            throw std::runtime_error("Failed to write trace file: " + std::string(path));
+        }
+    }
+
+    Profiler& Profiler::shared()
+    {
+        static Profiler profiler;
+        return profiler;
+    }
+}
@@ -0,0 +1,269 @@
+#include "scene.h"
+
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+
+#include "profiler.h"
+
+namespace baas::scene
+{
+    namespace
+    {
+        // Levels smaller than this aren't worth waking other threads for.
+        constexpr std::size_t PARALLEL_LEVEL_SIZE = 16384;
+        constexpr std::size_t UPDATE_GRAIN = 4096;
+        // Following child lists jumps around memory, so walking the levels already wins once about 3% of
+        // a million node scene changed.
+        constexpr std::size_t SUBTREE_UPDATE_DIVISOR = 32;
+    }
+
+    void TransformHierarchy::reserve(std::size_t count)
+    {
+        parents.reserve(count);
+        depths.reserve(count);
+        translations.reserve(count);
+        rotations.reserve(count);
+        scales.reserve(count);
+        worlds.reserve(count);
+        dirty_epochs.reserve(count);
+    }
+
+    uint32_t TransformHierarchy::add_node(uint32_t parent, const transform::Vec3& translation, const transform::Vec4& rotation, const transform::Vec3& scale)
+    {
+        if (parent != NO_PARENT && parent >= parents.size())
+        {
+            throw std::runtime_error("A node's parent has to be added before it");
+        }
+        auto node = static_cast<uint32_t>(parents.size());
+        parents.push_back(parent);
+        depths.push_back(parent == NO_PARENT ? 0 : depths[parent] + 1);
+        translations.push_back(translation);
+        rotations.push_back(rotation);
+        scales.push_back(scale);
+        worlds.push_back(transform::identity());
+        dirty_epochs.push_back(0);
+        mark_dirty(node);
+        levels_stale = true;
+        return node;
+    }
+
+    void TransformHierarchy::set_translation(uint32_t node, const transform::Vec3& translation)
+    {
+        translations[node] = translation;
+        mark_dirty(node);
+    }
+
+    void TransformHierarchy::set_rotation(uint32_t node, const transform::Vec4& rotation)
+    {
+        rotations[node] = rotation;
+        mark_dirty(node);
+    }
+
+    void TransformHierarchy::set_scale(uint32_t node, const transform::Vec3& scale)
+    {
+        scales[node] = scale;
+        mark_dirty(node);
+    }
+
+    std::size_t TransformHierarchy::update(job_system::JobSystem& jobs)
+    {
+        if (dirty_nodes.empty())
+        {
+            return 0;
+        }
+        profiler::Zone zone("update transforms");
+        if (levels_stale)
+        {
+            build_levels();
+        }
+
+        // Nested changes are counted twice, it only has to pick the cheaper walk.
+        std::size_t estimate{ 0 };
+        for (auto node : dirty_nodes)
+        {
+            estimate += subtree_sizes[node];
+        }
+        std::size_t updated = estimate * SUBTREE_UPDATE_DIVISOR < parents.size() ? update_subtrees(jobs) : update_levels(jobs);
+
+        dirty_nodes.clear();
+        if (++epoch == 0)
+        {
+            // Once every 4 billion updates the old epochs have to go before they come around again.
+            std::fill(dirty_epochs.begin(), dirty_epochs.end(), 0u);
+            epoch = 1;
+        }
+        return updated;
+    }
+
+    void TransformHierarchy::mark_dirty(uint32_t node)
+    {
+        if (dirty_epochs[node] != epoch)
+        {
+            dirty_epochs[node] = epoch;
+            dirty_nodes.push_back(node);
+        }
+    }
+
+    void TransformHierarchy::recompute(uint32_t node)
+    {
+        auto parent = parents[node];
+        auto local = transform::compose(translations[node], rotations[node], scales[node]);
+        worlds[node] = parent == NO_PARENT ? local : transform::multiply_affine(worlds[parent], local);
+        dirty_epochs[node] = epoch;
+    }
+
+    std::size_t TransformHierarchy::update_levels(job_system::JobSystem& jobs)
+    {
+        uint32_t first_level = depths[*std::min_element(dirty_nodes.begin(), dirty_nodes.end(),
+            [this](uint32_t a, uint32_t b) { return depths[a] < depths[b]; })];
+        std::size_t updated{ 0 };
+        std::atomic<std::size_t> level_updated{ 0 };
+        // Once a whole level was recomputed so is every level below it, without looking at any flags.
+        bool whole_level{ false };
+        for (std::size_t level = first_level; level + 1 < level_starts.size(); ++level)
+        {
+            auto update_range = [this, whole_level, &level_updated](std::size_t begin, std::size_t end)
+            {
+                std::size_t count{ 0 };
+                for (std::size_t i = begin; i < end; ++i)
+                {
+                    auto node = level_order[i];
+                    auto parent = parents[node];
+                    // The parent's level is done, its epoch says whether its world matrix just changed.
+                    if (!whole_level && dirty_epochs[node] != epoch && (parent == NO_PARENT || dirty_epochs[parent] != epoch))
+                    {
+                        continue;
+                    }
+                    recompute(node);
+                    ++count;
+                }
+                level_updated.fetch_add(count, std::memory_order_relaxed);
+            };
+            std::size_t begin = level_starts[level];
+            std::size_t end = level_starts[level + 1];
+            if (end - begin < PARALLEL_LEVEL_SIZE)
+            {
+                update_range(begin, end);
+            }
+            else
+            {
+                jobs.parallel_for(end - begin, [begin, &update_range](std::size_t first, std::size_t last)
+                    {
+                        update_range(begin + first, begin + last);
+                    }, UPDATE_GRAIN);
+            }
+            std::size_t count = level_updated.exchange(0, std::memory_order_relaxed);
+            whole_level = count == end - begin;
+            updated += count;
+        }
+        return updated;
+    }
+
+    std::size_t TransformHierarchy::update_subtrees(job_system::JobSystem& jobs)
+    {
+        std::sort(dirty_nodes.begin(), dirty_nodes.end(), [this](uint32_t a, uint32_t b) { return depths[a] < depths[b]; });
+        auto update_range = [this](std::size_t begin, std::size_t end)
+        {
+            for (std::size_t i = begin; i < end; ++i)
+            {
+                recompute(pending[i]);
+            }
+        };
+
+        // Each level is the children of what the level above recomputed, plus the changed nodes at that
+        // depth whose parent didn't change. Those with a changed parent are already among its children.
+        pending.clear();
+        std::size_t previous_begin{ 0 };
+        std::size_t previous_end{ 0 };
+        auto next_dirty = dirty_nodes.begin();
+        for (uint32_t depth = depths[*next_dirty]; previous_begin < previous_end || next_dirty != dirty_nodes.end(); ++depth)
+        {
+            std::size_t begin = pending.size();
+            for (std::size_t i = previous_begin; i < previous_end; ++i)
+            {
+                auto node = pending[i];
+                pending.insert(pending.end(), children.begin() + child_starts[node], children.begin() + child_starts[node + 1]);
+            }
+            for (; next_dirty != dirty_nodes.end() && depths[*next_dirty] == depth; ++next_dirty)
+            {
+                auto parent = parents[*next_dirty];
+                if (parent == NO_PARENT || dirty_epochs[parent] != epoch)
+                {
+                    pending.push_back(*next_dirty);
+                }
+            }
+            std::size_t end = pending.size();
+            if (end - begin < PARALLEL_LEVEL_SIZE)
+            {
+                update_range(begin, end);
+            }
+            else
+            {
+                jobs.parallel_for(end - begin, [begin, &update_range](std::size_t first, std::size_t last)
+                    {
+                        update_range(begin + first, begin + last);
+                    }, UPDATE_GRAIN);
+            }
+            previous_begin = begin;
+            previous_end = end;
+        }
+        return pending.size();
+    }
+
+    void TransformHierarchy::build_levels()
+    {
+        // Counting sort by depth, stable so nodes keep their order within a level.
+        uint32_t depth_count = depths.empty() ? 0 : *std::max_element(depths.begin(), depths.end()) + 1;
+        level_starts.assign(depth_count + 1, 0);
+        for (auto depth : depths)
+        {
+            ++level_starts[depth + 1];
+        }
+        for (uint32_t depth = 0; depth < depth_count; ++depth)
+        {
+            level_starts[depth + 1] += level_starts[depth];
+        }
+        level_order.resize(parents.size());
+        std::vector<uint32_t> next(level_starts.begin(), level_starts.end() - 1);
+        for (uint32_t node = 0; node < parents.size(); ++node)
+        {
+            level_order[next[depths[node]]++] = node;
+        }
+
+        // Same again by parent for the child lists.
+        child_starts.assign(parents.size() + 1, 0);
+        for (auto parent : parents)
+        {
+            if (parent != NO_PARENT)
+            {
+                ++child_starts[parent + 1];
+            }
+        }
+        for (std::size_t node = 0; node < parents.size(); ++node)
+        {
+            child_starts[node + 1] += child_starts[node];
+        }
+        children.resize(child_starts.back());
+        next.assign(child_starts.begin(), child_starts.end() - 1);
+        for (uint32_t node = 0; node < parents.size(); ++node)
+        {
+            if (parents[node] != NO_PARENT)
+            {
+                children[next[parents[node]]++] = node;
+            }
+        }
+
+        // Deepest level first, so every subtree is complete before it is added to its parent's.
+        subtree_sizes.assign(parents.size(), 1);
+        for (std::size_t i = level_order.size(); i-- > 0;)
+        {
+            auto node = level_order[i];
+            if (parents[node] != NO_PARENT)
+            {
+                subtree_sizes[parents[node]] += subtree_sizes[node];
+            }
+        }
+        levels_stale = false;
+    }
+}
@@ -0,0 +1,1005 @@
+#include "texture.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+#include "profiler.h"
+
+namespace baas::texture
+{
+    namespace
+    {
+        constexpr char TEXTURE_MAGIC[8] = { 'V', 'M', 'L', 'T', 'E', 'X', '\0', '\0' };
+        constexpr std::size_t LEVEL_ALIGNMENT = 16;
+
+        struct TextureFileHeader
+        {
+            char magic[8];
+            uint32_t version;
+            uint32_t header_size;
+            uint64_t key;
+            uint32_t format;
+            uint32_t srgb;
+            uint32_t level_count;
+            uint32_t reserved;
+            // Levels start here, after the level table.
+            uint64_t data_offset;
+            uint64_t file_size;
+        };
+        static_assert(std::is_trivially_copyable_v<TextureFileHeader>);
+        static_assert(std::is_trivially_copyable_v<Level>);
+
+        std::size_t align_up(std::size_t value, std::size_t alignment)
+        {
+            return (value + alignment - 1) / alignment * alignment;
+        }
+
+        float srgb_to_linear(float value)
+        {
+            return value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+        }
+
+        const std::array<float, 256>& linear_table()
+        {
+            static const std::array<float, 256> table = []
+            {
+                std::array<float, 256> result{};
+                for (int i = 0; i < 256; ++i)
+                {
+                    result[i] = srgb_to_linear(i / 255.0f);
+                }
+                return result;
+            }();
+            return table;
+        }
+
+        // Linear values halfway between neighbouring sRGB codes, encoding is a search instead of a pow.
+        const std::array<float, 255>& srgb_thresholds()
+        {
+            static const std::array<float, 255> table = []
+            {
+                std::array<float, 255> result{};
+                for (int i = 0; i < 255; ++i)
+                {
+                    result[i] = srgb_to_linear((i + 0.5f) / 255.0f);
+                }
+                return result;
+            }();
+            return table;
+        }
+
+        uint8_t linear_to_srgb(float value)
+        {
+            auto& thresholds = srgb_thresholds();
+            return static_cast<uint8_t>(std::upper_bound(thresholds.begin(), thresholds.end(), value) - thresholds.begin());
+        }
+
+        // 4x4 block with the edge pixels repeated past the image's border.
+        void read_block(const image_io::DecodedImage& image, uint32_t block_x, uint32_t block_y, uint8_t (&pixels)[16][4])
+        {
+            for (uint32_t y = 0; y < 4; ++y)
+            {
+                uint32_t source_y = std::min(block_y * 4 + y, image.height - 1);
+                for (uint32_t x = 0; x < 4; ++x)
+                {
+                    uint32_t source_x = std::min(block_x * 4 + x, image.width - 1);
+                    std::memcpy(pixels[y * 4 + x], image.rgba.data() + (std::size_t{ source_y } * image.width + source_x) * 4, 4);
+                }
+            }
+        }
+
+        // Direction of largest variance through power iteration on the covariance, channels is 3 or 4.
+        // Zero when all colors are the same.
+        template <int Channels>
+        std::array<float, Channels> principal_axis(const float (&colors)[16][4], int count, const std::array<float, Channels>& mean)
+        {
+            float covariance[Channels][Channels]{};
+            for (int i = 0; i < count; ++i)
+            {
+                for (int a = 0; a < Channels; ++a)
+                {
+                    for (int b = 0; b < Channels; ++b)
+                    {
+                        covariance[a][b] += (colors[i][a] - mean[a]) * (colors[i][b] - mean[b]);
+                    }
+                }
+            }
+            std::array<float, Channels> axis;
+            axis.fill(1.0f);
+            for (int iteration = 0; iteration < 8; ++iteration)
+            {
+                std::array<float, Channels> next{};
+                float length{ 0.0f };
+                for (int a = 0; a < Channels; ++a)
+                {
+                    for (int b = 0; b < Channels; ++b)
+                    {
+                        next[a] += covariance[a][b] * axis[b];
+                    }
+                    length = std::max(length, std::abs(next[a]));
+                }
+                if (length < 1e-6f)
+                {
+                    axis.fill(0.0f);
+                    return axis;
+                }
+                for (int a = 0; a < Channels; ++a)
+                {
+                    axis[a] = next[a] / length;
+                }
+            }
+            return axis;
+        }
+
+        // Endpoints at the extremes of the colors projected onto the principal axis.
+        template <int Channels>
+        void fit_endpoints(const float (&colors)[16][4], int count, float (&low)[4], float (&high)[4])
+        {
+            std::array<float, Channels> mean{};
+            for (int i = 0; i < count; ++i)
+            {
+                for (int c = 0; c < Channels; ++c)
+                {
+                    mean[c] += colors[i][c] / static_cast<float>(count);
+                }
+            }
+            auto axis = principal_axis<Channels>(colors, count, mean);
+            float length_squared{ 0.0f };
+            for (int c = 0; c < Channels; ++c)
+            {
+                length_squared += axis[c] * axis[c];
+            }
+            float min_t{ 0.0f };
+            float max_t{ 0.0f };
+            for (int i = 0; i < count && length_squared > 0.0f; ++i)
+            {
+                float t{ 0.0f };
+                for (int c = 0; c < Channels; ++c)
+                {
+                    t += (colors[i][c] - mean[c]) * axis[c];
+                }
+                t /= length_squared;
+                min_t = i == 0 ? t : std::min(min_t, t);
+                max_t = i == 0 ? t : std::max(max_t, t);
+            }
+            for (int c = 0; c < Channels; ++c)
+            {
+                low[c] = std::clamp(mean[c] + axis[c] * min_t, 0.0f, 255.0f);
+                high[c] = std::clamp(mean[c] + axis[c] * max_t, 0.0f, 255.0f);
+            }
+        }
+
+        // Least squares endpoints for colors fixed at weights along the line between them, false when the
+        // weights don't pin both endpoints down.
+        template <int Channels>
+        bool solve_endpoints(const float (&colors)[16][4], const float* weights, int count, float (&low)[4], float (&high)[4])
+        {
+            float aa{ 0.0f };
+            float ab{ 0.0f };
+            float bb{ 0.0f };
+            float ax[4]{};
+            float bx[4]{};
+            for (int i = 0; i < count; ++i)
+            {
+                float b = weights[i];
+                float a = 1.0f - b;
+                aa += a * a;
+                ab += a * b;
+                bb += b * b;
+                for (int c = 0; c < Channels; ++c)
+                {
+                    ax[c] += a * colors[i][c];
+                    bx[c] += b * colors[i][c];
+                }
+            }
+            float determinant = aa * bb - ab * ab;
+            if (std::abs(determinant) < 1e-6f)
+            {
+                return false;
+            }
+            for (int c = 0; c < Channels; ++c)
+            {
+                low[c] = std::clamp((ax[c] * bb - bx[c] * ab) / determinant, 0.0f, 255.0f);
+                high[c] = std::clamp((bx[c] * aa - ax[c] * ab) / determinant, 0.0f, 255.0f);
+            }
+            return true;
+        }
+
+        uint16_t pack_565(const float (&color)[4])
+        {
+            auto r = static_cast<uint32_t>(std::lround(color[0] * 31.0f / 255.0f));
+            auto g = static_cast<uint32_t>(std::lround(color[1] * 63.0f / 255.0f));
+            auto b = static_cast<uint32_t>(std::lround(color[2] * 31.0f / 255.0f));
+            return static_cast<uint16_t>(r << 11 | g << 5 | b);
+        }
+
+        std::array<int, 3> unpack_565(uint16_t packed)
+        {
+            int r = packed >> 11 & 31;
+            int g = packed >> 5 & 63;
+            int b = packed & 31;
+            return { r << 3 | r >> 2, g << 2 | g >> 4, b << 3 | b >> 2 };
+        }
+
+        // Palette of a BC1 block, the fourth entry is transparent black in the three color mode.
+        std::array<std::array<int, 4>, 4> bc1_palette(uint16_t color0, uint16_t color1)
+        {
+            auto a = unpack_565(color0);
+            auto b = unpack_565(color1);
+            std::array<std::array<int, 4>, 4> palette{};
+            for (int c = 0; c < 3; ++c)
+            {
+                palette[0][c] = a[c];
+                palette[1][c] = b[c];
+                if (color0 > color1)
+                {
+                    palette[2][c] = (2 * a[c] + b[c]) / 3;
+                    palette[3][c] = (a[c] + 2 * b[c]) / 3;
+                }
+                else
+                {
+                    palette[2][c] = (a[c] + b[c]) / 2;
+                    palette[3][c] = 0;
+                }
+            }
+            palette[0][3] = palette[1][3] = palette[2][3] = 255;
+            palette[3][3] = color0 > color1 ? 255 : 0;
+            return palette;
+        }
+
+        struct Bc1Candidate
+        {
+            uint16_t color0;
+            uint16_t color1;
+            uint32_t indices;
+            int error;
+        };
+
+        // Picks the nearest palette entry for every pixel, transparent pixels take entry 3 in the three color mode.
+        Bc1Candidate choose_bc1_indices(const uint8_t (&pixels)[16][4], uint16_t color0, uint16_t color1, bool transparent)
+        {
+            auto palette = bc1_palette(color0, color1);
+            Bc1Candidate candidate{ color0, color1, 0, 0 };
+            int usable = color0 > color1 ? 4 : 3;
+            for (int i = 0; i < 16; ++i)
+            {
+                if (transparent && pixels[i][3] < 128)
+                {
+                    candidate.indices |= 3u << (i * 2);
+                    continue;
+                }
+                int best{ 0 };
+                int best_error = std::numeric_limits<int>::max();
+                for (int entry = 0; entry < usable; ++entry)
+                {
+                    int error{ 0 };
+                    for (int c = 0; c < 3; ++c)
+                    {
+                        int difference = palette[entry][c] - pixels[i][c];
+                        error += difference * difference;
+                    }
+                    if (error < best_error)
+                    {
+                        best_error = error;
+                        best = entry;
+                    }
+                }
+                candidate.indices |= static_cast<uint32_t>(best) << (i * 2);
+                candidate.error += best_error;
+            }
+            return candidate;
+        }
+
+        // Orders the endpoints for the mode the block needs: color0 > color1 for four colors, <= for
+        // three colors with transparency.
+        Bc1Candidate evaluate_bc1(const uint8_t (&pixels)[16][4], const float (&low)[4], const float (&high)[4], bool transparent)
+        {
+            uint16_t color0 = pack_565(high);
+            uint16_t color1 = pack_565(low);
+            if ((color0 < color1) != transparent && color0 != color1)
+            {
+                std::swap(color0, color1);
+            }
+            return choose_bc1_indices(pixels, color0, color1, transparent);
+        }
+
+        void encode_bc1_block(const uint8_t (&pixels)[16][4], std::byte* out)
+        {
+            float colors[16][4]{};
+            int count{ 0 };
+            bool transparent{ false };
+            for (auto&& pixel : pixels)
+            {
+                if (pixel[3] < 128)
+                {
+                    transparent = true;
+                    continue;
+                }
+                for (int c = 0; c < 3; ++c)
+                {
+                    colors[count][c] = pixel[c];
+                }
+                ++count;
+            }
+
+            Bc1Candidate best{ 0, 0, 0xFFFFFFFFu, 0 };
+            if (count > 0)
+            {
+                float low[4]{};
+                float high[4]{};
+                fit_endpoints<3>(colors, count, low, high);
+                best = evaluate_bc1(pixels, low, high, transparent);
+                // Refit the endpoints to the chosen indices, a couple of rounds catch most of the gain.
+                for (int iteration = 0; iteration < 2 && best.error > 0; ++iteration)
+                {
+                    auto palette_weight = [&](uint32_t index, bool four_colors) -> float
+                    {
+                        // Weight of color1, the entry that was fit from low.
+                        constexpr float FOUR[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+                        constexpr float THREE[3] = { 0.0f, 1.0f, 0.5f };
+                        return four_colors ? FOUR[index] : THREE[index];
+                    };
+                    bool four_colors = best.color0 > best.color1;
+                    float weights[16];
+                    float opaque[16][4]{};
+                    int used{ 0 };
+                    for (int i = 0; i < 16; ++i)
+                    {
+                        uint32_t index = best.indices >> (i * 2) & 3u;
+                        if (transparent && pixels[i][3] < 128)
+                        {
+                            continue;
+                        }
+                        weights[used] = palette_weight(index, four_colors);
+                        for (int c = 0; c < 3; ++c)
+                        {
+                            opaque[used][c] = pixels[i][c];
+                        }
+                        ++used;
+                    }
+                    // color0 is fit as the first endpoint, color1 as the second.
+                    float first[4]{};
+                    float second[4]{};
+                    if (!solve_endpoints<3>(opaque, weights, used, first, second))
+                    {
+                        break;
+                    }
+                    auto candidate = choose_bc1_indices(pixels, pack_565(first), pack_565(second), transparent);
+                    // The refit may have flipped the order the mode needs, evaluate_bc1 swaps it back.
+                    if ((candidate.color0 > candidate.color1) != four_colors)
+                    {
+                        candidate = evaluate_bc1(pixels, second, first, transparent);
+                    }
+                    if (candidate.error >= best.error)
+                    {
+                        break;
+                    }
+                    best = candidate;
+                }
+            }
+            uint8_t bytes[8] = { static_cast<uint8_t>(best.color0), static_cast<uint8_t>(best.color0 >> 8), static_cast<uint8_t>(best.color1),
+                static_cast<uint8_t>(best.color1 >> 8), static_cast<uint8_t>(best.indices), static_cast<uint8_t>(best.indices >> 8),
+                static_cast<uint8_t>(best.indices >> 16), static_cast<uint8_t>(best.indices >> 24) };
+            std::memcpy(out, bytes, sizeof(bytes));
+        }
+
+        void decode_bc1_block(const std::byte* block, uint8_t (&pixels)[16][4])
+        {
+            uint8_t bytes[8];
+            std::memcpy(bytes, block, sizeof(bytes));
+            auto color0 = static_cast<uint16_t>(bytes[0] | bytes[1] << 8);
+            auto color1 = static_cast<uint16_t>(bytes[2] | bytes[3] << 8);
+            uint32_t indices = uint32_t{ bytes[4] } | uint32_t{ bytes[5] } << 8 | uint32_t{ bytes[6] } << 16 | uint32_t{ bytes[7] } << 24;
+            auto palette = bc1_palette(color0, color1);
+            for (int i = 0; i < 16; ++i)
+            {
+                auto& entry = palette[indices >> (i * 2) & 3u];
+                for (int c = 0; c < 4; ++c)
+                {
+                    pixels[i][c] = static_cast<uint8_t>(entry[c]);
+                }
+            }
+        }
+
+        constexpr int BC7_WEIGHTS[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+        // Mode 6 endpoint: 7 bits per channel and a low bit shared by the channels.
+        struct Bc7Endpoint
+        {
+            std::array<int, 4> quantized;
+            int p_bit;
+
+            int value(int channel) const { return quantized[channel] << 1 | p_bit; }
+        };
+
+        Bc7Endpoint quantize_bc7(const float (&color)[4])
+        {
+            Bc7Endpoint best{};
+            float best_error = std::numeric_limits<float>::max();
+            for (int p_bit = 0; p_bit < 2; ++p_bit)
+            {
+                Bc7Endpoint endpoint{ {}, p_bit };
+                float error{ 0.0f };
+                for (int c = 0; c < 4; ++c)
+                {
+                    endpoint.quantized[c] = std::clamp(static_cast<int>(std::lround((color[c] - p_bit) / 2.0f)), 0, 127);
+                    float difference = static_cast<float>(endpoint.value(c)) - color[c];
+                    error += difference * difference;
+                }
+                if (error < best_error)
+                {
+                    best_error = error;
+                    best = endpoint;
+                }
+            }
+            return best;
+        }
+
+        int bc7_interpolate(int a, int b, int weight)
+        {
+            return ((64 - weight) * a + weight * b + 32) >> 6;
+        }
+
+        struct Bc7Candidate
+        {
+            Bc7Endpoint endpoints[2];
+            uint8_t indices[16];
+            int error;
+        };
+
+        void choose_bc7_indices(const uint8_t (&pixels)[16][4], Bc7Candidate& candidate)
+        {
+            int palette[16][4];
+            for (int entry = 0; entry < 16; ++entry)
+            {
+                for (int c = 0; c < 4; ++c)
+                {
+                    palette[entry][c] = bc7_interpolate(candidate.endpoints[0].value(c), candidate.endpoints[1].value(c), BC7_WEIGHTS[entry]);
+                }
+            }
+            float direction[4];
+            float length_squared{ 0.0f };
+            for (int c = 0; c < 4; ++c)
+            {
+                direction[c] = static_cast<float>(palette[15][c] - palette[0][c]);
+                length_squared += direction[c] * direction[c];
+            }
+            candidate.error = 0;
+            for (int i = 0; i < 16; ++i)
+            {
+                // The projection onto the endpoint line lands next to the best entry, only its neighbours
+                // are compared instead of all 16.
+                float t{ 0.0f };
+                for (int c = 0; c < 4; ++c)
+                {
+                    t += (pixels[i][c] - palette[0][c]) * direction[c];
+                }
+                int guess = length_squared > 0.0f ? std::clamp(static_cast<int>(t / length_squared * 15.0f + 0.5f), 0, 15) : 0;
+                int best{ 0 };
+                int best_error = std::numeric_limits<int>::max();
+                for (int entry = std::max(guess - 1, 0); entry <= std::min(guess + 1, 15); ++entry)
+                {
+                    int error{ 0 };
+                    for (int c = 0; c < 4; ++c)
+                    {
+                        int difference = palette[entry][c] - pixels[i][c];
+                        error += difference * difference;
+                    }
+                    if (error < best_error)
+                    {
+                        best_error = error;
+                        best = entry;
+                    }
+                }
+                candidate.indices[i] = static_cast<uint8_t>(best);
+                candidate.error += best_error;
+            }
+        }
+
+        // Little endian bit stream of one 128 bit block.
+        class BlockBits
+        {
+        public:
+            void write(uint32_t value, int count)
+            {
+                for (int bit = 0; bit < count; ++bit, ++position)
+                {
+                    bytes[position / 8] = static_cast<uint8_t>(bytes[position / 8] | ((value >> bit) & 1u) << (position % 8));
+                }
+            }
+
+            uint32_t read(int count)
+            {
+                uint32_t value{ 0 };
+                for (int bit = 0; bit < count; ++bit, ++position)
+                {
+                    value |= uint32_t{ static_cast<uint8_t>(bytes[position / 8] >> (position % 8) & 1u) } << bit;
+                }
+                return value;
+            }
+
+            uint8_t bytes[16]{};
+            int position{ 0 };
+        };
+
+        void encode_bc7_block(const uint8_t (&pixels)[16][4], std::byte* out)
+        {
+            float colors[16][4];
+            for (int i = 0; i < 16; ++i)
+            {
+                for (int c = 0; c < 4; ++c)
+                {
+                    colors[i][c] = pixels[i][c];
+                }
+            }
+            float low[4]{};
+            float high[4]{};
+            fit_endpoints<4>(colors, 16, low, high);
+            Bc7Candidate best{ { quantize_bc7(low), quantize_bc7(high) }, {}, 0 };
+            choose_bc7_indices(pixels, best);
+            for (int iteration = 0; iteration < 2 && best.error > 0; ++iteration)
+            {
+                float weights[16];
+                for (int i = 0; i < 16; ++i)
+                {
+                    weights[i] = BC7_WEIGHTS[best.indices[i]] / 64.0f;
+                }
+                if (!solve_endpoints<4>(colors, weights, 16, low, high))
+                {
+                    break;
+                }
+                Bc7Candidate candidate{ { quantize_bc7(low), quantize_bc7(high) }, {}, 0 };
+                choose_bc7_indices(pixels, candidate);
+                if (candidate.error >= best.error)
+                {
+                    break;
+                }
+                best = candidate;
+            }
+
+            // The first index's top bit isn't stored, it has to be 0.
+            if (best.indices[0] >= 8)
+            {
+                std::swap(best.endpoints[0], best.endpoints[1]);
+                for (auto& index : best.indices)
+                {
+                    index = static_cast<uint8_t>(15 - index);
+                }
+            }
+            BlockBits bits;
+            bits.write(1u << 6, 7);
+            for (int c = 0; c < 4; ++c)
+            {
+                bits.write(static_cast<uint32_t>(best.endpoints[0].quantized[c]), 7);
+                bits.write(static_cast<uint32_t>(best.endpoints[1].quantized[c]), 7);
+            }
+            bits.write(static_cast<uint32_t>(best.endpoints[0].p_bit), 1);
+            bits.write(static_cast<uint32_t>(best.endpoints[1].p_bit), 1);
+            for (int i = 0; i < 16; ++i)
+            {
+                bits.write(best.indices[i], i == 0 ? 3 : 4);
+            }
+            std::memcpy(out, bits.bytes, sizeof(bits.bytes));
+        }
+
+        void decode_bc7_block(const std::byte* block, uint8_t (&pixels)[16][4])
+        {
+            BlockBits bits;
+            std::memcpy(bits.bytes, block, sizeof(bits.bytes));
+            if (bits.read(7) != 1u << 6)
+            {
+                for (auto& pixel : pixels)
+                {
+                    pixel[0] = 255;
+                    pixel[1] = 0;
+                    pixel[2] = 255;
+                    pixel[3] = 255;
+                }
+                return;
+            }
+            Bc7Endpoint endpoints[2]{};
+            for (int c = 0; c < 4; ++c)
+            {
+                endpoints[0].quantized[c] = static_cast<int>(bits.read(7));
+                endpoints[1].quantized[c] = static_cast<int>(bits.read(7));
+            }
+            endpoints[0].p_bit = static_cast<int>(bits.read(1));
+            endpoints[1].p_bit = static_cast<int>(bits.read(1));
+            for (int i = 0; i < 16; ++i)
+            {
+                auto index = bits.read(i == 0 ? 3 : 4);
+                for (int c = 0; c < 4; ++c)
+                {
+                    pixels[i][c] = static_cast<uint8_t>(bc7_interpolate(endpoints[0].value(c), endpoints[1].value(c), BC7_WEIGHTS[index]));
+                }
+            }
+        }
+
+        std::size_t block_bytes(Format format)
+        {
+            return format == Format::bc1 ? 8 : 16;
+        }
+
+        const char* format_name(Format format)
+        {
+            switch (format)
+            {
+            case Format::bc1:
+                return "BC1";
+            case Format::bc7:
+                return "BC7";
+            default:
+                return "RGBA8";
+            }
+        }
+
+        // Level sizes and offsets are checked against each other and the data, nothing in a damaged file
+        // may point outside it.
+        bool valid_levels(std::span<const Level> levels, Format format, std::size_t data_size)
+        {
+            if (levels.empty() || levels.front().width == 0 || levels.front().height == 0 ||
+                levels.size() != mip_count(levels.front().width, levels.front().height))
+            {
+                return false;
+            }
+            for (std::size_t i = 0; i < levels.size(); ++i)
+            {
+                auto& level = levels[i];
+                if (i > 0 && (level.width != std::max(1u, levels[i - 1].width / 2) || level.height != std::max(1u, levels[i - 1].height / 2)))
+                {
+                    return false;
+                }
+                if (level.size != level_size(format, level.width, level.height) || level.offset > data_size || level.size > data_size - level.offset)
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+    }
+
+    Texture::Texture(Format format, bool srgb, std::vector<Level> levels, std::vector<std::byte> data)
+        : texture_format(format), is_srgb(srgb), levels(std::move(levels)), built(std::move(data)), bytes(built)
+    {
+    }
+
+    Texture::Texture(Format format, bool srgb, std::vector<Level> levels, file_ops::MappedFile file, std::size_t data_offset)
+        : texture_format(format), is_srgb(srgb), levels(std::move(levels)), file(std::move(file))
+    {
+        bytes = this->file.bytes().subspan(data_offset);
+    }
+
+    uint32_t mip_count(uint32_t width, uint32_t height)
+    {
+        uint32_t count{ 1 };
+        while (width > 1 || height > 1)
+        {
+            width = std::max(1u, width / 2);
+            height = std::max(1u, height / 2);
+            ++count;
+        }
+        return count;
+    }
+
+    std::size_t level_size(Format format, uint32_t width, uint32_t height)
+    {
+        if (format == Format::rgba8)
+        {
+            return std::size_t{ width } * height * 4;
+        }
+        return std::size_t{ (width + 3) / 4 } * ((height + 3) / 4) * block_bytes(format);
+    }
+
+    std::vector<image_io::DecodedImage> generate_mips(image_io::DecodedImage image, bool srgb, job_system::JobSystem& jobs)
+    {
+        profiler::Zone zone("generate mips");
+        std::vector<image_io::DecodedImage> levels;
+        levels.reserve(mip_count(image.width, image.height));
+        levels.push_back(std::move(image));
+        auto& linear = linear_table();
+        while (levels.back().width > 1 || levels.back().height > 1)
+        {
+            auto& source = levels.back();
+            image_io::DecodedImage level;
+            level.width = std::max(1u, source.width / 2);
+            level.height = std::max(1u, source.height / 2);
+            level.rgba.resize(std::size_t{ level.width } * level.height * 4);
+            jobs.parallel_for(level.height, [&](std::size_t begin, std::size_t end)
+            {
+                for (std::size_t y = begin; y < end; ++y)
+                {
+                    const uint8_t* rows[2] = { source.rgba.data() + std::min<std::size_t>(y * 2, source.height - 1) * source.width * 4,
+                        source.rgba.data() + std::min<std::size_t>(y * 2 + 1, source.height - 1) * source.width * 4 };
+                    uint8_t* out = level.rgba.data() + y * level.width * 4;
+                    for (std::size_t x = 0; x < level.width; ++x, out += 4)
+                    {
+                        std::size_t columns[2] = { std::min<std::size_t>(x * 2, source.width - 1) * 4, std::min<std::size_t>(x * 2 + 1, source.width - 1) * 4 };
+                        for (int c = 0; c < 4; ++c)
+                        {
+                            if (srgb && c < 3)
+                            {
+                                float sum = linear[rows[0][columns[0] + c]] + linear[rows[0][columns[1] + c]] + linear[rows[1][columns[0] + c]] +
+                                    linear[rows[1][columns[1] + c]];
+                                out[c] = linear_to_srgb(sum * 0.25f);
+                            }
+                            else
+                            {
+                                int sum = rows[0][columns[0] + c] + rows[0][columns[1] + c] + rows[1][columns[0] + c] + rows[1][columns[1] + c];
+                                out[c] = static_cast<uint8_t>((sum + 2) / 4);
+                            }
+                        }
+                    }
+                }
+            }, 16);
+            levels.push_back(std::move(level));
+        }
+        return levels;
+    }
+
+    std::vector<std::byte> encode_level(const image_io::DecodedImage& image, Format format, job_system::JobSystem& jobs)
+    {
+        if (format == Format::rgba8)
+        {
+            auto bytes = std::as_bytes(std::span(image.rgba));
+            return { bytes.begin(), bytes.end() };
+        }
+        uint32_t blocks_x = (image.width + 3) / 4;
+        uint32_t blocks_y = (image.height + 3) / 4;
+        std::vector<std::byte> out(level_size(format, image.width, image.height));
+        std::size_t stride = block_bytes(format);
+        jobs.parallel_for(blocks_y, [&](std::size_t begin, std::size_t end)
+        {
+            uint8_t pixels[16][4];
+            for (std::size_t block_y = begin; block_y < end; ++block_y)
+            {
+                for (uint32_t block_x = 0; block_x < blocks_x; ++block_x)
+                {
+                    read_block(image, block_x, static_cast<uint32_t>(block_y), pixels);
+                    auto* block = out.data() + (block_y * blocks_x + block_x) * stride;
+                    if (format == Format::bc1)
+                    {
+                        encode_bc1_block(pixels, block);
+                    }
+                    else
+                    {
+                        encode_bc7_block(pixels, block);
+                    }
+                }
+            }
+        }, 4);
+        return out;
+    }
+
+    std::vector<uint8_t> decode_level(std::span<const std::byte> data, Format format, uint32_t width, uint32_t height)
+    {
+        if (data.size() != level_size(format, width, height))
+        {
+            throw std::runtime_error("Texture level data doesn't match its size");
+        }
+        if (format == Format::rgba8)
+        {
+            auto bytes = std::span(reinterpret_cast<const uint8_t*>(data.data()), data.size());
+            return { bytes.begin(), bytes.end() };
+        }
+        std::vector<uint8_t> rgba(std::size_t{ width } * height * 4);
+        uint32_t blocks_x = (width + 3) / 4;
+        uint32_t blocks_y = (height + 3) / 4;
+        uint8_t pixels[16][4];
+        for (uint32_t block_y = 0; block_y < blocks_y; ++block_y)
+        {
+            for (uint32_t block_x = 0; block_x < blocks_x; ++block_x)
+            {
+                auto* block = data.data() + (std::size_t{ block_y } * blocks_x + block_x) * block_bytes(format);
+                if (format == Format::bc1)
+                {
+                    decode_bc1_block(block, pixels);
+                }
+                else
+                {
+                    decode_bc7_block(block, pixels);
+                }
+                for (uint32_t y = 0; y < 4 && block_y * 4 + y < height; ++y)
+                {
+                    for (uint32_t x = 0; x < 4 && block_x * 4 + x < width; ++x)
+                    {
+                        std::memcpy(rgba.data() + (std::size_t{ block_y * 4 + y } * width + block_x * 4 + x) * 4, pixels[y * 4 + x], 4);
+                    }
+                }
+            }
+        }
+        return rgba;
+    }
+
+    Texture build_texture(image_io::DecodedImage image, const TextureOptions& options, job_system::JobSystem& jobs)
+    {
+        auto mips = generate_mips(std::move(image), options.srgb, jobs);
+        profiler::Zone zone("encode texture");
+        std::vector<Level> levels;
+        std::vector<std::byte> data;
+        for (auto&& mip : mips)
+        {
+            auto encoded = encode_level(mip, options.format, jobs);
+            std::size_t offset = align_up(data.size(), LEVEL_ALIGNMENT);
+            data.resize(offset);
+            data.insert(data.end(), encoded.begin(), encoded.end());
+            levels.push_back({ mip.width, mip.height, offset, encoded.size() });
+        }
+        return Texture(options.format, options.srgb, std::move(levels), std::move(data));
+    }
+
+    std::optional<Format> parse_format(std::string_view name)
+    {
+        if (name == "rgba8")
+        {
+            return Format::rgba8;
+        }
+        if (name == "bc1")
+        {
+            return Format::bc1;
+        }
+        if (name == "bc7")
+        {
+            return Format::bc7;
+        }
+        return std::nullopt;
+    }
+
+    std::string texture_path_for(const std::string_view source_path)
+    {
+        return std::string(source_path) + std::string(TEXTURE_EXTENSION);
+    }
+
+    std::string resolve_texture_path(const std::string_view model_path, const std::string_view map_entry)
+    {
+        std::string name(map_entry);
+        // Options come first and the file name last, names with spaces only work without options.
+        if (name.starts_with('-'))
+        {
+            auto last_space = name.find_last_of(" \t");
+            name = last_space == std::string::npos ? std::string() : name.substr(last_space + 1);
+        }
+        // Exported on Windows more often than not.
+        std::replace(name.begin(), name.end(), '\\', '/');
+        if (name.empty())
+        {
+            return name;
+        }
+        auto path = std::filesystem::path(name);
+        if (path.is_relative())
+        {
+            path = std::filesystem::path(model_path).parent_path() / path;
+        }
+        return path.lexically_normal().string();
+    }
+
+    uint64_t texture_key(std::span<const std::byte> source, const TextureOptions& options)
+    {
+        uint32_t settings[2] = { static_cast<uint32_t>(options.format), options.srgb ? 1u : 0u };
+        uint64_t key = file_ops::hash_bytes(std::as_bytes(std::span(settings)), TEXTURE_VERSION);
+        return file_ops::hash_bytes(source, key);
+    }
+
+    void write_texture_file(const std::string_view path, const Texture& texture, uint64_t key)
+    {
+        auto levels = texture.mip_levels();
+        TextureFileHeader header{};
+        std::memcpy(header.magic, TEXTURE_MAGIC, sizeof(TEXTURE_MAGIC));
+        header.version = TEXTURE_VERSION;
+        header.header_size = sizeof(TextureFileHeader);
+        header.key = key;
+        header.format = static_cast<uint32_t>(texture.format());
+        header.srgb = texture.srgb() ? 1 : 0;
+        header.level_count = static_cast<uint32_t>(levels.size());
+        // Levels stay 16 byte aligned in the mapped file too.
+        header.data_offset = align_up(sizeof(TextureFileHeader) + levels.size() * sizeof(Level), LEVEL_ALIGNMENT);
+        header.file_size = header.data_offset + texture.data().size();
+
+        // Same write and rename as the mesh cache.
+        const std::string final_path(path);
+        const std::string temp_path = final_path + ".tmp";
+        {
+            std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+            if (!out.is_open())
+            {
+                throw std::runtime_error("Failed to open texture file for writing: " + temp_path);
+            }
+            out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            out.write(reinterpret_cast<const char*>(levels.data()), static_cast<std::streamsize>(levels.size() * sizeof(Level)));
+            const char padding[LEVEL_ALIGNMENT]{};
+            out.write(padding, static_cast<std::streamsize>(header.data_offset - sizeof(header) - levels.size() * sizeof(Level)));
+            out.write(reinterpret_cast<const char*>(texture.data().data()), static_cast<std::streamsize>(texture.data().size()));
+            if (!out.good())
+            {
+                throw std::runtime_error("Failed to write texture file: " + temp_path);
+            }
+        }
+        std::filesystem::rename(temp_path, final_path);
+    }
+
+    std::optional<Texture> read_texture_file(const std::string_view path, uint64_t key)
+    {
+        if (!std::filesystem::exists(path))
+        {
+            return std::nullopt;
+        }
+        // Random access, levels are only touched when they are streamed in.
+        auto file = file_ops::map_file(path, file_ops::AccessHint::random);
+        auto bytes = file.bytes();
+        TextureFileHeader header;
+        if (bytes.size() < sizeof(header))
+        {
+            return std::nullopt;
+        }
+        std::memcpy(&header, bytes.data(), sizeof(header));
+        if (std::memcmp(header.magic, TEXTURE_MAGIC, sizeof(TEXTURE_MAGIC)) != 0 || header.version != TEXTURE_VERSION ||
+            header.header_size != sizeof(TextureFileHeader) || header.key != key || header.format > static_cast<uint32_t>(Format::bc7) ||
+            header.level_count == 0 || header.level_count > 32 || header.file_size != bytes.size() ||
+            header.data_offset < sizeof(header) + header.level_count * sizeof(Level) || header.data_offset > bytes.size())
+        {
+            return std::nullopt;
+        }
+        std::vector<Level> levels(header.level_count);
+        std::memcpy(levels.data(), bytes.data() + sizeof(header), levels.size() * sizeof(Level));
+        auto format = static_cast<Format>(header.format);
+        if (!valid_levels(levels, format, bytes.size() - header.data_offset))
+        {
+            return std::nullopt;
+        }
+        return Texture(format, header.srgb != 0, std::move(levels), std::move(file), header.data_offset);
+    }
+
+    Texture load_texture(const std::string_view source_path, const TextureOptions& options, mesh_cache::CachePolicy policy)
+    {
+        profiler::Zone zone("load texture");
+        auto source = file_ops::map_file(source_path, file_ops::AccessHint::sequential);
+        auto path = texture_path_for(source_path);
+        auto key = texture_key(source.bytes(), options);
+        if (policy == mesh_cache::CachePolicy::use_cache)
+        {
+            if (auto cached = read_texture_file(path, key))
+            {
+                return std::move(*cached);
+            }
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        image_io::DecodedImage image;
+        try
+        {
+            profiler::Zone decode_zone("decode image");
+            image = image_io::decode_image(source.bytes());
+        }
+        catch (std::exception& ex)
+        {
+            throw std::runtime_error(std::string(ex.what()) + ": " + std::string(source_path));
+        }
+        auto texture = build_texture(std::move(image), options);
+        auto build_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        // One write, textures are built on several threads at once.
+        std::ostringstream line;
+        line << "Built " << texture.mip_levels().size() << " mips of " << texture.width() << 'x' << texture.height() << ' '
+             << format_name(texture.format()) << " for " << source_path << " in " << build_ms << " ms\n";
+        std::cout << line.str();
+        if (policy != mesh_cache::CachePolicy::bypass)
+        {
+            try
+            {
+                write_texture_file(path, texture, key);
+            }
+            catch (std::exception& ex)
+            {
+                std::cerr << "Warning: " << ex.what() << '\n';
+            }
+        }
+        return texture;
+    }
+}
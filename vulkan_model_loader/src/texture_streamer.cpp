@@ -0,0 +1,322 @@
+#include "texture_streamer.h"
+
+#include <algorithm>
+#include <numeric>
+#include <exception>
+#include <stdexcept>
+
+#include "profiler.h"
+
+namespace baas::texture_streamer
+{
+    namespace
+    {
+        vk::Format vulkan_format(texture::Format format, bool srgb)
+        {
+            switch (format)
+            {
+            case texture::Format::bc1:
+                return srgb ? vk::Format::eBc1RgbaSrgbBlock : vk::Format::eBc1RgbaUnormBlock;
+            case texture::Format::bc7:
+                return srgb ? vk::Format::eBc7SrgbBlock : vk::Format::eBc7UnormBlock;
+            default:
+                return srgb ? vk::Format::eR8G8B8A8Srgb : vk::Format::eR8G8B8A8Unorm;
+            }
+        }
+    }
+
+    TextureStreamer::TextureStreamer(vk::Device device, gpu_allocator::GpuAllocator& allocator, upload_service::UploadService& uploads,
+        std::span<const uint32_t> queue_families, const StreamerConfig& config)
+        : device(device), allocator(allocator), uploads(uploads), config(config)
+    {
+        for (auto family : queue_families)
+        {
+            if (std::find(this->queue_families.begin(), this->queue_families.end(), family) == this->queue_families.end())
+            {
+                this->queue_families.push_back(family);
+            }
+        }
+        counters.budget_bytes = config.budget_bytes;
+    }
+
+    TextureStreamer::~TextureStreamer()
+    {
+        auto& jobs = job_system::shared();
+        for (auto&& entry : entries)
+        {
+            if (!entry.pending)
+            {
+                continue;
+            }
+            try
+            {
+                if (entry.pending_job)
+                {
+                    jobs.wait(entry.pending_job);
+                }
+                entry.pending_upload.wait();
+            }
+            catch (std::exception&)
+            {
+                // Nobody is left to report a failed upload to.
+            }
+        }
+    }
+
+    uint32_t TextureStreamer::add(texture::Texture source)
+    {
+        if (source.mip_levels().empty())
+        {
+            throw std::runtime_error("Can't stream a texture without levels");
+        }
+        auto stored_format = config.block_compression ? source.format() : texture::Format::rgba8;
+        auto format = vulkan_format(stored_format, source.srgb());
+        Entry entry{ std::move(source), format };
+        auto levels = entry.source.mip_levels();
+        auto last = static_cast<uint32_t>(levels.size() - 1);
+        entry.tail_level = last;
+        while (entry.tail_level > 0 && std::max(levels[entry.tail_level - 1].width, levels[entry.tail_level - 1].height) <= config.tail_size)
+        {
+            --entry.tail_level;
+        }
+        entry.finest_level = 0;
+        while (entry.finest_level < entry.tail_level && texture::level_size(stored_format, levels[entry.finest_level].width, levels[entry.finest_level].height) > config.max_level_bytes)
+        {
+            ++entry.finest_level;
+        }
+        entry.wanted_level = entry.tail_level;
+        entries.push_back(std::move(entry));
+        start_upload(entries.back(), entries.back().tail_level);
+        return static_cast<uint32_t>(entries.size() - 1);
+    }
+
+    void TextureStreamer::request(uint32_t index, float screen_size)
+    {
+        auto& entry = entries[index];
+        auto levels = entry.source.mip_levels();
+        uint32_t level = 0;
+        while (level + 1 < levels.size() && static_cast<float>(std::max(levels[level + 1].width, levels[level + 1].height)) >= screen_size)
+        {
+            ++level;
+        }
+        entry.wanted_level = std::clamp(level, entry.finest_level, entry.tail_level);
+    }
+
+    void TextureStreamer::update(std::pmr::memory_resource* scratch)
+    {
+        profiler::Zone zone("stream textures");
+        ++update_count;
+        // Every frame that could have bound a retired view has finished by now.
+        while (!retired.empty() && retired.front().update + config.frames_in_flight <= update_count &&
+            (!retired.front().upload || retired.front().upload.ready()))
+        {
+            retired.pop_front();
+        }
+
+        auto& jobs = job_system::shared();
+        for (auto&& entry : entries)
+        {
+            if (entry.pending_job && jobs.is_done(entry.pending_job))
+            {
+                auto job = std::move(entry.pending_job);
+                entry.pending_job = {};
+                try
+                {
+                    // Finished, so this only rethrows what the job threw.
+                    jobs.wait(job);
+                }
+                catch (...)
+                {
+                    // Some levels may have been recorded already, the image goes once they have executed.
+                    retired.push_back({ std::move(*entry.pending), update_count, uploads.flush() });
+                    entry.pending.reset();
+                    throw;
+                }
+            }
+            if (entry.pending && !entry.pending_job && entry.pending_upload.ready())
+            {
+                if (entry.current)
+                {
+                    retired.push_back({ std::move(*entry.current), update_count, {} });
+                }
+                entry.current = std::move(entry.pending);
+                entry.pending.reset();
+                resident_timeline_value = std::max(resident_timeline_value, entry.pending_upload.timeline_value());
+                ++view_version;
+            }
+        }
+
+        // Most levels missing first, then the cheapest, so small textures don't queue behind large ones.
+        std::pmr::vector<uint32_t> upgrades(scratch);
+        for (uint32_t i = 0; i < entries.size(); ++i)
+        {
+            auto& entry = entries[i];
+            if (entry.current && !entry.pending && entry.current->first_level > entry.wanted_level)
+            {
+                upgrades.push_back(i);
+            }
+        }
+        std::sort(upgrades.begin(), upgrades.end(), [this](uint32_t a, uint32_t b)
+            {
+                auto missing_a = entries[a].current->first_level - entries[a].wanted_level;
+                auto missing_b = entries[b].current->first_level - entries[b].wanted_level;
+                return missing_a != missing_b ? missing_a > missing_b : entries[a].current->bytes < entries[b].current->bytes;
+            });
+
+        // Budgeted by what every texture ends up with once its upload lands, images waiting to be
+        // retired aren't counted.
+        auto used = committed_bytes();
+        vk::DeviceSize started{ 0 };
+        std::pmr::vector<uint32_t> surplus(scratch);
+        bool surplus_collected{ false };
+        for (auto index : upgrades)
+        {
+            auto& entry = entries[index];
+            auto level = entry.current->first_level - 1;
+            auto bytes = window_bytes(entry, level);
+            if (started > 0 && started + bytes > config.upload_bytes_per_update)
+            {
+                break;
+            }
+            auto extra = bytes - entry.current->bytes;
+            if (used + extra > config.budget_bytes)
+            {
+                // Room comes from textures holding finer levels than they want, the biggest savings first.
+                if (!surplus_collected)
+                {
+                    for (uint32_t i = 0; i < entries.size(); ++i)
+                    {
+                        if (entries[i].current && !entries[i].pending && entries[i].current->first_level < entries[i].wanted_level)
+                        {
+                            surplus.push_back(i);
+                        }
+                    }
+                    std::sort(surplus.begin(), surplus.end(), [this](uint32_t a, uint32_t b)
+                        {
+                            return entries[a].current->bytes - window_bytes(entries[a], entries[a].wanted_level) <
+                                entries[b].current->bytes - window_bytes(entries[b], entries[b].wanted_level);
+                        });
+                    surplus_collected = true;
+                }
+                while (used + extra > config.budget_bytes && !surplus.empty())
+                {
+                    auto& donor = entries[surplus.back()];
+                    surplus.pop_back();
+                    auto kept = window_bytes(donor, donor.wanted_level);
+                    used -= donor.current->bytes - kept;
+                    started += kept;
+                    start_upload(donor, donor.wanted_level);
+                    ++counters.downgrades;
+                }
+                if (used + extra > config.budget_bytes)
+                {
+                    continue;
+                }
+            }
+            used += extra;
+            started += bytes;
+            start_upload(entry, level);
+            ++counters.upgrades;
+        }
+
+    }
+
+    vk::ImageView TextureStreamer::view(uint32_t index) const
+    {
+        auto& current = entries[index].current;
+        return current ? *current->view : vk::ImageView();
+    }
+
+    bool TextureStreamer::idle() const
+    {
+        auto& jobs = job_system::shared();
+        return std::all_of(entries.begin(), entries.end(), [&jobs](const Entry& entry)
+            {
+                return !entry.pending || ((!entry.pending_job || jobs.is_done(entry.pending_job)) && entry.pending_upload.ready());
+            });
+    }
+
+    Stats TextureStreamer::stats() const
+    {
+        auto result = counters;
+        result.resident_bytes = 0;
+        result.texture_count = static_cast<uint32_t>(entries.size());
+        result.satisfied_count = 0;
+        for (auto&& entry : entries)
+        {
+            if (entry.current)
+            {
+                result.resident_bytes += entry.current->bytes;
+                result.satisfied_count += entry.current->first_level <= entry.wanted_level ? 1 : 0;
+            }
+        }
+        return result;
+    }
+
+    void TextureStreamer::start_upload(Entry& entry, uint32_t first_level)
+    {
+        auto levels = entry.source.mip_levels();
+        auto level_count = static_cast<uint32_t>(levels.size()) - first_level;
+        auto& top = levels[first_level];
+        auto sharing = queue_families.size() > 1 ? vk::SharingMode::eConcurrent : vk::SharingMode::eExclusive;
+        auto image_info = vk::ImageCreateInfo({}, vk::ImageType::e2D, entry.format, vk::Extent3D(top.width, top.height, 1), level_count, 1,
+            vk::SampleCountFlagBits::e1, vk::ImageTiling::eOptimal, vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst, sharing, queue_families);
+        Resident resident;
+        resident.image = gpu_allocator::Image(allocator, image_info, vk::MemoryPropertyFlagBits::eDeviceLocal);
+        auto range = vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, level_count, 0, 1);
+        resident.view = device.createImageViewUnique(vk::ImageViewCreateInfo({}, resident.image.get(), vk::ImageViewType::e2D, entry.format, {}, range));
+        resident.first_level = first_level;
+        resident.bytes = window_bytes(entry, first_level);
+
+        // The job only reads the source, which never changes, and the config. Staging copies on a worker
+        // may wait for ring space, the render thread never does.
+        bool decode = !config.block_compression && entry.source.format() != texture::Format::rgba8;
+        auto image = resident.image.get();
+        counters.uploaded_bytes += resident.bytes;
+        entry.pending = std::move(resident);
+        entry.pending_upload = {};
+        entry.pending_job = job_system::shared().run([this, &entry, image, first_level, decode]()
+            {
+                profiler::Zone zone("stage texture levels");
+                auto levels = entry.source.mip_levels();
+                // Coarsest first, the staging copies then follow the order the levels are wanted in.
+                upload_service::UploadHandle handle;
+                for (auto level = static_cast<uint32_t>(levels.size()); level-- > first_level;)
+                {
+                    auto& mip = levels[level];
+                    auto data = entry.source.level_data(level);
+                    std::vector<uint8_t> decoded;
+                    if (decode)
+                    {
+                        decoded = texture::decode_level(data, entry.source.format(), mip.width, mip.height);
+                        data = std::as_bytes(std::span(decoded));
+                    }
+                    handle = uploads.upload_image(image, vk::Extent3D(mip.width, mip.height, 1), level - first_level, data);
+                }
+                // Batches are submitted in order, so the last copy's batch covers every level. Submitted
+                // here, a handle only becomes ready once its batch is.
+                uploads.flush();
+                entry.pending_upload = handle;
+            });
+    }
+
+    vk::DeviceSize TextureStreamer::window_bytes(const Entry& entry, uint32_t first_level) const
+    {
+        auto levels = entry.source.mip_levels();
+        auto stored_format = config.block_compression ? entry.source.format() : texture::Format::rgba8;
+        return std::accumulate(levels.begin() + first_level, levels.end(), vk::DeviceSize{ 0 }, [stored_format](vk::DeviceSize sum, const texture::Level& level)
+            {
+                return sum + texture::level_size(stored_format, level.width, level.height);
+            });
+    }
+
+    vk::DeviceSize TextureStreamer::committed_bytes() const
+    {
+        vk::DeviceSize total{ 0 };
+        for (auto&& entry : entries)
+        {
+            total += entry.pending ? entry.pending->bytes : entry.current ? entry.current->bytes : 0;
+        }
+        return total;
+    }
+}
@@ -0,0 +1,365 @@
+#include "tlsf_allocator.h"
+
+#include <algorithm>
+#include <bit>
+#include <stdexcept>
+#include <string>
+
+namespace baas::tlsf_allocator
+{
+    TlsfAllocator::TlsfAllocator(uint64_t capacity)
+        : total_size(capacity)
+    {
+        // The rounding in find_free needs some headroom below 2^64.
+        if (capacity == 0 || capacity > (1ull << 62))
+        {
+            throw std::runtime_error("TLSF capacity must be between 1 byte and 4 EiB");
+        }
+        for (auto&& heads : free_heads)
+        {
+            heads.fill(NONE);
+        }
+        insert_free(new_block(0, capacity));
+    }
+
+    void TlsfAllocator::mapping(uint64_t size, uint32_t& first_level, uint32_t& second_level)
+    {
+        auto highest_bit = static_cast<uint32_t>(std::bit_width(size) - 1);
+        if (highest_bit < SL_LOG2)
+        {
+            // Sizes below SL_COUNT get exact bins.
+            first_level = 0;
+            second_level = static_cast<uint32_t>(size);
+        }
+        else
+        {
+            first_level = highest_bit - SL_LOG2 + 1;
+            second_level = static_cast<uint32_t>(size >> (highest_bit - SL_LOG2)) ^ SL_COUNT;
+        }
+    }
+
+    std::optional<Allocation> TlsfAllocator::allocate(uint64_t size, uint64_t alignment)
+    {
+        if (alignment == 0 || !std::has_single_bit(alignment))
+        {
+            throw std::runtime_error("TLSF alignment must be a power of two, got " + std::to_string(alignment));
+        }
+        size = size == 0 ? 1 : size;
+        // Worst case padding is alignment - 1, searching for that much guarantees a fit.
+        uint64_t search_size = size + alignment - 1;
+        if (size > total_size || search_size > total_size)
+        {
+            return std::nullopt;
+        }
+        uint32_t index = find_free(search_size);
+        if (index == NONE)
+        {
+            return std::nullopt;
+        }
+        remove_free(index);
+
+        uint64_t aligned = (blocks[index].offset + alignment - 1) & ~(alignment - 1);
+        uint64_t padding = aligned - blocks[index].offset;
+        if (padding > 0)
+        {
+            // The previous physical block can't be free (it would have been merged), so the
+            // padding becomes its own free block.
+            uint32_t front = new_block(blocks[index].offset, padding);
+            uint32_t previous = blocks[index].prev_physical;
+            blocks[front].prev_physical = previous;
+            blocks[front].next_physical = index;
+            if (previous != NONE)
+            {
+                blocks[previous].next_physical = front;
+            }
+            blocks[index].prev_physical = front;
+            blocks[index].offset = aligned;
+            blocks[index].size -= padding;
+            insert_free(front);
+        }
+        if (blocks[index].size > size)
+        {
+            split(index, size);
+        }
+
+        used_size += blocks[index].size;
+        ++allocation_count;
+        return Allocation{ blocks[index].offset, blocks[index].size, index };
+    }
+
+    void TlsfAllocator::free(const Allocation& allocation)
+    {
+        uint32_t index = allocation.block;
+        if (index >= blocks.size() || blocks[index].is_free || blocks[index].size == 0 ||
+            blocks[index].offset != allocation.offset)
+        {
+            throw std::runtime_error("Freeing an allocation that isn't live");
+        }
+        used_size -= blocks[index].size;
+        --allocation_count;
+
+        uint32_t next = blocks[index].next_physical;
+        if (next != NONE && blocks[next].is_free)
+        {
+            remove_free(next);
+            merge_next(index);
+        }
+        uint32_t previous = blocks[index].prev_physical;
+        if (previous != NONE && blocks[previous].is_free)
+        {
+            remove_free(previous);
+            merge_next(previous);
+            index = previous;
+        }
+        insert_free(index);
+    }
+
+    Stats TlsfAllocator::stats() const
+    {
+        Stats result{};
+        result.capacity = total_size;
+        result.bytes_used = used_size;
+        result.bytes_free = total_size - used_size;
+        result.allocation_count = allocation_count;
+        result.free_block_count = free_block_count;
+        if (first_level_bitmap != 0)
+        {
+            // The largest block is somewhere in the highest non-empty bin.
+            auto first_level = static_cast<uint32_t>(std::bit_width(first_level_bitmap) - 1);
+            auto second_level = static_cast<uint32_t>(std::bit_width(second_level_bitmaps[first_level]) - 1);
+            for (uint32_t i = free_heads[first_level][second_level]; i != NONE; i = blocks[i].next_free)
+            {
+                result.largest_free_block = std::max(result.largest_free_block, blocks[i].size);
+            }
+        }
+        if (result.bytes_free > 0)
+        {
+            result.fragmentation = 1.0 - static_cast<double>(result.largest_free_block) / result.bytes_free;
+        }
+        return result;
+    }
+
+    void TlsfAllocator::validate() const
+    {
+        auto fail = [](const std::string& message)
+        {
+            throw std::runtime_error("TLSF invariant broken: " + message);
+        };
+
+        uint32_t first = NONE;
+        for (uint32_t i = 0; i < blocks.size(); ++i)
+        {
+            if (blocks[i].size != 0 && blocks[i].prev_physical == NONE)
+            {
+                if (first != NONE)
+                {
+                    fail("more than one block without a predecessor");
+                }
+                first = i;
+            }
+        }
+        if (first == NONE)
+        {
+            fail("no first block");
+        }
+
+        uint64_t offset{ 0 };
+        uint64_t used{ 0 };
+        uint32_t used_blocks{ 0 };
+        uint32_t free_blocks{ 0 };
+        uint32_t previous = NONE;
+        for (uint32_t i = first; i != NONE; i = blocks[i].next_physical)
+        {
+            const Block& block = blocks[i];
+            if (block.offset != offset || block.size == 0 || block.prev_physical != previous)
+            {
+                fail("physical chain is broken at offset " + std::to_string(offset));
+            }
+            if (block.is_free && previous != NONE && blocks[previous].is_free)
+            {
+                fail("two adjacent free blocks at offset " + std::to_string(offset));
+            }
+            if (block.is_free)
+            {
+                ++free_blocks;
+            }
+            else
+            {
+                ++used_blocks;
+                used += block.size;
+            }
+            offset += block.size;
+            previous = i;
+        }
+        if (offset != total_size || used != used_size || used_blocks != allocation_count || free_blocks != free_block_count)
+        {
+            fail("block totals don't match the counters");
+        }
+
+        uint32_t listed{ 0 };
+        for (uint32_t fl = 0; fl < FL_COUNT; ++fl)
+        {
+            bool any_in_level = false;
+            for (uint32_t sl = 0; sl < SL_COUNT; ++sl)
+            {
+                uint32_t head = free_heads[fl][sl];
+                bool bit = (second_level_bitmaps[fl] & (1u << sl)) != 0;
+                if (bit != (head != NONE))
+                {
+                    fail("second level bitmap out of sync");
+                }
+                any_in_level |= bit;
+                uint32_t previous_free = NONE;
+                for (uint32_t i = head; i != NONE; i = blocks[i].next_free)
+                {
+                    uint32_t block_fl;
+                    uint32_t block_sl;
+                    mapping(blocks[i].size, block_fl, block_sl);
+                    if (!blocks[i].is_free || block_fl != fl || block_sl != sl || blocks[i].prev_free != previous_free)
+                    {
+                        fail("free list holds a block from the wrong bin");
+                    }
+                    previous_free = i;
+                    ++listed;
+                }
+            }
+            if (any_in_level != ((first_level_bitmap & (1ull << fl)) != 0))
+            {
+                fail("first level bitmap out of sync");
+            }
+        }
+        if (listed != free_block_count)
+        {
+            fail("free lists don't hold every free block");
+        }
+    }
+
+    uint32_t TlsfAllocator::new_block(uint64_t offset, uint64_t size)
+    {
+        uint32_t index;
+        if (!unused_blocks.empty())
+        {
+            index = unused_blocks.back();
+            unused_blocks.pop_back();
+        }
+        else
+        {
+            index = static_cast<uint32_t>(blocks.size());
+            blocks.emplace_back();
+        }
+        blocks[index] = Block{ offset, size, NONE, NONE, NONE, NONE, false };
+        return index;
+    }
+
+    void TlsfAllocator::release_block(uint32_t index)
+    {
+        blocks[index] = Block{ 0, 0, NONE, NONE, NONE, NONE, false };
+        unused_blocks.push_back(index);
+    }
+
+    void TlsfAllocator::insert_free(uint32_t index)
+    {
+        uint32_t fl;
+        uint32_t sl;
+        mapping(blocks[index].size, fl, sl);
+        uint32_t head = free_heads[fl][sl];
+        blocks[index].is_free = true;
+        blocks[index].prev_free = NONE;
+        blocks[index].next_free = head;
+        if (head != NONE)
+        {
+            blocks[head].prev_free = index;
+        }
+        free_heads[fl][sl] = index;
+        second_level_bitmaps[fl] |= 1u << sl;
+        first_level_bitmap |= 1ull << fl;
+        ++free_block_count;
+    }
+
+    void TlsfAllocator::remove_free(uint32_t index)
+    {
+        uint32_t fl;
+        uint32_t sl;
+        mapping(blocks[index].size, fl, sl);
+        uint32_t previous = blocks[index].prev_free;
+        uint32_t next = blocks[index].next_free;
+        if (previous != NONE)
+        {
+            blocks[previous].next_free = next;
+        }
+        else
+        {
+            free_heads[fl][sl] = next;
+        }
+        if (next != NONE)
+        {
+            blocks[next].prev_free = previous;
+        }
+        if (free_heads[fl][sl] == NONE)
+        {
+            second_level_bitmaps[fl] &= ~(1u << sl);
+            if (second_level_bitmaps[fl] == 0)
+            {
+                first_level_bitmap &= ~(1ull << fl);
+            }
+        }
+        blocks[index].is_free = false;
+        blocks[index].prev_free = NONE;
+        blocks[index].next_free = NONE;
+        --free_block_count;
+    }
+
+    uint32_t TlsfAllocator::find_free(uint64_t size) const
+    {
+        // Round up to the next bin boundary so every block in the bin found is large enough.
+        auto highest_bit = static_cast<uint32_t>(std::bit_width(size) - 1);
+        if (highest_bit >= SL_LOG2)
+        {
+            size += (1ull << (highest_bit - SL_LOG2)) - 1;
+        }
+        uint32_t fl;
+        uint32_t sl;
+        mapping(size, fl, sl);
+
+        uint32_t second_level_map = second_level_bitmaps[fl] & (~0u << sl);
+        if (second_level_map == 0)
+        {
+            uint64_t first_level_map = fl + 1 < FL_COUNT ? first_level_bitmap & (~0ull << (fl + 1)) : 0;
+            if (first_level_map == 0)
+            {
+                return NONE;
+            }
+            fl = static_cast<uint32_t>(std::countr_zero(first_level_map));
+            second_level_map = second_level_bitmaps[fl];
+        }
+        sl = static_cast<uint32_t>(std::countr_zero(second_level_map));
+        return free_heads[fl][sl];
+    }
+
+    void TlsfAllocator::split(uint32_t index, uint64_t size)
+    {
+        uint32_t tail = new_block(blocks[index].offset + size, blocks[index].size - size);
+        uint32_t next = blocks[index].next_physical;
+        blocks[tail].prev_physical = index;
+        blocks[tail].next_physical = next;
+        if (next != NONE)
+        {
+            blocks[next].prev_physical = tail;
+        }
+        blocks[index].next_physical = tail;
+        blocks[index].size = size;
+        insert_free(tail);
+    }
+
+    void TlsfAllocator::merge_next(uint32_t index)
+    {
+        uint32_t next = blocks[index].next_physical;
+        blocks[index].size += blocks[next].size;
+        blocks[index].next_physical = blocks[next].next_physical;
+        if (blocks[index].next_physical != NONE)
+        {
+            blocks[blocks[index].next_physical].prev_physical = index;
+        }
+        release_block(next);
+    }
+}
@@ -0,0 +1,275 @@
+#include "upload_service.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "job_system.h"
+
+namespace baas::upload_service
+{
+    bool UploadHandle::ready() const
+    {
+        return owner != nullptr && owner->is_complete(value);
+    }
+
+    void UploadHandle::wait() const
+    {
+        if (owner != nullptr)
+        {
+            owner->wait(value);
+        }
+    }
+
+    UploadService::UploadService(vk::Device device, gpu_allocator::GpuAllocator& allocator, vk::Queue queue, uint32_t queue_family,
+        std::mutex* queue_mutex, vk::DeviceSize staging_size)
+        : device(device), allocator(allocator), queue(queue), queue_family(queue_family), queue_mutex(queue_mutex != nullptr ? queue_mutex : &own_queue_mutex)
+    {
+        staging_size = (staging_size + STAGING_ALIGNMENT - 1) & ~(STAGING_ALIGNMENT - 1);
+        staging = gpu_allocator::Buffer(allocator, staging_size, vk::BufferUsageFlagBits::eTransferSrc,
+            vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
+
+        auto type_info = vk::SemaphoreTypeCreateInfo(vk::SemaphoreType::eTimeline, 0);
+        timeline_semaphore = device.createSemaphoreUnique(vk::SemaphoreCreateInfo({}, &type_info));
+    }
+
+    UploadService::~UploadService()
+    {
+        // The staging buffer and command buffers must outlive every batch that uses them.
+        std::lock_guard lock(mutex);
+        if (recording && recording->bytes > 0)
+        {
+            submit_recording();
+        }
+        if (submitted_value > 0)
+        {
+            wait_locked(submitted_value);
+        }
+    }
+
+    UploadHandle UploadService::upload_buffer(vk::Buffer destination, vk::DeviceSize destination_offset, std::span<const std::byte> data)
+    {
+        std::unique_lock lock(mutex);
+        if (data.empty())
+        {
+            return UploadHandle(this, submitted_value);
+        }
+        // Large uploads go through in pieces so the ring can recycle space under them.
+        vk::DeviceSize max_chunk = staging.size() / 4;
+        for (vk::DeviceSize done = 0; done < data.size();)
+        {
+            vk::DeviceSize chunk = std::min<vk::DeviceSize>(data.size() - done, max_chunk);
+            auto space = reserve_staging(lock, chunk);
+            std::memcpy(space.data, data.data() + done, chunk);
+            auto& batch = current_batch();
+            batch.command_buffer->copyBuffer(space.buffer, destination, vk::BufferCopy(space.offset, destination_offset + done, chunk));
+            batch.bytes += chunk;
+            ++counters.copy_count;
+            done += chunk;
+            // Also keeps one off staging buffers from piling up in a single batch.
+            if (batch.bytes >= max_chunk)
+            {
+                submit_recording();
+            }
+        }
+        counters.bytes_uploaded += data.size();
+        // Batches execute in order, the last one covers every chunk.
+        return UploadHandle(this, recording ? recording->value : submitted_value);
+    }
+
+    UploadHandle UploadService::upload_image(vk::Image destination, vk::Extent3D extent, uint32_t mip_level, std::span<const std::byte> data,
+        vk::ImageLayout final_layout)
+    {
+        std::unique_lock lock(mutex);
+        if (data.size() > staging.size())
+        {
+            throw std::runtime_error("Image upload of " + std::to_string(data.size()) + " bytes doesn't fit in the staging buffer");
+        }
+        auto space = reserve_staging(lock, data.size());
+        std::memcpy(space.data, data.data(), data.size());
+
+        auto& batch = current_batch();
+        auto range = vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, mip_level, 1, 0, 1);
+        auto to_transfer = vk::ImageMemoryBarrier({}, vk::AccessFlagBits::eTransferWrite, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal,
+            VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, destination, range);
+        batch.command_buffer->pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer, {}, nullptr, nullptr, to_transfer);
+        auto region = vk::BufferImageCopy(space.offset, 0, 0, vk::ImageSubresourceLayers(vk::ImageAspectFlagBits::eColor, mip_level, 0, 1), vk::Offset3D(0, 0, 0), extent);
+        batch.command_buffer->copyBufferToImage(space.buffer, destination, vk::ImageLayout::eTransferDstOptimal, region);
+        // Visibility for the consumer comes from its wait on the timeline semaphore.
+        auto to_final = vk::ImageMemoryBarrier(vk::AccessFlagBits::eTransferWrite, {}, vk::ImageLayout::eTransferDstOptimal, final_layout,
+            VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, destination, range);
+        batch.command_buffer->pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eBottomOfPipe, {}, nullptr, nullptr, to_final);
+        batch.bytes += data.size();
+        ++counters.copy_count;
+        counters.bytes_uploaded += data.size();
+
+        auto handle = UploadHandle(this, batch.value);
+        if (batch.bytes >= staging.size() / 4)
+        {
+            submit_recording();
+        }
+        return handle;
+    }
+
+    UploadHandle UploadService::flush()
+    {
+        std::lock_guard lock(mutex);
+        if (recording && recording->bytes > 0)
+        {
+            submit_recording();
+        }
+        return UploadHandle(this, submitted_value);
+    }
+
+    bool UploadService::is_complete(uint64_t value) const
+    {
+        return device.getSemaphoreCounterValue(*timeline_semaphore) >= value;
+    }
+
+    void UploadService::wait(uint64_t value)
+    {
+        {
+            std::lock_guard lock(mutex);
+            if (value > submitted_value && recording && recording->bytes > 0)
+            {
+                submit_recording();
+            }
+            if (value > submitted_value)
+            {
+                throw std::runtime_error("Waiting for an upload that was never recorded");
+            }
+        }
+        // Other loader threads can keep recording while this one sleeps.
+        if (device.waitSemaphores(vk::SemaphoreWaitInfo({}, *timeline_semaphore, value), std::numeric_limits<uint64_t>::max()) != vk::Result::eSuccess)
+        {
+            throw std::runtime_error("Failed waiting for an upload");
+        }
+        std::lock_guard lock(mutex);
+        reclaim();
+    }
+
+    Stats UploadService::stats() const
+    {
+        std::lock_guard lock(mutex);
+        return counters;
+    }
+
+    UploadService::Batch& UploadService::current_batch()
+    {
+        if (!recording)
+        {
+            Batch batch;
+            if (!spare_batches.empty())
+            {
+                batch = std::move(spare_batches.back());
+                spare_batches.pop_back();
+                device.resetCommandPool(*batch.command_pool);
+            }
+            else
+            {
+                batch.command_pool = device.createCommandPoolUnique(vk::CommandPoolCreateInfo(vk::CommandPoolCreateFlagBits::eTransient, queue_family));
+                batch.command_buffer = std::move(device.allocateCommandBuffersUnique(vk::CommandBufferAllocateInfo(*batch.command_pool, vk::CommandBufferLevel::ePrimary, 1)).front());
+            }
+            batch.value = submitted_value + 1;
+            batch.bytes = 0;
+            batch.command_buffer->begin(vk::CommandBufferBeginInfo(vk::CommandBufferUsageFlagBits::eOneTimeSubmit));
+            recording = std::move(batch);
+        }
+        return *recording;
+    }
+
+    void UploadService::submit_recording()
+    {
+        auto& batch = *recording;
+        batch.command_buffer->end();
+        batch.staging_end = staging_head;
+
+        auto timeline_info = vk::TimelineSemaphoreSubmitInfo(nullptr, batch.value);
+        auto submit_info = vk::SubmitInfo({}, {}, *batch.command_buffer, *timeline_semaphore);
+        submit_info.pNext = &timeline_info;
+        {
+            std::lock_guard queue_lock(*queue_mutex);
+            queue.submit(submit_info);
+        }
+        submitted_value = batch.value;
+        ++counters.submit_count;
+        in_flight.push_back(std::move(batch));
+        recording.reset();
+    }
+
+    void UploadService::reclaim()
+    {
+        if (in_flight.empty())
+        {
+            return;
+        }
+        auto completed = device.getSemaphoreCounterValue(*timeline_semaphore);
+        while (!in_flight.empty() && in_flight.front().value <= completed)
+        {
+            staging_tail = in_flight.front().staging_end;
+            in_flight.front().overflow.clear();
+            spare_batches.push_back(std::move(in_flight.front()));
+            in_flight.pop_front();
+        }
+    }
+
+    UploadService::StagingSpace UploadService::reserve_staging(std::unique_lock<std::mutex>& lock, vk::DeviceSize size)
+    {
+        size = (size + STAGING_ALIGNMENT - 1) & ~(STAGING_ALIGNMENT - 1);
+        auto capacity = staging.size();
+        for (;;)
+        {
+            reclaim();
+            // A copy never wraps around the end of the ring, the rest of the lap is skipped instead.
+            auto offset = staging_head % capacity;
+            auto skipped = offset + size > capacity ? capacity - offset : 0;
+            if (staging_head + skipped + size - staging_tail <= capacity)
+            {
+                staging_head += skipped;
+                auto offset = staging_head % capacity;
+                staging_head += size;
+                return { staging.get(), offset, staging.mapped() + offset };
+            }
+
+            // Full, the space only comes back once older batches execute. Only workers wait for that, the
+            // render thread or anyone else stages the copy in a buffer of its own instead.
+            if (!job_system::shared().on_worker())
+            {
+                auto& buffer = current_batch().overflow.emplace_back(allocator, size, vk::BufferUsageFlagBits::eTransferSrc,
+                    vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
+                ++counters.staging_overflows;
+                return { buffer.get(), 0, buffer.mapped() };
+            }
+            if (recording && recording->bytes > 0)
+            {
+                submit_recording();
+            }
+            if (in_flight.empty())
+            {
+                throw std::runtime_error("Staging buffer is too small for a " + std::to_string(size) + " byte copy");
+            }
+            ++counters.staging_stalls;
+            // Unlocked, so other threads keep recording and flush or stats never queue up behind the wait.
+            auto value = in_flight.front().value;
+            lock.unlock();
+            auto result = device.waitSemaphores(vk::SemaphoreWaitInfo({}, *timeline_semaphore, value), std::numeric_limits<uint64_t>::max());
+            lock.lock();
+            if (result != vk::Result::eSuccess)
+            {
+                throw std::runtime_error("Failed waiting for an upload");
+            }
+        }
+    }
+
+    void UploadService::wait_locked(uint64_t value)
+    {
+        if (device.waitSemaphores(vk::SemaphoreWaitInfo({}, *timeline_semaphore, value), std::numeric_limits<uint64_t>::max()) != vk::Result::eSuccess)
+        {
+            throw std::runtime_error("Failed waiting for an upload");
+        }
+        reclaim();
+    }
+}